@@ -0,0 +1,57 @@
+#ifndef BENCH_BENCH_H_
+#define BENCH_BENCH_H_
+
+#include <string>
+#include <vector>
+#include <boost/chrono.hpp>
+#include <boost/filesystem/path.hpp>
+
+namespace bench {
+
+class Stopwatch {
+ public:
+  Stopwatch() : start_(boost::chrono::steady_clock::now()) {}
+
+  // Milliseconds since construction
+  double Elapsed() const {
+    return boost::chrono::duration<double, boost::milli>(
+               boost::chrono::steady_clock::now() - start_).count();
+  }
+
+ private:
+  boost::chrono::steady_clock::time_point start_;
+};
+
+// Directory the engine runs in while it exists, holding a copy of the
+// database and prefs that keep it from downloading subscriptions while it is
+// measured.
+class Sandbox {
+ public:
+  explicit Sandbox(const std::string& database);
+  ~Sandbox();
+
+  std::string database() const;
+
+ private:
+  boost::filesystem::path previous_;
+  boost::filesystem::path directory_;
+};
+
+// Evicts the file from the OS page cache so the next read hits the disk.
+// Returns false if the platform refused to do so.
+bool DropFileCache(const std::string& path);
+
+double Median(std::vector<double> samples);
+// Nearest-rank percentile, |fraction| between 0 and 1.
+double Percentile(std::vector<double> samples, double fraction);
+
+// Subcommands, each gets the arguments following its name.
+int DbLoad(int argc, char* argv[]);
+int Daemon(int argc, char* argv[]);
+int ListApply(int argc, char* argv[]);
+int Replay(int argc, char* argv[]);
+int Startup(int argc, char* argv[]);
+
+}  // namespace bench
+
+#endif  // BENCH_BENCH_H_
@@ -0,0 +1,108 @@
+#include "bench.h"
+#include "../src/adblock.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace bench {
+
+namespace {
+
+struct Request {
+  const char* location;
+  const char* type;
+  const char* document;
+};
+
+const Request kRequests[] = {
+    {"http://pagead2.googlesyndication.com/pagead/show_ads.js", "SCRIPT",
+     "http://bbs.pediy.com/"},
+    {"http://www.example.com/images/logo.png", "IMAGE",
+     "http://www.example.com/"},
+    {"http://ad.doubleclick.net/adj/site/zone;sz=728x90", "SUBDOCUMENT",
+     "http://news.example.org/"},
+    {"http://static.example.net/css/site.css", "STYLESHEET",
+     "http://static.example.net/"},
+};
+
+const size_t kRequestCount = sizeof(kRequests) / sizeof(kRequests[0]);
+
+void Query(adblock::AdBlock* adblock, int calls) {
+  for (int idx = 0; idx < calls; ++idx) {
+    const Request& request = kRequests[idx % kRequestCount];
+    adblock->CheckFilterMatch(request.location, request.type,
+                              request.document);
+  }
+}
+
+void RunEngine(const char* name, adblock::AdBlock* adblock, int calls,
+               int threads) {
+  std::vector<double> samples;
+  samples.reserve(calls);
+  for (int idx = 0; idx < calls; ++idx) {
+    const Request& request = kRequests[idx % kRequestCount];
+    Stopwatch call;
+    adblock->CheckFilterMatch(request.location, request.type,
+                              request.document);
+    samples.push_back(call.Elapsed() * 1000);
+  }
+
+  Stopwatch elapsed;
+  boost::thread_group group;
+  for (int idx = 0; idx < threads; ++idx) {
+    group.create_thread(boost::bind(Query, adblock, calls));
+  }
+  group.join_all();
+  double throughput = calls * threads / elapsed.Elapsed() * 1000;
+
+  std::cout << "  " << std::setw(10) << name << "  median "
+            << std::setw(8) << Median(samples) << " us  " << threads
+            << " threads " << std::setw(10) << throughput << " calls/s"
+            << std::endl;
+}
+
+}  // namespace
+
+// Compares filter queries answered by an engine in this process with the
+// ones forwarded to the filtering daemon, which has to be running. On Linux
+// it is built with daemon/Makefile.
+// Usage: bench daemon [-n calls] [-t threads]
+int Daemon(int argc, char* argv[]) {
+  int calls = 10000;
+  int threads = 4;
+  for (int idx = 0; idx + 1 < argc; idx += 2) {
+    std::string option(argv[idx]);
+    if (option == "-n") {
+      calls = std::max(1, std::atoi(argv[idx + 1]));
+    } else if (option == "-t") {
+      threads = std::max(1, std::atoi(argv[idx + 1]));
+    } else {
+      std::cerr << "Usage: bench daemon [-n calls] [-t threads]" << std::endl;
+      return 1;
+    }
+  }
+
+  adblock::AdBlockPtr daemon;
+  adblock::ConnectDaemon(&daemon);
+  if (!daemon) {
+    std::cerr << "The filtering daemon is not running" << std::endl;
+    return 1;
+  }
+  adblock::AdBlockPtr local;
+  adblock::CreateInstance(&local);
+  if (!local) {
+    return 1;
+  }
+
+  std::cout << std::fixed << std::setprecision(2) << "CheckFilterMatch, "
+            << calls << " calls" << std::endl;
+  RunEngine("in-process", local.get(), calls, threads);
+  RunEngine("daemon", daemon.get(), calls, threads);
+  return 0;
+}
+
+}  // namespace bench
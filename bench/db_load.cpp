@@ -0,0 +1,105 @@
+#include "bench.h"
+#include "../src/file_system.h"
+#include "../src/ini_parser.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace bench {
+
+namespace {
+
+struct Variant {
+  const char* name;
+  std::string path;
+  std::vector<double> cold;
+  std::vector<double> warm;
+};
+
+size_t LoadDatabase(const adblock::FileSystem& file_system,
+                    const std::string& path) {
+  adblock::IniParser parser;
+  file_system.ReadChunks(path,
+                         boost::bind(&adblock::IniParser::Feed, &parser, _1, _2));
+  parser.Finish();
+
+  size_t lines = 0;
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    lines += it->lines.size();
+  }
+  return lines;
+}
+
+void RunDatabase(adblock::DefaultFileSystem* file_system,
+                 const std::string& database, int iterations) {
+  std::string content = file_system->Read(database);
+  fs::path directory = fs::temp_directory_path();
+  std::string name = fs::unique_path("adblock-bench-%%%%%%%%").string();
+
+  Variant variants[] = {{"plain", (directory / name).string()},
+                        {"gzip", (directory / (name + ".gz")).string()}};
+  file_system->Write(variants[0].path, content);
+  file_system->WriteCompressed(variants[1].path, content);
+
+  bool dropped = true;
+  size_t lines = 0;
+  const size_t count = sizeof(variants) / sizeof(variants[0]);
+  for (int idx = 0; idx < iterations; ++idx) {
+    for (Variant* it = variants; it != variants + count; ++it) {
+      dropped = DropFileCache(it->path) && dropped;
+      Stopwatch cold;
+      lines = LoadDatabase(*file_system, it->path);
+      it->cold.push_back(cold.Elapsed());
+
+      Stopwatch warm;
+      LoadDatabase(*file_system, it->path);
+      it->warm.push_back(warm.Elapsed());
+    }
+  }
+
+  std::cout << database << " (" << lines << " lines)" << std::endl;
+  if (!dropped) {
+    std::cout << "  warning: page cache could not be dropped, cold numbers "
+                 "are warm" << std::endl;
+  }
+  std::cout << std::fixed << std::setprecision(2);
+  for (Variant* it = variants; it != variants + count; ++it) {
+    std::cout << "  " << std::setw(6) << it->name << "  size "
+              << std::setw(10) << fs::file_size(it->path) << " B  cold "
+              << std::setw(8) << Median(it->cold) << " ms  warm "
+              << std::setw(8) << Median(it->warm) << " ms" << std::endl;
+    fs::remove(it->path);
+  }
+}
+
+}  // namespace
+
+// Compares loading a filter database stored as plain text and gzip-compressed.
+// Usage: bench db-load [-n iterations] <patterns.ini>...
+int DbLoad(int argc, char* argv[]) {
+  int iterations = 10;
+  int first = 0;
+  if (argc >= 2 && std::string(argv[0]) == "-n") {
+    iterations = std::max(1, std::atoi(argv[1]));
+    first = 2;
+  }
+  if (first >= argc) {
+    std::cerr << "Usage: bench db-load [-n iterations] <patterns.ini>..."
+              << std::endl;
+    return 1;
+  }
+
+  adblock::DefaultFileSystem file_system;
+  for (int idx = first; idx < argc; ++idx) {
+    RunDatabase(&file_system, argv[idx], iterations);
+  }
+  return 0;
+}
+
+}  // namespace bench
@@ -0,0 +1,250 @@
+#include "bench.h"
+#include "../src/adblock.h"
+#include "../src/list_parser.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <boost/asio.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace asio = boost::asio;
+namespace fs = boost::filesystem;
+using asio::ip::tcp;
+
+namespace bench {
+
+namespace {
+
+// Milliseconds to wait for the engine to load, download and apply the list
+const std::uint32_t kApplyTimeout = 120000;
+
+// Serves one list on a loopback port. Each request is held until Release()
+// so the engine has finished starting before the list arrives.
+class ListServer {
+ public:
+  explicit ListServer(const std::string& content)
+      : content_(content),
+        acceptor_(service_, tcp::endpoint(asio::ip::address_v4::loopback(), 0)),
+        stopping_(false),
+        requests_(0),
+        released_(0) {
+    thread_ = boost::thread(&ListServer::Run, this);
+  }
+
+  ~ListServer() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stopping_ = true;
+    }
+    changed_.notify_all();
+    // Wakes up the blocking accept
+    boost::system::error_code error;
+    tcp::socket socket(service_);
+    socket.connect(acceptor_.local_endpoint(), error);
+    thread_.join();
+  }
+
+  std::string url() const {
+    std::ostringstream url;
+    url << "http://127.0.0.1:" << acceptor_.local_endpoint().port()
+        << "/list.txt";
+    return url.str();
+  }
+
+  // Waits until |count| requests arrived in total
+  bool WaitForRequests(int count, std::uint32_t timeout) {
+    boost::mutex::scoped_lock lock(mutex_);
+    return changed_.wait_for(lock, boost::chrono::milliseconds(timeout),
+                             [&] { return requests_ >= count; });
+  }
+
+  void Release() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      ++released_;
+    }
+    changed_.notify_all();
+  }
+
+ private:
+  std::string content_;
+  asio::io_service service_;
+  tcp::acceptor acceptor_;
+  boost::thread thread_;
+  boost::mutex mutex_;
+  boost::condition_variable changed_;
+  bool stopping_;
+  int requests_;
+  int released_;
+
+  void Run() {
+    while (true) {
+      tcp::socket socket(service_);
+      boost::system::error_code error;
+      acceptor_.accept(socket, error);
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (stopping_) {
+          return;
+        }
+      }
+      if (!error) {
+        Serve(&socket);
+      }
+    }
+  }
+
+  void Serve(tcp::socket* socket) {
+    boost::system::error_code error;
+    asio::streambuf buffer;
+    asio::read_until(*socket, buffer, "\r\n\r\n", error);
+    if (error) {
+      return;
+    }
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      int request = ++requests_;
+      changed_.notify_all();
+      while (released_ < request && !stopping_) {
+        changed_.wait(lock);
+      }
+      if (stopping_) {
+        return;
+      }
+    }
+
+    std::ostringstream header;
+    header << "HTTP/1.1 200 OK\r\n"
+           << "Content-Type: text/plain\r\n"
+           << "Content-Length: " << content_.length() << "\r\n"
+           << "Connection: close\r\n\r\n";
+    std::string head = header.str();
+    asio::write(*socket, asio::buffer(head), error);
+    if (!error) {
+      asio::write(*socket, asio::buffer(content_), error);
+    }
+  }
+};
+
+// Database holding nothing but the subscription to |url|. Having no filters
+// makes the engine download it right after loading.
+void WriteDatabase(const std::string& path, const std::string& url) {
+  std::ofstream database(path.c_str());
+  database << "# Adblock preferences" << std::endl
+           << "version=4" << std::endl
+           << std::endl
+           << "[Subscription]" << std::endl
+           << "url=" << url << std::endl
+           << "title=Bench list" << std::endl;
+}
+
+}  // namespace
+
+// Measures how long applying a complete filter list takes: the engine
+// downloads it from a local server right after starting with an empty
+// database, and the time from releasing the response until the filters are
+// in the matchers is taken. That covers streaming the list through the
+// native parser, the checksum, creating the filter objects and adding them
+// to the matchers. The native parse and checksum alone are timed as well to
+// show their share.
+// Usage: bench list-apply [-n runs] <list.txt>
+int ListApply(int argc, char* argv[]) {
+  int runs = 5;
+  int idx = 0;
+  if (argc >= 2 && std::string(argv[0]) == "-n") {
+    runs = std::max(1, std::atoi(argv[1]));
+    idx = 2;
+  }
+  if (argc - idx != 1) {
+    std::cerr << "Usage: bench list-apply [-n runs] <list.txt>" << std::endl;
+    return 1;
+  }
+  std::string path = argv[idx];
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (!file) {
+    std::cerr << "Cannot read " << path << std::endl;
+    return 1;
+  }
+  std::ostringstream content;
+  content << file.rdbuf();
+  std::string list = content.str();
+
+  std::vector<double> parse;
+  size_t filters = 0;
+  for (int run = 0; run < runs; ++run) {
+    Stopwatch elapsed;
+    adblock::ListParser parser;
+    parser.Feed(list.data(), list.length());
+    parser.Finish();
+    parse.push_back(elapsed.Elapsed());
+    if (!parser.valid()) {
+      std::cerr << path << " is not a filter list" << std::endl;
+      return 1;
+    }
+    filters = parser.pending_lines();
+  }
+
+  ListServer server(list);
+  std::string database =
+      (fs::temp_directory_path() /
+       fs::unique_path("adblock-bench-%%%%%%%%.db")).string();
+  WriteDatabase(database, server.url());
+
+  std::vector<double> apply;
+  for (int run = 0; run < runs; ++run) {
+    Sandbox sandbox(database);
+    adblock::AdBlockPtr adblock;
+    adblock::CreateInstance(&adblock);
+    if (!adblock) {
+      fs::remove(database);
+      return 1;
+    }
+    if (!adblock->WaitForReadiness(adblock::AdBlock::FILTERS_LOADED,
+                                   kApplyTimeout) ||
+        !server.WaitForRequests(run + 1, kApplyTimeout)) {
+      std::cerr << "The engine did not request the list" << std::endl;
+      fs::remove(database);
+      return 1;
+    }
+
+    Stopwatch elapsed;
+    server.Release();
+    if (!adblock->WaitForReadiness(adblock::AdBlock::FIRST_SYNC_DONE,
+                                   kApplyTimeout)) {
+      std::cerr << "The list was not applied" << std::endl;
+      fs::remove(database);
+      return 1;
+    }
+    apply.push_back(elapsed.Elapsed());
+    // Only successful downloads are listed in the stats
+    if (adblock->GetStats().find(server.url()) == std::string::npos) {
+      std::cerr << "The list download failed" << std::endl;
+      fs::remove(database);
+      return 1;
+    }
+  }
+  fs::remove(database);
+
+  std::cout << std::fixed << std::setprecision(2) << path << " ("
+            << list.length() << " B, " << filters << " lines, " << runs
+            << " runs)" << std::endl;
+  std::cout << "  " << std::setw(32) << std::left << "step" << std::right
+            << std::setw(12) << "median ms" << std::setw(12) << "min ms"
+            << std::endl;
+  std::cout << "  " << std::setw(32) << std::left << "native parse and checksum"
+            << std::right << std::setw(12) << Median(parse) << std::setw(12)
+            << *std::min_element(parse.begin(), parse.end()) << std::endl;
+  std::cout << "  " << std::setw(32) << std::left << "download until applied"
+            << std::right << std::setw(12) << Median(apply) << std::setw(12)
+            << *std::min_element(apply.begin(), apply.end()) << std::endl;
+  return 0;
+}
+
+}  // namespace bench
@@ -0,0 +1,88 @@
+#include "bench.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef WIN32
+#include <Windows.h>
+
+#pragma comment(lib, "Winmm.lib")
+#pragma comment(lib, "Wldap32.lib")
+#pragma comment(lib, "Ws2_32.lib")
+#ifdef _DEBUG
+#pragma comment(lib, "v8_snapshot-sd.lib")
+#pragma comment(lib, "v8_base.ia32-sd.lib")
+#pragma comment(lib, "icuuc-sd.lib")
+#pragma comment(lib, "icui18n-sd.lib")
+#pragma comment(lib, "libcurl-sd.lib")
+#pragma comment(lib, "libeay32-sd.lib")
+#pragma comment(lib, "ssleay32-sd.lib")
+#pragma comment(lib, "zlib-sd.lib")
+#else
+#pragma comment(lib, "v8_snapshot-s.lib")
+#pragma comment(lib, "v8_base.ia32-s.lib")
+#pragma comment(lib, "icuuc-s.lib")
+#pragma comment(lib, "icui18n-s.lib")
+#pragma comment(lib, "libcurl-s.lib")
+#pragma comment(lib, "libeay32-s.lib")
+#pragma comment(lib, "ssleay32-s.lib")
+#pragma comment(lib, "zlib-s.lib")
+#endif
+#endif  // WIN32
+
+namespace {
+
+struct Command {
+  const char* name;
+  int (*run)(int argc, char* argv[]);
+  const char* description;
+};
+
+const Command kCommands[] = {
+    {"db-load", bench::DbLoad,
+     "cold/warm load time and disk size of plain vs compressed databases"},
+    {"daemon", bench::Daemon,
+     "latency and throughput of the filtering daemon vs an in-process engine"},
+    {"list-apply", bench::ListApply,
+     "time from downloading a filter list until it is in the matchers"},
+    {"replay", bench::Replay,
+     "per-method throughput and latency percentiles of a request corpus"},
+    {"startup", bench::Startup,
+     "per-phase medians of repeated engine starts with a cold database"},
+};
+
+int Usage() {
+  std::cerr << "Usage: bench <command> [arguments]" << std::endl
+            << "Commands:" << std::endl;
+  for (size_t idx = 0; idx < sizeof(kCommands) / sizeof(kCommands[0]);
+       ++idx) {
+    std::cerr << "  " << kCommands[idx].name << "  "
+              << kCommands[idx].description << std::endl;
+  }
+  return 1;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    return Usage();
+  }
+
+  for (size_t idx = 0; idx < sizeof(kCommands) / sizeof(kCommands[0]); ++idx) {
+    if (std::strcmp(argv[1], kCommands[idx].name) == 0) {
+      try {
+        return kCommands[idx].run(argc - 2, argv + 2);
+      }
+      catch (const std::exception& e) {
+#ifdef WIN32
+        OutputDebugStringA(e.what());
+#endif  // WIN32
+        std::cerr << e.what() << std::endl;
+        return 1;
+      }
+    }
+  }
+  return Usage();
+}
@@ -0,0 +1,329 @@
+#include "bench.h"
+#include "../src/adblock.h"
+#include "../src/request_capture.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <boost/filesystem/operations.hpp>
+#include <boost/unordered_set.hpp>
+
+namespace fs = boost::filesystem;
+
+namespace bench {
+
+namespace {
+
+enum Method {
+  CHECK_FILTER_MATCH,
+  IS_WHITELISTED,
+  GET_ELEMENT_HIDING_SELECTORS,
+  GENERATE_CSS_CONTENT,
+  METHOD_COUNT
+};
+
+const char* const kMethodNames[METHOD_COUNT] = {
+    "CheckFilterMatch", "IsWhitelisted", "GetElementHidingSelectors",
+    "GenerateCSSContent"};
+
+// Milliseconds to wait for the engine to finish loading its filters
+const std::uint32_t kLoadTimeout = 60000;
+
+// One call of the engine, arguments in the order the method takes them
+struct Record {
+  Method method;
+  std::string args[3];
+};
+
+// Latencies in microseconds of the calls made during one phase
+struct Phase {
+  explicit Phase(const char* name) : name(name), passes(0), elapsed(0) {}
+
+  const char* name;
+  std::vector<double> samples[METHOD_COUNT];
+  int passes;
+  // Milliseconds spent replaying, including the harness itself
+  double elapsed;
+};
+
+void AddRecord(Method method, const std::string& arg0,
+               const std::string& arg1, const std::string& arg2,
+               std::vector<Record>* records) {
+  Record record;
+  record.method = method;
+  record.args[0] = arg0;
+  record.args[1] = arg1;
+  record.args[2] = arg2;
+  records->push_back(record);
+}
+
+// Calls in the order RequestCapture recorded them.
+bool LoadCapture(const std::string& path, std::vector<Record>* records) {
+  adblock::RequestCapture::UrlMode mode;
+  std::vector<adblock::CaptureRecord> captured;
+  if (!adblock::RequestCapture::Load(path, &mode, &captured)) {
+    std::cerr << path << " is truncated or corrupt" << std::endl;
+    return false;
+  }
+  if (mode != adblock::RequestCapture::FULL_URLS) {
+    std::cout << "warning: " << path << " holds anonymized URLs, matches "
+                 "depending on their paths differ" << std::endl;
+  }
+  for (auto it = captured.begin(); it != captured.end(); ++it) {
+    it->args.resize(3);
+    switch (it->method) {
+      case adblock::RequestCapture::CHECK_FILTER_MATCH:
+        AddRecord(CHECK_FILTER_MATCH, it->args[0], it->args[1], it->args[2],
+                  records);
+        break;
+      case adblock::RequestCapture::IS_WHITELISTED:
+        AddRecord(IS_WHITELISTED, it->args[0], it->args[1], it->args[2],
+                  records);
+        break;
+      case adblock::RequestCapture::GET_ELEMENT_HIDING_SELECTORS:
+        AddRecord(GET_ELEMENT_HIDING_SELECTORS, it->args[0], std::string(),
+                  std::string(), records);
+        break;
+    }
+  }
+  return true;
+}
+
+// Reads "location<TAB>type<TAB>document" lines, "#" starts a comment. The
+// calls are the ones the extension makes: every request checks whether its
+// document is whitelisted before it is matched, every document asks for its
+// selectors once.
+bool LoadCorpus(const std::string& path, std::vector<Record>* records) {
+  if (adblock::RequestCapture::IsCaptureFile(path)) {
+    return LoadCapture(path, records);
+  }
+
+  boost::unordered_set<std::string> documents;
+  std::ifstream file(path.c_str());
+  if (!file) {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  size_t number = 0;
+  while (std::getline(file, line)) {
+    ++number;
+    if (!line.empty() && line[line.length() - 1] == '\r') {
+      line.erase(line.length() - 1);
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    size_t first = line.find('\t');
+    size_t second =
+        first == std::string::npos ? first : line.find('\t', first + 1);
+    if (second == std::string::npos) {
+      std::cerr << path << ":" << number << ": expected three fields"
+                << std::endl;
+      return false;
+    }
+    std::string document = line.substr(second + 1);
+    if (documents.insert(document).second) {
+      AddRecord(GET_ELEMENT_HIDING_SELECTORS, document, std::string(),
+                std::string(), records);
+    }
+    AddRecord(IS_WHITELISTED, document, std::string(), std::string(),
+              records);
+    AddRecord(CHECK_FILTER_MATCH, line.substr(0, first),
+              line.substr(first + 1, second - first - 1), document, records);
+  }
+  return true;
+}
+
+// Makes all calls of the corpus, every pass ends with building the CSS.
+void ReplayPass(adblock::AdBlock* adblock, const std::vector<Record>& records,
+                Phase* phase) {
+  Stopwatch pass;
+  for (auto it = records.begin(); it != records.end(); ++it) {
+    Stopwatch call;
+    switch (it->method) {
+      case CHECK_FILTER_MATCH:
+        adblock->CheckFilterMatch(it->args[0], it->args[1], it->args[2]);
+        break;
+      case IS_WHITELISTED:
+        adblock->IsWhitelisted(it->args[0], it->args[1], it->args[2]);
+        break;
+      case GET_ELEMENT_HIDING_SELECTORS:
+        adblock->GetElementHidingSelectors(it->args[0]);
+        break;
+      default:
+        break;
+    }
+    phase->samples[it->method].push_back(call.Elapsed() * 1000);
+  }
+
+  Stopwatch css;
+  adblock->GenerateCSSContent();
+  phase->samples[GENERATE_CSS_CONTENT].push_back(css.Elapsed() * 1000);
+
+  phase->elapsed += pass.Elapsed();
+  ++phase->passes;
+}
+
+double Sum(const std::vector<double>& samples) {
+  double sum = 0;
+  for (auto it = samples.begin(); it != samples.end(); ++it) {
+    sum += *it;
+  }
+  return sum;
+}
+
+// Calls per second of time spent inside the engine
+double Throughput(const std::vector<double>& samples) {
+  double sum = Sum(samples);
+  return sum > 0 ? samples.size() / sum * 1000000 : 0;
+}
+
+std::string JsonString(const std::string& value) {
+  std::stringstream result;
+  result << '"';
+  for (auto it = value.begin(); it != value.end(); ++it) {
+    unsigned char c = static_cast<unsigned char>(*it);
+    if (c == '"' || c == '\\') {
+      result << '\\' << *it;
+    } else if (c < 0x20) {
+      result << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+             << static_cast<int>(c) << std::dec << std::setfill(' ');
+    } else {
+      result << *it;
+    }
+  }
+  result << '"';
+  return result.str();
+}
+
+void PrintPhase(const Phase& phase) {
+  std::cout << phase.name << " (" << phase.passes << " passes, "
+            << phase.elapsed << " ms)" << std::endl;
+  for (int method = 0; method < METHOD_COUNT; ++method) {
+    const std::vector<double>& samples = phase.samples[method];
+    std::cout << "  " << std::setw(26) << kMethodNames[method] << std::setw(9)
+              << samples.size() << " calls " << std::setw(12)
+              << Throughput(samples) << "/s  p50 " << std::setw(9)
+              << Percentile(samples, 0.5) << "  p90 " << std::setw(9)
+              << Percentile(samples, 0.9) << "  p99 " << std::setw(9)
+              << Percentile(samples, 0.99) << "  p99.9 " << std::setw(9)
+              << Percentile(samples, 0.999) << " us" << std::endl;
+  }
+}
+
+void WritePhase(const Phase& phase, std::ostream* out) {
+  *out << "    " << JsonString(phase.name) << ": {\"passes\": " << phase.passes
+       << ", \"elapsed_ms\": " << phase.elapsed << ", \"methods\": {";
+  for (int method = 0; method < METHOD_COUNT; ++method) {
+    const std::vector<double>& samples = phase.samples[method];
+    *out << (method ? "," : "") << "\n      "
+         << JsonString(kMethodNames[method])
+         << ": {\"calls\": " << samples.size()
+         << ", \"throughput\": " << Throughput(samples) << ", \"mean_us\": "
+         << (samples.empty() ? 0 : Sum(samples) / samples.size())
+         << ", \"p50_us\": " << Percentile(samples, 0.5)
+         << ", \"p90_us\": " << Percentile(samples, 0.9)
+         << ", \"p99_us\": " << Percentile(samples, 0.99)
+         << ", \"p999_us\": " << Percentile(samples, 0.999) << "}";
+  }
+  *out << "}}";
+}
+
+}  // namespace
+
+// Replays a corpus of requests or a capture file against an engine loaded
+// with a fixed database. The first pass after the engine is created counts as
+// cold, the following ones as warm.
+// Usage: bench replay [-n passes] [-o result.json] <adblock.db> <corpus>
+int Replay(int argc, char* argv[]) {
+  int passes = 5;
+  std::string output;
+  int idx = 0;
+  for (; idx + 1 < argc && argv[idx][0] == '-'; idx += 2) {
+    std::string option(argv[idx]);
+    if (option == "-n") {
+      passes = std::max(1, std::atoi(argv[idx + 1]));
+    } else if (option == "-o") {
+      // Paths are resolved before the engine moves into its sandbox
+      output = fs::absolute(argv[idx + 1]).string();
+    } else {
+      break;
+    }
+  }
+  if (argc - idx != 2) {
+    std::cerr << "Usage: bench replay [-n passes] [-o result.json] "
+                 "<adblock.db> <corpus>" << std::endl;
+    return 1;
+  }
+  std::string database = fs::absolute(argv[idx]).string();
+  std::string corpus = argv[idx + 1];
+
+  std::vector<Record> records;
+  if (!LoadCorpus(corpus, &records)) {
+    return 1;
+  }
+  if (records.empty()) {
+    std::cerr << corpus << " holds no calls" << std::endl;
+    return 1;
+  }
+
+  Sandbox sandbox(database);
+  bool dropped = DropFileCache(sandbox.database());
+
+  Stopwatch load;
+  adblock::AdBlockPtr adblock;
+  adblock::CreateInstance(&adblock);
+  if (!adblock) {
+    return 1;
+  }
+  // The database is read in the background after the engine is created
+  if (!adblock->WaitForReadiness(adblock::AdBlock::FILTERS_LOADED,
+                                 kLoadTimeout)) {
+    std::cerr << "The filters did not finish loading" << std::endl;
+    return 1;
+  }
+  double load_time = load.Elapsed();
+
+  Phase cold("cold");
+  ReplayPass(adblock.get(), records, &cold);
+  Phase warm("warm");
+  for (int pass = 0; pass < passes; ++pass) {
+    ReplayPass(adblock.get(), records, &warm);
+  }
+
+  std::cout << std::fixed << std::setprecision(2) << corpus << " ("
+            << records.size() << " calls), load " << load_time << " ms"
+            << std::endl;
+  if (!dropped) {
+    std::cout << "warning: page cache could not be dropped, the database "
+                 "was loaded warm" << std::endl;
+  }
+  PrintPhase(cold);
+  PrintPhase(warm);
+
+  if (!output.empty()) {
+    std::ofstream out(output.c_str());
+    out << std::fixed << std::setprecision(3) << "{\n"
+        << "  \"database\": " << JsonString(database) << ",\n"
+        << "  \"corpus\": " << JsonString(corpus) << ",\n"
+        << "  \"calls\": " << records.size() << ",\n"
+        << "  \"load_ms\": " << load_time << ",\n"
+        << "  \"cold_cache\": " << (dropped ? "true" : "false") << ",\n"
+        << "  \"phases\": {\n";
+    WritePhase(cold, &out);
+    out << ",\n";
+    WritePhase(warm, &out);
+    out << "\n  }\n}\n";
+    if (!out) {
+      std::cerr << "Failed to write " << output << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+}  // namespace bench
@@ -0,0 +1,141 @@
+#include "bench.h"
+#include "../src/adblock.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <boost/filesystem/operations.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace fs = boost::filesystem;
+namespace pt = boost::property_tree;
+
+namespace bench {
+
+namespace {
+
+// Milliseconds to wait for the engine to load its filters
+const std::uint32_t kLoadTimeout = 60000;
+
+// Samples of one phase over all starts, in milliseconds
+struct Phase {
+  Phase() : mark(true) {}
+
+  std::vector<double> start;
+  std::vector<double> duration;
+  // Whether the phase is a point in time, it never took any time then
+  bool mark;
+};
+
+// Adds the phases of the "startup_phases" section of GetStats() to |phases|,
+// the ones seen for the first time to |order| as well.
+bool AddPhases(const std::string& stats, std::map<std::string, Phase>* phases,
+               std::vector<std::string>* order) {
+  pt::ptree tree;
+  try {
+    std::istringstream in(stats);
+    pt::read_json(in, tree);
+  }
+  catch (const pt::json_parser_error& e) {
+    std::cerr << "Invalid stats: " << e.what() << std::endl;
+    return false;
+  }
+  auto profile = tree.get_child_optional("startup_phases");
+  if (!profile || !profile->get<bool>("finished", false)) {
+    std::cerr << "The startup profile is not finished" << std::endl;
+    return false;
+  }
+
+  for (auto it = profile->get_child("phases").begin();
+       it != profile->get_child("phases").end(); ++it) {
+    auto duration = it->second.get_optional<double>("ms");
+    if (!duration) {
+      continue;
+    }
+    if (phases->find(it->first) == phases->end()) {
+      order->push_back(it->first);
+    }
+    Phase& phase = (*phases)[it->first];
+    phase.start.push_back(it->second.get<double>("start_ms"));
+    phase.duration.push_back(*duration);
+    phase.mark = phase.mark && *duration == 0;
+  }
+  return true;
+}
+
+}  // namespace
+
+// Starts engines on a fixed database one after the other and reports the
+// median of every phase the engine profiled, see StartupProfile. The page
+// cache of the database is dropped before each start. Only the first start
+// also pays for loading the scripts' code into a fresh process, it is shown
+// separately.
+// Usage: bench startup [-n starts] <adblock.db>
+int Startup(int argc, char* argv[]) {
+  int starts = 10;
+  int idx = 0;
+  if (argc >= 2 && std::string(argv[0]) == "-n") {
+    starts = std::max(1, std::atoi(argv[1]));
+    idx = 2;
+  }
+  if (argc - idx != 1) {
+    std::cerr << "Usage: bench startup [-n starts] <adblock.db>" << std::endl;
+    return 1;
+  }
+  std::string database = fs::absolute(argv[idx]).string();
+
+  std::map<std::string, Phase> phases;
+  std::vector<std::string> order;
+  std::vector<double> totals;
+  bool dropped = true;
+  for (int start = 0; start < starts; ++start) {
+    Sandbox sandbox(database);
+    dropped = DropFileCache(sandbox.database()) && dropped;
+
+    Stopwatch elapsed;
+    adblock::AdBlockPtr adblock;
+    adblock::CreateInstance(&adblock);
+    if (!adblock) {
+      return 1;
+    }
+    if (!adblock->WaitForReadiness(adblock::AdBlock::FILTERS_LOADED,
+                                   kLoadTimeout)) {
+      std::cerr << "The filters did not finish loading" << std::endl;
+      return 1;
+    }
+    totals.push_back(elapsed.Elapsed());
+    if (!AddPhases(adblock->GetStats(), &phases, &order)) {
+      return 1;
+    }
+  }
+
+  std::cout << std::fixed << std::setprecision(2) << database << " ("
+            << starts << " starts)" << std::endl;
+  if (!dropped) {
+    std::cout << "warning: page cache could not be dropped, the database "
+                 "was loaded warm" << std::endl;
+  }
+  std::cout << "  " << std::setw(32) << std::left << "phase" << std::right
+            << std::setw(12) << "median ms" << std::setw(12) << "first ms"
+            << std::endl;
+  for (auto it = order.begin(); it != order.end(); ++it) {
+    const Phase& phase = phases[*it];
+    // Points in time are shown as the time they were reached at
+    const std::vector<double>& samples =
+        phase.mark ? phase.start : phase.duration;
+    std::cout << "  " << std::setw(32) << std::left
+              << (phase.mark ? "@ " + *it : *it) << std::right
+              << std::setw(12) << Median(samples) << std::setw(12)
+              << samples.front() << std::endl;
+  }
+  std::cout << "  " << std::setw(32) << std::left << "until filters loaded"
+            << std::right << std::setw(12) << Median(totals) << std::setw(12)
+            << totals.front() << std::endl;
+  return 0;
+}
+
+}  // namespace bench
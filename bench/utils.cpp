@@ -0,0 +1,84 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <boost/filesystem/operations.hpp>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif  // WIN32
+
+namespace fs = boost::filesystem;
+
+namespace bench {
+
+Sandbox::Sandbox(const std::string& database)
+    : previous_(fs::current_path()),
+      directory_(fs::temp_directory_path() /
+                 fs::unique_path("adblock-bench-%%%%%%%%")) {
+  fs::create_directories(directory_);
+  fs::copy_file(database, directory_ / "adblock.db");
+  std::ofstream prefs((directory_ / "prefs.json").string().c_str());
+  prefs << "{\"subscriptions_autoupdate\": false}";
+  prefs.close();
+  fs::current_path(directory_);
+}
+
+Sandbox::~Sandbox() {
+  boost::system::error_code error;
+  fs::current_path(previous_, error);
+  fs::remove_all(directory_, error);
+}
+
+std::string Sandbox::database() const {
+  return (directory_ / "adblock.db").string();
+}
+
+bool DropFileCache(const std::string& path) {
+#ifdef WIN32
+  // Opening a file without buffering makes the cache manager flush and
+  // purge the pages it holds for it
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  CloseHandle(file);
+  return true;
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  fdatasync(fd);
+  bool result = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+  close(fd);
+  return result;
+#endif  // WIN32
+}
+
+double Median(std::vector<double> samples) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t middle = samples.size() / 2;
+  std::nth_element(samples.begin(), samples.begin() + middle, samples.end());
+  return samples[middle];
+}
+
+double Percentile(std::vector<double> samples, double fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  size_t rank = static_cast<size_t>(std::ceil(fraction * samples.size()));
+  size_t index = rank > 0 ? std::min(rank, samples.size()) - 1 : 0;
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+}  // namespace bench
@@ -0,0 +1,111 @@
+#include "../src/adblock.h"
+#include "../src/daemon_channel.h"
+#include <stdexcept>
+#include <iostream>
+#ifdef WIN32
+#include <Windows.h>
+
+#pragma comment(lib, "Winmm.lib")
+#pragma comment(lib, "Wldap32.lib")
+#pragma comment(lib, "Ws2_32.lib")
+#ifdef _DEBUG
+#pragma comment(lib, "v8_snapshot-sd.lib")
+#pragma comment(lib, "v8_base.ia32-sd.lib")
+#pragma comment(lib, "icuuc-sd.lib")
+#pragma comment(lib, "icui18n-sd.lib")
+#pragma comment(lib, "libcurl-sd.lib")
+#pragma comment(lib, "libeay32-sd.lib")
+#pragma comment(lib, "ssleay32-sd.lib")
+#pragma comment(lib, "zlib-sd.lib")
+#else
+#pragma comment(lib, "v8_snapshot-s.lib")
+#pragma comment(lib, "v8_base.ia32-s.lib")
+#pragma comment(lib, "icuuc-s.lib")
+#pragma comment(lib, "icui18n-s.lib")
+#pragma comment(lib, "libcurl-s.lib")
+#pragma comment(lib, "libeay32-s.lib")
+#pragma comment(lib, "ssleay32-s.lib")
+#pragma comment(lib, "zlib-s.lib")
+#endif
+#else
+#include <pthread.h>
+#include <signal.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#endif  // WIN32
+
+namespace {
+
+// Requests are answered by this many threads, each one enters the engine
+const int kWorkerThreads = 4;
+
+#ifdef WIN32
+adblock::DaemonServer* g_server = nullptr;
+
+BOOL WINAPI ConsoleHandler(DWORD type) {
+  if (g_server != nullptr) {
+    g_server->Stop();
+  }
+  return TRUE;
+}
+#else
+// Waits for SIGINT or SIGTERM, which all other threads block, and stops
+// |server|. Stop() isn't safe in a signal handler.
+void WaitForSignal(const sigset_t* signals, adblock::DaemonServer* server) {
+  int signal;
+  if (sigwait(signals, &signal) == 0 && signal != SIGUSR1) {
+    server->Stop();
+  }
+}
+#endif  // WIN32
+
+}  // namespace
+
+// Hosts the filtering engine for all browser processes of the session.
+// Plugins connect to it and fall back to an engine of their own when it
+// isn't running.
+int main() {
+#ifndef WIN32
+  // Before any thread is started, they all inherit the mask
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif  // WIN32
+  try {
+    adblock::AdBlockPtr adblock;
+    adblock::CreateInstance(&adblock);
+    if (!adblock) {
+      return -1;
+    }
+
+    adblock::DaemonServer server(adblock);
+    if (!server.Create()) {
+      return -1;
+    }
+#ifdef WIN32
+    g_server = &server;
+    SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+    server.Run(kWorkerThreads);
+    g_server = nullptr;
+#else
+    boost::thread waiter(boost::bind(WaitForSignal, &signals, &server));
+    server.Run(kWorkerThreads);
+    // Wakes the waiter if the server stopped on its own
+    pthread_kill(waiter.native_handle(), SIGUSR1);
+    waiter.join();
+#endif  // WIN32
+  }
+  catch (const std::exception& e) {
+#ifdef WIN32
+    OutputDebugStringA(e.what());
+#endif  // WIN32
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
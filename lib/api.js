@@ -3,15 +3,48 @@ var API = (function() {
   var filterClasses = require("filterClasses");
   var Filter = filterClasses.Filter;
   var FilterType = filterClasses.FilterType;
+  var RegExpFilter = filterClasses.RegExpFilter;
   var Subscription = require("subscriptionClasses").Subscription;
   var SpecialSubscription = require("subscriptionClasses").SpecialSubscription;
   var defaultMatcher = require("matcher").defaultMatcher;
   var ElemHide = require("elemHide").ElemHide;
   var Synchronizer = require("synchronizer").Synchronizer;
   var Prefs = require("prefs").Prefs;
+  var FilterIndex = require("filterIndex").FilterIndex;
+  var DomainSet = filterClasses.DomainSet;
+
+  /**
+   * Open documents by handle, see beginDocument()
+   * @type Object
+   */
+  var documents = { __proto__: null };
+  var openDocuments = 0;
+  var nextDocument = 1;
+
+  /**
+   * Documents kept open at most, the oldest one is closed when another
+   * document begins. Same as AdBlock::MAX_OPEN_DOCUMENTS.
+   * @type Number
+   */
+  var maxDocuments = 1024;
+
+  /**
+   * checkFilterMatchInDocument() calls for documents that weren't open
+   * @type Number
+   */
+  var unknownDocuments = 0;
 
   function _matches(url, contentType, documentHost, thirdParty) {
     var filter = defaultMatcher.matchesAny(url, contentType, documentHost, thirdParty);
+    if (FilterIndex.isReader &&
+        !(filter && filter.type == FilterType.WHITELIST_FILTER)) {
+      // Filters added in this process take part, an exception from either
+      // side wins
+      var shared = FilterIndex.matchesAny(url, contentType, documentHost, thirdParty);
+      if (shared && (shared.type == FilterType.WHITELIST_FILTER || filter === null)) {
+        filter = shared;
+      }
+    }
     if (filter === null) {
       filter = {};
       filter.type = FilterType.NO_MATCH;
@@ -19,25 +52,82 @@ var API = (function() {
     return filter;
   }
 
+  function _checkFilterMatch(url, contentType, documentUrl) {
+    var requestHost = extractHostFromURL(url);
+    var documentHost = extractHostFromURL(documentUrl);
+    var thirdParty = isThirdParty(requestHost, documentHost);
+    return JSON.stringify(_matches(url, contentType, documentHost, thirdParty));
+  }
+
+  function _endDocument(handle) {
+    var document = documents[handle];
+    if (document) {
+      DomainSet.unpin(document.host, RegExpFilter.prototype.ignoreTrailingDot);
+      delete documents[handle];
+      openDocuments--;
+    }
+  }
+
   function _isWhitelisted(url, parentUrl, type) {
     // Ignore fragment identifier
     var index = url.indexOf("#");
     if (index >= 0)
       url = url.substring(0, index);
 
-    var filter = _matches(url, type || "DOCUMENT", extractHostFromURL(parentUrl || url), false);
-    return filter.type == FilterType.WHITELIST_FILTER ? filter : null;
+    // Only exception rules can make a difference here, the blocking rules
+    // aren't looked at
+    type = type || "DOCUMENT";
+    var documentHost = extractHostFromURL(parentUrl || url);
+    var filter = defaultMatcher.matchesWhitelist(url, type, documentHost, false);
+    if (!filter && FilterIndex.isReader)
+      filter = FilterIndex.matchesWhitelist(url, type, documentHost, false);
+    return filter;
   }
 
   return {
 
-    checkFilterMatch: function(url, contentType, documentUrl) {
-      var requestHost = extractHostFromURL(url);
-      var documentHost = extractHostFromURL(documentUrl);
-      var thirdParty = isThirdParty(requestHost, documentHost);
-      return JSON.stringify(_matches(url, contentType, documentHost, thirdParty));
+    checkFilterMatch: _checkFilterMatch,
+
+    /**
+     * Prepares the host, base domain and domain checks of a document for
+     * checkFilterMatchInDocument() calls of its sub-resources.
+     * @return {Number} handle to pass to endDocument() on navigation
+     */
+    beginDocument: function(documentUrl) {
+      var host = extractHostFromURL(documentUrl);
+      var handle = nextDocument++;
+      documents[handle] = {
+        host: host,
+        domain: getBaseDomain(host.replace(/\.+$/, ""))
+      };
+      openDocuments++;
+      DomainSet.pin(host, RegExpFilter.prototype.ignoreTrailingDot);
+      _endDocument(handle - maxDocuments);
+      return handle;
+    },
+
+    /**
+     * Matches like checkFilterMatch() for a document of beginDocument(). A
+     * document that was ended or evicted is matched by its address if the
+     * host still passes it as documentUrl, otherwise the result has
+     * unknownDocument set and the caller has to begin the document again.
+     */
+    checkFilterMatchInDocument: function(handle, url, contentType, documentUrl) {
+      var document = documents[handle];
+      if (!document) {
+        unknownDocuments++;
+        if (documentUrl)
+          return _checkFilterMatch(url, contentType, documentUrl);
+        return JSON.stringify({type: FilterType.NO_MATCH, unknownDocument: true});
+      }
+
+      var requestHost = extractHostFromURL(url).replace(/\.+$/, "");
+      var thirdParty = isThirdPartyOfDomain(requestHost, document.domain);
+      return JSON.stringify(_matches(url, contentType, document.host, thirdParty));
     },
 
+    endDocument: _endDocument,
+
     getElementHidingSelectors: function(url) {
       var host = extractHostFromURL(url);
       var hostDomain = getBaseDomain(host);
@@ -49,7 +139,16 @@ var API = (function() {
       return _isWhitelisted(url, parentUrl, type) != null;
     },
 
+    /**
+     * Turns blocking on a site on or off. Processes reading the filters
+     * shared by another one neither own nor save the exception rules, they
+     * refuse the change.
+     * @return {Boolean} whether the change was made
+     */
     toggleEnabled: function(url, enabled) {
+      if (FilterIndex.isReader)
+        return false;
+
       if (enabled) {  // Block ads on this site
         var filter = _isWhitelisted(url);
         while (filter) {
@@ -67,12 +166,49 @@ var API = (function() {
         }
         filter.disabled = false;
       }
+      return true;
     },
 
     generateCSSContent: function() {
       return ElemHide.generateCSSContent();
     },
 
+    getStats: function() {
+      var hits = defaultMatcher.cacheHits;
+      var lookups = hits + defaultMatcher.cacheMisses;
+      // Size and duration of the last download of every list
+      var downloads = {};
+      for (var i = 0; i < Subscription.subscriptions.length; i++) {
+        var subscription = Subscription.subscriptions[i];
+        if (subscription.downloadBytes) {
+          downloads[subscription.url] = {
+            bytes: subscription.downloadBytes,
+            ms: subscription.downloadTime
+          };
+        }
+      }
+      return JSON.stringify({
+        resultCache: {
+          hits: hits,
+          misses: defaultMatcher.cacheMisses,
+          hitRate: lookups ? hits / lookups : 0,
+          entries: defaultMatcher.cacheEntries
+        },
+        blacklist: defaultMatcher.blacklist.getStats(),
+        whitelist: defaultMatcher.whitelist.getStats(),
+        documentWhitelist: defaultMatcher.documentWhitelist.getStats(),
+        domainSets: {
+          sets: DomainSet.knownSetCount,
+          domains: DomainSet.knownDomainCount
+        },
+        openDocuments: openDocuments,
+        unknownDocuments: unknownDocuments,
+        downloads: downloads,
+        firstListTime: Synchronizer.firstListTime,
+        filterIndex: FilterIndex.role
+      });
+    },
+
   }
 
 })();
@@ -127,7 +127,15 @@ function isThirdParty(/**String*/ requestHost, /**String*/ documentHost)
   documentHost = documentHost.replace(/\.+$/, "");
 
   // Extract domain name - leave IP addresses unchanged, otherwise leave only base domain
-  var documentDomain = getBaseDomain(documentHost);
+  return isThirdPartyOfDomain(requestHost, getBaseDomain(documentHost));
+}
+
+/**
+ * Same as isThirdParty() for a document whose base domain is already known,
+ * trailing dots have to be removed from both arguments.
+ */
+function isThirdPartyOfDomain(/**String*/ requestHost, /**String*/ documentDomain)
+{
   if (requestHost.length > documentDomain.length)
     return (requestHost.substr(requestHost.length - documentDomain.length - 1) != "." + documentDomain);
   else
@@ -50,6 +50,14 @@ XMLHttpRequest.prototype = {
   status: 0,
   readyState: 0,
   responseText: null,
+  // Non-standard: bytes read from the network and transfer time in ms
+  bytesReceived: 0,
+  downloadTime: 0,
+  // Non-standard: if set, the response is parsed as a filter list while it
+  // arrives. Batches of filter lines are passed to this function, list
+  // receives the header and parameters and responseText stays empty.
+  onlistdata: null,
+  list: null,
 
   addEventListener: function(eventName, handler, capture) {
     var list;
@@ -99,11 +107,14 @@ XMLHttpRequest.prototype = {
       throw new Error("Sending data to server is not supported");
 
     this.readyState = 3;
-    webRequest.get(this._url, this._requestHeaders, function(result) {
+    var callback = function(result) {
       this.resultStatus = result.status;
       this.status = result.responseStatus;
       this.responseText = result.responseText;
       this._responseHeaders = result.responseHeaders;
+      this.bytesReceived = result.bytesReceived;
+      this.downloadTime = result.downloadTime;
+      this.list = result.list || null;
       this.readyState = 4;
 
       // Notify event listeners
@@ -116,7 +127,12 @@ XMLHttpRequest.prototype = {
       var list = this["_" + eventName + "Handlers"];
       for (var i = 0; i < list.length; i++)
         list[i].call(this, event);
-    }.bind(this));
+    }.bind(this);
+
+    if (this.onlistdata)
+      webRequest.getList(this._url, this._requestHeaders, this.onlistdata, callback);
+    else
+      webRequest.get(this._url, this._requestHeaders, callback);
   },
 
   setRequestHeader: function(name, value) {
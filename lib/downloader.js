@@ -23,6 +23,9 @@ require.scopes['downloader'] = (function() {
       this._doCheck();
     }.bind(this), initialDelay);
     this._downloading = Object.create(null);
+    this._queue = [];
+    this._running = [];
+    this._hostBackoff = Object.create(null);
   };
   Downloader.prototype = {
     /**
@@ -36,6 +39,48 @@ require.scopes['downloader'] = (function() {
      */
     _downloading: null,
 
+    /**
+     * Requests waiting for a free download slot, highest priority first.
+     * @type Array
+     */
+    _queue: null,
+
+    /**
+     * Priorities of the requests currently running.
+     * @type Array
+     */
+    _running: null,
+
+    /**
+     * Map of host names to their consecutive failures and the time until
+     * which no further requests are sent to them.
+     */
+    _hostBackoff: null,
+
+    /**
+     * Timer restarting the queue once a host backoff expires.
+     */
+    _queueTimer: null,
+
+    /**
+     * Maximal number of downloads running at the same time.
+     * @type Integer
+     */
+    maxConcurrentDownloads: 2,
+
+    /**
+     * Time to wait before contacting a host again after a failed request,
+     * doubles with each further failure.
+     * @type Integer
+     */
+    minHostBackoff: 30 * MILLIS_IN_SECOND,
+
+    /**
+     * Upper limit for the per host backoff.
+     * @type Integer
+     */
+    maxHostBackoff: 1 * MILLIS_IN_HOUR,
+
     /**
      * Function that will yield downloadable objects on each check.
      * @type Function
@@ -87,12 +132,34 @@ require.scopes['downloader'] = (function() {
      */
     onDownloadSuccess: null,
 
+    /**
+     * Callback receiving batches of lines while a filter list is downloaded.
+     * If set, lists are parsed natively as they arrive and onDownloadSuccess
+     * gets the parse result instead of the response text.
+     * @type Function
+     */
+    onDownloadData: null,
+
+    /**
+     * Callback to be triggered whenever the server answers a conditional
+     * request with "304 Not Modified".
+     * @type Function
+     */
+    onDownloadNotModified: null,
+
     /**
      * Callback to be triggered whenever a download fails.
      * @type Function
      */
     onDownloadError: null,
 
+    /**
+     * Callback to be triggered whenever a download task ends, after the
+     * handlers of its last request ran.
+     * @type Function
+     */
+    onTaskFinished: null,
+
     /**
      * Checks whether anything needs downloading.
      */
@@ -138,6 +205,15 @@ require.scopes['downloader'] = (function() {
       return url in this._downloading;
     },
 
+    /**
+     * Checks whether any download is running.
+     */
+    hasDownloads: function() /**Boolean*/ {
+      for (var url in this._downloading)
+        return true;
+      return false;
+    },
+
     /**
      * Starts a download.
      * @param {Downloadable} url  the object to be downloaded
@@ -165,16 +241,107 @@ require.scopes['downloader'] = (function() {
       return url;
     },
 
+    /**
+     * Starts a download task unless one is running for the object already.
+     * Redirects continue the task they belong to.
+     */
     _download: function(downloadable, redirects) {
-      if (downloadable.url in this._downloading)
+      if (!redirects) {
+        if (downloadable.url in this._downloading)
+          return;
+        this._downloading[downloadable.url] = true;
+        trigger("downloadStart");
+      }
+
+      // Keep the queue sorted by priority, first come first served otherwise
+      var item = { downloadable: downloadable, redirects: redirects };
+      var index = this._queue.length;
+      while (index > 0 && (this._queue[index - 1].downloadable.priority || 0) < (downloadable.priority || 0))
+        index--;
+      this._queue.splice(index, 0, item);
+      this._processQueue();
+    },
+
+    /**
+     * Ends a download task, called once no further redirect is followed.
+     */
+    _finishTask: function(downloadable) {
+      delete this._downloading[downloadable.url];
+      trigger("downloadFinished");
+      if (this.onTaskFinished)
+        this.onTaskFinished(downloadable);
+    },
+
+    /**
+     * Starts queued requests as long as there are free slots, skipping hosts
+     * that are backing off after failures. Requests only run alongside
+     * requests of the same priority so that the important lists get all the
+     * bandwidth.
+     */
+    _processQueue: function() {
+      var now = Date.now();
+      var retryTime = 0;
+      var runningPriority = Math.max.apply(Math, this._running);
+      for (var idx = 0; idx < this._queue.length && this._running.length < this.maxConcurrentDownloads; ) {
+        var item = this._queue[idx];
+        var priority = item.downloadable.priority || 0;
+        if (priority < runningPriority)
+          break;
+        var backoff = this._hostBackoff[this._getHost(this.getDownloadUrl(item.downloadable))];
+        if (backoff && backoff.until > now) {
+          if (!retryTime || backoff.until < retryTime)
+            retryTime = backoff.until;
+          idx++;
+          continue;
+        }
+        this._queue.splice(idx, 1);
+        this._running.push(priority);
+        runningPriority = Math.max(runningPriority, priority);
+        this._request(item.downloadable, item.redirects);
+      }
+
+      if (retryTime && !this._queueTimer) {
+        this._queueTimer = setTimeout(function() {
+          this._queueTimer = null;
+          this._processQueue();
+        }.bind(this), retryTime - now);
+      }
+    },
+
+    _getHost: function(/**String*/ url) /**String*/ {
+      var match = /^[\w\-]+:\/+(?:[^\/@]*@)?([^\/:?#]+)/.exec(url);
+      return match ? match[1].toLowerCase() : "";
+    },
+
+    /**
+     * Records the outcome of a request for the per host backoff.
+     */
+    _updateBackoff: function(/**String*/ host, /**Boolean*/ failed) {
+      if (!failed) {
+        delete this._hostBackoff[host];
         return;
+      }
+      var backoff = this._hostBackoff[host] || { failures: 0, until: 0 };
+      var delay = Math.min(this.minHostBackoff * Math.pow(2, backoff.failures), this.maxHostBackoff);
+      backoff.failures++;
+      backoff.until = Date.now() + delay;
+      this._hostBackoff[host] = backoff;
+    },
 
+    _request: function(downloadable, redirects) {
       var downloadURL = this.getDownloadUrl(downloadable);
       var request = null;
+      var redirected = false;
+
+      var redirect = function(url) {
+        redirected = true;
+        downloadable.redirectURL = url;
+        this._download(downloadable, redirects + 1);
+      }.bind(this);
 
       var errorCallback = function errorCallback(error) {
-        var channelStatus = request.resultStatus;
-        var responseStatus = request.status;
+        var channelStatus = request ? request.resultStatus : 0;
+        var responseStatus = request ? request.status : 0;
 
         reportError("Adblock: Downloading URL " + downloadable.url + " failed (" + error + ")\n" +
                        "Download address: " + downloadURL + "\n" +
@@ -184,54 +351,95 @@ require.scopes['downloader'] = (function() {
         if (this.onDownloadError) {
           // Allow one extra redirect if the error handler gives us a redirect URL
           var redirectCallback = null;
-          if (redirects <= this.maxRedirects) {
-            redirectCallback = function redirectCallback(url) {
-              downloadable.redirectURL = url;
-              this._download(downloadable, redirects + 1);
-            }.bind(this);
-          }
+          if (redirects <= this.maxRedirects)
+            redirectCallback = redirect;
           this.onDownloadError(downloadable, downloadURL, error, channelStatus, responseStatus, redirectCallback);
         }
       }.bind(this);
 
+      // Frees the slot and ends the task unless a redirect took it over
+      var done = function(hostFailed) {
+        this._running.splice(this._running.indexOf(downloadable.priority || 0), 1);
+        this._updateBackoff(this._getHost(downloadURL), hostFailed);
+        if (!redirected)
+          this._finishTask(downloadable);
+        this._processQueue();
+      }.bind(this);
+
       try {
         request = new XMLHttpRequest();
         request.open("GET", downloadURL);
       } catch (e) {
         errorCallback("synchronize_invalid_url");
+        done(false);
         return;
       }
 
-      request.addEventListener("error", function(event) {
-        delete this._downloading[downloadable.url];
-        errorCallback("synchronize_connection_error");
-      }.bind(this), false);
+      if (this.onDownloadData)
+        request.onlistdata = this.onDownloadData.bind(null, downloadable);
 
-      request.addEventListener("load", function(event) {
-        delete this._downloading[downloadable.url];
+      // Validators are only sent for the address they were received from
+      var conditional = this.onDownloadNotModified && !downloadable.redirectURL;
+      if (conditional) {
+        if (downloadable.etag)
+          request.setRequestHeader("If-None-Match", downloadable.etag);
+        if (downloadable.lastModified)
+          request.setRequestHeader("If-Modified-Since", downloadable.lastModified);
+      }
 
-        // Status will be 0 for non-HTTP requests
-        if (request.status && request.status != 200) {
+      request.addEventListener("error", function(event) {
+        this._recordTransfer(downloadable, request);
+        try {
           errorCallback("synchronize_connection_error");
-          return;
+        } finally {
+          done(true);
         }
+      }.bind(this), false);
 
-        this.onDownloadSuccess(downloadable, request.responseText, errorCallback, function redirectCallback(url) {
-          if (redirects >= this.maxRedirects) {
+      request.addEventListener("load", function(event) {
+        this._recordTransfer(downloadable, request);
+        // Overloaded or rate limiting servers should be left alone for a while
+        var hostFailed = (request.status >= 500 || request.status == 429);
+        try {
+          if (request.status == 304 && conditional) {
+            this.onDownloadNotModified(downloadable);
+            return;
+          }
+
+          // Status will be 0 for non-HTTP requests
+          if (request.status && request.status != 200) {
             errorCallback("synchronize_connection_error");
-          } else {
-            downloadable.redirectURL = url;
-            this._download(downloadable, redirects + 1);
+            return;
           }
-        }.bind(this));
+
+          this.onDownloadSuccess(downloadable, request.list || request.responseText, errorCallback, function redirectCallback(url) {
+            if (redirects >= this.maxRedirects)
+              errorCallback("synchronize_connection_error");
+            else
+              redirect(url);
+          }.bind(this));
+        } finally {
+          done(hostFailed);
+        }
       }.bind(this), false);
 
-      this._downloading[downloadable.url] = true;
       if (this.onDownloadStarted)
         this.onDownloadStarted(downloadable);
       request.send(null);
     },
 
+    /**
+     * Copies transfer statistics of a finished request to the downloadable.
+     */
+    _recordTransfer: function(downloadable, request) {
+      downloadable.bytesReceived = request.bytesReceived;
+      downloadable.downloadTime = request.downloadTime;
+      if (request.status == 200) {
+        downloadable.etag = request.getResponseHeader("etag");
+        downloadable.lastModified = request.getResponseHeader("last-modified");
+      }
+    },
+
     /**
      * Produces a soft and a hard expiration interval for a given supplied
      * expiration interval.
@@ -297,6 +505,37 @@ require.scopes['downloader'] = (function() {
      * @type Integer
      */
     hardExpiration: 0,
+
+    /**
+     * ETag validator of the data downloaded last, sent as If-None-Match.
+     * @type String
+     */
+    etag: null,
+
+    /**
+     * Last-Modified validator of the data downloaded last, sent as
+     * If-Modified-Since.
+     * @type String
+     */
+    lastModified: null,
+
+    /**
+     * Downloads with a higher priority are started first.
+     * @type Integer
+     */
+    priority: 0,
+
+    /**
+     * Bytes read from the network by the last download, including headers.
+     * @type Number
+     */
+    bytesReceived: 0,
+
+    /**
+     * Wall time of the last download in milliseconds.
+     * @type Number
+     */
+    downloadTime: 0,
   };
 
   return exports;
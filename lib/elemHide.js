@@ -5,6 +5,7 @@
 require.scopes['elemHide'] = (function() {
   var exports = {};
   var ElemHideException = require("filterClasses").ElemHideException;
+  var Utils = require("utils").Utils;
 
   /**
    * Lookup table, filters by their associated key
@@ -30,6 +31,123 @@ require.scopes['elemHide'] = (function() {
    */
   var exceptions = { __proto__: null };
 
+  /**
+   * Increases whenever filters are added to or removed from filterByKey
+   * @type Integer
+   */
+  var cssRevision = 0;
+
+  /**
+   * Result of generateCSSContent() and the revision it was built for
+   * @type Object
+   */
+  var cssContent = { revision: -1, text: undefined };
+
+  /**
+   * Set once generateCSSContent() was used, from then on the CSS is rebuilt
+   * in the background after changes.
+   * @type Boolean
+   */
+  var cssRequested = false;
+
+  /**
+   * Set while a rebuild is posted to the scheduler
+   * @type Boolean
+   */
+  var cssScheduled = false;
+
+  function forEachNow(items, process, done) {
+    for (var i = 0; i < items.length; i++)
+      process(items[i]);
+    done();
+  }
+
+  function escapeChar(match) {
+    return "\\" + match.charCodeAt(0).toString(16) + " ";
+  }
+
+  /**
+   * Builds the CSS of all element hiding filters and passes it to callback.
+   * Gives up without calling it if the filters change in the meantime.
+   * @param {Function} forEach Utils.forEachInSlices() or forEachNow()
+   * @param {Function} callback called with the CSS, undefined without filters
+   */
+  function buildCSSContent(forEach, callback) {
+    var revision = cssRevision;
+    var domains = { __proto__: null };
+    var result = [];
+    var hasFilters = false;
+    forEach(Object.keys(filterByKey), function(key) {
+      if (cssRevision != revision)
+        return false;
+
+      var filter = filterByKey[key];
+      var domain = filter.selectorDomain || "";
+
+      var list;
+      if (domain in domains) {
+        list = domains[domain];
+      } else {
+        list = { __proto__: null };
+        domains[domain] = list;
+      }
+      list[filter.selector] = key;
+      hasFilters = true;
+    }, function() {
+      if (!hasFilters) {
+        callback(undefined);
+        return;
+      }
+
+      // Return CSS data
+      var cssTemplate = "-moz-binding: url(about:abp-elemhidehit?%ID%#dummy) !important;";
+      forEach(Object.keys(domains), function(domain) {
+        if (cssRevision != revision)
+          return false;
+
+        var list = domains[domain];
+        if (domain) {
+          result.push(("@-moz-document domain(\"" + domain.split(",").join("\"),domain(\"") + "\"){").replace(/[^\x01-\x7F]/g, escapeChar));
+        } else {
+          result.push("@-moz-document url-prefix(\"http://\"),url-prefix(\"https://\")," + "url-prefix(\"mailbox://\"),url-prefix(\"imap://\")," + "url-prefix(\"news://\"),url-prefix(\"snews://\"){");
+        }
+        for (var selector in list) {
+          result.push(selector.replace(/[^\x01-\x7F]/g, escapeChar) + "{" + cssTemplate.replace("%ID%", list[selector]) + "}");
+        }
+        result.push("}");
+      }, function() {
+        callback(result.join("\n") + "\n");
+      });
+    });
+  }
+
+  /**
+   * Rebuilds the CSS in slices, so that generateCSSContent() doesn't have
+   * to build it in a query.
+   */
+  function prepareCSSContent() {
+    if (require("filterListener").FilterListener.isApplying) {
+      // More changes are on their way, look again after the next slice
+      scheduler.postTask(prepareCSSContent);
+      return;
+    }
+    cssScheduled = false;
+    if (cssContent.revision == cssRevision)
+      return;
+    var revision = cssRevision;
+    buildCSSContent(Utils.forEachInSlices, function(text) {
+      cssContent = { revision: revision, text: text };
+    });
+  }
+
+  function invalidateCSSContent() {
+    ++cssRevision;
+    if (cssRequested && !cssScheduled) {
+      cssScheduled = true;
+      scheduler.postTask(prepareCSSContent);
+    }
+  }
+
   /**
    * Element hiding component
    * @class
@@ -43,6 +161,7 @@ require.scopes['elemHide'] = (function() {
       keyByFilter = { __proto__: null };
       knownExceptions = { __proto__: null };
       exceptions = { __proto__: null };
+      invalidateCSSContent();
     },
 
     /**
@@ -71,6 +190,7 @@ require.scopes['elemHide'] = (function() {
         filterByKey[key] = filter;
         keyByFilter[filter.text] = key;
         ElemHide.isDirty = true;
+        invalidateCSSContent();
       }
     },
 
@@ -95,6 +215,7 @@ require.scopes['elemHide'] = (function() {
         var key = keyByFilter[filter.text];
         delete filterByKey[key];
         delete keyByFilter[filter.text];
+        invalidateCSSContent();
       }
     },
 
@@ -116,49 +237,20 @@ require.scopes['elemHide'] = (function() {
       return null;
     },
 
+    /**
+     * Generates the CSS of all element hiding filters. Usually it has been
+     * built in the background already.
+     * @return {String} CSS, undefined without filters
+     */
     generateCSSContent: function () {
-      var domains = { __proto__: null };
-      var result = [];
-      var hasFilters = false;
-      for (var key in filterByKey) {
-        var filter = filterByKey[key];
-        var domain = filter.selectorDomain || "";
-
-        var list;
-        if (domain in domains) {
-          list = domains[domain];
-        } else {
-          list = { __proto__: null };
-          domains[domain] = list;
-        }
-        list[filter.selector] = key;
-        hasFilters = true;
-      }
-      if (!hasFilters) {
-        return;
-      }
-
-      function escapeChar(match) {
-        return "\\" + match.charCodeAt(0).toString(16) + " ";
-      }
-
-      // Return CSS data
-      var cssTemplate = "-moz-binding: url(about:abp-elemhidehit?%ID%#dummy) !important;";
-      for (var domain in domains) {
-        var rules = [];
-        var list = domains[domain];
-
-        if (domain) {
-          result.push(("@-moz-document domain(\"" + domain.split(",").join("\"),domain(\"") + "\"){").replace(/[^\x01-\x7F]/g, escapeChar));
-        } else {
-          result.push("@-moz-document url-prefix(\"http://\"),url-prefix(\"https://\")," + "url-prefix(\"mailbox://\"),url-prefix(\"imap://\")," + "url-prefix(\"news://\"),url-prefix(\"snews://\"){");
-        }
-        for (var selector in list) {
-          result.push(selector.replace(/[^\x01-\x7F]/g, escapeChar) + "{" + cssTemplate.replace("%ID%", list[selector]) + "}");
-        }
-        result.push("}");
+      cssRequested = true;
+      if (cssContent.revision != cssRevision) {
+        var revision = cssRevision;
+        buildCSSContent(forEachNow, function(text) {
+          cssContent = { revision: revision, text: text };
+        });
       }
-      return result.join("\n") + "\n";
+      return cssContent.text;
     },
 
     /**
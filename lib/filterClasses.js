@@ -220,6 +220,336 @@ require.scopes['filterClasses'] = (function() {
     serialize: function(buffer) { }
   };
 
+  /**
+   * Domain restrictions of filters, shared by all filters with the same
+   * domain list. Domain names are interned as integers, so that a document
+   * domain is split into its parent domains once per request instead of
+   * once per filter, and checking a filter compares integers only.
+   * @param {Object} domains map of upper-case domains to whether the filter
+   *                 is active on them, "" holding the value for all others
+   * @constructor
+   */
+  function DomainSet(domains) {
+    this.domains = domains;
+    this.defaultValue = domains[""];
+
+    var entries = [];
+    for (var domain in domains)
+      if (domain != "")
+        entries.push([DomainSet.intern(domain), domains[domain]]);
+    entries.sort(function(a, b) { return a[0] - b[0]; });
+
+    this.ids = [];
+    this.includes = [];
+    for (var i = 0; i < entries.length; i++) {
+      this.ids.push(entries[i][0]);
+      this.includes.push(entries[i][1]);
+    }
+  }
+  exports.DomainSet = DomainSet;
+
+  /**
+   * Ids of the interned domain names
+   * @type Object
+   */
+  DomainSet.domainIds = { __proto__: null };
+
+  /**
+   * Number of domain sets referring to each interned domain name
+   * @type Object
+   */
+  DomainSet.domainRefs = { __proto__: null };
+
+  /**
+   * Number of domain name ids assigned so far, ids aren't reused
+   * @type Number
+   */
+  DomainSet.domainCount = 0;
+
+  /**
+   * Number of entries in domainIds
+   * @type Number
+   */
+  DomainSet.knownDomainCount = 0;
+
+  /**
+   * Known domain sets by their source
+   * @type Object
+   */
+  DomainSet.knownSets = { __proto__: null };
+
+  /**
+   * Number of domain set ids assigned so far, ids aren't reused
+   * @type Number
+   */
+  DomainSet.setCount = 0;
+
+  /**
+   * Number of entries in knownSets
+   * @type Number
+   */
+  DomainSet.knownSetCount = 0;
+
+  /**
+   * Returns the id of a domain name, assigning a new one if needed. Each
+   * call has to be matched by a call of DomainSet.releaseName().
+   * @return {Number}
+   */
+  DomainSet.intern = function(/**String*/ domain) {
+    var id = DomainSet.domainIds[domain];
+    if (typeof id == "undefined") {
+      id = DomainSet.domainIds[domain] = ++DomainSet.domainCount;
+      DomainSet.domainRefs[domain] = 0;
+      DomainSet.knownDomainCount++;
+    }
+    DomainSet.domainRefs[domain]++;
+    return id;
+  };
+
+  DomainSet.releaseName = function(/**String*/ domain) {
+    if (--DomainSet.domainRefs[domain] == 0) {
+      delete DomainSet.domainIds[domain];
+      delete DomainSet.domainRefs[domain];
+      DomainSet.knownDomainCount--;
+    }
+  };
+
+  /**
+   * Returns the domain set for a domainSource value of a filter, parsing it
+   * only when no other filter uses the same domains.
+   * @return {DomainSet}
+   */
+  DomainSet.fromSource = function(/**String*/ source, /**String*/ separator, /**Boolean*/ ignoreTrailingDot) {
+    var key = (ignoreTrailingDot ? "." : "") + separator + source;
+    if (key in DomainSet.knownSets) {
+      DomainSet.knownSets[key].refs++;
+      return DomainSet.knownSets[key];
+    }
+
+    var domains = null;
+    var list = source.split(separator);
+    if (list.length == 1 && list[0][0] != "~") {
+      // Fast track for the common one-domain scenario
+      domains = { __proto__: null, "": false };
+      if (ignoreTrailingDot)
+        list[0] = list[0].replace(/\.+$/, "");
+      domains[list[0]] = true;
+    } else {
+      var hasIncludes = false;
+      for (var i = 0; i < list.length; i++) {
+        var domain = list[i];
+        if (ignoreTrailingDot)
+          domain = domain.replace(/\.+$/, "");
+        if (domain == "")
+          continue;
+
+        var include;
+        if (domain[0] == "~") {
+          include = false;
+          domain = domain.substr(1);
+        } else {
+          include = true;
+          hasIncludes = true;
+        }
+
+        if (!domains)
+          domains = { __proto__: null };
+
+        domains[domain] = include;
+      }
+      if (!domains)
+        domains = { __proto__: null };
+      domains[""] = !hasIncludes;
+    }
+
+    var set = new DomainSet(domains);
+    set.id = DomainSet.setCount++;
+    set.key = key;
+    set.refs = 1;
+    DomainSet.knownSetCount++;
+    return (DomainSet.knownSets[key] = set);
+  };
+
+  /**
+   * Gives up a domain set obtained from DomainSet.fromSource(), the set and
+   * the names only it refers to are dropped with its last user.
+   */
+  DomainSet.release = function(/**DomainSet*/ set) {
+    if (--set.refs > 0)
+      return;
+
+    delete DomainSet.knownSets[set.key];
+    DomainSet.knownSetCount--;
+    for (var domain in set.domains)
+      if (domain != "")
+        DomainSet.releaseName(domain);
+  };
+
+  /**
+   * Contexts of documents that are kept open, by ignoreTrailingDot and
+   * domain, see DomainSet.pin()
+   * @type Object
+   */
+  DomainSet.pinned = { __proto__: null };
+
+  var lastContext = null;
+
+  /**
+   * Returns the DomainContext of a document domain. The one last used is
+   * kept since the filters of a request all ask for the same, contexts of
+   * pinned domains are kept until they are unpinned.
+   * @return {DomainContext}
+   */
+  DomainSet.context = function(/**String*/ docDomain, /**Boolean*/ ignoreTrailingDot) {
+    if (lastContext && lastContext.docDomain === docDomain &&
+        lastContext.ignoreTrailingDot == ignoreTrailingDot &&
+        lastContext.domainCount == DomainSet.domainCount)
+      return lastContext;
+
+    var key = (ignoreTrailingDot ? "." : " ") + docDomain;
+    var entry = DomainSet.pinned[key];
+    if (entry && entry.context.domainCount == DomainSet.domainCount)
+      return (lastContext = entry.context);
+
+    // Names interned since the context was created may match the domain
+    lastContext = new DomainContext(docDomain, ignoreTrailingDot);
+    if (entry)
+      entry.context = lastContext;
+    return lastContext;
+  };
+
+  /**
+   * Keeps the context of a document domain, including the results of the
+   * domain checks done so far, until unpin() is called as often.
+   */
+  DomainSet.pin = function(/**String*/ docDomain, /**Boolean*/ ignoreTrailingDot) {
+    var key = (ignoreTrailingDot ? "." : " ") + docDomain;
+    var entry = DomainSet.pinned[key];
+    if (!entry)
+      entry = DomainSet.pinned[key] = {context: DomainSet.context(docDomain, ignoreTrailingDot), refs: 0};
+    entry.refs++;
+  };
+
+  DomainSet.unpin = function(/**String*/ docDomain, /**Boolean*/ ignoreTrailingDot) {
+    var key = (ignoreTrailingDot ? "." : " ") + docDomain;
+    var entry = DomainSet.pinned[key];
+    if (entry && --entry.refs == 0)
+      delete DomainSet.pinned[key];
+  };
+
+  DomainSet.prototype = {
+    /**
+     * Index of the set in the order the sets were created
+     * @type Number
+     */
+    id: 0,
+
+    /**
+     * Key of the set in DomainSet.knownSets
+     * @type String
+     */
+    key: null,
+
+    /**
+     * Number of filters using the set
+     * @type Number
+     */
+    refs: 0,
+
+    /**
+     * Map of upper-case domains as described for ActiveFilter.domains
+     * @type Object
+     */
+    domains: null,
+
+    /**
+     * Whether the filter is active on domains that aren't listed
+     * @type Boolean
+     */
+    defaultValue: false,
+
+    /**
+     * Sorted ids of the listed domains and whether the filter is active on
+     * each of them
+     * @type Number[]
+     */
+    ids: null,
+    includes: null,
+
+    /**
+     * Checks whether the filters of this set are active on the domain of a
+     * context, the result is remembered by the context.
+     * @return {Boolean}
+     */
+    isActiveIn: function(/**DomainContext*/ context) {
+      var result = context.active[this.id];
+      if (typeof result != "undefined")
+        return result;
+
+      result = this.defaultValue;
+      var ids = context.ids;
+      for (var i = 0; i < ids.length; i++) {
+        var include = this.lookup(ids[i]);
+        if (include !== null) {
+          result = include;
+          break;
+        }
+      }
+      return (context.active[this.id] = result);
+    },
+
+    /**
+     * Returns whether the filter is active on a domain id, null if the
+     * domain isn't listed.
+     * @return {Boolean}
+     */
+    lookup: function(/**Number*/ id) {
+      var ids = this.ids;
+      var low = 0;
+      var high = ids.length - 1;
+      while (low <= high) {
+        var middle = (low + high) >> 1;
+        if (ids[middle] < id)
+          low = middle + 1;
+        else if (ids[middle] > id)
+          high = middle - 1;
+        else
+          return this.includes[middle];
+      }
+      return null;
+    }
+  };
+
+  /**
+   * A document domain prepared for domain checks: the ids of the domain and
+   * its parent domains, most specific first, and the results of the checks
+   * done so far by DomainSet id. Names no filter refers to are left out.
+   * @constructor
+   */
+  function DomainContext(/**String*/ docDomain, /**Boolean*/ ignoreTrailingDot) {
+    this.docDomain = docDomain;
+    this.ignoreTrailingDot = ignoreTrailingDot;
+    this.domainCount = DomainSet.domainCount;
+    this.ids = [];
+    this.active = { __proto__: null };
+
+    var domain = docDomain;
+    if (ignoreTrailingDot)
+      domain = domain.replace(/\.+$/, "");
+    domain = domain.toUpperCase();
+    while (true) {
+      var id = DomainSet.domainIds[domain];
+      if (typeof id != "undefined")
+        this.ids.push(id);
+
+      var nextDot = domain.indexOf(".");
+      if (nextDot < 0)
+        break;
+      domain = domain.substr(nextDot + 1);
+    }
+  }
+  exports.DomainContext = DomainContext;
+
   /**
    * Abstract base class for filters that can get hits
    * @param {String} text see Filter()
@@ -303,51 +633,46 @@ require.scopes['filterClasses'] = (function() {
     ignoreTrailingDot: true,
 
     /**
-     * Map containing domains that this filter should match on/not match on or null if the filter should match on all domains
-     * @type Object
+     * Shared domain restrictions of this filter or null if the filter should
+     * match on all domains
+     * @type DomainSet
      */
-    get domains() {
-      var domains = null;
-
+    get domainSet() {
+      var set = null;
       if (this.domainSource) {
-        var list = this.domainSource.split(this.domainSeparator);
-        if (list.length == 1 && list[0][0] != "~") {
-          // Fast track for the common one-domain scenario
-          domains = { __proto__: null, "": false };
-          if (this.ignoreTrailingDot)
-            list[0] = list[0].replace(/\.+$/, "");
-          domains[list[0]] = true;
-        } else {
-          var hasIncludes = false;
-          for (var i = 0; i < list.length; i++) {
-            var domain = list[i];
-            if (this.ignoreTrailingDot)
-              domain = domain.replace(/\.+$/, "");
-            if (domain == "")
-              continue;
-
-            var include;
-            if (domain[0] == "~") {
-              include = false;
-              domain = domain.substr(1);
-            } else {
-              include = true;
-              hasIncludes = true;
-            }
-
-            if (!domains)
-              domains = { __proto__: null };
-
-            domains[domain] = include;
-          }
-          domains[""] = !hasIncludes;
-        }
-
+        set = DomainSet.fromSource(this.domainSource, this.domainSeparator, this.ignoreTrailingDot);
+        this._domainSetSource = this.domainSource;
         delete this.domainSource;
       }
 
-      this.__defineGetter__("domains", function() { return domains; });
-      return this.domains;
+      this.__defineGetter__("domainSet", function() { return set; });
+      return this.domainSet;
+    },
+
+    /**
+     * Gives the domain set back once the filter is no longer applied, it is
+     * looked up again when the filter is used next.
+     */
+    releaseDomains: function() {
+      if (!this.hasOwnProperty("domainSet"))
+        return;
+
+      var set = this.domainSet;
+      delete this.domainSet;
+      if (set) {
+        DomainSet.release(set);
+        this.domainSource = this._domainSetSource;
+        delete this._domainSetSource;
+      }
+    },
+
+    /**
+     * Map containing domains that this filter should match on/not match on or null if the filter should match on all domains
+     * @type Object
+     */
+    get domains() {
+      var set = this.domainSet;
+      return (set ? set.domains : null);
     },
 
     /**
@@ -356,28 +681,16 @@ require.scopes['filterClasses'] = (function() {
      */
     isActiveOnDomain: function(/**String*/ docDomain) {
       // If no domains are set the rule matches everywhere
-      if (!this.domains)
+      var set = this.domainSet;
+      if (!set)
         return true;
 
       // If the document has no host name, match only if the filter
       // isn't restricted to specific domains
       if (!docDomain)
-        return this.domains[""];
-
-      if (this.ignoreTrailingDot)
-        docDomain = docDomain.replace(/\.+$/, "");
-      docDomain = docDomain.toUpperCase();
-
-      while (true) {
-        if (docDomain in this.domains)
-          return this.domains[docDomain];
+        return set.defaultValue;
 
-        var nextDot = docDomain.indexOf(".");
-        if (nextDot < 0)
-          break;
-        docDomain = docDomain.substr(nextDot + 1);
-      }
-      return this.domains[""];
+      return set.isActiveIn(DomainSet.context(docDomain, this.ignoreTrailingDot));
     },
 
     /**
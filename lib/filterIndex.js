@@ -0,0 +1,213 @@
+/**
+ * @fileOverview Shares the request filters between processes. The process
+ * that owns the shared index publishes the filters of its matcher, all other
+ * processes match against the published index instead of loading the
+ * filters themselves. One of them takes over once the owner exits.
+ */
+
+require.scopes['filterIndex'] = (function() {
+  var exports = {};
+  var FilterNotifier = require("filterNotifier").FilterNotifier;
+  var filterClasses = require("filterClasses");
+  var Filter = filterClasses.Filter;
+  var RegExpFilter = filterClasses.RegExpFilter;
+  var defaultMatcher = require("matcher").defaultMatcher;
+
+  /**
+   * Milliseconds to wait for further filter changes before publishing
+   * @type Integer
+   */
+  var publishDelay = 1000;
+
+  /**
+   * Milliseconds between the checks of a reader whether the builder exited
+   * @type Integer
+   */
+  var takeOverInterval = 10000;
+
+  /**
+   * Filter properties as understood by the native index
+   */
+  var FilterFlags = {
+    MATCH_CASE: 1,
+    THIRD_PARTY: 2,
+    FIRST_PARTY: 4,
+    COLLAPSE: 8,
+    NO_COLLAPSE: 16,
+    MALWARE: 32,
+    DOMAIN_DEFAULT: 128,
+    HAS_DOMAINS: 256
+  };
+
+  var publishScheduled = false;
+
+  function exportFilter(filter, result) {
+    // Same pattern RegExpFilter.fromText() passed to the constructor
+    var pattern = filter.text;
+    if (pattern.substr(0, 2) == "@@")
+      pattern = pattern.substr(2);
+    var match = (pattern.indexOf("$") >= 0 ? Filter.optionsRegExp.exec(pattern) : null);
+    if (match)
+      pattern = match.input.substr(0, match.index);
+
+    var flags = 0;
+    if (filter.matchCase)
+      flags |= FilterFlags.MATCH_CASE;
+    if (filter.thirdParty === true)
+      flags |= FilterFlags.THIRD_PARTY;
+    else if (filter.thirdParty === false)
+      flags |= FilterFlags.FIRST_PARTY;
+    if (filter.collapse === true)
+      flags |= FilterFlags.COLLAPSE;
+    else if (filter.collapse === false)
+      flags |= FilterFlags.NO_COLLAPSE;
+    for (var i = 0; i < filter.subscriptions.length; i++) {
+      if (filter.subscriptions[i].title == "Malware Domains")
+        flags |= FilterFlags.MALWARE;
+    }
+
+    var domains = [];
+    if (filter.domains) {
+      flags |= FilterFlags.HAS_DOMAINS;
+      for (var domain in filter.domains) {
+        if (domain == "") {
+          if (filter.domains[domain])
+            flags |= FilterFlags.DOMAIN_DEFAULT;
+        } else {
+          domains.push(filter.domains[domain] ? domain : "~" + domain);
+        }
+      }
+    }
+
+    result.push(filter.text, pattern, filter.contentType >>> 0, flags, domains.join("|"));
+  }
+
+  function exportMatcher(matcher) {
+    var result = [];
+    for (var keyword in matcher.filterByKeyword) {
+      var list = matcher.filterByKeyword[keyword];
+      result.push(keyword, list.length);
+      for (var i = 0; i < list.length; i++)
+        exportFilter(list[i], result);
+    }
+    return result;
+  }
+
+  function scheduleTakeOver() {
+    setTimeout(function() {
+      if (filterIndex.takeOver())
+        FilterIndex._becomeBuilder();
+      else
+        scheduleTakeOver();
+    }, takeOverInterval);
+  }
+
+  function onChange(action) {
+    if (action == "load" || action == "applied" || /^(filter|subscription)\.(added|removed|disabled|updated)$/.test(action))
+      FilterIndex.schedulePublish();
+    return 1;
+  }
+
+  var FilterIndex = exports.FilterIndex = {
+    /**
+     * "builder" if this process publishes the index, "reader" if it matches
+     * against the index of another process, empty if the index isn't used.
+     * @type String
+     */
+    role: "",
+
+    get isReader() {
+      return this.role == "reader";
+    },
+
+    /**
+     * Decides the role of this process, must be called before the filters
+     * are loaded.
+     */
+    init: function() {
+      this.role = filterIndex.attach();
+      if (this.role == "builder")
+        FilterNotifier.addListener(onChange);
+      else if (this.role == "reader")
+        scheduleTakeOver();
+    },
+
+    /**
+     * Reads the whole database once this process took the place of the
+     * builder, a reader only kept the element hiding filters. Queries are
+     * matched against the index published last until the request filters
+     * are in the matcher.
+     */
+    _becomeBuilder: function() {
+      var FilterStorage = require("filterStorage").FilterStorage;
+      var Subscription = require("subscriptionClasses").Subscription;
+      FilterStorage.readOnly = false;
+      var urls = Subscription.subscriptions.map(function(subscription) {
+        return subscription.url;
+      });
+      for (var i = 0; i < urls.length; i++)
+        Subscription.removeSubscription(urls[i], true);
+
+      // Small databases may be applied before the "load" listeners all ran
+      var FilterListener = require("filterListener").FilterListener;
+      var loaded = false;
+      var listener = function(action) {
+        if (action == "load")
+          loaded = true;
+        if (!loaded || FilterListener.isApplying)
+          return 1;
+
+        FilterNotifier.removeListener(listener);
+        this.role = "builder";
+        FilterNotifier.addListener(onChange);
+        require("synchronizer").Synchronizer.init();
+        this.publish();
+        return 0;
+      }.bind(this);
+      FilterNotifier.addListener(listener);
+      FilterStorage.loadFromDisk();
+    },
+
+    schedulePublish: function() {
+      if (publishScheduled)
+        return;
+      publishScheduled = true;
+      setTimeout(function() {
+        publishScheduled = false;
+        // Not before the changes are all in, "applied" schedules it again
+        if (!require("filterListener").FilterListener.isApplying)
+          this.publish();
+      }.bind(this), publishDelay);
+    },
+
+    /**
+     * Publishes the filters of the default matcher as a new generation.
+     * @return {Integer} generation or 0 on failure
+     */
+    publish: function() {
+      return filterIndex.publish(exportMatcher(defaultMatcher.blacklist),
+                                 exportMatcher(defaultMatcher.whitelist));
+    },
+
+    /**
+     * Matches against the published index, see Matcher.matchesAny().
+     * @return {Object} serialized filter or null
+     */
+    matchesAny: function(location, contentType, docDomain, thirdParty) {
+      return filterIndex.match(location, RegExpFilter.typeMap[contentType] || 0,
+                               docDomain || "", !!thirdParty);
+    },
+
+    /**
+     * Looks for an exception rule in the published index only, the blocking
+     * rules aren't tested. See CombinedMatcher.matchesWhitelist().
+     * @return {Object} serialized filter or null
+     */
+    matchesWhitelist: function(location, contentType, docDomain, thirdParty) {
+      return filterIndex.match(location, RegExpFilter.typeMap[contentType] || 0,
+                               docDomain || "", !!thirdParty, true);
+    }
+  };
+
+  return exports;
+})();
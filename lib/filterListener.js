@@ -10,6 +10,7 @@ require.scopes['filterListener'] = (function() {
   var defaultMatcher = require("matcher").defaultMatcher;
   var filterClasses = require("filterClasses");
   var Subscription = require("subscriptionClasses").Subscription;
+  var Utils = require("utils").Utils;
   var ActiveFilter = filterClasses.ActiveFilter;
   var RegExpFilter = filterClasses.RegExpFilter;
   var ElemHideBase = filterClasses.ElemHideBase;
@@ -20,6 +21,25 @@ require.scopes['filterListener'] = (function() {
    */
   var isDirty = 0;
 
+  /**
+   * Value of defaultMatcher.whitelistRevision the host was last told about
+   * @type Integer
+   */
+  var whitelistRevision = 0;
+
+  /**
+   * Filter lists that are being applied in slices, see applyFilters()
+   * @type Integer
+   */
+  var pendingApplications = 0;
+
+  /**
+   * Filters passed on to the matchers or ElemHide by their text, so that a
+   * reload can take out the ones that are gone without clearing everything.
+   * @type Object
+   */
+  var appliedFilters = { __proto__: null };
+
   /**
    * This object can be used to change properties of the filter change listeners.
    * @class
@@ -41,6 +61,15 @@ require.scopes['filterListener'] = (function() {
         FilterStorage.saveToDisk();
     },
 
+    /**
+     * Whether filter changes are still being applied to the matchers. The
+     * generic "applied" notification is sent once they are all in.
+     * @type Boolean
+     */
+    get isApplying() {
+      return pendingApplications > 0;
+    },
+
     /**
      * Initializes filter listener on startup, registers the necessary hooks.
      */
@@ -53,6 +82,8 @@ require.scopes['filterListener'] = (function() {
           onSubscriptionChange(match[2], item, newValue, oldValue);
         else
           onGenericChange(action, item);
+
+        notifyWhitelistChange();
         return 1;
       });
 
@@ -62,25 +93,63 @@ require.scopes['filterListener'] = (function() {
 
 
   /**
-   * Notifies Matcher instances or ElemHide object about a new filter
-   * if necessary.
-   * @param {Filter} filter filter that has been added
+   * Lets the host drop its cached page whitelisting results if exception
+   * rules changed since it was told last.
    */
-  function addFilter(filter) {
+  function notifyWhitelistChange() {
+    if (defaultMatcher.whitelistRevision != whitelistRevision) {
+      whitelistRevision = defaultMatcher.whitelistRevision;
+      trigger("whitelistChanged");
+    }
+  }
+
+  /**
+   * Applies addFilter() or removeFilter() to a whole list. Lists are long,
+   * they are applied in slices with queries answered in between. Both
+   * functions check the current state of the filter, so slices of different
+   * changes may interleave.
+   */
+  function applyFilters(/**Filter[]*/ filters, /**Function*/ method, /**Function*/ done) {
+    ++pendingApplications;
+    Utils.forEachInSlices(filters, method, function() {
+      notifyWhitelistChange();
+      if (done)
+        done();
+      if (--pendingApplications == 0)
+        FilterNotifier.triggerListeners("applied");
+    });
+  }
+
+  /**
+   * Whether a filter belongs into the matchers or ElemHide, that is it is
+   * enabled and in at least one enabled subscription.
+   */
+  function isActive(/**Filter*/ filter) {
     if (!(filter instanceof ActiveFilter) || filter.disabled)
-      return;
+      return false;
 
-    var hasEnabled = false;
     for (var i = 0; i < filter.subscriptions.length; i++)
       if (!filter.subscriptions[i].disabled)
-        hasEnabled = true;
-    if (!hasEnabled)
+        return true;
+    return false;
+  }
+
+  /**
+   * Notifies Matcher instances or ElemHide object about a new filter
+   * if necessary.
+   * @param {Filter} filter filter that has been added
+   */
+  function addFilter(filter) {
+    if (!isActive(filter) || filter.text in appliedFilters)
       return;
 
     if (filter instanceof RegExpFilter)
       defaultMatcher.add(filter);
     else if (filter instanceof ElemHideBase)
       ElemHide.add(filter);
+    else
+      return;
+    appliedFilters[filter.text] = filter;
   }
 
   /**
@@ -89,29 +158,41 @@ require.scopes['filterListener'] = (function() {
    * @param {Filter} filter filter that has been removed
    */
   function removeFilter(filter) {
-    if (!(filter instanceof ActiveFilter))
+    if (!(filter.text in appliedFilters) || isActive(filter))
       return;
 
-    if (!filter.disabled) {
-      var hasEnabled = false;
-      for (var i = 0; i < filter.subscriptions.length; i++)
-        if (!filter.subscriptions[i].disabled)
-          hasEnabled = true;
-      if (hasEnabled)
-        return;
-    }
-
+    filter = appliedFilters[filter.text];
+    delete appliedFilters[filter.text];
     if (filter instanceof RegExpFilter)
       defaultMatcher.remove(filter);
     else if (filter instanceof ElemHideBase)
       ElemHide.remove(filter);
+    filter.releaseDomains();
+  }
+
+  /**
+   * Returns the filters of the first list that are not in the second one.
+   */
+  function filtersMissing(/**Filter[]*/ filters, /**Filter[]*/ others) {
+    var known = { __proto__: null };
+    for (var i = 0; i < others.length; i++)
+      known[others[i].text] = true;
+
+    var result = [];
+    for (var i = 0; i < filters.length; i++)
+      if (!(filters[i].text in known))
+        result.push(filters[i]);
+    return result;
   }
 
   /**
    * Subscription change listener
    */
   function onSubscriptionChange(action, subscription, newValue, oldValue) {
-    FilterListener.setDirty(1);
+    if (action == "added" || action == "removed" || action == "updated")
+      FilterListener.setDirty(1);
+    else
+      FilterStorage.journalSubscription(subscription);
 
     if (action != "added" && action != "removed" && action != "disabled" && action != "updated")
       return;
@@ -129,10 +210,16 @@ require.scopes['filterListener'] = (function() {
     if (action == "added" || action == "removed" || action == "disabled") {
       var method = (action == "added" || (action == "disabled" && newValue == false) ? addFilter : removeFilter);
       if (subscription.filters)
-        subscription.filters.forEach(method);
+        applyFilters(subscription.filters, method);
     } else if (action == "updated") {
-      subscription.oldFilters.forEach(removeFilter);
-      subscription.filters.forEach(addFilter);
+      // Only the difference is applied, new filters go in before the old
+      // ones are taken out, so queries between the slices never see the
+      // list missing
+      var added = filtersMissing(subscription.filters, subscription.oldFilters);
+      var removed = filtersMissing(subscription.oldFilters, subscription.filters);
+      applyFilters(added, addFilter, function() {
+        applyFilters(removed, removeFilter);
+      });
     }
   }
 
@@ -142,6 +229,8 @@ require.scopes['filterListener'] = (function() {
   function onFilterChange(action, filter, newValue, oldValue) {
     if (action == "hitCount" || action == "lastHit")
       FilterListener.setDirty(0.002);
+    else if (action == "added" || action == "removed" || action == "disabled")
+      FilterStorage.journalFilter("filter." + action, filter, newValue, oldValue);
     else
       FilterListener.setDirty(1);
 
@@ -164,15 +253,41 @@ require.scopes['filterListener'] = (function() {
    */
   function onGenericChange(action) {
     if (action == "load") {
+      profiler.mark("load");
       isDirty = 0;
 
-      defaultMatcher.clear();
-      ElemHide.clear();
+      // The matchers are not cleared, filters still applied from before the
+      // reload keep matching until the loaded ones are in and only those
+      // that are gone are taken out then. Request filters go into the
+      // matcher before the element hiding filters are added, so the startup
+      // profile can tell both apart.
+      var requestFilters = [];
+      var hidingFilters = [];
       for (var idx = 0; idx < Subscription.subscriptions.length; ++idx) {
         var subscription = Subscription.subscriptions[idx];
-        if (!subscription.disabled)
-          subscription.filters.forEach(addFilter);
+        if (subscription.disabled)
+          continue;
+        for (var i = 0; i < subscription.filters.length; i++) {
+          var filter = subscription.filters[i];
+          if (filter instanceof ElemHideBase)
+            hidingFilters.push(filter);
+          else
+            requestFilters.push(filter);
+        }
       }
+      profiler.begin("matcher");
+      applyFilters(requestFilters, addFilter, function() {
+        profiler.end("matcher");
+        profiler.begin("element_hiding");
+        applyFilters(hidingFilters, addFilter, function() {
+          profiler.end("element_hiding");
+          var stale = [];
+          for (var text in appliedFilters)
+            if (!isActive(appliedFilters[text]))
+              stale.push(appliedFilters[text]);
+          applyFilters(stale, removeFilter);
+        });
+      });
     } else if (action == "saved") {
       isDirty = 0;
     }
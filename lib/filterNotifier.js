@@ -39,7 +39,7 @@ require.scopes['filterNotifier'] = (function() {
 
     /**
      * Notifies listeners about an event
-     * @param {String} action event code ("load", "save", "elemhideupdate",
+     * @param {String} action event code ("load", "save", "applied", "elemhideupdate",
      *                 "subscription.added", "subscription.removed",
      *                 "subscription.disabled", "subscription.title",
      *                 "subscription.lastDownload", "subscription.downloadStatus",
@@ -9,6 +9,14 @@ require.scopes['filterStorage'] = (function() {
   var SpecialSubscription = subscriptionClasses.SpecialSubscription;
   var ExternalSubscription = subscriptionClasses.ExternalSubscription;
   var FilterNotifier = require("filterNotifier").FilterNotifier;
+  var Utils = require("utils").Utils;
+
+  /**
+   * Filter lines of a section created in one step when loading, see
+   * FilterStorage.loadFromDisk()
+   * @type Integer
+   */
+  var loadStepLines = 64;
 
   /**
    * Version number of the filter storage file format.
@@ -16,6 +24,24 @@ require.scopes['filterStorage'] = (function() {
    */
   var formatVersion = 4;
 
+  /**
+   * Number of journal records after which the journal is compacted into the
+   * database.
+   * @type Integer
+   */
+  var journalCompactThreshold = 200;
+
+  /**
+   * Subscription properties recorded in the journal when subscription
+   * metadata changes.
+   * @type Array of String
+   */
+  var journalSubscriptionProperties = [
+    "title", "fixedTitle", "disabled", "homepage", "lastDownload",
+    "downloadStatus", "lastSuccess", "lastCheck", "expires", "softExpiration",
+    "errors", "version", "etag", "lastModified", "downloadBytes", "downloadTime"
+  ];
+
   /**
    * This class reads user's filters from disk, manages them in memory
    * and writes them back.
@@ -47,12 +73,29 @@ require.scopes['filterStorage'] = (function() {
       return this.database;
     },
 
+    /**
+     * File that changes made since the last database write are appended to
+     * @type String
+     */
+    get journal() {
+      var file = this.database ? this.database + ".journal" : null;
+      this.__defineGetter__("journal", function() { return file; });
+      return this.journal;
+    },
+
     /**
      * Map of properties listed in the filter storage file before the sections
      * start. Right now this should be only the format version.
      */
     fileProperties: { __proto__: null },
 
+    /**
+     * Set if the request filters are shared by another process. Only the
+     * element hiding filters are loaded then and nothing is written back.
+     * @type Boolean
+     */
+    readOnly: false,
+
     _loading: false,
 
     /**
@@ -68,40 +111,290 @@ require.scopes['filterStorage'] = (function() {
       }
 
       this._loading = true;
-      fileSystem.read(database, function(result) {
-        var err = result.error;
-        var lines = result.content.split(/[\r\n]+/);
+      fileSystem.readDatabase(database, function(result) {
+        profiler.begin("filter_objects");
+        // Filter sections are split into steps, the database is applied in
+        // slices with queries answered in between
+        var steps = [];
+        for (var i = 0; i < result.sections.length; ++i) {
+          var section = result.sections[i];
+          var lines = section.lines;
+          if (lines && lines.length > loadStepLines && section.name != "user patterns") {
+            for (var j = 0; j < lines.length; j += loadStepLines)
+              steps.push({ name: section.name, data: lines.slice(j, j + loadStepLines) });
+          } else {
+            steps.push({ name: section.name, data: section.properties || lines || null });
+          }
+        }
+
         var parser = new INIParser();
-        for (var i = 0; i < lines.length; ++i) {
-          parser.process(lines[i]);
+        parser.fileProperties = result.fileProperties;
+        Utils.forEachInSlices(steps, function(step) {
+          parser.processSection(step.name, step.data);
+        }, this._onDatabaseRead.bind(this, database, result.error, parser));
+      }.bind(this));
+    },
+
+    /**
+     * Finishes loadFromDisk() once all sections of the database are processed.
+     */
+    _onDatabaseRead: function(database, err, parser) {
+      profiler.end("filter_objects");
+      if (!err && Subscription.subscriptions.length == 0) {
+        err = new Error("No data in the database");
+      }
+
+      if (!err) {
+        this.fileProperties = parser.fileProperties;
+
+        if (parser.userFilters) {
+          for (var idx = 0; idx < parser.userFilters.length; ++idx) {
+            var filter = Filter.fromText(parser.userFilters[idx]);
+            Subscription.addfilter(filter, null, undefined, true);
+          }
         }
-        parser.process(null);
+      } else {
+        reportError(err);
+      }
 
-        if (!err && Subscription.subscriptions.length == 0) {
-          err = new Error("No data in the database");
+      if (database != this.database) {
+        this._loading = false;
+        FilterNotifier.triggerListeners("load");
+        this.saveToDisk();
+        return;
+      }
+
+      profiler.begin("journal");
+      fileSystem.read(this.journal, function(result) {
+        if (!result.error) {
+          this._journalRecords = this._replayJournal(result.content);
         }
+        profiler.end("journal");
+
+        this._loading = false;
+        FilterNotifier.triggerListeners("load");
+        if (this._journalRecords) {
+          this._scheduleCompaction();
+        }
+      }.bind(this));
+    },
+
+    /**
+     * Records queued for appending to the journal
+     * @type Array of String
+     */
+    _journalQueue: [],
+
+    /**
+     * URLs of subscriptions whose metadata should be written to the journal
+     * with the next flush.
+     * @type Object
+     */
+    _journalSubscriptions: { __proto__: null },
+
+    /**
+     * Will be set to true while journal records are being appended.
+     * @type Boolean
+     */
+    _journalWriting: false,
+
+    /**
+     * Will be set to true if a journal flush has been scheduled.
+     * @type Boolean
+     */
+    _journalFlushScheduled: false,
+
+    /**
+     * Number of records in the journal file.
+     * @type Integer
+     */
+    _journalRecords: 0,
+
+    /**
+     * Will be set to true while the journal is being replayed.
+     * @type Boolean
+     */
+    _replaying: false,
+
+    /**
+     * Records a filter change in the journal instead of rewriting the whole
+     * database.
+     * @param {String} action "filter.added", "filter.removed" or "filter.disabled"
+     * @param {Filter} filter
+     * @param {Subscription|Boolean} item subscription the filter has been
+     *      added to/removed from or the new value of the disabled property
+     * @param {Integer} [position] position of the filter in the subscription
+     */
+    journalFilter: function(action, filter, item, position) {
+      var record = { action: action, text: filter.text };
+      if (action == "filter.disabled") {
+        record.value = item;
+      } else {
+        record.url = item.url;
+        record.position = position;
+        if (item.defaults) {
+          record.defaults = item.defaults;
+        }
+      }
+      this._journal(JSON.stringify(record));
+    },
+
+    /**
+     * Records changed subscription metadata in the journal. The properties are
+     * captured when the journal is flushed, so subsequent changes in the same
+     * turn are coalesced into one record.
+     * @param {Subscription} subscription
+     */
+    journalSubscription: function(subscription) {
+      if (this._loading || this._replaying || this.readOnly) {
+        return;
+      }
+      this._journalSubscriptions[subscription.url] = true;
+      this._scheduleJournalFlush();
+    },
+
+    _journal: function(record) {
+      if (this._loading || this._replaying || this.readOnly) {
+        return;
+      }
+      this._journalQueue.push(record);
+      this._scheduleJournalFlush();
+    },
 
-        if (!err) {
-          this.fileProperties = parser.fileProperties;
+    _scheduleJournalFlush: function() {
+      if (this._journalFlushScheduled) {
+        return;
+      }
+      this._journalFlushScheduled = true;
+      setTimeout(function() {
+        this._journalFlushScheduled = false;
+        this._flushJournal();
+      }.bind(this), 0);
+    },
 
-          if (parser.userFilters) {
-            for (var idx = 0; idx < parser.userFilters.length; ++idx) {
-              var filter = Filter.fromText(parser.userFilters[idx]);
-              Subscription.addfilter(filter, null, undefined, true);
+    _flushJournal: function() {
+      for (var url in this._journalSubscriptions) {
+        if (url in Subscription.knownSubscriptions) {
+          var subscription = Subscription.knownSubscriptions[url];
+          var properties = {};
+          for (var idx = 0; idx < journalSubscriptionProperties.length; ++idx) {
+            var key = journalSubscriptionProperties[idx];
+            if (key in subscription) {
+              properties[key] = subscription[key];
             }
           }
-        } else {
-          reportError(err);
+          this._journalQueue.push(JSON.stringify({
+            action: "subscription",
+            url: url,
+            properties: properties
+          }));
         }
+      }
+      this._journalSubscriptions = { __proto__: null };
 
-        this._loading = false;
-        FilterNotifier.triggerListeners("load");
-        if (database != this.database) {
-          this.saveToDisk();
+      // Records queued while the database is written are kept until the old
+      // journal has been removed.
+      if (this._journalWriting || this._saving || !this._journalQueue.length) {
+        return;
+      }
+
+      var records = this._journalQueue;
+      this._journalQueue = [];
+      this._journalWriting = true;
+      fileSystem.append(this.journal, records.join("\n") + "\n", function(e) {
+        this._journalWriting = false;
+        if (e) {
+          reportError(e);
+          return;
+        }
+        this._journalRecords += records.length;
+        if (this._journalRecords >= journalCompactThreshold) {
+          this._scheduleCompaction();
+        } else {
+          this._flushJournal();
         }
       }.bind(this));
     },
 
+    /**
+     * Rewrites the database in the background, which also truncates the
+     * journal.
+     */
+    _scheduleCompaction: function() {
+      setTimeout(function() {
+        this.saveToDisk();
+      }.bind(this), 0);
+    },
+
+    /**
+     * Applies journal records on top of the state loaded from the database.
+     * @param {String} content journal file content
+     * @return {Integer} number of records in the journal
+     */
+    _replayJournal: function(content) {
+      var lines = content.split(/[\r\n]+/);
+      var count = 0;
+      this._replaying = true;
+      try {
+        for (var idx = 0; idx < lines.length; ++idx) {
+          if (!lines[idx]) {
+            continue;
+          }
+          ++count;
+          try {
+            this._applyJournalRecord(JSON.parse(lines[idx]));
+          } catch (e) {
+            reportError(e);
+          }
+        }
+      } finally {
+        this._replaying = false;
+      }
+      return count;
+    },
+
+    _applyJournalRecord: function(record) {
+      switch (record.action) {
+        case "filter.added":
+          var subscription = Subscription.fromURL(record.url);
+          if (record.defaults && !subscription.defaults) {
+            subscription.defaults = record.defaults;
+            subscription._title = record.defaults[0] + "Group_title";
+          }
+          var filter = Filter.fromText(record.text);
+          if (subscription.filters.indexOf(filter) < 0) {
+            var position = Math.min(record.position, subscription.filters.length);
+            Subscription.addFilter(filter, subscription, position, true);
+          }
+          break;
+        case "filter.removed":
+          if (record.url in Subscription.knownSubscriptions &&
+              record.text in Filter.knownFilters) {
+            Subscription.removeFilter(Filter.knownFilters[record.text],
+                                      Subscription.knownSubscriptions[record.url]);
+          }
+          break;
+        case "filter.disabled":
+          var filter = Filter.fromText(record.text);
+          if (filter instanceof ActiveFilter) {
+            filter._disabled = record.value;
+          }
+          break;
+        case "subscription":
+          if (record.url in Subscription.knownSubscriptions) {
+            var subscription = Subscription.knownSubscriptions[record.url];
+            for (var key in record.properties) {
+              if ("_" + key in subscription) {
+                subscription["_" + key] = record.properties[key];
+              } else {
+                subscription[key] = record.properties[key];
+              }
+            }
+          }
+          break;
+      }
+    },
+
     _generateFilterData: function(subscriptions) {
       var data = [];
       data.push("# Adblock preferences");
@@ -158,6 +451,9 @@ require.scopes['filterStorage'] = (function() {
      * @param {String} [database] File to be written
      */
     saveToDisk: function(database) {
+      if (this.readOnly) {
+        return;
+      }
       var explicitFile = true;
       if (!database) {
         database = this.database;
@@ -175,18 +471,42 @@ require.scopes['filterStorage'] = (function() {
       var subscriptions = Subscription.subscriptions.filter(function(s) {
         return !(s instanceof ExternalSubscription);
       });
-      fileSystem.write(database, this._generateFilterData(subscriptions), function(e) {
+      if (!explicitFile) {
+        // The snapshot includes every change recorded so far
+        this._journalQueue = [];
+        this._journalSubscriptions = { __proto__: null };
+      }
+      // Compressed databases are read back transparently, so the preference
+      // can be toggled at any time
+      var write = Prefs.db_compressed ? fileSystem.writeCompressed : fileSystem.write;
+      write(database, this._generateFilterData(subscriptions), function(e) {
         if (e) {
           reportError(e);
         }
         if (!explicitFile) {
-          this._saving = false;
-          if (this._needsSave) {
-            this._needsSave = false;
-            this.saveToDisk();
-          } else {
-            FilterNotifier.triggerListeners("saved");
+          var finish = function() {
+            this._saving = false;
+            if (this._needsSave) {
+              this._needsSave = false;
+              this.saveToDisk();
+            } else {
+              FilterNotifier.triggerListeners("saved");
+              this._flushJournal();
+            }
+          }.bind(this);
+
+          if (e || !this._journalRecords) {
+            finish();
+            return;
           }
+          fileSystem.remove(this.journal, function(e) {
+            if (e) {
+              reportError(e);
+            } else {
+              this._journalRecords = 0;
+            }
+            finish();
+          }.bind(this));
         }
       }.bind(this));
     }
@@ -207,35 +527,8 @@ require.scopes['filterStorage'] = (function() {
       if (this.wantObj === true && (match = /^(\w+)=(.*)$/.exec(val))) {
         this.curObj[match[1]] = match[2];
       } else if (val === null || (match = /^\s*\[(.+)\]\s*$/.exec(val))) {
-        if (this.curObj) {
-          // Process current object before going to next section
-          switch (this.curSection) {
-            case "filter":
-            case "pattern":
-              if ("text" in this.curObj) {
-                Filter.fromObject(this.curObj);
-              }
-              break;
-            case "subscription":
-              Subscription.fromObject(this.curObj);
-              break;
-            case "subscription filters":
-            case "subscription patterns":
-              if (Subscription.subscriptions.length) {
-                var subscription = Subscription.subscriptions[Subscription.subscriptions.length - 1];
-                for (var idx = 0; idx < this.curObj.length; ++idx) {
-                  var text = this.curObj[idx];
-                  var filter = Filter.fromText(text);
-                  subscription.filters.push(filter);
-                  filter.subscriptions.push(subscription);
-                }
-              }
-              break;
-            case "user patterns":
-              this.userFilters = this.curObj;
-              break;
-          }
-        }
+        // Process current object before going to next section
+        this.processSection(this.curSection, this.curObj);
         if (val === null) {
           return;
         }
@@ -260,6 +553,48 @@ require.scopes['filterStorage'] = (function() {
       } else if (this.wantObj === false && val) {
         this.curObj.push(val.replace(/\\\[/g, "["));
       }
+    },
+
+    /**
+     * Creates the objects described by a completely parsed section. Also used
+     * with the sections produced by fileSystem.readDatabase().
+     * @param {String} section lower-cased section name
+     * @param {Object|Array of String} obj properties or lines of the section
+     */
+    processSection: function(section, obj) {
+      if (!obj) {
+        return;
+      }
+      switch (section) {
+        case "filter":
+        case "pattern":
+          if ("text" in obj) {
+            Filter.fromObject(obj);
+          }
+          break;
+        case "subscription":
+          Subscription.fromObject(obj);
+          break;
+        case "subscription filters":
+        case "subscription patterns":
+          if (Subscription.subscriptions.length) {
+            var subscription = Subscription.subscriptions[Subscription.subscriptions.length - 1];
+            for (var idx = 0; idx < obj.length; ++idx) {
+              var text = obj[idx];
+              if (FilterStorage.readOnly && text.indexOf("#") < 0) {
+                // Not an element hiding filter, matched in the shared index
+                continue;
+              }
+              var filter = Filter.fromText(text);
+              subscription.filters.push(filter);
+              filter.subscriptions.push(subscription);
+            }
+          }
+          break;
+        case "user patterns":
+          this.userFilters = obj;
+          break;
+      }
     }
   };
 
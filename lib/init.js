@@ -2,10 +2,16 @@ var Prefs = require("prefs").Prefs;
 var FilterNotifier = require("filterNotifier").FilterNotifier;
 var FilterListener = require("filterListener").FilterListener;
 var Synchronizer = require("synchronizer").Synchronizer;
+var FilterStorage = require("filterStorage").FilterStorage;
+var FilterIndex = require("filterIndex").FilterIndex;
 
 function load_listener(action) {
   if (action === "load") {
     FilterNotifier.removeListener(load_listener);
+    if (FilterIndex.isReader) {
+      // Subscriptions are kept up to date by the process sharing its filters
+      return 0;
+    }
     var subscriptionClasses = require("subscriptionClasses");
     var Subscription = subscriptionClasses.Subscription;
     var DownloadableSubscription = subscriptionClasses.DownloadableSubscription;
@@ -45,8 +51,38 @@ function load_listener(action) {
   return 1;
 }
 
+/**
+ * Tells the host about the stages of the startup that follow the scripts:
+ * "filtersLoaded" once the filters of the database are in the matchers,
+ * "firstSyncDone" once the lists downloaded meanwhile are applied as well.
+ */
+var filtersLoading = false;
+function startup_listener(action) {
+  if (action === "load") {
+    filtersLoading = true;
+  } else if (action === "applied" && filtersLoading) {
+    FilterNotifier.removeListener(startup_listener);
+    trigger("filtersLoaded");
+    Synchronizer.whenIdle(function() {
+      trigger("firstSyncDone");
+    });
+    return 0;
+  }
+  return 1;
+}
+
 function initAdblock() {
-  FilterNotifier.addListener(load_listener);
-  FilterListener.init();
-  Synchronizer.init();
+  // The role has to be known before the filters are loaded
+  Prefs.onLoaded(function() {
+    if (Prefs.shared_filter_index) {
+      FilterIndex.init();
+      FilterStorage.readOnly = FilterIndex.isReader;
+    }
+    FilterNotifier.addListener(load_listener);
+    FilterNotifier.addListener(startup_listener);
+    FilterListener.init();
+    if (!FilterIndex.isReader) {
+      Synchronizer.init();
+    }
+  });
 }
@@ -31,12 +31,30 @@ require.scopes['matcher'] = (function() {
      */
     keywordByFilter: null,
 
+    /**
+     * Filters of every keyword split into groups of equal content types and
+     * third-party option, so that a lookup only tests the filters that can
+     * apply to the request. Each group is
+     * {contentType, thirdParty, filters, order}, order holding the position
+     * of every filter within its keyword.
+     * @type Object
+     */
+    groupsByKeyword: null,
+
+    /**
+     * Position given to the next filter added
+     * @type Number
+     */
+    nextOrder: 0,
+
     /**
      * Removes all known filters
      */
     clear: function() {
       this.filterByKeyword = { __proto__: null };
       this.keywordByFilter = { __proto__: null };
+      this.groupsByKeyword = { __proto__: null };
+      this.nextOrder = 0;
     },
 
     /**
@@ -57,6 +75,18 @@ require.scopes['matcher'] = (function() {
       else
         oldEntry.push(filter);
       this.keywordByFilter[filter.text] = keyword;
+
+      var groups = this.groupsByKeyword[keyword];
+      if (typeof groups == "undefined")
+        groups = this.groupsByKeyword[keyword] = [];
+      var group = this._findGroup(groups, filter);
+      if (group === null) {
+        group = {contentType: filter.contentType, thirdParty: filter.thirdParty,
+                 filters: [], order: []};
+        groups.push(group);
+      }
+      group.filters.push(filter);
+      group.order.push(this.nextOrder++);
     },
 
     /**
@@ -81,6 +111,32 @@ require.scopes['matcher'] = (function() {
       }
 
       delete this.keywordByFilter[filter.text];
+
+      var groups = this.groupsByKeyword[keyword];
+      var group = this._findGroup(groups, filter);
+      var index = group.filters.indexOf(filter);
+      if (index >= 0) {
+        group.filters.splice(index, 1);
+        group.order.splice(index, 1);
+      }
+      if (group.filters.length == 0) {
+        groups.splice(groups.indexOf(group), 1);
+        if (groups.length == 0)
+          delete this.groupsByKeyword[keyword];
+      }
+    },
+
+    /**
+     * Returns the group of a keyword a filter belongs to, null if there is
+     * none yet.
+     */
+    _findGroup: function(groups, /**RegExpFilter*/ filter) {
+      for (var i = 0; i < groups.length; i++) {
+        var group = groups[i];
+        if (group.contentType == filter.contentType && group.thirdParty == filter.thirdParty)
+          return group;
+      }
+      return null;
     },
 
     /**
@@ -139,16 +195,32 @@ require.scopes['matcher'] = (function() {
     },
 
     /**
-     * Checks whether the entries for a particular keyword match a URL
+     * Checks whether the entries for a particular keyword match a URL. Only
+     * groups that apply to the content type and party are tested, the first
+     * matching filter in the order of filterByKeyword wins.
      */
     _checkEntryMatch: function(keyword, location, contentType, docDomain, thirdParty) {
-      var list = this.filterByKeyword[keyword];
-      for (var i = 0; i < list.length; i++) {
-        var filter = list[i];
-        if (filter.matches(location, contentType, docDomain, thirdParty))
-          return filter;
+      var groups = this.groupsByKeyword[keyword];
+      var typeMask = RegExpFilter.typeMap[contentType];
+      var result = null;
+      var resultOrder = Infinity;
+      for (var i = 0; i < groups.length; i++) {
+        var group = groups[i];
+        if ((group.contentType & typeMask) == 0 ||
+            (group.thirdParty != null && group.thirdParty != thirdParty))
+          continue;
+
+        var filters = group.filters;
+        var order = group.order;
+        for (var j = 0; j < filters.length && order[j] < resultOrder; j++) {
+          if (filters[j].matches(location, contentType, docDomain, thirdParty)) {
+            result = filters[j];
+            resultOrder = order[j];
+            break;
+          }
+        }
       }
-      return null;
+      return result;
     },
 
     /**
@@ -174,6 +246,47 @@ require.scopes['matcher'] = (function() {
       }
 
       return null;
+    },
+
+    /**
+     * Describes how the filters are spread over the keywords and their
+     * content type and party groups. Sizes are counted per power of two:
+     * sizes[i] is the number of keywords with 2^i to 2^(i+1)-1 filters,
+     * groupSizes[i] the same for groups.
+     */
+    getStats: function() {
+      var result = {filters: 0, keywords: 0, keywordless: 0, largest: 0, sizes: [],
+                    groups: 0, largestGroup: 0, groupSizes: []};
+      function count(sizes, size) {
+        var log = 0;
+        while ((size >> (log + 1)) > 0)
+          log++;
+        while (sizes.length <= log)
+          sizes.push(0);
+        sizes[log]++;
+      }
+
+      for (var keyword in this.filterByKeyword) {
+        var size = this.filterByKeyword[keyword].length;
+        result.filters += size;
+
+        var groups = this.groupsByKeyword[keyword];
+        for (var i = 0; i < groups.length; i++) {
+          var groupSize = groups[i].filters.length;
+          result.groups++;
+          result.largestGroup = Math.max(result.largestGroup, groupSize);
+          count(result.groupSizes, groupSize);
+        }
+
+        if (keyword == "") {
+          result.keywordless = size;
+          continue;
+        }
+        result.keywords++;
+        result.largest = Math.max(result.largest, size);
+        count(result.sizes, size);
+      }
+      return result;
     }
   };
 
@@ -185,11 +298,19 @@ require.scopes['matcher'] = (function() {
   function CombinedMatcher() {
     this.blacklist = new Matcher();
     this.whitelist = new Matcher();
+    this.documentWhitelist = new Matcher();
     this.keys = { __proto__: null };
     this.resultCache = { __proto__: null };
   }
   exports.CombinedMatcher = CombinedMatcher;
 
+  /**
+   * Content types of the exception rules that disable filtering on a whole
+   * page, kept in documentWhitelist as well
+   * @type Number
+   */
+  CombinedMatcher.documentTypes = RegExpFilter.typeMap.DOCUMENT | RegExpFilter.typeMap.ELEMHIDE;
+
   /**
    * Maximal number of matching cache entries to be kept
    * @type Number
@@ -209,6 +330,19 @@ require.scopes['matcher'] = (function() {
      */
     whitelist: null,
 
+    /**
+     * Matcher for the $document and $elemhide exception rules, page checks
+     * only look at these.
+     * @type Matcher
+     */
+    documentWhitelist: null,
+
+    /**
+     * Incremented whenever an exception rule is added or removed
+     * @type Number
+     */
+    whitelistRevision: 0,
+
     /**
      * Exception rules that are limited by public keys, mapped by the corresponding keys.
      * @type Object
@@ -227,15 +361,24 @@ require.scopes['matcher'] = (function() {
      */
     cacheEntries: 0,
 
+    /**
+     * Lookups answered from resultCache and ones that had to match
+     * @type Number
+     */
+    cacheHits: 0,
+    cacheMisses: 0,
+
     /**
      * @see Matcher#clear
      */
     clear: function() {
       this.blacklist.clear();
       this.whitelist.clear();
+      this.documentWhitelist.clear();
       this.keys = { __proto__: null };
       this.resultCache = { __proto__: null };
       this.cacheEntries = 0;
+      this.whitelistRevision++;
     },
 
     /**
@@ -249,7 +392,10 @@ require.scopes['matcher'] = (function() {
         }
         else {
           this.whitelist.add(filter);
+          if (filter.contentType & CombinedMatcher.documentTypes)
+            this.documentWhitelist.add(filter);
         }
+        this.whitelistRevision++;
       } else {
         this.blacklist.add(filter);
       }
@@ -271,7 +417,10 @@ require.scopes['matcher'] = (function() {
         }
         else {
           this.whitelist.remove(filter);
+          if (filter.contentType & CombinedMatcher.documentTypes)
+            this.documentWhitelist.remove(filter);
         }
+        this.whitelistRevision++;
       } else {
         this.blacklist.remove(filter);
       }
@@ -349,8 +498,11 @@ require.scopes['matcher'] = (function() {
      */
     matchesAny: function(location, contentType, docDomain, thirdParty) {
       var key = location + " " + contentType + " " + docDomain + " " + thirdParty;
-      if (key in this.resultCache)
+      if (key in this.resultCache) {
+        this.cacheHits++;
         return this.resultCache[key];
+      }
+      this.cacheMisses++;
 
       var result = this.matchesAnyInternal(location, contentType, docDomain, thirdParty);
 
@@ -365,6 +517,19 @@ require.scopes['matcher'] = (function() {
       return result;
     },
 
+    /**
+     * Looks for an exception rule only, without testing any blocking rules.
+     * Page checks with content type DOCUMENT or ELEMHIDE only go through
+     * documentWhitelist. For parameters see Matcher.matchesAny().
+     * @return {WhitelistFilter} matching exception rule or null
+     */
+    matchesWhitelist: function(location, contentType, docDomain, thirdParty) {
+      var matcher = this.whitelist;
+      if (RegExpFilter.typeMap[contentType] & CombinedMatcher.documentTypes)
+        matcher = this.documentWhitelist;
+      return matcher.matchesAny(location, contentType, docDomain, thirdParty);
+    },
+
     /**
      * Looks up whether any filters match the given website key.
      */
@@ -6,11 +6,19 @@ require.scopes['prefs'] = (function(){
     locale: "en-US",
     db_directory: null,
     db_file: "adblock.db",
+    db_compressed: false,
     subscriptions_autoupdate: true,
+    // Delay of the first update check after startup
+    subscriptions_check_delay_ms: 6 * 60 * 1000,
+    shared_filter_index: false,
+    // Longest engine turn of a filter list update, 0 applies lists at once
+    task_slice_ms: 25,
   };
   var values = Object.create(defaults);
   var path = fileSystem.resolve("prefs.json");
   var listeners = [];
+  var loadCallbacks = [];
+  var isLoaded = false;
   var isDirty = false;
   var isSaving = false;
 
@@ -49,6 +57,12 @@ require.scopes['prefs'] = (function(){
           reportError(e);
         }
       }
+      isLoaded = true;
+      var callbacks = loadCallbacks;
+      loadCallbacks = [];
+      for (var idx = 0; idx < callbacks.length; ++idx) {
+        callbacks[idx]();
+      }
     });
   }
 
@@ -78,6 +92,14 @@ require.scopes['prefs'] = (function(){
       if (index >= 0) {
         listeners.splice(index, 1);
       }
+    },
+    // Calls back once the stored values are available
+    onLoaded: function(callback) {
+      if (isLoaded) {
+        callback();
+      } else {
+        loadCallbacks.push(callback);
+      }
     }
   };
 
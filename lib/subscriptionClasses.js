@@ -217,6 +217,14 @@ require.scopes['subscriptionClasses'] = (function() {
         result._errors = parseInt(obj.errors) || 0;
       if ("version" in obj)
         result.version = parseInt(obj.version) || 0;
+      if ("etag" in obj)
+        result.etag = obj.etag;
+      if ("lastModified" in obj)
+        result.lastModified = obj.lastModified;
+      if ("downloadBytes" in obj)
+        result.downloadBytes = parseInt(obj.downloadBytes) || 0;
+      if ("downloadTime" in obj)
+        result.downloadTime = parseInt(obj.downloadTime) || 0;
       if ("requiredVersion" in obj) {
         var app_version = require("info").app_version;
         result.requiredVersion = parseFloat(obj.requiredVersion);
@@ -660,6 +668,30 @@ require.scopes['subscriptionClasses'] = (function() {
      */
     upgradeRequired: false,
 
+    /**
+     * ETag header of the last successful download
+     * @type String
+     */
+    etag: null,
+
+    /**
+     * Last-Modified header of the last successful download
+     * @type String
+     */
+    lastModified: null,
+
+    /**
+     * Bytes read from the network by the last download (compressed size)
+     * @type Number
+     */
+    downloadBytes: 0,
+
+    /**
+     * Wall time of the last download in milliseconds
+     * @type Number
+     */
+    downloadTime: 0,
+
     /**
      * See Subscription.serialize()
      */
@@ -681,6 +713,14 @@ require.scopes['subscriptionClasses'] = (function() {
         buffer.push("version=" + this.version);
       if (this.requiredVersion)
         buffer.push("requiredVersion=" + this.requiredVersion);
+      if (this.etag)
+        buffer.push("etag=" + this.etag);
+      if (this.lastModified)
+        buffer.push("lastModified=" + this.lastModified);
+      if (this.downloadBytes)
+        buffer.push("downloadBytes=" + this.downloadBytes);
+      if (this.downloadTime)
+        buffer.push("downloadTime=" + this.downloadTime);
     }
   };
 
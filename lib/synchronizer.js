@@ -20,7 +20,6 @@ require.scopes['synchronizer'] = (function() {
   var Subscription = subscriptionClasses.Subscription;
   var DownloadableSubscription = subscriptionClasses.DownloadableSubscription;
   var Utils = require("utils").Utils;
-  var INITIAL_DELAY = 6 * MILLIS_IN_MINUTE;
   var CHECK_INTERVAL = 1 * MILLIS_IN_HOUR;
   var DEFAULT_EXPIRATION_INTERVAL = 5 * MILLIS_IN_DAY;
 
@@ -30,6 +29,24 @@ require.scopes['synchronizer'] = (function() {
    */
   var downloader = null;
 
+  /**
+   * Time the synchronizer was initialized at.
+   * @type Integer
+   */
+  var startTime = 0;
+
+  /**
+   * Addresses of the feature subscriptions, these are downloaded after the
+   * blocking lists.
+   */
+  var featureURLs = null;
+
+  /**
+   * Functions waiting for the synchronizer to become idle, see whenIdle()
+   * @type Array of Function
+   */
+  var idleCallbacks = [];
+
   /**
    * This object is responsible for downloading filter subscriptions whenever
    * necessary.
@@ -40,13 +57,49 @@ require.scopes['synchronizer'] = (function() {
      * Called on module startup.
      */
     init: function() {
-      downloader = new Downloader(this._getDownloadables.bind(this), INITIAL_DELAY, CHECK_INTERVAL);
+      startTime = Date.now();
+      downloader = new Downloader(this._getDownloadables.bind(this), Prefs.subscriptions_check_delay_ms, CHECK_INTERVAL);
       downloader.onExpirationChange = this._onExpirationChange.bind(this);
       downloader.onDownloadStarted = this._onDownloadStarted.bind(this);
+      downloader.onDownloadData = this._onDownloadData.bind(this);
       downloader.onDownloadSuccess = this._onDownloadSuccess.bind(this);
+      downloader.onDownloadNotModified = this._onDownloadNotModified.bind(this);
       downloader.onDownloadError = this._onDownloadError.bind(this);
+      downloader.onTaskFinished = this._checkIdle.bind(this);
+      FilterNotifier.addListener(function(action) {
+        if (action == "applied")
+          Synchronizer._checkIdle();
+        return 1;
+      });
     },
 
+    /**
+     * Calls callback once no download is running and the downloaded lists
+     * are applied, right away if that's the case already.
+     */
+    whenIdle: function(/**Function*/ callback) {
+      idleCallbacks.push(callback);
+      this._checkIdle();
+    },
+
+    _checkIdle: function() {
+      if (!idleCallbacks.length || (downloader && downloader.hasDownloads()) ||
+          require("filterListener").FilterListener.isApplying)
+        return;
+
+      var callbacks = idleCallbacks;
+      idleCallbacks = [];
+      for (var idx = 0; idx < callbacks.length; ++idx)
+        callbacks[idx]();
+    },
+
+    /**
+     * Milliseconds from initialization until the first filter list was
+     * downloaded and applied, 0 until that happened.
+     * @type Integer
+     */
+    firstListTime: 0,
+
     /**
      * Checks whether a subscription is currently being downloaded.
      * @param {String} url  URL of the subscription
@@ -62,7 +115,6 @@ require.scopes['synchronizer'] = (function() {
      * @param {Boolean} manual  true for a manually started download (should not trigger fallback requests)
      */
     execute: function(subscription, manual) {
-      trigger("downloadStart");
       downloader.download(this._getDownloadable(subscription, manual));
     },
 
@@ -94,9 +146,25 @@ require.scopes['synchronizer'] = (function() {
       result.softExpiration = subscription.softExpiration * MILLIS_IN_SECOND;
       result.hardExpiration = subscription.expires * MILLIS_IN_SECOND;
       result.manual = manual;
+      result.priority = (this._isFeatureSubscription(subscription) ? 0 : 1);
+      // A conditional request can only be answered with the filters we have
+      if (subscription.filters.length) {
+        result.etag = subscription.etag;
+        result.lastModified = subscription.lastModified;
+      }
       return result;
     },
 
+    _isFeatureSubscription: function(/**Subscription*/ subscription) {
+      if (!featureURLs) {
+        featureURLs = Object.create(null);
+        var list = require("subscriptions").FeatureSubscriptions;
+        for (var idx = 0; idx < list.length; ++idx)
+          featureURLs[list[idx].url] = true;
+      }
+      return subscription.url in featureURLs;
+    },
+
     _onExpirationChange: function(downloadable) {
       var subscription = Subscription.fromURL(downloadable.url);
       subscription.lastCheck = Math.round(downloadable.lastCheck / MILLIS_IN_SECOND);
@@ -104,28 +172,54 @@ require.scopes['synchronizer'] = (function() {
       subscription.expires = Math.round(downloadable.hardExpiration / MILLIS_IN_SECOND);
     },
 
+    /**
+     * Stores the transfer statistics of the last download on the subscription.
+     */
+    _recordTransfer: function(subscription, downloadable) {
+      subscription.downloadBytes = downloadable.bytesReceived;
+      subscription.downloadTime = Math.round(downloadable.downloadTime);
+    },
+
     _onDownloadStarted: function(downloadable) {
+      // Collects the filters of a streamed download
+      downloadable.filters = [];
       var subscription = Subscription.fromURL(downloadable.url);
       FilterNotifier.triggerListeners("subscription.downloadStatus", subscription);
     },
 
-    _onDownloadSuccess: function(downloadable, responseText, errorCallback, redirectCallback) {
+    _onDownloadData: function(downloadable, lines) {
+      this._addFilters(downloadable.filters, lines);
+    },
+
+    /**
+     * Splits a downloaded filter list into its parts. The result has the same
+     * form as the one of the native parser used for streamed downloads (see
+     * webRequest.getList), with the filter lines added.
+     */
+    _parseList: function(/**String*/ responseText) {
       var lines = responseText.split(/[\r\n]+/);
       var match = /\[Adblock(?:\s*Plus\s*([\d\.]+)?)?\]/i.exec(lines[0]);
       if (!match)
-        return errorCallback("synchronize_invalid_data");
-      var minVersion = parseFloat(match[1]);
+        return { valid: false };
+
+      var list = {
+        valid: true,
+        minVersion: match[1] || "",
+        checksumMismatch: false,
+        params: {
+          redirect: null,
+          homepage: null,
+          title: null,
+          version: null,
+          expires: null
+        },
+        lines: lines
+      };
 
       // Don't remove parameter comments immediately but add them to a list first,
       // they need to be considered in the checksum calculation.
       var remove = [];
-      var params = {
-        redirect: null,
-        homepage: null,
-        title: null,
-        version: null,
-        expires: null
-      };
+      var params = list.params;
       for (var i = 1; i < lines.length; i++) {
         var match = /^\s*!\s*(\w+)\s*:\s*(.*)/.exec(lines[i]);
         if (match) {
@@ -137,12 +231,45 @@ require.scopes['synchronizer'] = (function() {
           } else if (keyword == "checksum") {
             lines.splice(i--, 1);
             var checksum = Utils.generateChecksum(lines);
-            if (checksum && checksum != value.replace(/=+$/, ""))
-              return errorCallback("synchronize_checksum_mismatch");
+            if (checksum && checksum != value.replace(/=+$/, "")) {
+              list.checksumMismatch = true;
+              return list;
+            }
           }
         }
       }
 
+      // Remove lines containing parameters
+      for (var i = remove.length - 1; i >= 0; i--)
+        lines.splice(remove[i], 1);
+      lines.shift();
+      return list;
+    },
+
+    /**
+     * Converts filter lines to filters and appends them to an array.
+     */
+    _addFilters: function(/**Filter[]*/ filters, /**String[]*/ lines) {
+      for (var idx = 0; idx < lines.length; ++idx) {
+        var line = Filter.normalize(lines[idx]);
+        if (line)
+          filters.push(Filter.fromText(line));
+      }
+    },
+
+    _onDownloadSuccess: function(downloadable, data, errorCallback, redirectCallback) {
+      // Streamed lists arrive parsed, their filters have been created while
+      // downloading already
+      var list = (typeof data == "string" ? this._parseList(data) : data);
+      var filters = downloadable.filters;
+      downloadable.filters = null;
+      if (!list.valid)
+        return errorCallback("synchronize_invalid_data");
+      if (list.checksumMismatch)
+        return errorCallback("synchronize_checksum_mismatch");
+      var minVersion = parseFloat(list.minVersion);
+      var params = list.params;
+
       if (params.redirect)
         return redirectCallback(params.redirect);
 
@@ -158,14 +285,13 @@ require.scopes['synchronizer'] = (function() {
       }
 
       // The download actually succeeded
+      this._recordTransfer(subscription, downloadable);
+      subscription.etag = downloadable.etag;
+      subscription.lastModified = downloadable.lastModified;
       subscription.lastSuccess = subscription.lastDownload = Math.round(Date.now() / MILLIS_IN_SECOND);
       subscription.downloadStatus = "synchronize_ok";
       subscription.errors = 0;
 
-      // Remove lines containing parameters
-      for (var i = remove.length - 1; i >= 0; i--)
-        lines.splice(remove[i], 1);
-
       // Process parameters
       if (params.homepage) {
         subscription.homepage = params.homepage;
@@ -207,22 +333,45 @@ require.scopes['synchronizer'] = (function() {
         }
       }
 
-      // Process filters
-      lines.shift();
-      var filters = [];
-      for (var idx = 0; idx < lines.length; ++idx) {
-        var line = lines[idx];
+      // Process filters, a whole list is parsed in slices
+      var lines = list.lines || [];
+      subscription._pendingFilters = filters;
+      Utils.forEachInSlices(lines, function(line) {
+        if (subscription._pendingFilters != filters)
+          return false;  // A newer download of the list took over
         line = Filter.normalize(line);
         if (line)
           filters.push(Filter.fromText(line));
-      }
+      }, function() {
+        delete subscription._pendingFilters;
+        Subscription.updateSubscriptionFilters(subscription, filters);
+        if (!this.firstListTime)
+          this.firstListTime = Date.now() - startTime;
+      }.bind(this));
+    },
 
-      Subscription.updateSubscriptionFilters(subscription, filters);
-      trigger("downloadFinished");
+    _onDownloadNotModified: function(downloadable) {
+      var subscription = Subscription.fromURL(downloadable.url);
+      this._recordTransfer(subscription, downloadable);
+
+      // Filters are unchanged, only renew the expiration. The hard expiration
+      // was set to twice the interval announced by the list.
+      var now = Math.round(Date.now() / MILLIS_IN_SECOND);
+      var expirationInterval = DEFAULT_EXPIRATION_INTERVAL;
+      if (subscription.lastSuccess && subscription.expires > subscription.lastSuccess)
+        expirationInterval = (subscription.expires - subscription.lastSuccess) / 2 * MILLIS_IN_SECOND;
+      var expiration = downloader.processExpirationInterval(expirationInterval);
+      subscription.softExpiration = Math.round(expiration[0] / MILLIS_IN_SECOND);
+      subscription.expires = Math.round(expiration[1] / MILLIS_IN_SECOND);
+      subscription.lastCheck = now;
+      subscription.lastSuccess = subscription.lastDownload = now;
+      subscription.errors = 0;
+      subscription.downloadStatus = "synchronize_ok";
     },
 
     _onDownloadError: function(downloadable, downloadURL, error, channelStatus, responseStatus, redirectCallback) {
       var subscription = Subscription.fromURL(downloadable.url);
+      this._recordTransfer(subscription, downloadable);
       subscription.lastDownload = Math.round(Date.now() / MILLIS_IN_SECOND);
       subscription.downloadStatus = error;
 
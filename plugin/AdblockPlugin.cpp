@@ -26,7 +26,12 @@ void AdblockPlugin::StaticInitialize()
 {
     // Place one-time initialization stuff here; As of FireBreath 1.4 this should only
     // be called once per process
-    adblock::CreateInstance(&g_adblock);
+    // Share the engine of the filtering daemon if one is running
+    adblock::ConnectDaemon(&g_adblock);
+    // Otherwise load the engine in the background, pages opened meanwhile
+    // get answers according to the startup policy
+    if (!g_adblock)
+        adblock::CreateInstanceAsync(&g_adblock);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -4,6 +4,8 @@
 #include "global/config.h"
 #include "AdblockPluginAPI.h"
 
+#include <boost/bind.hpp>
+
 #pragma comment(lib, "Winmm.lib")
 #pragma comment(lib, "Wldap32.lib")
 #pragma comment(lib, "Ws2_32.lib")
@@ -29,12 +31,43 @@
 #pragma comment(lib, "libglog-s.lib")
 #endif
 
+namespace {
+
+// Runs on a thread of the engine, the browser calls back on its own thread
+template <typename Result>
+void InvokeCallback(const FB::JSObjectPtr& callback, Result result,
+                    bool timed_out) {
+  callback->InvokeAsync("", FB::variant_list_of(result)(timed_out));
+}
+
+void InvokeReadinessCallback(const FB::JSObjectPtr& callback,
+                             adblock::AdBlock::Readiness readiness) {
+  std::int32_t stage = readiness;
+  callback->InvokeAsync("", FB::variant_list_of(stage));
+}
+
+}  // namespace
+
 std::string AdblockPluginAPI::CheckFilterMatch(const std::string& location,
                                                const std::string& type,
                                                const std::string& document) {
   return adblock_->CheckFilterMatch(location, type, document);
 }
 
+std::uint32_t AdblockPluginAPI::BeginDocument(const std::string& document) {
+  return adblock_->BeginDocument(document);
+}
+
+std::string AdblockPluginAPI::CheckFilterMatchInDocument(
+    std::uint32_t document, const std::string& location,
+    const std::string& type) {
+  return adblock_->CheckFilterMatch(document, location, type);
+}
+
+void AdblockPluginAPI::EndDocument(std::uint32_t document) {
+  adblock_->EndDocument(document);
+}
+
 std::string AdblockPluginAPI::GetElementHidingSelectors(
     const std::string& domain) {
   return adblock_->GetElementHidingSelectors(domain);
@@ -46,8 +79,8 @@ bool AdblockPluginAPI::IsWhitelisted(const std::string& url,
   return adblock_->IsWhitelisted(url, parent_url, type);
 }
 
-void AdblockPluginAPI::ToggleEnabled(const std::string& url, bool enabled) {
-  adblock_->ToggleEnabled(url, enabled);
+bool AdblockPluginAPI::ToggleEnabled(const std::string& url, bool enabled) {
+  return adblock_->ToggleEnabled(url, enabled);
 }
 
 std::string AdblockPluginAPI::GenerateCSSContent() {
@@ -69,3 +102,51 @@ void AdblockPluginAPI::Report(const std::string& type,
 std::uint8_t AdblockPluginAPI::GetDownloadingTask() {
   return adblock_->GetDownloadingTask();
 }
+
+std::string AdblockPluginAPI::GetStats() { return adblock_->GetStats(); }
+
+void AdblockPluginAPI::CheckFilterMatchAsync(const std::string& location,
+                                             const std::string& type,
+                                             const std::string& document,
+                                             const FB::JSObjectPtr& callback,
+                                             std::uint32_t timeout_ms) {
+  adblock_->CheckFilterMatchAsync(
+      location, type, document,
+      boost::bind(&InvokeCallback<std::string>, callback, _1, _2), timeout_ms);
+}
+
+void AdblockPluginAPI::CheckFilterMatchInDocumentAsync(
+    std::uint32_t document, const std::string& location,
+    const std::string& type, const FB::JSObjectPtr& callback,
+    std::uint32_t timeout_ms) {
+  adblock_->CheckFilterMatchAsync(
+      document, location, type,
+      boost::bind(&InvokeCallback<std::string>, callback, _1, _2), timeout_ms);
+}
+
+void AdblockPluginAPI::GetElementHidingSelectorsAsync(
+    const std::string& domain, const FB::JSObjectPtr& callback,
+    std::uint32_t timeout_ms) {
+  adblock_->GetElementHidingSelectorsAsync(
+      domain, boost::bind(&InvokeCallback<std::string>, callback, _1, _2),
+      timeout_ms);
+}
+
+void AdblockPluginAPI::IsWhitelistedAsync(const std::string& url,
+                                          const std::string& parent_url,
+                                          const std::string& type,
+                                          const FB::JSObjectPtr& callback,
+                                          std::uint32_t timeout_ms) {
+  adblock_->IsWhitelistedAsync(
+      url, parent_url, type,
+      boost::bind(&InvokeCallback<bool>, callback, _1, _2), timeout_ms);
+}
+
+std::int32_t AdblockPluginAPI::GetReadiness() {
+  return adblock_->readiness();
+}
+
+void AdblockPluginAPI::OnReadiness(const FB::JSObjectPtr& callback) {
+  adblock_->AddReadinessCallback(
+      boost::bind(&InvokeReadinessCallback, callback, _1));
+}
@@ -16,6 +16,13 @@ class AdblockPluginAPI : public FB::JSAPIAuto {
       : plugin_(plugin), host_(host), adblock_(adblock) {
     registerMethod("checkFilterMatch",
                    make_method(this, &AdblockPluginAPI::CheckFilterMatch));
+    registerMethod("beginDocument",
+                   make_method(this, &AdblockPluginAPI::BeginDocument));
+    registerMethod(
+        "checkFilterMatchInDocument",
+        make_method(this, &AdblockPluginAPI::CheckFilterMatchInDocument));
+    registerMethod("endDocument",
+                   make_method(this, &AdblockPluginAPI::EndDocument));
     registerMethod(
         "getElementHidingSelectors",
         make_method(this, &AdblockPluginAPI::GetElementHidingSelectors));
@@ -33,6 +40,22 @@ class AdblockPluginAPI : public FB::JSAPIAuto {
     registerMethod("report", make_method(this, &AdblockPluginAPI::Report));
     registerMethod("getDownloadingTask",
                    make_method(this, &AdblockPluginAPI::GetDownloadingTask));
+    registerMethod("getStats", make_method(this, &AdblockPluginAPI::GetStats));
+    registerMethod(
+        "checkFilterMatchAsync",
+        make_method(this, &AdblockPluginAPI::CheckFilterMatchAsync));
+    registerMethod(
+        "checkFilterMatchInDocumentAsync",
+        make_method(this, &AdblockPluginAPI::CheckFilterMatchInDocumentAsync));
+    registerMethod(
+        "getElementHidingSelectorsAsync",
+        make_method(this, &AdblockPluginAPI::GetElementHidingSelectorsAsync));
+    registerMethod("isWhitelistedAsync",
+                   make_method(this, &AdblockPluginAPI::IsWhitelistedAsync));
+    registerMethod("getReadiness",
+                   make_method(this, &AdblockPluginAPI::GetReadiness));
+    registerMethod("onReadiness",
+                   make_method(this, &AdblockPluginAPI::OnReadiness));
   }
 
   virtual ~AdblockPluginAPI() {}
@@ -41,12 +64,18 @@ class AdblockPluginAPI : public FB::JSAPIAuto {
                                const std::string& type,
                                const std::string& document);
 
+  std::uint32_t BeginDocument(const std::string& document);
+  std::string CheckFilterMatchInDocument(std::uint32_t document,
+                                         const std::string& location,
+                                         const std::string& type);
+  void EndDocument(std::uint32_t document);
+
   std::string GetElementHidingSelectors(const std::string& domain);
 
   bool IsWhitelisted(const std::string& url, const std::string& parent_url,
                      const std::string& type);
 
-  void ToggleEnabled(const std::string& url, bool enabled);
+  bool ToggleEnabled(const std::string& url, bool enabled);
 
   bool block_ads();
   bool block_malware();
@@ -59,6 +88,35 @@ class AdblockPluginAPI : public FB::JSAPIAuto {
 
   std::uint8_t GetDownloadingTask();
 
+  std::string GetStats();
+
+  // Call |callback| with the result and whether the deadline passed, on the
+  // browser's main thread. A |timeout_ms| of 0 waits as long as it takes.
+  void CheckFilterMatchAsync(const std::string& location,
+                             const std::string& type,
+                             const std::string& document,
+                             const FB::JSObjectPtr& callback,
+                             std::uint32_t timeout_ms);
+  void CheckFilterMatchInDocumentAsync(std::uint32_t document,
+                                       const std::string& location,
+                                       const std::string& type,
+                                       const FB::JSObjectPtr& callback,
+                                       std::uint32_t timeout_ms);
+  void GetElementHidingSelectorsAsync(const std::string& domain,
+                                      const FB::JSObjectPtr& callback,
+                                      std::uint32_t timeout_ms);
+  void IsWhitelistedAsync(const std::string& url,
+                          const std::string& parent_url,
+                          const std::string& type,
+                          const FB::JSObjectPtr& callback,
+                          std::uint32_t timeout_ms);
+
+  // -1 if the engine failed to start, else 0 to 3 from starting to done
+  // with the first synchronization, see adblock::AdBlock::Readiness
+  std::int32_t GetReadiness();
+  // Call |callback| with every stage the engine reaches from now on
+  void OnReadiness(const FB::JSObjectPtr& callback);
+
  private:
   AdblockPluginWeakPtr plugin_;
   FB::BrowserHostPtr host_;
@@ -1,6 +1,7 @@
 #ifndef ADBLOCK_H_
 #define ADBLOCK_H_
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <string>
 #include <cstdint>
@@ -9,27 +10,111 @@ namespace adblock {
 
 class AdBlock {
  public:
+  typedef boost::function<void()> ConfigCallback;
+  // Completion of an asynchronous query. |timed_out| is set when the
+  // deadline passed before the engine got to the query, |result| holds the
+  // fail-open answer then.
+  typedef boost::function<void(const std::string& result, bool timed_out)>
+      StringCallback;
+  typedef boost::function<void(bool result, bool timed_out)> BoolCallback;
+
+  // Startup stages of the engine, in the order they are reached
+  enum Readiness {
+    // The scripts failed to load, queries get default answers
+    INIT_FAILED = -1,
+    STARTING,
+    // The scripts are evaluated, the filters are still being loaded
+    CODE_LOADED,
+    // The filters of the database are in the matchers
+    FILTERS_LOADED,
+    // The lists downloaded at startup are applied as well
+    FIRST_SYNC_DONE
+  };
+  typedef boost::function<void(Readiness readiness)> ReadinessCallback;
+
+  // Documents kept open at most, beginning another one ends the oldest
+  enum { MAX_OPEN_DOCUMENTS = 1024 };
+
   virtual ~AdBlock() {}
   virtual bool block_ads() = 0;
   virtual bool block_malware() = 0;
   virtual bool dont_track_me() = 0;
+  // Called whenever the host changes one of the settings above
+  virtual void AddConfigCallback(const ConfigCallback& callback) = 0;
   virtual std::string CheckFilterMatch(const std::string& location,
                                        const std::string& type,
                                        const std::string& document) = 0;
+  // Prepares the host, base domain and domain checks of a frame's document
+  // once for the CheckFilterMatch() calls of its sub-resources. The handle
+  // is released with EndDocument() on navigation. Requests of a document
+  // that was evicted are matched by its address for a while, later results
+  // have "unknownDocument" set and the document has to be begun again.
+  // Before the engine is ready, see AdblockSettings::startup_policy, the
+  // handle is 0 and matches like an unknown document.
+  virtual std::uint32_t BeginDocument(const std::string& document) = 0;
+  virtual std::string CheckFilterMatch(std::uint32_t document,
+                                       const std::string& location,
+                                       const std::string& type) = 0;
+  virtual void EndDocument(std::uint32_t document) = 0;
   virtual std::string GetElementHidingSelectors(const std::string& domain) = 0;
   virtual bool IsWhitelisted(const std::string& url,
                              const std::string& parent_url,
                              const std::string& type) = 0;
-  virtual void ToggleEnabled(const std::string& url, bool enabled) = 0;
+  // Turns blocking on the site of |url| on or off, false if the change was
+  // refused: the engine isn't ready or this process reads the filters another
+  // process shares, which owns the exception rules.
+  virtual bool ToggleEnabled(const std::string& url, bool enabled) = 0;
   virtual std::string GenerateCSSContent() = 0;
   virtual void Report(const std::string& type, const std::string& documentUrl,
                       const std::string& url, const std::string& rule) = 0;
+  // Asynchronous versions of the queries above, they return right away and
+  // call |callback| exactly once from a thread of the engine. Queries are
+  // answered in the order they were made. A |timeout_ms| of 0 means no
+  // deadline.
+  virtual void CheckFilterMatchAsync(const std::string& location,
+                                     const std::string& type,
+                                     const std::string& document,
+                                     const StringCallback& callback,
+                                     std::uint32_t timeout_ms) = 0;
+  virtual void CheckFilterMatchAsync(std::uint32_t document,
+                                     const std::string& location,
+                                     const std::string& type,
+                                     const StringCallback& callback,
+                                     std::uint32_t timeout_ms) = 0;
+  virtual void GetElementHidingSelectorsAsync(const std::string& domain,
+                                              const StringCallback& callback,
+                                              std::uint32_t timeout_ms) = 0;
+  virtual void IsWhitelistedAsync(const std::string& url,
+                                  const std::string& parent_url,
+                                  const std::string& type,
+                                  const BoolCallback& callback,
+                                  std::uint32_t timeout_ms) = 0;
+  virtual void GenerateCSSContentAsync(const StringCallback& callback,
+                                       std::uint32_t timeout_ms) = 0;
+  virtual Readiness readiness() = 0;
+  // Waits until the engine reached |readiness|, false if it failed to start
+  // or |timeout_ms| passed first. A |timeout_ms| of 0 waits as long as it
+  // takes.
+  virtual bool WaitForReadiness(Readiness readiness,
+                                std::uint32_t timeout_ms) = 0;
+  // Called from a thread of the engine with every stage reached from now on.
+  virtual void AddReadinessCallback(const ReadinessCallback& callback) = 0;
   virtual std::uint8_t GetDownloadingTask() = 0;
+  // Call counts, latency histograms, result cache and filter statistics and
+  // V8 heap usage as JSON
+  virtual std::string GetStats() = 0;
 };
 
 typedef boost::shared_ptr<AdBlock> AdBlockPtr;
 
 void CreateInstance(AdBlockPtr* adblock);
+// Returns right away, the engine is loaded on a thread of its own. Queries
+// made before its filters are loaded follow the startup policy of the
+// settings, see AdblockSettings::startup_policy.
+void CreateInstanceAsync(AdBlockPtr* adblock);
+// Connects to a running filtering daemon instead of hosting an engine in
+// this process, |adblock| stays empty if no daemon is running.
+void ConnectDaemon(AdBlockPtr* adblock);
 
 }  // namespace adblock
 
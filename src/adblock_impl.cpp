@@ -1,6 +1,6 @@
 #include "adblock_impl.h"
 #include "js_object.h"
-#include <ctime>
+#include "process_util.h"
 
 #ifdef WIN32
 #include <Windows.h>
@@ -10,11 +10,12 @@
 #include <v8/v8-debug.h>
 #endif  // ENABLE_DEBUGGER_SUPPORT
 
+#include <ctime>
+#include <sstream>
+
 #include <boost/bind.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/interprocess/managed_shared_memory.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
 
 #include <glog/logging.h>
 
@@ -22,6 +23,20 @@ namespace adblock {
 
 extern std::string js_sources[];
 
+// Seconds between two statistics dumps to the log
+const int kStatsLogInterval = 60;
+
+// Script calls of queries that missed their deadline waiting to run in the
+// background at most
+const size_t kMaxLateQueries = 256;
+
+// Addresses of documents kept after the scripts evicted them, their requests
+// are matched by address until then
+const std::uint32_t kKeptDocuments = 4 * AdBlock::MAX_OPEN_DOCUMENTS;
+
+// Default answer of CheckFilterMatch() for fail-closed engines
+const char kBlockedByDefault[] = "{\"type\":2,\"collapse\":null}";
+
 #ifdef ENABLE_DEBUGGER_SUPPORT
 v8::Persistent<v8::Context> debug_message_context;
 
@@ -60,10 +75,37 @@ void CreateInstance(AdBlockPtr* adblock) {
   }
 }
 
-AdBlockImpl::AdBlockImpl() : downloading_count_(0) {}
+void CreateInstanceAsync(AdBlockPtr* adblock) {
+  AdBlockImpl* result = new AdBlockImpl();
+  result->InitAsync();
+  *adblock = AdBlockPtr(result);
+}
+
+AdBlockImpl::AdBlockImpl()
+    : AsyncAdBlock(STARTING),
+      env_(nullptr),
+      aggregator_(&reporter_),
+      process_name_(CurrentProcessName()),
+      downloading_count_(0) {
+  // Summaries collected so far go out before raw reporting takes over
+  config_.AddChangeCallback(
+      boost::bind(&ReportAggregator::Flush, &aggregator_));
+  config_.AddChangeCallback(
+      boost::bind(&AdBlockImpl::UpdateCapture, this, _1));
+  config_.AddChangeCallback(
+      boost::bind(&AdBlockImpl::UpdateStatsLog, this, _1));
+}
 
 AdBlockImpl::~AdBlockImpl() {
+  if (init_thread_.joinable()) {
+    init_thread_.join();
+  }
+  // The query and dump threads use the environment
+  StopQueries();
+  stats_.StopDump();
   if (env_ != nullptr) {
+    // Its task might be waiting for the isolate
+    env_->task_scheduler()->Stop();
     v8::Locker locker(env_->isolate());
     v8::HandleScope handle_scope(env_->isolate());
     env_->Dispose();
@@ -71,22 +113,42 @@ AdBlockImpl::~AdBlockImpl() {
   }
 }
 
-bool AdBlockImpl::Init() {
+bool AdBlockImpl::Init() { return Load(v8::Isolate::GetCurrent()); }
+
+void AdBlockImpl::InitAsync() {
+  // The loading thread hasn't entered the isolate
+  init_thread_ = boost::thread(
+      boost::bind(&AdBlockImpl::Load, this, v8::Isolate::GetCurrent()));
+}
+
+bool AdBlockImpl::Load(v8::Isolate* isolate) {
   try {
-    v8::Isolate* isolate = v8::Isolate::GetCurrent();
     v8::Locker locker(isolate);
     v8::HandleScope handle_scope(isolate);
+    std::uint64_t start = EngineStats::Now();
     v8::Local<v8::Context> context = v8::Context::New(isolate);
     v8::Context::Scope context_scope(context);
 
     env_ = Environment::New(context);
+    // Before any thread of the environment could take it
+    EngineLock engine_lock(env_);
     js_object::Setup(env_);
+    filter_index_ = env_->GetFilterIndex();
+    StartupProfile* profile = env_->startup_profile();
+    profile->Record("context", start, EngineStats::Now());
 
     env_->SetEventCallback("downloadStart",
                            boost::bind(&AdBlockImpl::DownloadStart, this, _1));
     env_->SetEventCallback(
         "downloadFinished",
         boost::bind(&AdBlockImpl::DownloadFinished, this, _1));
+    env_->SetEventCallback(
+        "whitelistChanged",
+        boost::bind(&AdBlockImpl::WhitelistChanged, this, _1));
+    env_->SetEventCallback("filtersLoaded",
+                           boost::bind(&AdBlockImpl::FiltersLoaded, this, _1));
+    env_->SetEventCallback("firstSyncDone",
+                           boost::bind(&AdBlockImpl::FirstSyncDone, this, _1));
 
 #ifdef ENABLE_DEBUGGER_SUPPORT
     debug_message_context.Reset(isolate, context);
@@ -96,18 +158,25 @@ bool AdBlockImpl::Init() {
 #endif  // ENABLE_DEBUGGER_SUPPORT
 
     for (int idx = 0; !js_sources[idx].empty(); idx += 2) {
+      std::string phase = "script " + js_sources[idx];
+      profile->Begin(phase);
       env_->Evaluate(js_sources[idx + 1], js_sources[idx]);
+      profile->End(phase);
     }
 
+    profile->Begin("init");
     auto fun_name = v8::String::NewFromUtf8(isolate, "initAdblock");
     auto process_val = context->Global()->Get(fun_name);
     JsValue(isolate, process_val).Call();
+    profile->End("init");
+    startup()->Reach(CODE_LOADED);
   }
   catch (const std::exception& e) {
 #ifdef WIN32
     OutputDebugStringA(e.what());
 #endif  // WIN32
     std::cerr << e.what() << std::endl;
+    startup()->Reach(INIT_FAILED);
     return false;
   }
   return true;
@@ -116,25 +185,200 @@ bool AdBlockImpl::Init() {
 std::string AdBlockImpl::CheckFilterMatch(const std::string& location,
                                           const std::string& type,
                                           const std::string& document) {
-  SETUP_THREAD_CONTEXT(env_);
+  return CheckFilterMatchBefore(location, type, document, QueryDeadline(),
+                                nullptr);
+}
+
+std::string AdBlockImpl::CheckFilterMatchBefore(const std::string& location,
+                                                const std::string& type,
+                                                const std::string& document,
+                                                std::uint64_t deadline,
+                                                bool* timed_out) {
+  if (!AwaitStartup(deadline, timed_out)) {
+    return DefaultMatch();
+  }
+  std::uint64_t begin = config_.capture_requests() ? capture_.Begin() : 0;
+  std::string result;
+  {
+    EngineStats::Timer timer(&stats_, EngineStats::CHECK_FILTER_MATCH);
+    EngineLock engine_lock(env_, boost::defer_lock);
+    if (LockEngine(&engine_lock, deadline)) {
+      result = CallCheckFilterMatch(location, type, document);
+    } else {
+      stats_.RecordDeadlineMiss(EngineStats::CHECK_FILTER_MATCH);
+      if (timed_out) {
+        *timed_out = true;
+      }
+      FinishLater(boost::bind(&AdBlockImpl::CallCheckFilterMatch, this,
+                              location, type, document));
+      result = DefaultMatch();
+    }
+  }
+
+  // Outside the engine lock, long results are hashed
+  capture_.Record(RequestCapture::CHECK_FILTER_MATCH, begin, location, type,
+                  document, result);
+  return result;
+}
+
+std::string AdBlockImpl::CallCheckFilterMatch(const std::string& location,
+                                              const std::string& type,
+                                              const std::string& document) {
+  SETUP_LOCKED_THREAD_CONTEXT(env_);
 
   JsValue func(isolate, env_->Evaluate("API.checkFilterMatch"));
   CallParams params;
   params.emplace_back(v8::String::NewFromUtf8(isolate, location.c_str()));
   params.emplace_back(v8::String::NewFromUtf8(isolate, type.c_str()));
   params.emplace_back(v8::String::NewFromUtf8(isolate, document.c_str()));
+  return V8_STRING_TO_STD_STRING(
+      v8::Local<v8::String>::Cast<v8::Value>(func.Call(params)));
+}
+
+std::uint32_t AdBlockImpl::BeginDocument(const std::string& document) {
+  if (!AwaitCode()) {
+    return 0;
+  }
+  std::uint32_t handle;
+  {
+    SETUP_TIMED_THREAD_CONTEXT(env_, &stats_);
+
+    JsValue func(isolate, env_->Evaluate("API.beginDocument"));
+    CallParams params;
+    params.emplace_back(v8::String::NewFromUtf8(isolate, document.c_str()));
+    handle = func.Call(params)->Uint32Value();
+  }
 
+  boost::mutex::scoped_lock lock(documents_mutex_);
+  documents_[handle] = document;
+  documents_.erase(handle - kKeptDocuments);
+  return handle;
+}
+
+std::string AdBlockImpl::CheckFilterMatch(std::uint32_t document,
+                                          const std::string& location,
+                                          const std::string& type) {
+  return CheckDocumentMatchBefore(document, location, type, QueryDeadline(),
+                                  nullptr);
+}
+
+std::string AdBlockImpl::CheckDocumentMatchBefore(std::uint32_t document,
+                                                  const std::string& location,
+                                                  const std::string& type,
+                                                  std::uint64_t deadline,
+                                                  bool* timed_out) {
+  if (!AwaitStartup(deadline, timed_out)) {
+    return DefaultMatch();
+  }
+  std::uint64_t begin = config_.capture_requests() ? capture_.Begin() : 0;
+  // The scripts fall back to it if they evicted the document already
+  std::string document_url;
+  {
+    boost::mutex::scoped_lock lock(documents_mutex_);
+    auto it = documents_.find(document);
+    if (it != documents_.end()) {
+      document_url = it->second;
+    }
+  }
+  std::string result;
+  {
+    EngineStats::Timer timer(&stats_,
+                             EngineStats::CHECK_FILTER_MATCH_IN_DOCUMENT);
+    EngineLock engine_lock(env_, boost::defer_lock);
+    if (LockEngine(&engine_lock, deadline)) {
+      result = CallCheckDocumentMatch(document, location, type, document_url);
+    } else {
+      stats_.RecordDeadlineMiss(EngineStats::CHECK_FILTER_MATCH_IN_DOCUMENT);
+      if (timed_out) {
+        *timed_out = true;
+      }
+      FinishLater(boost::bind(&AdBlockImpl::CallCheckDocumentMatch, this,
+                              document, location, type, document_url));
+      result = DefaultMatch();
+    }
+  }
+
+  if (begin != 0) {
+    // Captured as the plain call, replays don't open documents
+    capture_.Record(RequestCapture::CHECK_FILTER_MATCH, begin, location, type,
+                    document_url, result);
+  }
+  return result;
+}
+
+std::string AdBlockImpl::CallCheckDocumentMatch(
+    std::uint32_t document, const std::string& location,
+    const std::string& type, const std::string& document_url) {
+  SETUP_LOCKED_THREAD_CONTEXT(env_);
+
+  JsValue func(isolate, env_->Evaluate("API.checkFilterMatchInDocument"));
+  CallParams params;
+  params.emplace_back(v8::Integer::NewFromUnsigned(document));
+  params.emplace_back(v8::String::NewFromUtf8(isolate, location.c_str()));
+  params.emplace_back(v8::String::NewFromUtf8(isolate, type.c_str()));
+  params.emplace_back(v8::String::NewFromUtf8(isolate, document_url.c_str()));
   return V8_STRING_TO_STD_STRING(
       v8::Local<v8::String>::Cast<v8::Value>(func.Call(params)));
 }
 
+void AdBlockImpl::EndDocument(std::uint32_t document) {
+  if (!AwaitCode()) {
+    return;
+  }
+  {
+    SETUP_TIMED_THREAD_CONTEXT(env_, &stats_);
+
+    JsValue func(isolate, env_->Evaluate("API.endDocument"));
+    CallParams params;
+    params.emplace_back(v8::Integer::NewFromUnsigned(document));
+    func.Call(params);
+  }
+
+  boost::mutex::scoped_lock lock(documents_mutex_);
+  documents_.erase(document);
+}
+
 std::string AdBlockImpl::GetElementHidingSelectors(const std::string& domain) {
-  SETUP_THREAD_CONTEXT(env_);
+  return GetElementHidingSelectorsBefore(domain, QueryDeadline(), nullptr);
+}
+
+std::string AdBlockImpl::GetElementHidingSelectorsBefore(
+    const std::string& domain, std::uint64_t deadline, bool* timed_out) {
+  if (!AwaitStartup(deadline, timed_out)) {
+    return DefaultSelectors();
+  }
+  std::uint64_t begin = config_.capture_requests() ? capture_.Begin() : 0;
+  std::string result;
+  {
+    EngineStats::Timer timer(&stats_,
+                             EngineStats::GET_ELEMENT_HIDING_SELECTORS);
+    EngineLock engine_lock(env_, boost::defer_lock);
+    if (LockEngine(&engine_lock, deadline)) {
+      result = CallGetElementHidingSelectors(domain);
+    } else {
+      stats_.RecordDeadlineMiss(EngineStats::GET_ELEMENT_HIDING_SELECTORS);
+      if (timed_out) {
+        *timed_out = true;
+      }
+      FinishLater(boost::bind(&AdBlockImpl::CallGetElementHidingSelectors,
+                              this, domain));
+      result = DefaultSelectors();
+    }
+  }
+
+  // Outside the engine lock, the selector lists are long and get hashed
+  capture_.Record(RequestCapture::GET_ELEMENT_HIDING_SELECTORS, begin, domain,
+                  std::string(), std::string(), result);
+  return result;
+}
+
+std::string AdBlockImpl::CallGetElementHidingSelectors(
+    const std::string& domain) {
+  SETUP_LOCKED_THREAD_CONTEXT(env_);
 
   JsValue func(isolate, env_->Evaluate("API.getElementHidingSelectors"));
   CallParams params;
   params.emplace_back(v8::String::NewFromUtf8(isolate, domain.c_str()));
-
   return V8_STRING_TO_STD_STRING(
       v8::Local<v8::String>::Cast<v8::Value>(func.Call(params)));
 }
@@ -142,8 +386,57 @@ std::string AdBlockImpl::GetElementHidingSelectors(const std::string& domain) {
 bool AdBlockImpl::IsWhitelisted(const std::string& url,
                                 const std::string& parent_url,
                                 const std::string& type) {
-  SETUP_THREAD_CONTEXT(env_);
+  return IsWhitelistedBefore(url, parent_url, type, QueryDeadline(), nullptr);
+}
+
+bool AdBlockImpl::IsWhitelistedBefore(const std::string& url,
+                                      const std::string& parent_url,
+                                      const std::string& type,
+                                      std::uint64_t deadline,
+                                      bool* timed_out) {
+  if (!AwaitStartup(deadline, timed_out)) {
+    return false;
+  }
+  std::uint64_t begin = config_.capture_requests() ? capture_.Begin() : 0;
+  EngineStats::Timer timer(&stats_, EngineStats::IS_WHITELISTED);
+  // Exception rules published by another process count as well
+  whitelist_cache_.SetIndexGeneration(filter_index_->generation());
+  std::string key = WhitelistCache::Key(url, parent_url, type);
+  bool result;
+  if (whitelist_cache_.Lookup(key, &result)) {
+    capture_.Record(RequestCapture::IS_WHITELISTED, begin, url, parent_url,
+                    type, result ? "1" : "0");
+    return result;
+  }
+
+  {
+    EngineLock engine_lock(env_, boost::defer_lock);
+    if (LockEngine(&engine_lock, deadline)) {
+      result = CallIsWhitelisted(url, parent_url, type, key);
+    } else {
+      stats_.RecordDeadlineMiss(EngineStats::IS_WHITELISTED);
+      if (timed_out) {
+        *timed_out = true;
+      }
+      FinishLater(boost::bind(&AdBlockImpl::CallIsWhitelisted, this, url,
+                              parent_url, type, key));
+      result = false;
+    }
+  }
 
+  // Outside the engine lock, hashed URLs take their time
+  capture_.Record(RequestCapture::IS_WHITELISTED, begin, url, parent_url, type,
+                  result ? "1" : "0");
+  return result;
+}
+
+bool AdBlockImpl::CallIsWhitelisted(const std::string& url,
+                                    const std::string& parent_url,
+                                    const std::string& type,
+                                    const std::string& key) {
+  SETUP_LOCKED_THREAD_CONTEXT(env_);
+  // Exception rules can only change while the engine is locked
+  std::uint32_t generation = whitelist_cache_.generation();
   JsValue func(isolate, env_->Evaluate("API.isWhitelisted"));
   CallParams params;
   params.emplace_back(v8::String::NewFromUtf8(isolate, url.c_str()));
@@ -154,21 +447,31 @@ bool AdBlockImpl::IsWhitelisted(const std::string& url,
     }
   }
 
-  return func.Call(params)->BooleanValue();
+  bool result = func.Call(params)->BooleanValue();
+  whitelist_cache_.Store(key, generation, result);
+  return result;
 }
 
-void AdBlockImpl::ToggleEnabled(const std::string& url, bool enabled) {
-  SETUP_THREAD_CONTEXT(env_);
+bool AdBlockImpl::ToggleEnabled(const std::string& url, bool enabled) {
+  if (!AwaitCode()) {
+    return false;
+  }
+  EngineStats::Timer timer(&stats_, EngineStats::TOGGLE_ENABLED);
+  SETUP_TIMED_THREAD_CONTEXT(env_, &stats_);
 
   JsValue func(isolate, env_->Evaluate("API.toggleEnabled"));
   CallParams params;
   params.emplace_back(v8::String::NewFromUtf8(isolate, url.c_str()));
   params.emplace_back(v8::Boolean::New(enabled));
-  func.Call(params);
+  return func.Call(params)->BooleanValue();
 }
 
 std::string AdBlockImpl::GenerateCSSContent() {
-  SETUP_THREAD_CONTEXT(env_);
+  if (!AwaitCode()) {
+    return std::string();
+  }
+  EngineStats::Timer timer(&stats_, EngineStats::GENERATE_CSS_CONTENT);
+  SETUP_TIMED_THREAD_CONTEXT(env_, &stats_);
 
   JsValue func(isolate, env_->Evaluate("API.generateCSSContent"));
   return JsValue(isolate, func.Call()).ToStdString();
@@ -177,23 +480,14 @@ std::string AdBlockImpl::GenerateCSSContent() {
 void AdBlockImpl::Report(const std::string& type,
                          const std::string& documentUrl, const std::string& url,
                          const std::string& rule) {
-  boost::property_tree::ptree root;
-  std::stringstream ss;
-
-  root.put<std::time_t>("time", std::time(nullptr));
-  root.put<std::string>("type", type);
-  root.put<int>("pid", GetCurrentProcessId());
-  root.put<std::string>("process", GetCurrentProcessName());
-  root.put<std::string>("website", documentUrl);
-  if (url.length()) {
-    root.put<std::string>("location", url);
-    if (rule.length()) {
-      root.put<std::string>("rule", rule);
-    }
+  if (config_.raw_reports()) {
+    // A rule is only meaningful together with the blocked location
+    reporter_.Write(type, process_name_, documentUrl, url,
+                    url.length() ? rule : std::string());
+  } else {
+    aggregator_.Add(type, process_name_, documentUrl,
+                    url.length() ? rule : std::string());
   }
-
-  boost::property_tree::write_json(ss, root, false);
-  sender_.Send(ss.str());
 }
 
 bool AdBlockImpl::block_ads() { return config_.block_ads(); }
@@ -202,17 +496,146 @@ bool AdBlockImpl::block_malware() { return config_.block_malware(); }
 
 bool AdBlockImpl::dont_track_me() { return config_.dont_track_me(); }
 
-std::string AdBlockImpl::GetCurrentProcessName() {
-  char file_name[MAX_PATH] = {0};
-  if (GetModuleFileNameA(NULL, file_name, MAX_PATH)) {
-    boost::filesystem::path path(file_name);
-    return path.filename().string();
-  }
-  return "";
+void AdBlockImpl::AddConfigCallback(const ConfigCallback& callback) {
+  config_.AddChangeCallback(boost::bind(callback));
 }
 
 std::uint8_t AdBlockImpl::GetDownloadingTask() { return downloading_count_; }
 
+std::string AdBlockImpl::GetStats() {
+  std::stringstream result;
+  result << "{";
+  stats_.WriteJson(&result);
+  result << ", \"whitelist_cache\": ";
+  whitelist_cache_.WriteJson(&result);
+  result << ", \"async\": ";
+  executor()->WriteJson(&result);
+  result << ", \"startup\": ";
+  startup()->WriteJson(&result);
+  // Doesn't wait for the engine to start
+  AdBlock::Readiness readiness = startup()->readiness();
+  if (readiness < CODE_LOADED) {
+    result << "}";
+    return result.str();
+  }
+  result << ", \"tasks\": ";
+  env_->task_scheduler()->WriteJson(&result);
+  result << ", \"startup_phases\": ";
+  env_->startup_profile()->WriteJson(&result);
+
+  SETUP_THREAD_CONTEXT(env_);
+  v8::HeapStatistics heap;
+  isolate->GetHeapStatistics(&heap);
+  result << ", \"heap\": {\"used\": " << heap.used_heap_size()
+         << ", \"total\": " << heap.total_heap_size()
+         << ", \"limit\": " << heap.heap_size_limit() << "}";
+
+  JsValue func(isolate, env_->Evaluate("API.getStats"));
+  result << ", \"script\": " << JsValue(isolate, func.Call()).ToStdString()
+         << "}";
+  return result.str();
+}
+
+void AdBlockImpl::UpdateCapture(const AdblockSettings& settings) {
+  RequestCapture::UrlMode mode =
+      static_cast<RequestCapture::UrlMode>(settings.capture_urls);
+  if (!settings.capture_requests) {
+    capture_.Stop();
+    return;
+  }
+  if (capture_.Begin() != 0 && capture_.mode() == mode) {
+    return;
+  }
+
+  // Every process captures into a file of its own next to the logs
+  std::stringstream name;
+  name << "capture-" << CurrentProcessId() << "-" << std::time(nullptr)
+       << ".bin";
+  boost::filesystem::path directory(FLAGS_log_dir);
+  boost::system::error_code error;
+  boost::filesystem::create_directories(directory, error);
+  capture_.Start((directory / name.str()).string(), mode);
+}
+
+void AdBlockImpl::UpdateStatsLog(const AdblockSettings& settings) {
+  if (settings.log_stats) {
+    stats_.StartDump(kStatsLogInterval,
+                     boost::bind(&AdBlockImpl::GetStats, this));
+  } else {
+    stats_.StopDump();
+  }
+}
+
+std::string AdBlockImpl::DefaultMatch() {
+  return config_.fail_closed() ? kBlockedByDefault
+                               : AsyncAdBlock::DefaultMatch();
+}
+
+bool AdBlockImpl::AwaitStartup(std::uint64_t deadline, bool* timed_out) {
+  bool ready;
+  switch (config_.startup_policy()) {
+    case STARTUP_WAIT:
+      ready = startup()->WaitFor(FILTERS_LOADED, deadline);
+      break;
+    case STARTUP_DEFAULT:
+      ready = startup()->WaitFor(FILTERS_LOADED, EngineStats::Now());
+      break;
+    default:
+      ready = startup()->WaitFor(CODE_LOADED, deadline);
+      break;
+  }
+  if (!ready) {
+    startup()->RecordEarlyAnswer();
+    if (timed_out) {
+      *timed_out = true;
+    }
+  }
+  return ready;
+}
+
+bool AdBlockImpl::AwaitCode() {
+  std::uint64_t deadline = config_.startup_policy() == STARTUP_DEFAULT
+                               ? EngineStats::Now()
+                               : QueryDeadline();
+  if (!startup()->WaitFor(CODE_LOADED, deadline)) {
+    startup()->RecordEarlyAnswer();
+    return false;
+  }
+  return true;
+}
+
+std::uint64_t AdBlockImpl::QueryDeadline() {
+  std::uint16_t budget = config_.query_budget_ms();
+  return budget ? EngineStats::Now() + budget * 1000000ULL : 0;
+}
+
+bool AdBlockImpl::LockEngine(EngineLock* lock, std::uint64_t deadline) {
+  std::uint64_t begin = EngineStats::Now();
+  // Holds back the scripts' scheduled tasks until the query had its turn
+  TaskScheduler::ForegroundWait wait(env_->task_scheduler());
+  if (deadline == 0) {
+    lock->Lock();
+  } else if (!lock->TryLockFor(boost::chrono::nanoseconds(
+                 deadline > begin ? deadline - begin : 0))) {
+    return false;
+  }
+  stats_.RecordLockWait(begin);
+  return true;
+}
+
+void AdBlockImpl::FinishLater(const boost::function<void()>& call) {
+  // A busy engine falls behind anyway, the caches get warmed by the queries
+  // that follow. Asynchronous queries always go first.
+  executor()->PostIdle(boost::bind(&AdBlockImpl::FinishLate, this, call),
+                       kMaxLateQueries);
+}
+
+void AdBlockImpl::FinishLate(const boost::function<void()>& call) {
+  // Not a query of its own, neither timed nor captured
+  EngineLock engine_lock(env_);
+  call();
+}
+
 void AdBlockImpl::DownloadStart(const JsValueList& args) {
   ++downloading_count_;
 }
@@ -221,4 +644,20 @@ void AdBlockImpl::DownloadFinished(const JsValueList& args) {
   --downloading_count_;
 }
 
+void AdBlockImpl::WhitelistChanged(const JsValueList& args) {
+  whitelist_cache_.Invalidate();
+}
+
+void AdBlockImpl::FiltersLoaded(const JsValueList& args) {
+  StartupProfile* profile = env_->startup_profile();
+  if (profile->Finish("filters_loaded")) {
+    LOG(INFO) << "Startup phases: " << profile->ToString();
+  }
+  startup()->Reach(FILTERS_LOADED);
+}
+
+void AdBlockImpl::FirstSyncDone(const JsValueList& args) {
+  startup()->Reach(FIRST_SYNC_DONE);
+}
+
 }  // namespace adblock
@@ -2,45 +2,136 @@
 #define ADBLOCK_IMPL_H_
 
 #include "adblock.h"
+#include "engine_stats.h"
+#include "filter_index.h"
 #include "js_value.h"
 #include "ipc.h"
+#include "query_executor.h"
+#include "report_aggregator.h"
+#include "report_channel.h"
+#include "request_capture.h"
+#include "whitelist_cache.h"
+
+#include <map>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace adblock {
 
+class EngineLock;
 class Environment;
 
-class AdBlockImpl : public AdBlock {
+class AdBlockImpl : public AsyncAdBlock {
  public:
   AdBlockImpl();
   ~AdBlockImpl();
 
   bool Init();
+  // Init() on a thread of its own, see CreateInstanceAsync()
+  void InitAsync();
 
   bool block_ads();
   bool block_malware();
   bool dont_track_me();
+  void AddConfigCallback(const ConfigCallback& callback);
 
   std::string CheckFilterMatch(const std::string& location,
                                const std::string& type,
                                const std::string& document);
+  std::uint32_t BeginDocument(const std::string& document);
+  std::string CheckFilterMatch(std::uint32_t document,
+                               const std::string& location,
+                               const std::string& type);
+  void EndDocument(std::uint32_t document);
   std::string GetElementHidingSelectors(const std::string& domain);
   bool IsWhitelisted(const std::string& url, const std::string& parent_url,
                      const std::string& type);
-  void ToggleEnabled(const std::string& url, bool enabled);
+  bool ToggleEnabled(const std::string& url, bool enabled);
   std::string GenerateCSSContent();
   void Report(const std::string& type, const std::string& documentUrl,
               const std::string& url, const std::string& rule);
   std::uint8_t GetDownloadingTask();
+  std::string GetStats();
 
  private:
   Environment* env_;
   AdblockConfig config_;
-  AdblockSender sender_;
+  ReportWriter reporter_;
+  ReportAggregator aggregator_;
+  std::string process_name_;
   std::uint8_t downloading_count_;
+  RequestCapture capture_;
+  EngineStats stats_;
+  // Addresses of the open documents and of the last ones the scripts
+  // evicted, for the request capture and as the scripts' fallback
+  boost::mutex documents_mutex_;
+  std::map<std::uint32_t, std::string> documents_;
+  // Kept apart from the environment, the whitelist cache reads its
+  // generation without locking the engine
+  FilterIndexPtr filter_index_;
+  WhitelistCache whitelist_cache_;
+  boost::thread init_thread_;
+
+  bool Load(v8::Isolate* isolate);
+  // Applies the startup policy, false if the query has to give its default
+  // answer because the engine isn't ready. Sets |*timed_out| then, if given.
+  bool AwaitStartup(std::uint64_t deadline, bool* timed_out);
+  // Waits for the scripts as the startup policy and the query budget allow,
+  // false if they can't be used yet: the caller returns its empty answer or
+  // does nothing then.
+  bool AwaitCode();
+
+  // Same as the public queries, but give the default answer if the engine
+  // isn't ready or can't be locked before |deadline|, 0 waits. A query that
+  // missed the lock still makes its script call in the background to warm
+  // the caches. The public queries pass the deadline of the query budget,
+  // asynchronous ones their own.
+  std::string CheckFilterMatchBefore(const std::string& location,
+                                     const std::string& type,
+                                     const std::string& document,
+                                     std::uint64_t deadline, bool* timed_out);
+  std::string CheckDocumentMatchBefore(std::uint32_t document,
+                                       const std::string& location,
+                                       const std::string& type,
+                                       std::uint64_t deadline,
+                                       bool* timed_out);
+  std::string GetElementHidingSelectorsBefore(const std::string& domain,
+                                              std::uint64_t deadline,
+                                              bool* timed_out);
+  bool IsWhitelistedBefore(const std::string& url,
+                           const std::string& parent_url,
+                           const std::string& type, std::uint64_t deadline,
+                           bool* timed_out);
+  // The script calls of the queries above, the caller holds the EngineLock
+  std::string CallCheckFilterMatch(const std::string& location,
+                                   const std::string& type,
+                                   const std::string& document);
+  std::string CallCheckDocumentMatch(std::uint32_t document,
+                                     const std::string& location,
+                                     const std::string& type,
+                                     const std::string& document_url);
+  std::string CallGetElementHidingSelectors(const std::string& domain);
+  // Also stores the answer in the whitelist cache under |key|
+  bool CallIsWhitelisted(const std::string& url, const std::string& parent_url,
+                         const std::string& type, const std::string& key);
+
+  std::string DefaultMatch();
+  // Deadline of a query made now from the configured budget, 0 if none
+  std::uint64_t QueryDeadline();
+  bool LockEngine(EngineLock* lock, std::uint64_t deadline);
+  // Makes a script call that missed its deadline once no asynchronous query
+  // is waiting, without recording it in the stats or the capture
+  void FinishLater(const boost::function<void()>& call);
+  void FinishLate(const boost::function<void()>& call);
 
   void DownloadStart(const JsValueList& args);
   void DownloadFinished(const JsValueList& args);
-  std::string GetCurrentProcessName();
+  void WhitelistChanged(const JsValueList& args);
+  void FiltersLoaded(const JsValueList& args);
+  void FirstSyncDone(const JsValueList& args);
+  void UpdateCapture(const AdblockSettings& settings);
+  void UpdateStatsLog(const AdblockSettings& settings);
 };
 
 }  // namespace adblock
@@ -0,0 +1,933 @@
+#include "daemon_channel.h"
+#include "process_util.h"
+
+#include <climits>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif  // WIN32
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/thread/thread.hpp>
+#include <glog/logging.h>
+
+namespace adblock {
+
+namespace ipc = boost::interprocess;
+
+namespace {
+
+const char kSegmentName[] =
+    "asdv2_adblock_daemon_{5095C5F0-D82D-4442-9A62-8769871F42D1}";
+const char kChannelName[] = "DaemonChannel";
+
+// Power of two, the request queue has one cell per slot so it can't overflow
+const std::uint32_t kSlotCount = 64;
+// Payloads that don't fit into the slot are allocated from the segment
+const std::uint32_t kSlotData = 16 * 1024;
+const size_t kHeapSize = 16 * 1024 * 1024;
+
+// Checks of the slot before a client goes to sleep, a round trip to an idle
+// daemon usually completes within them
+const int kSpinCount = 4000;
+// Milliseconds between checks whether the other side is still alive
+const int kWaitSlice = 50;
+// Milliseconds a client waits for an answer before failing open
+const int kCallTimeout = 5000;
+// Seconds between attempts to reach a daemon that is not running
+const std::time_t kReconnectInterval = 5;
+// Seconds between checks for slots left behind by exited clients
+const std::time_t kReapInterval = 5;
+
+// The queue and slot states are shared between processes
+BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT_LOCK_FREE == 2);
+
+// A request is SERVING once a worker picked it up. A client that gives up
+// waiting marks a request ABANDONED if no worker has it yet, anyone may
+// release the slot then. A request that is being served is CANCELLED
+// instead, its worker releases the slot.
+enum SlotState { IDLE, REQUEST, RESPONSE, ABANDONED, SERVING, CANCELLED };
+
+enum Method {
+  CHECK_FILTER_MATCH,
+  GET_ELEMENT_HIDING_SELECTORS,
+  IS_WHITELISTED,
+  TOGGLE_ENABLED,
+  GENERATE_CSS_CONTENT,
+  GET_DOWNLOADING_TASK,
+  GET_STATS,
+  BEGIN_DOCUMENT,
+  CHECK_DOCUMENT_MATCH,
+  END_DOCUMENT
+};
+
+// Answers given while the daemon can't be reached
+const char kNoMatch[] = "{\"type\":0}";
+const char kNoSelectors[] =
+    "{\"host\": \"\", \"hostDomain\": \"\", \"selectors\": []}";
+
+// Event 0 is the doorbell of the daemon, event 1 + n the one of slot n
+const size_t kDoorbellEvent = 0;
+
+inline size_t SlotEvent(std::uint32_t index) { return 1 + index; }
+
+// Documents are named "<daemon pid>:<handle>" between the processes, so a
+// restarted daemon can tell handles of its predecessor from its own
+std::string DocumentToken(std::uint32_t handle) {
+  std::stringstream token;
+  token << CurrentProcessId() << ":" << handle;
+  return token.str();
+}
+
+bool ParseDocumentToken(const std::string& token, std::uint32_t* handle) {
+  std::stringstream stream(token);
+  std::uint32_t pid;
+  char separator;
+  return stream >> pid >> separator >> *handle && separator == ':' &&
+         pid == CurrentProcessId();
+}
+
+size_t EncodedSize(const std::vector<std::string>& args) {
+  size_t size = 0;
+  for (auto it = args.begin(); it != args.end(); ++it) {
+    size += sizeof(std::uint32_t) + it->length();
+  }
+  return size;
+}
+
+// Arguments are stored as length prefixed strings
+void Encode(const std::vector<std::string>& args, char* out) {
+  for (auto it = args.begin(); it != args.end(); ++it) {
+    std::uint32_t length = static_cast<std::uint32_t>(it->length());
+    std::memcpy(out, &length, sizeof(length));
+    out += sizeof(length);
+    std::memcpy(out, it->data(), length);
+    out += length;
+  }
+}
+
+bool Decode(const char* data, size_t size, std::vector<std::string>* args) {
+  size_t pos = 0;
+  while (pos < size) {
+    std::uint32_t length;
+    if (size - pos < sizeof(length)) {
+      return false;
+    }
+    std::memcpy(&length, data + pos, sizeof(length));
+    pos += sizeof(length);
+    if (size - pos < length) {
+      return false;
+    }
+    args->push_back(std::string(data + pos, length));
+    pos += length;
+  }
+  return true;
+}
+
+}  // namespace
+
+struct DaemonSlot {
+  // Client process using the slot, 0 if it's free
+  boost::atomic<std::uint32_t> owner;
+  boost::atomic<std::uint32_t> state;
+  std::uint32_t method;
+  std::uint32_t size;
+  // Handle of a payload allocated from the segment, -1 if it is in data
+  std::int64_t large;
+  char data[kSlotData];
+};
+
+struct QueueCell {
+  boost::atomic<std::uint32_t> sequence;
+  std::uint32_t slot;
+};
+
+struct DaemonChannel {
+  boost::atomic<std::uint32_t> daemon_pid;
+  // Bumped for every queued request, workers sleep on it
+  boost::atomic<std::uint32_t> doorbell;
+  boost::atomic<std::uint32_t> sleepers;
+  char padding0[64];
+  boost::atomic<std::uint32_t> enqueue_position;
+  char padding1[64];
+  boost::atomic<std::uint32_t> dequeue_position;
+  char padding2[64];
+  QueueCell queue[kSlotCount];
+  DaemonSlot slots[kSlotCount];
+
+  DaemonChannel() : daemon_pid(0), doorbell(0), sleepers(0) {
+    enqueue_position.store(0);
+    dequeue_position.store(0);
+    for (std::uint32_t idx = 0; idx < kSlotCount; ++idx) {
+      queue[idx].sequence.store(idx);
+      slots[idx].owner.store(0);
+      slots[idx].state.store(IDLE);
+      slots[idx].large = -1;
+    }
+  }
+
+  // Bounded multi-producer/multi-consumer queue of slot numbers
+  bool Enqueue(std::uint32_t slot) {
+    std::uint32_t position = enqueue_position.load(boost::memory_order_relaxed);
+    while (true) {
+      QueueCell* cell = &queue[position & (kSlotCount - 1)];
+      std::uint32_t sequence = cell->sequence.load(boost::memory_order_acquire);
+      std::int32_t diff = static_cast<std::int32_t>(sequence - position);
+      if (diff == 0) {
+        if (enqueue_position.compare_exchange_weak(
+                position, position + 1, boost::memory_order_relaxed)) {
+          cell->slot = slot;
+          cell->sequence.store(position + 1, boost::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = enqueue_position.load(boost::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool Dequeue(std::uint32_t* slot) {
+    std::uint32_t position = dequeue_position.load(boost::memory_order_relaxed);
+    while (true) {
+      QueueCell* cell = &queue[position & (kSlotCount - 1)];
+      std::uint32_t sequence = cell->sequence.load(boost::memory_order_acquire);
+      std::int32_t diff = static_cast<std::int32_t>(sequence - (position + 1));
+      if (diff == 0) {
+        if (dequeue_position.compare_exchange_weak(
+                position, position + 1, boost::memory_order_relaxed)) {
+          *slot = cell->slot;
+          cell->sequence.store(position + kSlotCount,
+                               boost::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = dequeue_position.load(boost::memory_order_relaxed);
+      }
+    }
+  }
+};
+
+// Sleeping on words in shared memory. Linux futexes work on any shared
+// mapping, Windows gets one named auto-reset event per word instead.
+class DaemonWaiter {
+ public:
+  DaemonWaiter() {}
+  ~DaemonWaiter();
+
+  // Returns once |word| no longer holds |value|, on a wakeup or after
+  // |timeout| milliseconds, whatever comes first.
+  void Wait(boost::atomic<std::uint32_t>* word, std::uint32_t value,
+            size_t event, int timeout);
+  void Wake(boost::atomic<std::uint32_t>* word, size_t event, bool all);
+
+ private:
+#ifdef WIN32
+  boost::mutex mutex_;
+  std::vector<HANDLE> events_;
+
+  HANDLE Event(size_t event);
+#endif  // WIN32
+};
+
+#ifdef WIN32
+
+DaemonWaiter::~DaemonWaiter() {
+  for (auto it = events_.begin(); it != events_.end(); ++it) {
+    if (*it != NULL) {
+      CloseHandle(*it);
+    }
+  }
+}
+
+HANDLE DaemonWaiter::Event(size_t event) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (events_.size() <= event) {
+    events_.resize(event + 1, NULL);
+  }
+  if (events_[event] == NULL) {
+    std::stringstream name;
+    name << "asdv2_adblock_daemon_" << event
+         << "_{5095C5F0-D82D-4442-9A62-8769871F42D1}";
+    events_[event] = CreateEventA(NULL, FALSE, FALSE, name.str().c_str());
+  }
+  return events_[event];
+}
+
+void DaemonWaiter::Wait(boost::atomic<std::uint32_t>* word,
+                        std::uint32_t value, size_t event, int timeout) {
+  HANDLE handle = Event(event);
+  if (word->load(boost::memory_order_acquire) != value) {
+    return;
+  }
+  // A wakeup between the check and the wait leaves the event set
+  WaitForSingleObject(handle, handle != NULL ? timeout : 1);
+}
+
+void DaemonWaiter::Wake(boost::atomic<std::uint32_t>* /*word*/, size_t event,
+                        bool /*all*/) {
+  HANDLE handle = Event(event);
+  if (handle != NULL) {
+    SetEvent(handle);
+  }
+}
+
+#else
+
+DaemonWaiter::~DaemonWaiter() {}
+
+void DaemonWaiter::Wait(boost::atomic<std::uint32_t>* word,
+                        std::uint32_t value, size_t /*event*/, int timeout) {
+  struct timespec relative;
+  relative.tv_sec = timeout / 1000;
+  relative.tv_nsec = (timeout % 1000) * 1000000L;
+  // Not FUTEX_PRIVATE_FLAG, the word is shared with other processes
+  syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAIT,
+          static_cast<int>(value), &relative, nullptr, 0);
+}
+
+void DaemonWaiter::Wake(boost::atomic<std::uint32_t>* word,
+                        size_t /*event*/, bool all) {
+  syscall(SYS_futex, reinterpret_cast<int*>(word), FUTEX_WAKE,
+          all ? INT_MAX : 1, nullptr, nullptr, 0);
+}
+
+#endif  // WIN32
+
+DaemonServer::DaemonServer(AdBlockPtr engine)
+    : engine_(engine),
+      segment_(nullptr),
+      channel_(nullptr),
+      waiter_(new DaemonWaiter()),
+      stopping_(false),
+      next_reap_(0) {}
+
+DaemonServer::~DaemonServer() {
+  if (channel_ != nullptr) {
+    channel_->daemon_pid.store(0, boost::memory_order_release);
+  }
+  delete segment_;
+  if (segment_ != nullptr) {
+    ipc::shared_memory_object::remove(kSegmentName);
+  }
+}
+
+bool DaemonServer::Create() {
+  try {
+    // A segment left behind by a daemon that crashed is replaced
+    try {
+      ipc::managed_shared_memory existing(ipc::open_only, kSegmentName);
+      DaemonChannel* channel =
+          existing.find<DaemonChannel>(kChannelName).first;
+      if (channel != nullptr) {
+        std::uint32_t pid = channel->daemon_pid.load();
+        if (pid != 0 && ProcessExists(pid)) {
+          LOG(ERROR) << "Filtering daemon " << pid << " is running already";
+          return false;
+        }
+      }
+    }
+    catch (const ipc::interprocess_exception&) {
+    }
+    ipc::shared_memory_object::remove(kSegmentName);
+
+    segment_ = new ipc::managed_shared_memory(
+        ipc::create_only, kSegmentName, sizeof(DaemonChannel) + kHeapSize);
+    channel_ = segment_->construct<DaemonChannel>(kChannelName)();
+    channel_->daemon_pid.store(CurrentProcessId(),
+                               boost::memory_order_release);
+  }
+  catch (const ipc::interprocess_exception& e) {
+    LOG(ERROR) << "Failed to create the daemon segment: " << e.what();
+    delete segment_;
+    segment_ = nullptr;
+    channel_ = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void DaemonServer::Run(int threads) {
+  if (channel_ == nullptr) {
+    return;
+  }
+  boost::thread_group workers;
+  for (int idx = 1; idx < threads; ++idx) {
+    workers.create_thread(boost::bind(&DaemonServer::Work, this));
+  }
+  Work();
+  workers.join_all();
+}
+
+void DaemonServer::Stop() {
+  stopping_.store(true);
+  if (channel_ != nullptr) {
+    channel_->doorbell.fetch_add(1);
+    waiter_->Wake(&channel_->doorbell, kDoorbellEvent, true);
+  }
+}
+
+void DaemonServer::Work() {
+  while (!stopping_.load()) {
+    std::uint32_t index;
+    if (channel_->Dequeue(&index)) {
+      Serve(index);
+      continue;
+    }
+
+    // Clients only ring when someone sleeps, so announce it before the
+    // doorbell is read and the queue checked once more
+    channel_->sleepers.fetch_add(1);
+    std::uint32_t doorbell = channel_->doorbell.load();
+    if (channel_->Dequeue(&index)) {
+      channel_->sleepers.fetch_sub(1);
+      Serve(index);
+      continue;
+    }
+    waiter_->Wait(&channel_->doorbell, doorbell, kDoorbellEvent,
+                  kReapInterval * 1000 / 10);
+    channel_->sleepers.fetch_sub(1);
+    Reap();
+  }
+  // The auto-reset doorbell of Windows wakes one worker at a time, each
+  // one wakes the next on its way out
+  channel_->doorbell.fetch_add(1);
+  waiter_->Wake(&channel_->doorbell, kDoorbellEvent, true);
+}
+
+void DaemonServer::Serve(std::uint32_t index) {
+  DaemonSlot* slot = &channel_->slots[index];
+  std::uint32_t expected = REQUEST;
+  if (!slot->state.compare_exchange_strong(expected, SERVING)) {
+    // The client gave up before anyone picked the request up
+    if (expected == ABANDONED) {
+      Release(slot, ABANDONED);
+    }
+    return;
+  }
+
+  std::vector<std::string> args;
+  bool valid;
+  if (slot->large >= 0) {
+    char* data = static_cast<char*>(
+        segment_->get_address_from_handle(
+            static_cast<ipc::managed_shared_memory::handle_t>(slot->large)));
+    valid = Decode(data, slot->size, &args);
+    segment_->deallocate(data);
+    slot->large = -1;
+  } else {
+    valid = slot->size <= kSlotData && Decode(slot->data, slot->size, &args);
+  }
+
+  std::string response;
+  if (valid) {
+    try {
+      response = Dispatch(slot->method, args);
+    }
+    catch (const std::exception& e) {
+      LOG(ERROR) << "Daemon request " << slot->method << " failed: "
+                 << e.what();
+    }
+  }
+
+  slot->size = static_cast<std::uint32_t>(response.length());
+  if (response.length() > kSlotData) {
+    void* data = segment_->allocate(response.length(), std::nothrow);
+    if (data != nullptr) {
+      std::memcpy(data, response.data(), response.length());
+      slot->large = segment_->get_handle_from_address(data);
+    } else {
+      LOG(ERROR) << "No room for a response of " << response.length()
+                 << " bytes";
+      slot->size = 0;
+    }
+  } else {
+    std::memcpy(slot->data, response.data(), response.length());
+  }
+
+  expected = SERVING;
+  if (!slot->state.compare_exchange_strong(expected, RESPONSE)) {
+    // The client gave up waiting, the slot is ours to release
+    Release(slot, CANCELLED);
+    return;
+  }
+  waiter_->Wake(&slot->state, SlotEvent(index), true);
+}
+
+bool DaemonServer::Release(DaemonSlot* slot, std::uint32_t state) {
+  // Only one of the workers and the reaper gets to free the payload
+  if (!slot->state.compare_exchange_strong(state, IDLE)) {
+    return false;
+  }
+  if (slot->large >= 0) {
+    segment_->deallocate(segment_->get_address_from_handle(
+        static_cast<ipc::managed_shared_memory::handle_t>(slot->large)));
+    slot->large = -1;
+  }
+  slot->owner.store(0, boost::memory_order_release);
+  return true;
+}
+
+std::string DaemonServer::Dispatch(std::uint32_t method,
+                                   const std::vector<std::string>& args) {
+  switch (method) {
+    case CHECK_FILTER_MATCH:
+      if (args.size() == 3) {
+        return engine_->CheckFilterMatch(args[0], args[1], args[2]);
+      }
+      break;
+    case GET_ELEMENT_HIDING_SELECTORS:
+      if (args.size() == 1) {
+        return engine_->GetElementHidingSelectors(args[0]);
+      }
+      break;
+    case IS_WHITELISTED:
+      if (args.size() == 3) {
+        return engine_->IsWhitelisted(args[0], args[1], args[2]) ? "1" : "0";
+      }
+      break;
+    case TOGGLE_ENABLED:
+      if (args.size() == 2) {
+        return engine_->ToggleEnabled(args[0], args[1] == "1") ? "1" : "0";
+      }
+      break;
+    case GENERATE_CSS_CONTENT:
+      return engine_->GenerateCSSContent();
+    case GET_DOWNLOADING_TASK:
+      return std::string(1, static_cast<char>(engine_->GetDownloadingTask()));
+    case GET_STATS:
+      return engine_->GetStats();
+    case BEGIN_DOCUMENT:
+      if (args.size() == 1) {
+        return DocumentToken(engine_->BeginDocument(args[0]));
+      }
+      break;
+    case CHECK_DOCUMENT_MATCH:
+      if (args.size() == 3) {
+        // An empty answer asks the client to begin the document again
+        std::uint32_t handle;
+        if (!ParseDocumentToken(args[0], &handle)) {
+          return "";
+        }
+        return engine_->CheckFilterMatch(handle, args[1], args[2]);
+      }
+      break;
+    case END_DOCUMENT:
+      if (args.size() == 1) {
+        std::uint32_t handle;
+        if (ParseDocumentToken(args[0], &handle)) {
+          engine_->EndDocument(handle);
+        }
+        return "";
+      }
+      break;
+  }
+  LOG(ERROR) << "Invalid daemon request " << method;
+  return "";
+}
+
+void DaemonServer::Reap() {
+  boost::mutex::scoped_lock lock(reap_mutex_, boost::try_to_lock);
+  std::time_t now = std::time(nullptr);
+  if (!lock.owns_lock() || now < next_reap_) {
+    return;
+  }
+  next_reap_ = now + kReapInterval;
+
+  for (std::uint32_t idx = 0; idx < kSlotCount; ++idx) {
+    DaemonSlot* slot = &channel_->slots[idx];
+    std::uint32_t state = slot->state.load(boost::memory_order_acquire);
+    // Abandoned requests whose queue entry got lost, whoever the client is
+    if (state == ABANDONED) {
+      Release(slot, ABANDONED);
+      continue;
+    }
+    std::uint32_t owner = slot->owner.load(boost::memory_order_acquire);
+    // Requests that are queued or being served are released by a worker
+    if (owner == 0 || ProcessExists(owner) || state == REQUEST ||
+        state == SERVING || state == CANCELLED) {
+      continue;
+    }
+    Release(slot, state);
+  }
+}
+
+DaemonClient::DaemonClient()
+    : aggregator_(&reporter_),
+      process_name_(CurrentProcessName()),
+      waiter_(new DaemonWaiter()),
+      next_connect_(0),
+      next_document_(1) {
+  connection_.channel = nullptr;
+  connection_.daemon_pid = 0;
+  config_.AddChangeCallback(
+      boost::bind(&ReportAggregator::Flush, &aggregator_));
+}
+
+DaemonClient::~DaemonClient() {
+  StopQueries();
+  boost::mutex::scoped_lock lock(mutex_);
+  if (connection_.channel != nullptr) {
+    for (auto it = free_slots_.begin(); it != free_slots_.end(); ++it) {
+      connection_.channel->slots[*it].owner.store(0);
+    }
+  }
+}
+
+bool DaemonClient::Connect() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return ConnectLocked();
+}
+
+bool DaemonClient::ConnectLocked() {
+  if (connection_.channel != nullptr) {
+    return true;
+  }
+  std::time_t now = std::time(nullptr);
+  if (now < next_connect_) {
+    return false;
+  }
+  next_connect_ = now + kReconnectInterval;
+
+  try {
+    SegmentPtr segment(new Segment(ipc::open_only, kSegmentName));
+    DaemonChannel* channel = segment->find<DaemonChannel>(kChannelName).first;
+    if (channel == nullptr) {
+      return false;
+    }
+    std::uint32_t pid = channel->daemon_pid.load(boost::memory_order_acquire);
+    if (pid == 0 || !ProcessExists(pid)) {
+      return false;
+    }
+    connection_.segment = segment;
+    connection_.channel = channel;
+    connection_.daemon_pid = pid;
+    free_slots_.clear();
+  }
+  catch (const ipc::interprocess_exception&) {
+    return false;
+  }
+  return true;
+}
+
+void DaemonClient::Disconnect(const Connection& connection) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (connection_.channel != connection.channel) {
+    return;
+  }
+  LOG(ERROR) << "Lost the filtering daemon " << connection.daemon_pid;
+  connection_.segment.reset();
+  connection_.channel = nullptr;
+  connection_.daemon_pid = 0;
+  free_slots_.clear();
+  next_connect_ = std::time(nullptr) + kReconnectInterval;
+}
+
+bool DaemonClient::AcquireSlot(std::uint32_t* index, Connection* connection) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (!ConnectLocked()) {
+    return false;
+  }
+  *connection = connection_;
+  if (!free_slots_.empty()) {
+    *index = free_slots_.back();
+    free_slots_.pop_back();
+    return true;
+  }
+
+  std::uint32_t pid = CurrentProcessId();
+  for (std::uint32_t idx = 0; idx < kSlotCount; ++idx) {
+    std::uint32_t expected = 0;
+    if (connection_.channel->slots[idx].owner.compare_exchange_strong(
+            expected, pid)) {
+      *index = idx;
+      return true;
+    }
+  }
+  LOG(ERROR) << "All daemon slots are taken";
+  return false;
+}
+
+void DaemonClient::ReleaseSlot(std::uint32_t index,
+                               const Connection& connection) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (connection_.channel == connection.channel) {
+    free_slots_.push_back(index);
+  }
+}
+
+bool DaemonClient::Call(std::uint32_t method,
+                        const std::vector<std::string>& args,
+                        std::string* response) {
+  std::uint32_t index;
+  Connection connection;
+  if (!AcquireSlot(&index, &connection)) {
+    return false;
+  }
+  Segment* segment = connection.segment.get();
+  DaemonChannel* channel = connection.channel;
+  DaemonSlot* slot = &channel->slots[index];
+
+  size_t size = EncodedSize(args);
+  if (size > kSlotData) {
+    void* data = segment->allocate(size, std::nothrow);
+    if (data == nullptr) {
+      ReleaseSlot(index, connection);
+      return false;
+    }
+    Encode(args, static_cast<char*>(data));
+    slot->large = segment->get_handle_from_address(data);
+  } else {
+    Encode(args, slot->data);
+  }
+  slot->method = method;
+  slot->size = static_cast<std::uint32_t>(size);
+  slot->state.store(REQUEST, boost::memory_order_release);
+
+  if (!channel->Enqueue(index)) {
+    // Nobody saw the request, the slot is still ours
+    LOG(ERROR) << "Daemon request queue is full";
+    if (slot->large >= 0) {
+      segment->deallocate(segment->get_address_from_handle(
+          static_cast<Segment::handle_t>(slot->large)));
+      slot->large = -1;
+    }
+    slot->state.store(IDLE, boost::memory_order_release);
+    ReleaseSlot(index, connection);
+    return false;
+  }
+  channel->doorbell.fetch_add(1);
+  if (channel->sleepers.load() != 0) {
+    waiter_->Wake(&channel->doorbell, kDoorbellEvent, false);
+  }
+
+  boost::chrono::steady_clock::time_point deadline =
+      boost::chrono::steady_clock::now() +
+      boost::chrono::milliseconds(kCallTimeout);
+  for (int spin = 0; spin < kSpinCount; ++spin) {
+    std::uint32_t state = slot->state.load(boost::memory_order_acquire);
+    if (state != REQUEST && state != SERVING) {
+      break;
+    }
+  }
+  std::uint32_t state;
+  while ((state = slot->state.load(boost::memory_order_acquire)) == REQUEST ||
+         state == SERVING) {
+    waiter_->Wait(&slot->state, state, SlotEvent(index), kWaitSlice);
+    state = slot->state.load(boost::memory_order_acquire);
+    if (state != REQUEST && state != SERVING) {
+      break;
+    }
+    if (boost::chrono::steady_clock::now() >= deadline ||
+        !ProcessExists(connection.daemon_pid)) {
+      // The daemon releases the slot
+      std::uint32_t expected = state;
+      if (slot->state.compare_exchange_strong(
+              expected, state == REQUEST ? ABANDONED : CANCELLED)) {
+        LOG(ERROR) << "Daemon request " << method << " timed out";
+        if (!ProcessExists(connection.daemon_pid)) {
+          Disconnect(connection);
+        }
+        return false;
+      }
+    }
+  }
+
+  if (slot->large >= 0) {
+    void* data = segment->get_address_from_handle(
+        static_cast<Segment::handle_t>(slot->large));
+    response->assign(static_cast<const char*>(data), slot->size);
+    segment->deallocate(data);
+    slot->large = -1;
+  } else {
+    response->assign(slot->data, slot->size);
+  }
+  slot->state.store(IDLE, boost::memory_order_release);
+  ReleaseSlot(index, connection);
+  return true;
+}
+
+bool DaemonClient::block_ads() { return config_.block_ads(); }
+
+bool DaemonClient::block_malware() { return config_.block_malware(); }
+
+bool DaemonClient::dont_track_me() { return config_.dont_track_me(); }
+
+void DaemonClient::AddConfigCallback(const ConfigCallback& callback) {
+  config_.AddChangeCallback(boost::bind(callback));
+}
+
+std::string DaemonClient::CheckFilterMatch(const std::string& location,
+                                           const std::string& type,
+                                           const std::string& document) {
+  std::vector<std::string> args;
+  args.push_back(location);
+  args.push_back(type);
+  args.push_back(document);
+  std::string response;
+  if (!Call(CHECK_FILTER_MATCH, args, &response)) {
+    return kNoMatch;
+  }
+  return response;
+}
+
+std::uint32_t DaemonClient::BeginDocument(const std::string& document) {
+  // The daemon learns about the document with its first sub-resource
+  boost::mutex::scoped_lock lock(documents_mutex_);
+  std::uint32_t handle = next_document_++;
+  documents_[handle].url = document;
+  documents_.erase(handle - MAX_OPEN_DOCUMENTS);
+  return handle;
+}
+
+std::string DaemonClient::CheckFilterMatch(std::uint32_t document,
+                                           const std::string& location,
+                                           const std::string& type) {
+  Document entry;
+  {
+    boost::mutex::scoped_lock lock(documents_mutex_);
+    auto it = documents_.find(document);
+    if (it == documents_.end()) {
+      return kNoMatch;
+    }
+    entry = it->second;
+  }
+
+  // A second attempt after the daemon was restarted
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (entry.token.empty()) {
+      std::vector<std::string> args;
+      args.push_back(entry.url);
+      if (!Call(BEGIN_DOCUMENT, args, &entry.token) || entry.token.empty()) {
+        break;
+      }
+      boost::mutex::scoped_lock lock(documents_mutex_);
+      auto it = documents_.find(document);
+      if (it != documents_.end()) {
+        it->second.token = entry.token;
+      }
+    }
+
+    std::vector<std::string> args;
+    args.push_back(entry.token);
+    args.push_back(location);
+    args.push_back(type);
+    std::string response;
+    if (!Call(CHECK_DOCUMENT_MATCH, args, &response)) {
+      return kNoMatch;
+    }
+    if (!response.empty()) {
+      return response;
+    }
+    entry.token.clear();
+  }
+  return CheckFilterMatch(location, type, entry.url);
+}
+
+void DaemonClient::EndDocument(std::uint32_t document) {
+  std::string token;
+  {
+    boost::mutex::scoped_lock lock(documents_mutex_);
+    auto it = documents_.find(document);
+    if (it == documents_.end()) {
+      return;
+    }
+    token = it->second.token;
+    documents_.erase(it);
+  }
+  if (!token.empty()) {
+    std::vector<std::string> args;
+    args.push_back(token);
+    std::string response;
+    Call(END_DOCUMENT, args, &response);
+  }
+}
+
+std::string DaemonClient::GetElementHidingSelectors(
+    const std::string& domain) {
+  std::vector<std::string> args(1, domain);
+  std::string response;
+  if (!Call(GET_ELEMENT_HIDING_SELECTORS, args, &response)) {
+    return kNoSelectors;
+  }
+  return response;
+}
+
+bool DaemonClient::IsWhitelisted(const std::string& url,
+                                 const std::string& parent_url,
+                                 const std::string& type) {
+  std::vector<std::string> args;
+  args.push_back(url);
+  args.push_back(parent_url);
+  args.push_back(type);
+  std::string response;
+  return Call(IS_WHITELISTED, args, &response) && response == "1";
+}
+
+bool DaemonClient::ToggleEnabled(const std::string& url, bool enabled) {
+  std::vector<std::string> args;
+  args.push_back(url);
+  args.push_back(enabled ? "1" : "0");
+  std::string response;
+  return Call(TOGGLE_ENABLED, args, &response) && response == "1";
+}
+
+std::string DaemonClient::GenerateCSSContent() {
+  std::string response;
+  Call(GENERATE_CSS_CONTENT, std::vector<std::string>(), &response);
+  return response;
+}
+
+void DaemonClient::Report(const std::string& type,
+                          const std::string& documentUrl,
+                          const std::string& url, const std::string& rule) {
+  if (config_.raw_reports()) {
+    reporter_.Write(type, process_name_, documentUrl, url,
+                    url.length() ? rule : std::string());
+  } else {
+    aggregator_.Add(type, process_name_, documentUrl,
+                    url.length() ? rule : std::string());
+  }
+}
+
+std::uint8_t DaemonClient::GetDownloadingTask() {
+  std::string response;
+  if (!Call(GET_DOWNLOADING_TASK, std::vector<std::string>(), &response) ||
+      response.length() != 1) {
+    return 0;
+  }
+  return static_cast<std::uint8_t>(response[0]);
+}
+
+std::string DaemonClient::GetStats() {
+  std::string response;
+  if (!Call(GET_STATS, std::vector<std::string>(), &response)) {
+    return "{}";
+  }
+  return response;
+}
+
+void ConnectDaemon(AdBlockPtr* adblock) {
+  *adblock = nullptr;
+  DaemonClient* client = new DaemonClient();
+  if (client->Connect()) {
+    *adblock = AdBlockPtr(client);
+  } else {
+    delete client;
+  }
+}
+
+}  // namespace adblock
@@ -0,0 +1,137 @@
+#ifndef DAEMON_CHANNEL_H_
+#define DAEMON_CHANNEL_H_
+
+#include "adblock.h"
+#include "ipc.h"
+#include "query_executor.h"
+#include "report_aggregator.h"
+#include "report_channel.h"
+
+#include <ctime>
+#include <map>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace adblock {
+
+struct DaemonChannel;
+struct DaemonSlot;
+class DaemonWaiter;
+
+// Hosts one engine for all processes that connect to it. Clients put their
+// requests into slots of a shared segment and queue the slot numbers, the
+// worker threads answer in the same slot. Waiting happens on the shared
+// words themselves (futexes on Linux, named events on Windows).
+class DaemonServer {
+ public:
+  explicit DaemonServer(AdBlockPtr engine);
+  ~DaemonServer();
+
+  // Creates the shared segment, fails if another daemon is running.
+  bool Create();
+  // Serves requests on |threads| workers until Stop() is called.
+  void Run(int threads);
+  void Stop();
+
+ private:
+  AdBlockPtr engine_;
+  boost::interprocess::managed_shared_memory* segment_;
+  DaemonChannel* channel_;
+  boost::scoped_ptr<DaemonWaiter> waiter_;
+  boost::atomic<bool> stopping_;
+
+  boost::mutex reap_mutex_;
+  std::time_t next_reap_;
+
+  void Work();
+  void Serve(std::uint32_t index);
+  // Frees the payload and the slot if it still is in |state|, false if
+  // someone else released it
+  bool Release(DaemonSlot* slot, std::uint32_t state);
+  std::string Dispatch(std::uint32_t method,
+                       const std::vector<std::string>& args);
+  void Reap();
+};
+
+// Engine living in the daemon process. Filter queries are forwarded,
+// settings and reports are handled locally since they are shared memory
+// already. Queries fail open while the daemon is unreachable.
+class DaemonClient : public AsyncAdBlock {
+ public:
+  DaemonClient();
+  ~DaemonClient();
+
+  bool Connect();
+
+  bool block_ads();
+  bool block_malware();
+  bool dont_track_me();
+  void AddConfigCallback(const ConfigCallback& callback);
+
+  std::string CheckFilterMatch(const std::string& location,
+                               const std::string& type,
+                               const std::string& document);
+  std::uint32_t BeginDocument(const std::string& document);
+  std::string CheckFilterMatch(std::uint32_t document,
+                               const std::string& location,
+                               const std::string& type);
+  void EndDocument(std::uint32_t document);
+  std::string GetElementHidingSelectors(const std::string& domain);
+  bool IsWhitelisted(const std::string& url, const std::string& parent_url,
+                     const std::string& type);
+  bool ToggleEnabled(const std::string& url, bool enabled);
+  std::string GenerateCSSContent();
+  void Report(const std::string& type, const std::string& documentUrl,
+              const std::string& url, const std::string& rule);
+  std::uint8_t GetDownloadingTask();
+  std::string GetStats();
+
+ private:
+  typedef boost::interprocess::managed_shared_memory Segment;
+  typedef boost::shared_ptr<Segment> SegmentPtr;
+
+  // Calls in flight keep the segment mapped when the daemon goes away
+  struct Connection {
+    SegmentPtr segment;
+    DaemonChannel* channel;
+    std::uint32_t daemon_pid;
+  };
+
+  struct Document {
+    std::string url;
+    // Name of the document in the daemon, empty until it was begun there
+    std::string token;
+  };
+
+  AdblockConfig config_;
+  ReportWriter reporter_;
+  ReportAggregator aggregator_;
+  std::string process_name_;
+
+  boost::mutex mutex_;
+  Connection connection_;
+  boost::scoped_ptr<DaemonWaiter> waiter_;
+  std::time_t next_connect_;
+  // Slots claimed by this process that no thread is using right now
+  std::vector<std::uint32_t> free_slots_;
+
+  boost::mutex documents_mutex_;
+  std::map<std::uint32_t, Document> documents_;
+  std::uint32_t next_document_;
+
+  bool ConnectLocked();
+  void Disconnect(const Connection& connection);
+  bool AcquireSlot(std::uint32_t* index, Connection* connection);
+  void ReleaseSlot(std::uint32_t index, const Connection& connection);
+  bool Call(std::uint32_t method, const std::vector<std::string>& args,
+            std::string* response);
+};
+
+}  // namespace adblock
+
+#endif  // DAEMON_CHANNEL_H_
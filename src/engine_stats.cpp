@@ -0,0 +1,170 @@
+#include "engine_stats.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include <boost/chrono.hpp>
+#include <glog/logging.h>
+
+namespace adblock {
+
+namespace {
+
+const char* const kMethodNames[EngineStats::METHOD_COUNT] = {
+    "CheckFilterMatch", "GetElementHidingSelectors", "IsWhitelisted",
+    "ToggleEnabled", "GenerateCSSContent", "CheckFilterMatchInDocument"};
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : sum_(0), max_(0) {
+  for (size_t idx = 0; idx < BUCKET_COUNT; ++idx) {
+    buckets_[idx].store(0, boost::memory_order_relaxed);
+  }
+}
+
+size_t LatencyHistogram::BucketIndex(std::uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return static_cast<size_t>(value);
+  }
+  int magnitude = SUB_BUCKET_BITS;
+  while (magnitude < MAX_MAGNITUDE && (value >> (magnitude + 1)) != 0) {
+    ++magnitude;
+  }
+  if ((value >> (magnitude + 1)) != 0) {
+    return BUCKET_COUNT - 1;
+  }
+  // The bits below the leading one select the linear bucket
+  size_t sub = static_cast<size_t>(value >> (magnitude - SUB_BUCKET_BITS)) &
+               (SUB_BUCKETS - 1);
+  return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+std::uint64_t LatencyHistogram::BucketValue(size_t index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+  std::uint64_t top = SUB_BUCKETS + index % SUB_BUCKETS;
+  return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(std::uint64_t nanoseconds) {
+  sum_.fetch_add(nanoseconds, boost::memory_order_relaxed);
+  buckets_[BucketIndex(nanoseconds)].fetch_add(1, boost::memory_order_relaxed);
+  std::uint64_t max = max_.load(boost::memory_order_relaxed);
+  while (nanoseconds > max &&
+         !max_.compare_exchange_weak(max, nanoseconds,
+                                     boost::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::WriteJson(std::ostream* out) const {
+  static const double kPercentiles[] = {0.5, 0.9, 0.99, 0.999};
+  static const char* const kNames[] = {"p50_us", "p90_us", "p99_us",
+                                       "p999_us"};
+  const size_t count = sizeof(kPercentiles) / sizeof(kPercentiles[0]);
+
+  std::uint64_t buckets[BUCKET_COUNT];
+  std::uint64_t total = 0;
+  for (size_t idx = 0; idx < BUCKET_COUNT; ++idx) {
+    buckets[idx] = buckets_[idx].load(boost::memory_order_relaxed);
+    total += buckets[idx];
+  }
+
+  *out << "{\"calls\": " << total << ", \"mean_us\": "
+       << (total ? sum_.load(boost::memory_order_relaxed) / 1000.0 / total
+                 : 0);
+  size_t bucket = 0;
+  std::uint64_t seen = 0;
+  for (size_t idx = 0; idx < count; ++idx) {
+    // Nearest rank, the same definition "bench replay" uses
+    std::uint64_t rank =
+        static_cast<std::uint64_t>(kPercentiles[idx] * total + 0.999999);
+    while (bucket < BUCKET_COUNT && seen + buckets[bucket] < rank) {
+      seen += buckets[bucket++];
+    }
+    *out << ", \"" << kNames[idx] << "\": "
+         << (total ? BucketValue(std::min<size_t>(bucket, BUCKET_COUNT - 1)) /
+                         1000.0
+                   : 0);
+  }
+  *out << ", \"max_us\": " << max_.load(boost::memory_order_relaxed) / 1000.0
+       << "}";
+}
+
+EngineStats::EngineStats() : started_(Now()), dump_generation_(0) {
+  for (int method = 0; method < METHOD_COUNT; ++method) {
+    deadline_misses_[method].store(0, boost::memory_order_relaxed);
+  }
+}
+
+EngineStats::~EngineStats() { StopDump(); }
+
+std::uint64_t EngineStats::Now() {
+  return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+             boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void EngineStats::WriteJson(std::ostream* out) const {
+  // The caller's stream keeps its format
+  std::ios_base::fmtflags flags = out->flags();
+  std::streamsize precision = out->precision();
+  *out << std::fixed << std::setprecision(3)
+       << "\"uptime_s\": " << (Now() - started_) / 1000000000 << ", "
+       << "\"methods\": {";
+  for (int method = 0; method < METHOD_COUNT; ++method) {
+    *out << (method ? ", " : "") << "\"" << kMethodNames[method] << "\": ";
+    methods_[method].WriteJson(out);
+  }
+  *out << "}, \"lock_wait\": ";
+  lock_wait_.WriteJson(out);
+  *out << ", \"deadline_misses\": {";
+  for (int method = 0; method < METHOD_COUNT; ++method) {
+    *out << (method ? ", " : "") << "\"" << kMethodNames[method] << "\": "
+         << deadline_misses_[method].load(boost::memory_order_relaxed);
+  }
+  *out << "}";
+  out->flags(flags);
+  out->precision(precision);
+}
+
+void EngineStats::StartDump(int seconds, const DumpSource& source) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (thread_.joinable()) {
+    return;
+  }
+  thread_ = boost::thread(&EngineStats::Dump, this, seconds, source,
+                          dump_generation_);
+}
+
+void EngineStats::StopDump() {
+  // Taken out under the lock, so only one caller joins it and a dump
+  // started meanwhile gets a thread of its own
+  boost::thread thread;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!thread_.joinable()) {
+      return;
+    }
+    ++dump_generation_;
+    thread = boost::move(thread_);
+  }
+  wakeup_.notify_all();
+  thread.join();
+}
+
+void EngineStats::Dump(int seconds, DumpSource source,
+                       std::uint32_t generation) {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (generation == dump_generation_) {
+    wakeup_.timed_wait(lock, boost::posix_time::seconds(seconds));
+    if (generation != dump_generation_) {
+      break;
+    }
+    lock.unlock();
+    LOG(INFO) << "Engine stats: " << source();
+    lock.lock();
+  }
+}
+
+}  // namespace adblock
@@ -0,0 +1,114 @@
+#ifndef ENGINE_STATS_H_
+#define ENGINE_STATS_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace adblock {
+
+// Latency distribution with a bounded relative error, in the style of
+// HdrHistogram: every power of two is split into 16 linear buckets, so a
+// reported value is at most 1/16 above the real one. Recording is a few
+// relaxed atomic increments, readers see a slightly torn but usable view.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(std::uint64_t nanoseconds);
+  // Writes count, mean, percentiles and maximum in microseconds as JSON.
+  void WriteJson(std::ostream* out) const;
+
+ private:
+  enum {
+    SUB_BUCKET_BITS = 4,
+    SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+    // Values from 2^40 ns, about 18 minutes, on share the last bucket
+    MAX_MAGNITUDE = 40,
+    BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS
+  };
+
+  boost::atomic<std::uint64_t> sum_;
+  boost::atomic<std::uint64_t> max_;
+  boost::atomic<std::uint64_t> buckets_[BUCKET_COUNT];
+
+  static size_t BucketIndex(std::uint64_t value);
+  // Highest value that falls into |index|
+  static std::uint64_t BucketValue(size_t index);
+};
+
+// Counters of the engine that are cheap enough to stay on permanently.
+class EngineStats {
+ public:
+  enum Method {
+    CHECK_FILTER_MATCH,
+    GET_ELEMENT_HIDING_SELECTORS,
+    IS_WHITELISTED,
+    TOGGLE_ENABLED,
+    GENERATE_CSS_CONTENT,
+    CHECK_FILTER_MATCH_IN_DOCUMENT,
+    METHOD_COUNT
+  };
+
+  // Times a call from construction to destruction.
+  class Timer {
+   public:
+    Timer(EngineStats* stats, Method method)
+        : stats_(stats), method_(method), begin_(Now()) {}
+    ~Timer() { stats_->methods_[method_].Record(Now() - begin_); }
+
+   private:
+    EngineStats* stats_;
+    Method method_;
+    std::uint64_t begin_;
+  };
+
+  typedef boost::function<std::string()> DumpSource;
+
+  EngineStats();
+  ~EngineStats();
+
+  // Nanoseconds of a monotonic clock
+  static std::uint64_t Now();
+
+  void RecordLockWait(std::uint64_t begin) {
+    lock_wait_.Record(Now() - begin);
+  }
+  // |method| gave the default answer since the engine was busy
+  void RecordDeadlineMiss(Method method) {
+    deadline_misses_[method].fetch_add(1, boost::memory_order_relaxed);
+  }
+
+  // Writes the "uptime_s", "methods", "lock_wait" and "deadline_misses"
+  // members of the stats object, without the enclosing braces.
+  void WriteJson(std::ostream* out) const;
+
+  // Logs what |source| returns every |seconds| until StopDump() is called,
+  // does nothing while a dump is running.
+  void StartDump(int seconds, const DumpSource& source);
+  void StopDump();
+
+ private:
+  std::uint64_t started_;
+  LatencyHistogram methods_[METHOD_COUNT];
+  LatencyHistogram lock_wait_;
+  boost::atomic<std::uint64_t> deadline_misses_[METHOD_COUNT];
+
+  boost::mutex mutex_;
+  boost::condition_variable wakeup_;
+  // Bumped by StopDump(), a dump thread runs while it matches its own
+  std::uint32_t dump_generation_;
+  boost::thread thread_;
+
+  void Dump(int seconds, DumpSource source, std::uint32_t generation);
+};
+
+}  // namespace adblock
+
+#endif  // ENGINE_STATS_H_
@@ -26,7 +26,8 @@ namespace adblock {
 
 Environment::Environment(const v8::Local<v8::Context>& context)
     : isolate_(context->GetIsolate()),
-      context_(context->GetIsolate(), context) {
+      context_(context->GetIsolate(), context),
+      task_scheduler_(this) {
   event_map_.clear();
   timeout_threads_.clear();
 
@@ -46,10 +47,16 @@ Environment::Environment(const v8::Local<v8::Context>& context)
 
   google::InitGoogleLogging("adblock");
   FLAGS_log_dir = boost::filesystem::absolute("Logs", current_path_).string();
+#ifdef WIN32
   FLAGS_alsologtodbg = true;
+#endif  // WIN32
 }
 
 Environment::~Environment() {
+  // Completed requests would start threads on this environment
+  if (web_request_) {
+    web_request_->Stop();
+  }
   context_->SetAlignedPointerInEmbedderData(kContextEmbedderDataIndex, nullptr);
   for (auto it = timeout_threads_.begin(); it != timeout_threads_.end(); ++it) {
     (*it)->interrupt();
@@ -156,4 +163,11 @@ adblock::WebRequestPtr Environment::GetWebRequest() {
   return web_request_;
 }
 
+adblock::FilterIndexPtr Environment::GetFilterIndex() {
+  if (!filter_index_) {
+    filter_index_.reset(new FilterIndex());
+  }
+  return filter_index_;
+}
+
 }  // namespace adblock
@@ -3,11 +3,16 @@
 
 #include "js_value.h"
 #include "file_system.h"
+#include "filter_index.h"
 #include "log_system.h"
+#include "startup_profile.h"
+#include "task_scheduler.h"
 #include "web_request.h"
 
+#include <boost/chrono.hpp>
 #include <boost/unordered/unordered_map.hpp>
 #include <boost/function.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 #include <boost/thread/thread.hpp>
 
 namespace adblock {
@@ -52,8 +57,20 @@ class Environment {
   void SetWebRequest(WebRequestPtr web_reqeust);
   WebRequestPtr GetWebRequest();
 
+  FilterIndexPtr GetFilterIndex();
+
   inline ThreadGroup& GetTimeoutThreads() { return timeout_threads_; }
 
+  // Runs the tasks of scheduler.postTask()
+  TaskScheduler* task_scheduler() { return &task_scheduler_; }
+
+  // Phases of the startup, recorded by the engine and by profiler.begin()
+  // and profiler.end() of the scripts
+  StartupProfile* startup_profile() { return &startup_profile_; }
+
+  // Taken before the v8::Locker of the isolate, see EngineLock
+  boost::recursive_timed_mutex& engine_mutex() { return engine_mutex_; }
+
  private:
   explicit Environment(const v8::Local<v8::Context>& context);
   ~Environment();
@@ -69,7 +86,31 @@ class Environment {
   FileSystemPtr file_system_;
   LogSystemPtr log_system_;
   WebRequestPtr web_request_;
+  FilterIndexPtr filter_index_;
   std::string current_path_;
+  boost::recursive_timed_mutex engine_mutex_;
+  TaskScheduler task_scheduler_;
+  StartupProfile startup_profile_;
+};
+
+// Every thread takes this lock before it locks the isolate. Unlike
+// v8::Locker it can give up after a timeout, so a query can tell that the
+// engine is busy without waiting for it. Recursive like v8::Locker.
+class EngineLock {
+ public:
+  explicit EngineLock(Environment* env) : lock_(env->engine_mutex()) {}
+  // Leaves the locking to Lock() or TryLockFor()
+  EngineLock(Environment* env, boost::defer_lock_t)
+      : lock_(env->engine_mutex(), boost::defer_lock) {}
+
+  void Lock() { lock_.lock(); }
+  bool TryLockFor(boost::chrono::nanoseconds timeout) {
+    return lock_.try_lock_for(timeout);
+  }
+  bool owns_lock() const { return lock_.owns_lock(); }
+
+ private:
+  boost::unique_lock<boost::recursive_timed_mutex> lock_;
 };
 
 }  // namespace adblock
@@ -1,8 +1,10 @@
 #include "file_system.h"
 
 #include <sstream>
+#include <vector>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <zlib.h>
 
 namespace adblock {
 
@@ -14,6 +16,34 @@ class RuntimeErrorWithErrno : public std::runtime_error {
 
 namespace fs = boost::filesystem;
 
+namespace {
+
+const unsigned int kChunkSize = 64 * 1024;
+
+class GzFile {
+ public:
+  GzFile(const std::string& path, const char* mode)
+      : file_(gzopen(path.c_str(), mode)) {}
+  ~GzFile() { Close(); }
+
+  // Flushes what is left to write, Z_OK on success
+  int Close() {
+    int result = Z_OK;
+    if (file_) {
+      result = gzclose(file_);
+      file_ = nullptr;
+    }
+    return result;
+  }
+
+  operator gzFile() const { return file_; }
+
+ private:
+  gzFile file_;
+};
+
+}  // namespace
+
 DefaultFileSystem::DefaultFileSystem(const std::string& cwd /*= ""*/)
     : current_path_(cwd) {
 #ifdef _MSC_VER
@@ -32,12 +62,66 @@ std::string DefaultFileSystem::Read(const std::string& path) const {
   return stream.str();
 }
 
+void DefaultFileSystem::ReadChunks(const std::string& path,
+                                   const ChunkCallback& callback) const {
+  // gzread() passes data that isn't gzip-compressed through unchanged
+  GzFile file(path, "rb");
+  if (!file) {
+    throw RuntimeErrorWithErrno("Failed to open \"" + path + "\"");
+  }
+  gzbuffer(file, kChunkSize);
+
+  std::vector<char> buffer(kChunkSize);
+  int length;
+  while ((length = gzread(file, &buffer[0], kChunkSize)) > 0) {
+    callback(&buffer[0], length);
+  }
+  if (length < 0) {
+    int error;
+    throw std::runtime_error("Failed to read \"" + path + "\" (" +
+                             gzerror(file, &error) + ")");
+  }
+}
+
 void DefaultFileSystem::Write(const std::string& path,
                               const std::string& data) {
   fs::ofstream fstream(path);
   fstream << data;
 }
 
+void DefaultFileSystem::WriteCompressed(const std::string& path,
+                                        const std::string& data) {
+  GzFile file(path, "wb6");
+  if (!file) {
+    throw RuntimeErrorWithErrno("Failed to open \"" + path + "\"");
+  }
+  if (data.length() &&
+      gzwrite(file, data.data(), static_cast<unsigned>(data.length())) <= 0) {
+    int error;
+    throw std::runtime_error("Failed to write \"" + path + "\" (" +
+                             gzerror(file, &error) + ")");
+  }
+  // The end of the data is only written out on closing
+  int result = file.Close();
+  if (result == Z_ERRNO) {
+    throw RuntimeErrorWithErrno("Failed to write \"" + path + "\"");
+  } else if (result != Z_OK) {
+    throw std::runtime_error("Failed to write \"" + path + "\" (" +
+                             zError(result) + ")");
+  }
+}
+
+void DefaultFileSystem::Append(const std::string& path,
+                               const std::string& data) {
+  fs::ofstream fstream(path, std::ios_base::out | std::ios_base::app |
+                                 std::ios_base::binary);
+  if (!fstream.is_open()) {
+    throw RuntimeErrorWithErrno("Failed to open \"" + path + "\"");
+  }
+  fstream << data;
+  fstream.flush();
+}
+
 bool DefaultFileSystem::Remove(const std::string& path) {
   return fs::remove(path);
 }
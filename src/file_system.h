@@ -2,6 +2,8 @@
 #define FILE_SYSTEM_H_
 
 #include <ctime>
+#include <string>
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
 namespace adblock {
@@ -22,9 +24,18 @@ class FileSystem {
     std::time_t last_write_time;
   };
 
+  typedef boost::function<void(const char* data, size_t size)> ChunkCallback;
+
   virtual ~FileSystem() {}
   virtual std::string Read(const std::string& path) const = 0;
+  // Reads a file piece by piece, gzip-compressed files are decompressed on
+  // the fly.
+  virtual void ReadChunks(const std::string& path,
+                          const ChunkCallback& callback) const = 0;
   virtual void Write(const std::string& path, const std::string& data) = 0;
+  virtual void WriteCompressed(const std::string& path,
+                               const std::string& data) = 0;
+  virtual void Append(const std::string& path, const std::string& data) = 0;
   virtual bool Remove(const std::string& path) = 0;
   virtual void Move(const std::string& from, const std::string& to) = 0;
   virtual StatResult Stat(const std::string& path) const = 0;
@@ -37,7 +48,11 @@ class DefaultFileSystem : public FileSystem {
  public:
   DefaultFileSystem(const std::string& cwd = "");
   std::string Read(const std::string& path) const;
+  void ReadChunks(const std::string& path,
+                  const ChunkCallback& callback) const;
   void Write(const std::string& path, const std::string& data);
+  void WriteCompressed(const std::string& path, const std::string& data);
+  void Append(const std::string& path, const std::string& data);
   bool Remove(const std::string& path);
   void Move(const std::string& from, const std::string& to);
   FileSystem::StatResult Stat(const std::string& path) const;
@@ -0,0 +1,1149 @@
+#include "filter_index.h"
+#include "process_util.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <boost/atomic.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/regex.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/unordered/unordered_map.hpp>
+#include <glog/logging.h>
+
+namespace adblock {
+
+namespace ipc = boost::interprocess;
+
+namespace {
+
+const char kControlName[] =
+    "asdv2_adblock_filter_index_{5095C5F0-D82D-4442-9A62-8769871F42D1}";
+// Named after the layout version, older segments are not found
+const char kControlObject[] = "FilterIndexControl3";
+const char kImagePrefix[] = "asdv2_adblock_filter_index_";
+const char kImageSuffix[] = "_{5095C5F0-D82D-4442-9A62-8769871F42D1}";
+const char kImageObject[] = "FilterIndex";
+const char kReadersObject[] = "FilterIndexReaders";
+const char kLockFileName[] = "asdv2_adblock_filter_index.lock";
+
+const std::uint32_t kMagic = 0x58444941;  // "AIDX"
+const std::uint32_t kVersion = 3;
+// Room for the segment manager next to the image
+const size_t kSegmentOverhead = 64 * 1024;
+// Opening attempts when the builder replaces the generation meanwhile
+const int kOpenAttempts = 3;
+// Processes using the index at once, one that finds no free entry retries
+// on its next use
+const std::uint32_t kMaxAttached = 64;
+
+// The generation counter is shared between processes
+BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT_LOCK_FREE == 2);
+
+// Pattern properties derived while building the image
+enum PatternFlags {
+  REGEXP = 1 << 16,
+  ANCHOR_START = 1 << 17,
+  ANCHOR_HOST = 1 << 18,
+  ANCHOR_END = 1 << 19
+};
+
+enum Table { BLACKLIST = 0, WHITELIST = 1, TABLE_COUNT = 2 };
+
+struct TableRecord {
+  std::uint32_t first;
+  // Number of slots, a power of two or zero
+  std::uint32_t count;
+};
+
+struct BucketRecord {
+  std::uint32_t hash;
+  std::uint32_t keyword;
+  std::uint32_t keyword_length;
+  std::uint32_t first;
+  // Zero marks an empty slot
+  std::uint32_t count;
+  std::uint32_t groups;
+  std::uint32_t group_count;
+};
+
+// Filters of a bucket with the same content types and party options, as
+// ascending filter indexes in the members array
+struct GroupRecord {
+  std::uint32_t content_type;
+  // THIRD_PARTY and FIRST_PARTY flags of the filters
+  std::uint32_t party;
+  std::uint32_t first;
+  std::uint32_t count;
+};
+
+struct FilterRecord {
+  std::uint32_t text;
+  std::uint32_t text_length;
+  std::uint32_t pattern;
+  std::uint32_t pattern_length;
+  std::uint32_t content_type;
+  std::uint32_t flags;
+  std::uint32_t domains;
+  std::uint32_t domain_count;
+};
+
+// Filters with the same domain list share its records
+struct DomainRecord {
+  // Id of the interned domain name
+  std::uint32_t name;
+  std::uint32_t include;
+};
+
+// Slot of the hash table that interns the domain names
+struct NameRecord {
+  std::uint32_t hash;
+  std::uint32_t name;
+  // Zero marks an empty slot
+  std::uint32_t length;
+  std::uint32_t id;
+};
+
+std::uint32_t Hash(const char* value, size_t length) {
+  // FNV-1a
+  std::uint32_t hash = 2166136261u;
+  for (size_t idx = 0; idx < length; ++idx) {
+    hash ^= static_cast<unsigned char>(value[idx]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+std::string ImageName(std::uint32_t generation) {
+  std::stringstream name;
+  name << kImagePrefix << generation << kImageSuffix;
+  return name.str();
+}
+
+inline char LowerAscii(char c) {
+  return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+inline char UpperAscii(char c) {
+  return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+inline bool IsKeywordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '%';
+}
+
+inline bool IsSchemeChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+// Characters the "^" placeholder stands for, same ranges as the regular
+// expression generated by RegExpFilter.
+inline bool IsSeparator(char c) {
+  unsigned char value = static_cast<unsigned char>(c);
+  if (value >= 0x80) {
+    return false;
+  }
+  return !((value >= '0' && value <= '9') || (value >= 'a' && value <= 'z') ||
+           (value >= 'A' && value <= 'Z') || value == '%' || value == '-' ||
+           value == '.' || value == '_');
+}
+
+}  // namespace
+
+struct FilterIndexControl {
+  boost::atomic<std::uint32_t> generation;
+  // Oldest generation whose image may still exist
+  boost::atomic<std::uint32_t> oldest;
+  // Ids of the processes using the index, 0 marks a free entry. Entries of
+  // processes that died are reaped, the last process to leave removes the
+  // segments.
+  boost::atomic<std::uint32_t> attached[kMaxAttached];
+
+  FilterIndexControl() : generation(0), oldest(0) {
+    for (std::uint32_t idx = 0; idx < kMaxAttached; ++idx) {
+      attached[idx].store(0);
+    }
+  }
+};
+
+struct FilterIndexHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t size;
+  TableRecord tables[TABLE_COUNT];
+  std::uint32_t buckets;
+  std::uint32_t bucket_count;
+  std::uint32_t groups;
+  std::uint32_t group_count;
+  std::uint32_t members;
+  std::uint32_t member_count;
+  std::uint32_t filters;
+  std::uint32_t filter_count;
+  std::uint32_t domains;
+  std::uint32_t domain_count;
+  std::uint32_t names;
+  std::uint32_t name_count;
+  std::uint32_t strings;
+  std::uint32_t string_size;
+};
+
+struct FilterIndexRegexCache {
+  typedef boost::shared_ptr<boost::regex> RegexPtr;
+
+  boost::mutex mutex;
+  // Invalid expressions are cached as null pointers
+  boost::unordered_map<std::uint32_t, RegexPtr> regexes;
+};
+
+namespace {
+
+// Lays the tables out in one block of memory, all references are indexes
+// into the arrays that follow the header.
+class ImageBuilder {
+ public:
+  void AddTable(Table table, const BucketList& buckets);
+  void Finish(std::vector<char>* image);
+
+ private:
+  TableRecord tables_[TABLE_COUNT];
+  std::vector<BucketRecord> buckets_;
+  std::vector<GroupRecord> groups_;
+  std::vector<std::uint32_t> members_;
+  std::vector<FilterRecord> filters_;
+  std::vector<DomainRecord> domains_;
+  // Domain lists and names added so far
+  boost::unordered_map<std::string, std::pair<std::uint32_t, std::uint32_t> >
+      domain_lists_;
+  boost::unordered_map<std::string, std::uint32_t> name_ids_;
+  std::vector<NameRecord> names_;
+  std::string strings_;
+
+  std::uint32_t AddString(const std::string& value);
+  std::uint32_t AddName(const std::string& name);
+  void AddDomains(const std::string& domains, FilterRecord* record);
+  void AddGroups(const KeywordBucket& bucket, BucketRecord* record);
+  void AddFilter(const FilterData& data);
+};
+
+std::uint32_t ImageBuilder::AddString(const std::string& value) {
+  std::uint32_t offset = static_cast<std::uint32_t>(strings_.length());
+  strings_.append(value);
+  return offset;
+}
+
+void ImageBuilder::AddTable(Table table, const BucketList& buckets) {
+  std::uint32_t slots = 0;
+  if (!buckets.empty()) {
+    slots = 1;
+    while (slots < buckets.size() * 2) {
+      slots <<= 1;
+    }
+  }
+  tables_[table].first = static_cast<std::uint32_t>(buckets_.size());
+  tables_[table].count = slots;
+  BucketRecord empty = {};
+  buckets_.resize(buckets_.size() + slots, empty);
+
+  for (auto it = buckets.begin(); it != buckets.end(); ++it) {
+    if (it->filters.empty()) {
+      continue;
+    }
+    BucketRecord record;
+    record.hash = Hash(it->keyword.data(), it->keyword.length());
+    record.keyword = AddString(it->keyword);
+    record.keyword_length = static_cast<std::uint32_t>(it->keyword.length());
+    record.first = static_cast<std::uint32_t>(filters_.size());
+    record.count = static_cast<std::uint32_t>(it->filters.size());
+    AddGroups(*it, &record);
+    for (auto filter = it->filters.begin(); filter != it->filters.end();
+         ++filter) {
+      AddFilter(*filter);
+    }
+
+    std::uint32_t slot = record.hash & (slots - 1);
+    while (buckets_[tables_[table].first + slot].count != 0) {
+      slot = (slot + 1) & (slots - 1);
+    }
+    buckets_[tables_[table].first + slot] = record;
+  }
+}
+
+void ImageBuilder::AddGroups(const KeywordBucket& bucket,
+                             BucketRecord* record) {
+  const std::uint32_t party_flags =
+      FilterData::THIRD_PARTY | FilterData::FIRST_PARTY;
+  std::vector<GroupRecord> groups;
+  std::vector<std::vector<std::uint32_t> > members;
+  for (size_t idx = 0; idx < bucket.filters.size(); ++idx) {
+    const FilterData& filter = bucket.filters[idx];
+    size_t group = 0;
+    while (group < groups.size() &&
+           (groups[group].content_type != filter.content_type ||
+            groups[group].party != (filter.flags & party_flags))) {
+      ++group;
+    }
+    if (group == groups.size()) {
+      // The members are laid out once all groups of the bucket are known
+      GroupRecord entry = {filter.content_type, filter.flags & party_flags, 0,
+                           0};
+      groups.push_back(entry);
+      members.resize(groups.size());
+    }
+    members[group].push_back(record->first + static_cast<std::uint32_t>(idx));
+  }
+
+  record->groups = static_cast<std::uint32_t>(groups_.size());
+  record->group_count = static_cast<std::uint32_t>(groups.size());
+  for (size_t group = 0; group < groups.size(); ++group) {
+    groups[group].first = static_cast<std::uint32_t>(members_.size());
+    groups[group].count = static_cast<std::uint32_t>(members[group].size());
+    members_.insert(members_.end(), members[group].begin(),
+                    members[group].end());
+    groups_.push_back(groups[group]);
+  }
+}
+
+void ImageBuilder::AddFilter(const FilterData& data) {
+  FilterRecord record;
+  record.text = AddString(data.text);
+  record.text_length = static_cast<std::uint32_t>(data.text.length());
+  record.content_type = data.content_type;
+  record.flags = data.flags;
+
+  // Same normalization as the regexp getter of RegExpFilter
+  std::string pattern = data.pattern;
+  if (pattern.length() >= 2 && pattern[0] == '/' &&
+      pattern[pattern.length() - 1] == '/') {
+    record.flags |= REGEXP;
+    pattern = pattern.substr(1, pattern.length() - 2);
+  } else {
+    std::string collapsed;
+    for (size_t idx = 0; idx < pattern.length(); ++idx) {
+      if (pattern[idx] != '*' || collapsed.empty() ||
+          collapsed[collapsed.length() - 1] != '*') {
+        collapsed.push_back(pattern[idx]);
+      }
+    }
+    pattern.swap(collapsed);
+    if (!pattern.empty() && pattern[0] == '*') {
+      pattern.erase(0, 1);
+    }
+    if (!pattern.empty() && pattern[pattern.length() - 1] == '*') {
+      pattern.erase(pattern.length() - 1);
+    }
+    if (pattern.length() >= 2 &&
+        pattern.compare(pattern.length() - 2, 2, "^|") == 0) {
+      pattern.erase(pattern.length() - 1);
+    }
+    if (pattern.compare(0, 2, "||") == 0) {
+      record.flags |= ANCHOR_HOST;
+      pattern.erase(0, 2);
+    } else if (!pattern.empty() && pattern[0] == '|') {
+      record.flags |= ANCHOR_START;
+      pattern.erase(0, 1);
+    }
+    if (!pattern.empty() && pattern[pattern.length() - 1] == '|') {
+      record.flags |= ANCHOR_END;
+      pattern.erase(pattern.length() - 1);
+    }
+  }
+
+  // The pattern usually is a part of the text already
+  size_t position = data.text.find(pattern);
+  if (position != std::string::npos) {
+    record.pattern = record.text + static_cast<std::uint32_t>(position);
+  } else {
+    record.pattern = AddString(pattern);
+  }
+  record.pattern_length = static_cast<std::uint32_t>(pattern.length());
+
+  record.domains = 0;
+  record.domain_count = 0;
+  if (data.flags & FilterData::HAS_DOMAINS) {
+    AddDomains(data.domains, &record);
+  }
+  filters_.push_back(record);
+}
+
+void ImageBuilder::AddDomains(const std::string& domains,
+                              FilterRecord* record) {
+  auto known = domain_lists_.find(domains);
+  if (known != domain_lists_.end()) {
+    record->domains = known->second.first;
+    record->domain_count = known->second.second;
+    return;
+  }
+
+  record->domains = static_cast<std::uint32_t>(domains_.size());
+  size_t start = 0;
+  while (start <= domains.length()) {
+    size_t end = domains.find('|', start);
+    if (end == std::string::npos) {
+      end = domains.length();
+    }
+    std::string domain = domains.substr(start, end - start);
+    start = end + 1;
+    if (domain.empty()) {
+      continue;
+    }
+    DomainRecord entry;
+    entry.include = domain[0] != '~';
+    if (!entry.include) {
+      domain.erase(0, 1);
+    }
+    entry.name = AddName(domain);
+    domains_.push_back(entry);
+    ++record->domain_count;
+  }
+  domain_lists_[domains] =
+      std::make_pair(record->domains, record->domain_count);
+}
+
+std::uint32_t ImageBuilder::AddName(const std::string& name) {
+  auto known = name_ids_.find(name);
+  if (known != name_ids_.end()) {
+    return known->second;
+  }
+  NameRecord record;
+  record.hash = Hash(name.data(), name.length());
+  record.name = AddString(name);
+  record.length = static_cast<std::uint32_t>(name.length());
+  record.id = static_cast<std::uint32_t>(names_.size());
+  names_.push_back(record);
+  name_ids_[name] = record.id;
+  return record.id;
+}
+
+template <typename T>
+void AppendArray(const std::vector<T>& items, std::vector<char>* image,
+                 std::uint32_t* offset, std::uint32_t* count) {
+  *offset = static_cast<std::uint32_t>(image->size());
+  *count = static_cast<std::uint32_t>(items.size());
+  if (!items.empty()) {
+    const char* data = reinterpret_cast<const char*>(&items[0]);
+    image->insert(image->end(), data, data + items.size() * sizeof(T));
+  }
+}
+
+void ImageBuilder::Finish(std::vector<char>* image) {
+  FilterIndexHeader header = {};
+  header.magic = kMagic;
+  header.version = kVersion;
+  for (int table = 0; table < TABLE_COUNT; ++table) {
+    header.tables[table] = tables_[table];
+  }
+
+  image->assign(sizeof(header), 0);
+  AppendArray(buckets_, image, &header.buckets, &header.bucket_count);
+  AppendArray(groups_, image, &header.groups, &header.group_count);
+  AppendArray(members_, image, &header.members, &header.member_count);
+  AppendArray(filters_, image, &header.filters, &header.filter_count);
+  AppendArray(domains_, image, &header.domains, &header.domain_count);
+
+  std::uint32_t slots = 0;
+  if (!names_.empty()) {
+    slots = 1;
+    while (slots < names_.size() * 2) {
+      slots <<= 1;
+    }
+  }
+  NameRecord empty = {};
+  std::vector<NameRecord> names(slots, empty);
+  for (auto it = names_.begin(); it != names_.end(); ++it) {
+    std::uint32_t slot = it->hash & (slots - 1);
+    while (names[slot].length != 0) {
+      slot = (slot + 1) & (slots - 1);
+    }
+    names[slot] = *it;
+  }
+  AppendArray(names, image, &header.names, &header.name_count);
+  header.strings = static_cast<std::uint32_t>(image->size());
+  header.string_size = static_cast<std::uint32_t>(strings_.length());
+  image->insert(image->end(), strings_.begin(), strings_.end());
+  header.size = static_cast<std::uint32_t>(image->size());
+  std::memcpy(&(*image)[0], &header, sizeof(header));
+}
+
+// Read access to a mapped image
+class ImageView {
+ public:
+  explicit ImageView(const FilterIndexHeader* header)
+      : base_(reinterpret_cast<const char*>(header)), header_(header) {}
+
+  const BucketRecord* FindBucket(Table table, const char* keyword,
+                                 size_t length) const;
+  const GroupRecord& group(std::uint32_t index) const {
+    return reinterpret_cast<const GroupRecord*>(base_ + header_->groups)[index];
+  }
+  std::uint32_t member(std::uint32_t index) const {
+    return reinterpret_cast<const std::uint32_t*>(base_ +
+                                                  header_->members)[index];
+  }
+  const FilterRecord& filter(std::uint32_t index) const {
+    return reinterpret_cast<const FilterRecord*>(base_ +
+                                                 header_->filters)[index];
+  }
+  const DomainRecord& domain(std::uint32_t index) const {
+    return reinterpret_cast<const DomainRecord*>(base_ +
+                                                 header_->domains)[index];
+  }
+  const char* string(std::uint32_t offset) const {
+    return base_ + header_->strings + offset;
+  }
+  // Id of an interned domain name, -1 if no filter refers to it
+  std::int64_t FindName(const char* name, size_t length) const;
+
+ private:
+  const char* base_;
+  const FilterIndexHeader* header_;
+};
+
+const BucketRecord* ImageView::FindBucket(Table table, const char* keyword,
+                                          size_t length) const {
+  const TableRecord& info = header_->tables[table];
+  if (info.count == 0) {
+    return nullptr;
+  }
+  const BucketRecord* buckets =
+      reinterpret_cast<const BucketRecord*>(base_ + header_->buckets) +
+      info.first;
+  std::uint32_t hash = Hash(keyword, length);
+  for (std::uint32_t slot = hash & (info.count - 1);;
+       slot = (slot + 1) & (info.count - 1)) {
+    const BucketRecord& bucket = buckets[slot];
+    if (bucket.count == 0) {
+      return nullptr;
+    }
+    if (bucket.hash == hash && bucket.keyword_length == length &&
+        std::memcmp(string(bucket.keyword), keyword, length) == 0) {
+      return &bucket;
+    }
+  }
+}
+
+std::int64_t ImageView::FindName(const char* name, size_t length) const {
+  const std::uint32_t slots = header_->name_count;
+  if (slots == 0 || length == 0) {
+    return -1;
+  }
+  const NameRecord* names =
+      reinterpret_cast<const NameRecord*>(base_ + header_->names);
+  std::uint32_t hash = Hash(name, length);
+  for (std::uint32_t slot = hash & (slots - 1);;
+       slot = (slot + 1) & (slots - 1)) {
+    const NameRecord& record = names[slot];
+    if (record.length == 0) {
+      return -1;
+    }
+    if (record.hash == hash && record.length == length &&
+        std::memcmp(string(record.name), name, length) == 0) {
+      return record.id;
+    }
+  }
+}
+
+// The request being matched, prepared once for all filters
+struct MatchContext {
+  const std::string* location;
+  std::string lower_location;
+  std::uint32_t content_type;
+  bool third_party;
+  // Interned names of the document domain and its parent domains, most
+  // specific first. Domains no filter refers to are left out.
+  std::vector<std::uint32_t> domain_ids;
+};
+
+// Returns whether |pattern| matches |location| starting at |start|. "*"
+// stands for any number of characters, "^" for a separator or the end of
+// the address. A floating pattern may start anywhere after |start|.
+bool MatchAt(const char* pattern, size_t pattern_length,
+             const std::string& location, size_t start, bool floating,
+             bool anchor_end, bool fold) {
+  const size_t npos = std::string::npos;
+  size_t pi = 0;
+  size_t si = start;
+  size_t star_pi = floating ? 0 : npos;
+  size_t star_si = start;
+  const size_t length = location.length();
+
+  while (true) {
+    if (pi == pattern_length) {
+      if (!anchor_end || si == length) {
+        return true;
+      }
+    } else if (pattern[pi] == '*') {
+      star_pi = ++pi;
+      star_si = si;
+      continue;
+    } else if (si < length) {
+      char expected = fold ? LowerAscii(pattern[pi]) : pattern[pi];
+      if (expected == '^' ? IsSeparator(location[si])
+                          : expected == location[si]) {
+        ++pi;
+        ++si;
+        continue;
+      }
+    } else if (pattern[pi] == '^') {
+      ++pi;
+      continue;
+    }
+
+    // Let the last wildcard take one more character
+    if (star_pi == npos || star_si >= length) {
+      return false;
+    }
+    pi = star_pi;
+    si = ++star_si;
+  }
+}
+
+bool MatchHostAnchored(const char* pattern, size_t pattern_length,
+                       const std::string& location, bool anchor_end,
+                       bool fold) {
+  // Scheme followed by slashes, then the pattern at the start of the host
+  // name or of any of its labels
+  size_t pos = 0;
+  while (pos < location.length() && IsSchemeChar(location[pos])) {
+    ++pos;
+  }
+  if (pos == 0 || pos >= location.length() || location[pos] != ':') {
+    return false;
+  }
+  ++pos;
+  size_t slashes = pos;
+  while (pos < location.length() && location[pos] == '/') {
+    ++pos;
+  }
+  if (pos == slashes) {
+    return false;
+  }
+
+  size_t label = pos;
+  while (true) {
+    if (MatchAt(pattern, pattern_length, location, label, false, anchor_end,
+                fold)) {
+      return true;
+    }
+    size_t next = label;
+    while (next < location.length() && location[next] != '.' &&
+           location[next] != '/') {
+      ++next;
+    }
+    if (next == label || next >= location.length() || location[next] != '.') {
+      return false;
+    }
+    label = next + 1;
+  }
+}
+
+bool IsActiveOnDomain(const ImageView& image, const FilterRecord& filter,
+                      const MatchContext& context) {
+  if (!(filter.flags & FilterData::HAS_DOMAINS)) {
+    return true;
+  }
+  for (size_t idx = 0; idx < context.domain_ids.size(); ++idx) {
+    for (std::uint32_t entry = 0; entry < filter.domain_count; ++entry) {
+      const DomainRecord& domain = image.domain(filter.domains + entry);
+      if (domain.name == context.domain_ids[idx]) {
+        return domain.include != 0;
+      }
+    }
+  }
+  return (filter.flags & FilterData::DOMAIN_DEFAULT) != 0;
+}
+
+bool MatchRegex(const ImageView& image, std::uint32_t index,
+                const FilterRecord& filter, const std::string& location,
+                FilterIndexRegexCache* cache) {
+  FilterIndexRegexCache::RegexPtr regex;
+  {
+    boost::mutex::scoped_lock lock(cache->mutex);
+    auto it = cache->regexes.find(index);
+    if (it != cache->regexes.end()) {
+      regex = it->second;
+    } else {
+      try {
+        boost::regex::flag_type flags = boost::regex::ECMAScript;
+        if (!(filter.flags & FilterData::MATCH_CASE)) {
+          flags |= boost::regex::icase;
+        }
+        const char* source = image.string(filter.pattern);
+        regex.reset(
+            new boost::regex(source, source + filter.pattern_length, flags));
+      }
+      catch (const boost::regex_error& e) {
+        LOG(ERROR) << "Invalid regular expression in filter index: "
+                   << e.what();
+      }
+      cache->regexes[index] = regex;
+    }
+  }
+  return regex && boost::regex_search(location, *regex);
+}
+
+bool FilterMatches(const ImageView& image, std::uint32_t index,
+                   const MatchContext& context, FilterIndexRegexCache* cache) {
+  const FilterRecord& filter = image.filter(index);
+  if (!(filter.content_type & context.content_type)) {
+    return false;
+  }
+  if ((filter.flags & FilterData::THIRD_PARTY) && !context.third_party) {
+    return false;
+  }
+  if ((filter.flags & FilterData::FIRST_PARTY) && context.third_party) {
+    return false;
+  }
+  if (!IsActiveOnDomain(image, filter, context)) {
+    return false;
+  }
+
+  if (filter.flags & REGEXP) {
+    return MatchRegex(image, index, filter, *context.location, cache);
+  }
+  bool fold = !(filter.flags & FilterData::MATCH_CASE);
+  const std::string& location = fold ? context.lower_location
+                                     : *context.location;
+  const char* pattern = image.string(filter.pattern);
+  bool anchor_end = (filter.flags & ANCHOR_END) != 0;
+  if (filter.flags & ANCHOR_HOST) {
+    return MatchHostAnchored(pattern, filter.pattern_length, location,
+                             anchor_end, fold);
+  }
+  return MatchAt(pattern, filter.pattern_length, location, 0,
+                 !(filter.flags & ANCHOR_START), anchor_end, fold);
+}
+
+// Index of the first filter for |keyword| that matches, -1 if none does.
+// Groups that can't apply to the request are skipped as a whole, the others
+// only need to be searched up to the best match found so far.
+std::int64_t CheckBucket(const ImageView& image, Table table,
+                         const char* keyword, size_t length,
+                         const MatchContext& context,
+                         FilterIndexRegexCache* cache) {
+  const BucketRecord* bucket = image.FindBucket(table, keyword, length);
+  if (bucket == nullptr) {
+    return -1;
+  }
+  const std::uint32_t excluded_party =
+      context.third_party ? FilterData::FIRST_PARTY : FilterData::THIRD_PARTY;
+  std::int64_t result = -1;
+  for (std::uint32_t group_idx = 0; group_idx < bucket->group_count;
+       ++group_idx) {
+    const GroupRecord& group = image.group(bucket->groups + group_idx);
+    if (!(group.content_type & context.content_type) ||
+        (group.party & excluded_party)) {
+      continue;
+    }
+    for (std::uint32_t idx = 0; idx < group.count; ++idx) {
+      std::uint32_t filter = image.member(group.first + idx);
+      if (result >= 0 && filter >= result) {
+        break;
+      }
+      if (FilterMatches(image, filter, context, cache)) {
+        result = filter;
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+FilterIndex::FilterIndex()
+    : role_(NONE),
+      control_(nullptr),
+      attached_entry_(kMaxAttached),
+      failed_generation_(0) {
+  mapping_.header = nullptr;
+  mapping_.readers = nullptr;
+  mapping_.generation = 0;
+}
+
+FilterIndex::~FilterIndex() {
+  if (mapping_.readers != nullptr) {
+    mapping_.readers->fetch_sub(1, boost::memory_order_release);
+  }
+  if (control_ != nullptr && Detach()) {
+    std::uint32_t generation =
+        control_->generation.load(boost::memory_order_acquire);
+    for (std::uint32_t idx = control_->oldest.load(); idx != generation + 1;
+         ++idx) {
+      if (idx != 0) {
+        ipc::shared_memory_object::remove(ImageName(idx).c_str());
+      }
+    }
+    control_ = nullptr;
+    control_segment_.reset();
+    ipc::shared_memory_object::remove(kControlName);
+  }
+  if (role_ == BUILDER) {
+    lock_.unlock();
+  }
+}
+
+FilterIndex::Role FilterIndex::Attach() {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (role_ != NONE) {
+    return role_;
+  }
+
+  boost::system::error_code error;
+  boost::filesystem::path path =
+      boost::filesystem::temp_directory_path(error) / kLockFileName;
+  if (error) {
+    LOG(ERROR) << "Failed to locate the filter index lock: " << error.message();
+    return role_;
+  }
+  {
+    // file_lock requires an existing file
+    std::ofstream touch(path.string().c_str(), std::ios::app);
+  }
+
+  try {
+    ipc::file_lock file_lock(path.string().c_str());
+    lock_.swap(file_lock);
+    role_ = lock_.try_lock() ? BUILDER : READER;
+  }
+  catch (const ipc::interprocess_exception& e) {
+    LOG(ERROR) << "Failed to lock the filter index: " << e.what();
+    return role_;
+  }
+  OpenControl();
+  return role_;
+}
+
+bool FilterIndex::OpenControl() {
+  try {
+    if (role_ == BUILDER) {
+      control_segment_.reset(
+          new Segment(ipc::open_or_create, kControlName, 4096));
+      control_ =
+          control_segment_->find_or_construct<FilterIndexControl>(
+              kControlObject)();
+    } else {
+      control_segment_.reset(new Segment(ipc::open_only, kControlName));
+      control_ = control_segment_->find_no_lock<FilterIndexControl>(
+          kControlObject).first;
+    }
+    if (control_ != nullptr && !Register()) {
+      LOG(ERROR) << "Too many processes use the filter index";
+      control_ = nullptr;
+    }
+  }
+  catch (const ipc::interprocess_exception&) {
+    // Readers retry once the builder created the segment
+    if (role_ == BUILDER) {
+      LOG(ERROR) << "Failed to create the filter index control segment";
+    }
+    control_ = nullptr;
+  }
+  if (control_ == nullptr) {
+    control_segment_.reset();
+  }
+  return control_ != nullptr;
+}
+
+bool FilterIndex::Register() {
+  std::uint32_t pid = CurrentProcessId();
+  for (int pass = 0; pass < 2; ++pass) {
+    for (std::uint32_t idx = 0; idx < kMaxAttached; ++idx) {
+      std::uint32_t expected = 0;
+      if (control_->attached[idx].compare_exchange_strong(expected, pid)) {
+        attached_entry_ = idx;
+        return true;
+      }
+    }
+    // Entries of processes that died are freed before giving up
+    Reap();
+  }
+  return false;
+}
+
+void FilterIndex::Reap() {
+  for (std::uint32_t idx = 0; idx < kMaxAttached; ++idx) {
+    std::uint32_t pid = control_->attached[idx].load();
+    if (pid != 0 && !ProcessExists(pid)) {
+      control_->attached[idx].compare_exchange_strong(pid, 0);
+    }
+  }
+}
+
+bool FilterIndex::Detach() {
+  control_->attached[attached_entry_].store(0);
+  attached_entry_ = kMaxAttached;
+  Reap();
+  for (std::uint32_t idx = 0; idx < kMaxAttached; ++idx) {
+    if (control_->attached[idx].load() != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FilterIndex::TakeOver() {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (role_ != READER) {
+    return role_ == BUILDER;
+  }
+  // The lock file is released when the builder exits, however it went
+  try {
+    if (!lock_.try_lock()) {
+      return false;
+    }
+  }
+  catch (const ipc::interprocess_exception& e) {
+    LOG(ERROR) << "Failed to lock the filter index: " << e.what();
+    return false;
+  }
+  role_ = BUILDER;
+  if (control_ != nullptr) {
+    Reap();
+  } else {
+    OpenControl();
+  }
+  LOG(INFO) << "Took over building the filter index at generation "
+            << (control_ != nullptr ? control_->generation.load() : 0);
+  return true;
+}
+
+std::uint32_t FilterIndex::Publish(const BucketList& blacklist,
+                                   const BucketList& whitelist) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (role_ != BUILDER || (control_ == nullptr && !OpenControl())) {
+    return 0;
+  }
+
+  ImageBuilder builder;
+  builder.AddTable(BLACKLIST, blacklist);
+  builder.AddTable(WHITELIST, whitelist);
+  std::vector<char> image;
+  builder.Finish(&image);
+
+  std::uint32_t generation =
+      control_->generation.load(boost::memory_order_acquire) + 1;
+  if (generation == 0) {
+    generation = 1;
+  }
+  std::string name = ImageName(generation);
+  try {
+    // Left behind by a builder that exited while publishing
+    ipc::shared_memory_object::remove(name.c_str());
+    Segment segment(ipc::create_only, name.c_str(),
+                    image.size() + kSegmentOverhead);
+    char* data = segment.construct<char>(kImageObject)[image.size()]();
+    std::memcpy(data, &image[0], image.size());
+    segment.construct<boost::atomic<std::uint32_t> >(kReadersObject)(0);
+  }
+  catch (const ipc::interprocess_exception& e) {
+    LOG(ERROR) << "Failed to publish the filter index: " << e.what();
+    ipc::shared_memory_object::remove(name.c_str());
+    return 0;
+  }
+
+  control_->generation.store(generation, boost::memory_order_release);
+  // Kept while a reader that took over loads the filters
+  if (mapping_.readers != nullptr) {
+    mapping_.readers->fetch_sub(1, boost::memory_order_release);
+    mapping_.segment.reset();
+    mapping_.regexes.reset();
+    mapping_.readers = nullptr;
+    mapping_.header = nullptr;
+    mapping_.generation = 0;
+  }
+  RemoveUnused(generation);
+  Reap();
+  return generation;
+}
+
+void FilterIndex::RemoveUnused(std::uint32_t generation) {
+  // Images a reader still maps are kept, the oldest of them is where the
+  // next attempt starts
+  std::uint32_t first = control_->oldest.load(boost::memory_order_acquire);
+  std::uint32_t kept = generation;
+  for (std::uint32_t idx = first; idx != generation; ++idx) {
+    if (idx == 0) {
+      continue;
+    }
+    std::string name = ImageName(idx);
+    try {
+      Segment segment(ipc::open_only, name.c_str());
+      boost::atomic<std::uint32_t>* readers =
+          segment.find_no_lock<boost::atomic<std::uint32_t> >(kReadersObject)
+              .first;
+      if (readers != nullptr &&
+          readers->load(boost::memory_order_acquire) != 0) {
+        if (kept == generation) {
+          kept = idx;
+        }
+        continue;
+      }
+    }
+    catch (const ipc::interprocess_exception&) {
+      // Removed already
+      continue;
+    }
+    ipc::shared_memory_object::remove(name.c_str());
+  }
+  control_->oldest.store(kept, boost::memory_order_release);
+}
+
+FilterIndex::Mapping FilterIndex::CurrentMapping() {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (role_ != READER || (control_ == nullptr && !OpenControl())) {
+    return mapping_;
+  }
+
+  std::uint32_t generation =
+      control_->generation.load(boost::memory_order_acquire);
+  for (int attempt = 0; attempt < kOpenAttempts; ++attempt) {
+    if (generation == 0 || generation == mapping_.generation ||
+        generation == failed_generation_) {
+      break;
+    }
+    try {
+      SegmentPtr segment(new Segment(ipc::open_only,
+                                     ImageName(generation).c_str()));
+      std::pair<char*, size_t> image =
+          segment->find_no_lock<char>(kImageObject);
+      boost::atomic<std::uint32_t>* readers =
+          segment->find_no_lock<boost::atomic<std::uint32_t> >(kReadersObject)
+              .first;
+      const FilterIndexHeader* header =
+          reinterpret_cast<const FilterIndexHeader*>(image.first);
+      if (header == nullptr || readers == nullptr ||
+          image.second < sizeof(FilterIndexHeader) ||
+          header->magic != kMagic || header->version != kVersion ||
+          header->size > image.second) {
+        LOG(ERROR) << "Ignoring invalid filter index generation "
+                   << generation;
+        failed_generation_ = generation;
+        break;
+      }
+      // Keeps the builder from removing the image while it is mapped here
+      readers->fetch_add(1, boost::memory_order_acq_rel);
+      if (mapping_.readers != nullptr) {
+        mapping_.readers->fetch_sub(1, boost::memory_order_release);
+      }
+      mapping_.segment = segment;
+      mapping_.readers = readers;
+      mapping_.header = header;
+      mapping_.generation = generation;
+      mapping_.regexes.reset(new FilterIndexRegexCache());
+      break;
+    }
+    catch (const ipc::interprocess_exception&) {
+      // The builder may have replaced the generation in the meantime
+      std::uint32_t current =
+          control_->generation.load(boost::memory_order_acquire);
+      if (current == generation) {
+        failed_generation_ = generation;
+        break;
+      }
+      generation = current;
+    }
+  }
+  return mapping_;
+}
+
+std::uint32_t FilterIndex::generation() {
+  return CurrentMapping().generation;
+}
+
+bool FilterIndex::Match(const std::string& location,
+                        std::uint32_t content_type,
+                        const std::string& doc_domain, bool third_party,
+                        bool whitelist_only, FilterMatch* result) {
+  result->type = FilterMatch::NO_MATCH;
+  Mapping mapping = CurrentMapping();
+  if (mapping.header == nullptr) {
+    return false;
+  }
+  ImageView image(mapping.header);
+
+  MatchContext context;
+  context.location = &location;
+  context.lower_location = location;
+  for (size_t idx = 0; idx < location.length(); ++idx) {
+    context.lower_location[idx] = LowerAscii(location[idx]);
+  }
+  context.content_type = content_type;
+  context.third_party = third_party;
+  if (!doc_domain.empty()) {
+    size_t length = doc_domain.length();
+    while (length > 0 && doc_domain[length - 1] == '.') {
+      --length;
+    }
+    std::string domain(length, '\0');
+    for (size_t idx = 0; idx < length; ++idx) {
+      domain[idx] = UpperAscii(doc_domain[idx]);
+    }
+    size_t suffix = 0;
+    while (true) {
+      std::int64_t id = image.FindName(domain.data() + suffix, length - suffix);
+      if (id >= 0) {
+        context.domain_ids.push_back(static_cast<std::uint32_t>(id));
+      }
+      size_t dot = domain.find('.', suffix);
+      if (dot == std::string::npos) {
+        break;
+      }
+      suffix = dot + 1;
+    }
+  }
+
+  // Same candidate order as CombinedMatcher.matchesAnyInternal(), keywords
+  // from the address first and the empty keyword last
+  const std::string& lower = context.lower_location;
+  FilterIndexRegexCache* cache = mapping.regexes.get();
+  std::int64_t blocking = -1;
+  std::int64_t whitelist = -1;
+  size_t pos = 0;
+  while (whitelist < 0) {
+    const char* keyword = "";
+    size_t length = 0;
+    bool last = false;
+    while (pos < lower.length() && !IsKeywordChar(lower[pos])) {
+      ++pos;
+    }
+    if (pos < lower.length()) {
+      size_t start = pos;
+      while (pos < lower.length() && IsKeywordChar(lower[pos])) {
+        ++pos;
+      }
+      if (pos - start < 3) {
+        continue;
+      }
+      keyword = lower.data() + start;
+      length = pos - start;
+    } else {
+      last = true;
+    }
+
+    whitelist = CheckBucket(image, WHITELIST, keyword, length, context, cache);
+    if (whitelist < 0 && blocking < 0 && !whitelist_only) {
+      blocking = CheckBucket(image, BLACKLIST, keyword, length, context, cache);
+    }
+    if (last) {
+      break;
+    }
+  }
+
+  std::int64_t index = whitelist >= 0 ? whitelist : blocking;
+  if (index < 0) {
+    return false;
+  }
+  const FilterRecord& filter = image.filter(static_cast<std::uint32_t>(index));
+  result->type = whitelist >= 0 ? FilterMatch::WHITELIST_FILTER
+                                : FilterMatch::BLOCKING_FILTER;
+  result->text.assign(image.string(filter.text), filter.text_length);
+  result->collapse = (filter.flags & FilterData::COLLAPSE)
+                         ? 1
+                         : (filter.flags & FilterData::NO_COLLAPSE) ? 0 : -1;
+  result->malware = (filter.flags & FilterData::MALWARE) != 0;
+  return true;
+}
+
+}  // namespace adblock
@@ -0,0 +1,140 @@
+#ifndef FILTER_INDEX_H_
+#define FILTER_INDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace adblock {
+
+struct FilterIndexControl;
+struct FilterIndexHeader;
+struct FilterIndexRegexCache;
+
+// Request filter as exported by the JavaScript matcher.
+struct FilterData {
+  enum Flags {
+    MATCH_CASE = 1 << 0,
+    THIRD_PARTY = 1 << 1,
+    FIRST_PARTY = 1 << 2,
+    COLLAPSE = 1 << 3,
+    NO_COLLAPSE = 1 << 4,
+    MALWARE = 1 << 5,
+    // Value of the "" entry of the domains map, used for unlisted domains
+    DOMAIN_DEFAULT = 1 << 7,
+    HAS_DOMAINS = 1 << 8
+  };
+
+  std::string text;
+  // Filter text without the exception marker and options
+  std::string pattern;
+  std::uint32_t content_type;
+  std::uint32_t flags;
+  // Upper-case domains, excluded ones prefixed with "~", separated by "|"
+  std::string domains;
+};
+
+// Filters sharing a keyword, in the order the matcher tries them.
+struct KeywordBucket {
+  std::string keyword;
+  std::vector<FilterData> filters;
+};
+
+typedef std::vector<KeywordBucket> BucketList;
+
+struct FilterMatch {
+  enum Type { NO_MATCH = 0, BLOCKING_FILTER = 2, WHITELIST_FILTER = 3 };
+
+  Type type;
+  std::string text;
+  // Only meaningful for blocking filters: -1 unset, 0 false, 1 true
+  int collapse;
+  bool malware;
+};
+
+// Request filters compiled into one flat image that lives in shared memory.
+// One process, the builder, holds the lock file and publishes a new
+// generation of the image whenever its filters change. All other processes
+// map the current generation and match against it, so the filters are kept
+// in memory once for all of them. A reader takes over once the builder is
+// gone. A generation is removed once no reader maps it any more, the
+// segments are removed when the last live process detaches.
+class FilterIndex {
+ public:
+  enum Role { NONE, BUILDER, READER };
+
+  FilterIndex();
+  ~FilterIndex();
+
+  // Decides which role this process plays.
+  Role Attach();
+  Role role() const { return role_; }
+  // Reader side, becomes the builder if the one before exited. The index
+  // mapped last is matched until the first Publish(). True if this process
+  // is the builder now.
+  bool TakeOver();
+
+  // Builder side, returns the generation published or 0 on failure.
+  std::uint32_t Publish(const BucketList& blacklist,
+                        const BucketList& whitelist);
+
+  // Reader side, mirrors CombinedMatcher.matchesAny(). |content_type| is the
+  // RegExpFilter.typeMap value of the request type. With |whitelist_only|
+  // the blocking buckets are skipped, like CombinedMatcher.matchesWhitelist().
+  bool Match(const std::string& location, std::uint32_t content_type,
+             const std::string& doc_domain, bool third_party,
+             bool whitelist_only, FilterMatch* result);
+
+  // Generation currently mapped, 0 if none is available yet.
+  std::uint32_t generation();
+
+ private:
+  typedef boost::interprocess::managed_shared_memory Segment;
+  typedef boost::shared_ptr<Segment> SegmentPtr;
+
+  struct Mapping {
+    SegmentPtr segment;
+    // Count of the readers mapping the image, kept in the image segment
+    boost::atomic<std::uint32_t>* readers;
+    const FilterIndexHeader* header;
+    std::uint32_t generation;
+    // Filters written as regular expressions, compiled on first use
+    boost::shared_ptr<FilterIndexRegexCache> regexes;
+  };
+
+  Role role_;
+  boost::interprocess::file_lock lock_;
+  SegmentPtr control_segment_;
+  FilterIndexControl* control_;
+  // Entry holding the id of this process in the control segment
+  std::uint32_t attached_entry_;
+
+  boost::mutex mutex_;
+  Mapping mapping_;
+  // Generation that could not be mapped, not retried until the next one
+  std::uint32_t failed_generation_;
+
+  bool OpenControl();
+  // Enters this process into the control segment, false if it is full
+  bool Register();
+  // Frees the entries of processes that died
+  void Reap();
+  // Leaves the control segment, true if no live process uses it any more
+  bool Detach();
+  // Builder side, removes the images older than |generation| that no reader
+  // maps.
+  void RemoveUnused(std::uint32_t generation);
+  Mapping CurrentMapping();
+};
+
+typedef boost::shared_ptr<FilterIndex> FilterIndexPtr;
+
+}  // namespace adblock
+
+#endif  // FILTER_INDEX_H_
@@ -0,0 +1,191 @@
+#include "ini_parser.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace {
+
+// Sections are only handed to worker threads if there is enough data to
+// make it worthwhile.
+const size_t kMinBytesPerThread = 256 * 1024;
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+inline bool IsWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// Matches /^\s*\[(.+)\]\s*$/ and returns the lower-cased section name.
+bool ParseSectionHeader(const std::string& line, std::string* name) {
+  size_t begin = 0;
+  while (begin < line.length() && IsSpace(line[begin])) {
+    ++begin;
+  }
+  size_t end = line.length();
+  while (end > begin && IsSpace(line[end - 1])) {
+    --end;
+  }
+  if (end - begin < 3 || line[begin] != '[' || line[end - 1] != ']') {
+    return false;
+  }
+
+  name->assign(line, begin + 1, end - begin - 2);
+  for (auto it = name->begin(); it != name->end(); ++it) {
+    if (*it >= 'A' && *it <= 'Z') {
+      *it = *it - 'A' + 'a';
+    }
+  }
+  return true;
+}
+
+// Matches /^(\w+)=(.*)$/.
+bool ParseProperty(const std::string& line, std::string* key,
+                   std::string* value) {
+  size_t pos = 0;
+  while (pos < line.length() && IsWordChar(line[pos])) {
+    ++pos;
+  }
+  if (pos == 0 || pos == line.length() || line[pos] != '=') {
+    return false;
+  }
+  key->assign(line, 0, pos);
+  value->assign(line, pos + 1, std::string::npos);
+  return true;
+}
+
+adblock::IniParser::SectionType GetSectionType(const std::string& name) {
+  if (name == "filter" || name == "pattern" || name == "subscription") {
+    return adblock::IniParser::SECTION_OBJECT;
+  }
+  if (name == "subscription filters" || name == "subscription patterns" ||
+      name == "user patterns") {
+    return adblock::IniParser::SECTION_LIST;
+  }
+  return adblock::IniParser::SECTION_UNKNOWN;
+}
+
+}  // namespace
+
+namespace adblock {
+
+IniParser::IniParser() : pending_bytes_(0), finished_(false) {
+  // The file properties behave like an object section without a header
+  sections_.push_back(Section());
+  sections_.back().type = SECTION_OBJECT;
+}
+
+void IniParser::Feed(const char* data, size_t size) {
+  const char* end = data + size;
+  const char* line_start = data;
+  for (const char* pos = data; pos < end; ++pos) {
+    if (*pos != '\r' && *pos != '\n') {
+      continue;
+    }
+    if (partial_line_.length()) {
+      partial_line_.append(line_start, pos);
+      AddLine(partial_line_.data(),
+              partial_line_.data() + partial_line_.length());
+      partial_line_.clear();
+    } else {
+      AddLine(line_start, pos);
+    }
+    line_start = pos + 1;
+  }
+  partial_line_.append(line_start, end);
+}
+
+void IniParser::Finish() {
+  if (finished_) {
+    return;
+  }
+  finished_ = true;
+  AddLine(partial_line_.data(), partial_line_.data() + partial_line_.length());
+  partial_line_.clear();
+
+  size_t thread_count = boost::thread::hardware_concurrency();
+  if (thread_count > pending_bytes_ / kMinBytesPerThread) {
+    thread_count = pending_bytes_ / kMinBytesPerThread;
+  }
+  if (thread_count <= 1) {
+    ParseSections(sections_.begin(), sections_.end());
+    return;
+  }
+
+  // Split the sections into contiguous chunks of roughly equal size
+  size_t bytes_per_thread = pending_bytes_ / thread_count + 1;
+  boost::thread_group threads;
+  auto chunk_start = sections_.begin();
+  size_t chunk_bytes = 0;
+  for (auto it = sections_.begin(); it != sections_.end(); ++it) {
+    for (auto line = it->lines.begin(); line != it->lines.end(); ++line) {
+      chunk_bytes += line->length();
+    }
+    if (chunk_bytes >= bytes_per_thread) {
+      threads.create_thread(
+          boost::bind(&IniParser::ParseSections, chunk_start, it + 1));
+      chunk_start = it + 1;
+      chunk_bytes = 0;
+    }
+  }
+  ParseSections(chunk_start, sections_.end());
+  threads.join_all();
+}
+
+void IniParser::AddLine(const char* begin, const char* end) {
+  if (begin == end) {
+    return;
+  }
+
+  // A property line can never look like a section header, so unlike
+  // INIParser.process there is no need to check for properties first.
+  std::string line(begin, end);
+  std::string name;
+  if (ParseSectionHeader(line, &name)) {
+    sections_.push_back(Section());
+    sections_.back().type = GetSectionType(name);
+    sections_.back().name.swap(name);
+    return;
+  }
+
+  Section& current = sections_.back();
+  if (current.type != SECTION_UNKNOWN) {
+    pending_bytes_ += line.length();
+    current.lines.push_back(std::string());
+    current.lines.back().swap(line);
+  }
+}
+
+void IniParser::ParseSection(Section* section) {
+  if (section->type == SECTION_OBJECT) {
+    std::string key;
+    std::string value;
+    for (auto it = section->lines.begin(); it != section->lines.end(); ++it) {
+      if (ParseProperty(*it, &key, &value)) {
+        section->properties.push_back(std::make_pair(key, value));
+      }
+    }
+    LineList().swap(section->lines);
+  } else if (section->type == SECTION_LIST) {
+    for (auto it = section->lines.begin(); it != section->lines.end(); ++it) {
+      // Unescape "\[" which is used to protect filters from being mistaken
+      // for section headers
+      size_t pos = 0;
+      while ((pos = it->find("\\[", pos)) != std::string::npos) {
+        it->erase(pos, 1);
+        ++pos;
+      }
+    }
+  }
+}
+
+void IniParser::ParseSections(SectionList::iterator begin,
+                              SectionList::iterator end) {
+  for (auto it = begin; it != end; ++it) {
+    ParseSection(&*it);
+  }
+}
+
+}  // namespace adblock
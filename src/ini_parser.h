@@ -0,0 +1,64 @@
+#ifndef INI_PARSER_H_
+#define INI_PARSER_H_
+
+#include <string>
+#include <vector>
+
+namespace adblock {
+
+// Parses the filter storage file format (patterns.ini) the same way
+// INIParser in lib/filterStorage.js does. Input is tokenized into sections
+// as it is fed, the sections themselves are parsed in parallel by Finish().
+class IniParser {
+ public:
+  typedef std::vector<std::pair<std::string, std::string>> PropertyList;
+  typedef std::vector<std::string> LineList;
+
+  enum SectionType {
+    SECTION_UNKNOWN,
+    SECTION_OBJECT,
+    SECTION_LIST
+  };
+
+  struct Section {
+    Section() : type(SECTION_UNKNOWN) {}
+
+    // Lower-cased section name, empty for the properties preceding the
+    // first section header.
+    std::string name;
+    SectionType type;
+    PropertyList properties;
+    LineList lines;
+  };
+  typedef std::vector<Section> SectionList;
+
+  IniParser();
+
+  void Feed(const char* data, size_t size);
+  void Finish();
+
+  inline const PropertyList& file_properties() const {
+    return sections_.front().properties;
+  }
+  // Sections following the file properties, in file order.
+  inline SectionList::const_iterator begin() const {
+    return sections_.begin() + 1;
+  }
+  inline SectionList::const_iterator end() const { return sections_.end(); }
+  inline size_t size() const { return sections_.size() - 1; }
+
+ private:
+  SectionList sections_;
+  std::string partial_line_;
+  size_t pending_bytes_;
+  bool finished_;
+
+  void AddLine(const char* begin, const char* end);
+  static void ParseSection(Section* section);
+  static void ParseSections(SectionList::iterator begin,
+                            SectionList::iterator end);
+};
+
+}  // namespace adblock
+
+#endif  // INI_PARSER_H_
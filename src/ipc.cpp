@@ -1,11 +1,32 @@
 #include "ipc.h"
+
+#include <algorithm>
+
+#include <boost/thread/thread.hpp>
 #include <glog/logging.h>
 
 namespace adblock {
 
 namespace ipc = boost::interprocess;
 
-AdblockConfig::AdblockConfig() : adblock_control_(nullptr), segment_(nullptr) {}
+namespace {
+
+// Seconds to wait before opening the host's segment again after a failure
+const std::time_t kMinOpenBackoff = 1;
+const std::time_t kMaxOpenBackoff = 64;
+// Attempts to copy the settings before giving up on an update the host
+// doesn't finish, it may have died in the middle of Publish
+const int kMaxReadAttempts = 1000;
+
+}  // namespace
+
+AdblockConfig::AdblockConfig()
+    : segment_(nullptr),
+      adblock_control_(nullptr),
+      sequence_(1),
+      flags_(0),
+      next_open_(0),
+      backoff_(0) {}
 
 AdblockConfig::~AdblockConfig() {
   if (segment_ != nullptr) {
@@ -25,75 +46,117 @@ bool AdblockConfig::Init() {
     if (segment_) {
       auto res = segment_->find<AdblockControl>("AdblockControl");
       if (res.second == 1 && res.first != nullptr) {
-        adblock_control_ = res.first;
+        if (res.first->layout_version != AdblockControl::LAYOUT_VERSION ||
+            res.first->size != sizeof(AdblockControl)) {
+          // The host has to be updated, the defaults apply until then
+          if (!backoff_) {
+            LOG(ERROR) << "[AdblockConfig::Init()] Unsupported control "
+                          "layout " << res.first->layout_version;
+          }
+          return false;
+        }
+        adblock_control_.store(res.first, boost::memory_order_release);
         return true;
       }
     }
     return false;
   }
   catch (const ipc::interprocess_exception& e) {
-    LOG(ERROR) << "[AdblockConfig::Init()] " << e.what() << std::endl;
+    // Only the first of a series of failures is worth a log entry
+    if (!backoff_) {
+      LOG(ERROR) << "[AdblockConfig::Init()] " << e.what() << std::endl;
+    }
     return false;
   }
 }
 
-bool AdblockConfig::block_ads() {
-  if (!adblock_control_) {
-    Init();
-  }
-  if (adblock_control_) {
-    return adblock_control_->block_ads;
-  }
-  return false;
-}
+void AdblockConfig::Update() {
+  std::vector<ChangeCallback> callbacks;
+  AdblockSettings settings;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
 
-bool AdblockConfig::block_malware() {
-  if (!adblock_control_) {
-    Init();
-  }
-  if (adblock_control_) {
-    return adblock_control_->block_malware;
-  }
-  return false;
-}
+    AdblockControl* control = adblock_control_.load();
+    if (!control) {
+      std::time_t now = std::time(nullptr);
+      if (now < next_open_.load()) {
+        return;
+      }
+      if (!Init()) {
+        backoff_ = backoff_ ? std::min(backoff_ * 2, kMaxOpenBackoff)
+                            : kMinOpenBackoff;
+        next_open_.store(now + backoff_);
+        return;
+      }
+      backoff_ = 0;
+      control = adblock_control_.load();
+    }
 
-bool AdblockConfig::dont_track_me() {
-  if (!adblock_control_) {
-    Init();
+    std::uint32_t sequence;
+    int attempts = 0;
+    for (;;) {
+      sequence = control->sequence.load(boost::memory_order_acquire);
+      if (!(sequence & 1)) {
+        settings = control->settings;
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if (control->sequence.load(boost::memory_order_relaxed) == sequence) {
+          break;
+        }
+      }
+      if (++attempts == kMaxReadAttempts) {
+        // Keeps the cached flags. Taking an unfinished sequence means the
+        // next query doesn't try again before the host publishes anew.
+        if ((sequence & 1) && sequence != sequence_.load()) {
+          LOG(WARNING) << "[AdblockConfig::Update()] Settings update "
+                          "doesn't finish, keeping the current ones";
+          sequence_.store(sequence, boost::memory_order_release);
+        }
+        return;
+      }
+      boost::this_thread::yield();
+    }
+    if (sequence == sequence_.load()) {
+      return;
+    }
+
+    std::uint32_t flags = (settings.block_ads ? BLOCK_ADS : 0) |
+                          (settings.block_malware ? BLOCK_MALWARE : 0) |
+                          (settings.dont_track_me ? DONT_TRACK_ME : 0) |
+                          (settings.raw_reports ? RAW_REPORTS : 0) |
+                          (settings.capture_requests ? CAPTURE_REQUESTS : 0) |
+                          ((settings.capture_urls & CAPTURE_URLS_MASK)
+                           << CAPTURE_URLS_SHIFT) |
+                          (settings.log_stats ? LOG_STATS : 0) |
+                          (settings.fail_closed ? FAIL_CLOSED : 0) |
+                          ((settings.startup_policy & STARTUP_POLICY_MASK)
+                           << STARTUP_POLICY_SHIFT) |
+                          (static_cast<std::uint32_t>(settings.query_budget_ms)
+                           << QUERY_BUDGET_SHIFT);
+    bool changed = flags != flags_.load();
+    flags_.store(flags, boost::memory_order_relaxed);
+    sequence_.store(sequence, boost::memory_order_release);
+    if (changed) {
+      callbacks = callbacks_;
+    }
   }
-  if (adblock_control_) {
-    return adblock_control_->dont_track_me;
+
+  for (auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+    (*it)(settings);
   }
-  return false;
 }
 
-AdblockSender::AdblockSender() : queue_(nullptr) {}
-
-AdblockSender::~AdblockSender() {
-  if (queue_ != nullptr) {
-    delete queue_;
-    queue_ = nullptr;
-  }
+void AdblockConfig::AddChangeCallback(const ChangeCallback& callback) {
+  boost::mutex::scoped_lock lock(mutex_);
+  callbacks_.push_back(callback);
 }
 
-void AdblockSender::Send(const std::string& msg) {
-  try {
-    if (!queue_) {
-      queue_ = new ipc::message_queue(
-          ipc::open_only,
-          "asdv2_adblock_shared_queue_{5095C5F0-D82D-4442-9A62-8769871F42D1}");
-    }
-    queue_->try_send(msg.data(), msg.size(), 0);
-  }
-  catch (const ipc::interprocess_exception& e) {
-    LOG(ERROR) << "[AdblockSender::Send] " << e.what() << std::endl;
-    return;
-  }
-  catch (const std::bad_alloc&) {
-    LOG(ERROR) << "Failed to allocate memory when creating message_queue object"
-               << std::endl;
-    return;
-  }
+void AdblockConfig::Publish(AdblockControl* control,
+                            const AdblockSettings& settings) {
+  std::uint32_t sequence = control->sequence.load(boost::memory_order_relaxed);
+  control->sequence.store(sequence + 1, boost::memory_order_relaxed);
+  boost::atomic_thread_fence(boost::memory_order_release);
+  control->settings = settings;
+  control->sequence.store(sequence + 2, boost::memory_order_release);
 }
 
 }  // namespace adblock
@@ -1,41 +1,155 @@
 #ifndef IPC_H_
 #define IPC_H_
 
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
 #include <boost/interprocess/managed_shared_memory.hpp>
-#include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace adblock {
 
-typedef struct _AdblockControl {
+// What a query does while the filters of the engine are still being loaded
+enum StartupPolicy {
+  // Answer from the filters loaded so far, only the scripts are waited for
+  STARTUP_QUERY,
+  // Wait for the filters, no longer than the query budget if there is one
+  STARTUP_WAIT,
+  // Give the default answer right away
+  STARTUP_DEFAULT
+};
+
+struct AdblockSettings {
   bool block_ads;
   bool block_malware;
   bool dont_track_me;
-} AdblockControl;
+  // Send every blocked request instead of per-page summaries
+  bool raw_reports;
+  // Log the queries the engine answers, see RequestCapture
+  bool capture_requests;
+  // RequestCapture::UrlMode of the captured URLs
+  std::uint8_t capture_urls;
+  // Write the engine statistics to the log periodically
+  bool log_stats;
+  // Milliseconds a query may wait for the engine before it gets the default
+  // answer, 0 waits as long as it takes
+  std::uint16_t query_budget_ms;
+  // The default answer of CheckFilterMatch blocks instead of allowing
+  bool fail_closed;
+  // StartupPolicy of the queries made before the filters are loaded
+  std::uint8_t startup_policy;
+};
+
+// Shared with the host, which updates it through AdblockConfig::Publish. The
+// sequence is odd while an update is in progress and changes with every
+// update, readers retry until they see the same even value before and after
+// copying the settings. The layout version and size come first and never
+// move, a control object with another layout is ignored.
+struct AdblockControl {
+  // Raised with every change of the layout below
+  enum { LAYOUT_VERSION = 2 };
 
+  std::uint32_t layout_version;
+  std::uint32_t size;
+  boost::atomic<std::uint32_t> sequence;
+  AdblockSettings settings;
+
+  AdblockControl()
+      : layout_version(LAYOUT_VERSION),
+        size(sizeof(AdblockControl)),
+        sequence(0) {
+    settings.block_ads = false;
+    settings.block_malware = false;
+    settings.dont_track_me = false;
+    settings.raw_reports = false;
+    settings.capture_requests = false;
+    settings.capture_urls = 0;
+    settings.log_stats = false;
+    settings.query_budget_ms = 0;
+    settings.fail_closed = false;
+    settings.startup_policy = STARTUP_QUERY;
+  }
+};
+
+// Reads the settings the host shares. A local copy answers all queries and
+// is only refreshed when the shared sequence moves. While the host's segment
+// doesn't exist, attempts to open it back off exponentially.
 class AdblockConfig {
  public:
+  typedef boost::function<void(const AdblockSettings&)> ChangeCallback;
+
   AdblockConfig();
   ~AdblockConfig();
 
-  bool block_ads();
-  bool block_malware();
-  bool dont_track_me();
+  bool block_ads() { return (flags() & BLOCK_ADS) != 0; }
+  bool block_malware() { return (flags() & BLOCK_MALWARE) != 0; }
+  bool dont_track_me() { return (flags() & DONT_TRACK_ME) != 0; }
+  bool raw_reports() { return (flags() & RAW_REPORTS) != 0; }
+  bool capture_requests() { return (flags() & CAPTURE_REQUESTS) != 0; }
+  std::uint8_t capture_urls() {
+    return (flags() >> CAPTURE_URLS_SHIFT) & CAPTURE_URLS_MASK;
+  }
+  bool log_stats() { return (flags() & LOG_STATS) != 0; }
+  std::uint16_t query_budget_ms() {
+    return static_cast<std::uint16_t>(flags() >> QUERY_BUDGET_SHIFT);
+  }
+  bool fail_closed() { return (flags() & FAIL_CLOSED) != 0; }
+  StartupPolicy startup_policy() {
+    return static_cast<StartupPolicy>((flags() >> STARTUP_POLICY_SHIFT) &
+                                      STARTUP_POLICY_MASK);
+  }
+
+  // Callbacks run on the thread that notices a change, outside of any lock.
+  void AddChangeCallback(const ChangeCallback& callback);
+
+  // Host side: replaces the shared settings, there must be one writer only.
+  static void Publish(AdblockControl* control,
+                      const AdblockSettings& settings);
 
  private:
-  boost::interprocess::managed_shared_memory* segment_;
-  AdblockControl* adblock_control_;
+  enum {
+    BLOCK_ADS = 1 << 0,
+    BLOCK_MALWARE = 1 << 1,
+    DONT_TRACK_ME = 1 << 2,
+    RAW_REPORTS = 1 << 3,
+    CAPTURE_REQUESTS = 1 << 4,
+    CAPTURE_URLS_SHIFT = 5,
+    CAPTURE_URLS_MASK = 3,
+    LOG_STATS = 1 << 7,
+    FAIL_CLOSED = 1 << 8,
+    STARTUP_POLICY_SHIFT = 9,
+    STARTUP_POLICY_MASK = 3,
+    QUERY_BUDGET_SHIFT = 16
+  };
 
-  bool Init();
-};
+  boost::mutex mutex_;
+  boost::interprocess::managed_shared_memory* segment_;
+  boost::atomic<AdblockControl*> adblock_control_;
+  // Shared sequence the local flags were copied at, odd before the first copy
+  // or when the last update couldn't be read
+  boost::atomic<std::uint32_t> sequence_;
+  boost::atomic<std::uint32_t> flags_;
+  boost::atomic<std::time_t> next_open_;
+  std::time_t backoff_;
+  std::vector<ChangeCallback> callbacks_;
 
-class AdblockSender {
- public:
-  AdblockSender();
-  ~AdblockSender();
-  void Send(const std::string& msg);
+  std::uint32_t flags() {
+    AdblockControl* control =
+        adblock_control_.load(boost::memory_order_acquire);
+    if (control ? control->sequence.load(boost::memory_order_acquire) !=
+                      sequence_.load(boost::memory_order_acquire)
+                : std::time(nullptr) >=
+                      next_open_.load(boost::memory_order_relaxed)) {
+      Update();
+    }
+    return flags_.load(boost::memory_order_relaxed);
+  }
 
- private:
-  boost::interprocess::message_queue* queue_;
+  bool Init();
+  void Update();
 };
 
 }  // namespace adblock
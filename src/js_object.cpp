@@ -1,5 +1,8 @@
 #include "js_object.h"
 #include "js_error.h"
+#include "engine_stats.h"
+#include "ini_parser.h"
+#include "md5.h"
 
 #include <boost/filesystem/operations.hpp>
 
@@ -126,14 +129,50 @@ void TriggerCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
   }
 }
 
+// md5Checksum(lines): base64 MD5 of the UTF-8 lines joined by "\n", without
+// padding. Hashes line by line instead of joining and re-encoding the whole
+// list in script, which is slow for lists of several megabytes.
+void Md5ChecksumCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 1 || !args[0]->IsArray()) {
+    ADB_THROW_EXCEPTION(isolate, "md5Checksum expects an array of lines");
+  }
+
+  auto lines = v8::Local<v8::Array>::Cast(args[0]);
+  Md5 md5;
+  std::vector<char> buffer;
+  for (std::uint32_t idx = 0; idx < lines->Length(); ++idx) {
+    if (idx) {
+      md5.Update("\n", 1);
+    }
+    v8::Local<v8::String> line = lines->Get(idx)->ToString();
+    int length = line->Utf8Length();
+    if (length == 0) {
+      continue;
+    }
+    if (buffer.size() < static_cast<size_t>(length)) {
+      buffer.resize(length);
+    }
+    line->WriteUtf8(&buffer[0], length, nullptr,
+                    v8::String::NO_NULL_TERMINATION);
+    md5.Update(&buffer[0], length);
+  }
+  args.GetReturnValue().Set(
+      v8::String::NewFromUtf8(isolate, md5.Base64Digest().c_str()));
+}
+
 void Setup(Environment* env) {
   auto global = env->context()->Global();
   ADB_SET_METHOD(global, "setTimeout", SetTimeoutCallback);
   ADB_SET_METHOD(global, "clearTimeout", ClearTimeoutCallback);
   ADB_SET_METHOD(global, "trigger", TriggerCallback);
+  ADB_SET_METHOD(global, "md5Checksum", Md5ChecksumCallback);
   ADB_SET_OBJECT(global, "fileSystem", file_system_object::Setup(env));
   ADB_SET_OBJECT(global, "webRequest", web_request_object::Setup(env));
+  ADB_SET_OBJECT(global, "filterIndex", filter_index_object::Setup(env));
   ADB_SET_OBJECT(global, "console", console_object::Setup(env));
+  ADB_SET_OBJECT(global, "scheduler", scheduler_object::Setup(env));
+  ADB_SET_OBJECT(global, "profiler", profiler_object::Setup(env));
 }
 
 namespace file_system_object {
@@ -172,11 +211,119 @@ void ReadThread::Run() {
   delete this;
 }
 
+v8::Local<v8::Object> ToV8Object(v8::Isolate* isolate,
+                                 const IniParser::PropertyList& properties) {
+  v8::Local<v8::Object> result = v8::Object::New();
+  for (auto it = properties.begin(); it != properties.end(); ++it) {
+    result->Set(STD_STRING_TO_V8_STRING(isolate, it->first),
+                STD_STRING_TO_V8_STRING(isolate, it->second));
+  }
+  return result;
+}
+
+void ReadDatabaseThread::Run() {
+  IniParser parser;
+  std::string error;
+  StartupProfile* profile = env_->startup_profile();
+
+  std::uint64_t start = EngineStats::Now();
+  try {
+    // Decompressed chunks go straight into the parser so that the whole file
+    // is never held in memory twice
+    file_system_->ReadChunks(
+        path_, boost::bind(&IniParser::Feed, &parser, _1, _2));
+  }
+  catch (const std::exception& e) {
+    error = e.what();
+  }
+  std::uint64_t read = EngineStats::Now();
+  profile->Record("database_read", start, read);
+  parser.Finish();
+  std::uint64_t parsed = EngineStats::Now();
+  profile->Record("ini_parse", read, parsed);
+
+  SETUP_THREAD_CONTEXT(env_);
+
+  v8::Local<v8::Array> sections = v8::Array::New(parser.size());
+  uint32_t index = 0;
+  for (auto it = parser.begin(); it != parser.end(); ++it) {
+    v8::Local<v8::Object> section = v8::Object::New();
+    section->Set(STD_STRING_TO_V8_STRING(isolate, "name"),
+                 STD_STRING_TO_V8_STRING(isolate, it->name));
+    if (it->type == IniParser::SECTION_OBJECT) {
+      section->Set(STD_STRING_TO_V8_STRING(isolate, "properties"),
+                   ToV8Object(isolate, it->properties));
+    } else if (it->type == IniParser::SECTION_LIST) {
+      v8::Local<v8::Array> lines = v8::Array::New(it->lines.size());
+      for (uint32_t idx = 0; idx < it->lines.size(); ++idx) {
+        lines->Set(idx, STD_STRING_TO_V8_STRING(isolate, it->lines[idx]));
+      }
+      section->Set(STD_STRING_TO_V8_STRING(isolate, "lines"), lines);
+    }
+    sections->Set(index++, section);
+  }
+
+  v8::Local<v8::Object> result = v8::Object::New();
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "fileProperties"),
+              ToV8Object(isolate, parser.file_properties()));
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "sections"), sections);
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "error"),
+              STD_STRING_TO_V8_STRING(isolate, error));
+  // Includes the wait for the engine
+  profile->Record("database_objects", parsed, EngineStats::Now());
+
+  CallParams params;
+  params.push_back(result);
+  try {
+    callback_->Call(params);
+  }
+  catch (const std::exception& e) {
+#ifdef WIN32
+    OutputDebugStringA(e.what());
+#endif  // WIN32
+    std::cerr << e.what() << std::endl;
+  }
+
+  delete this;
+}
+
 void WriteThread::Run() {
   std::string error;
 
   try {
-    file_system_->Write(path_, data_);
+    if (compress_) {
+      file_system_->WriteCompressed(path_, data_);
+    } else {
+      file_system_->Write(path_, data_);
+    }
+  }
+  catch (const std::exception& e) {
+    error = e.what();
+  }
+
+  SETUP_THREAD_CONTEXT(env_);
+
+  auto result = v8::String::NewFromUtf8(isolate, error.c_str());
+  CallParams params;
+  params.push_back(result);
+  try {
+    callback_->Call(params);
+  }
+  catch (const std::exception& e) {
+#ifdef WIN32
+    OutputDebugStringA(e.what());
+#endif  // WIN32
+    std::cerr << e.what() << std::endl;
+  }
+
+  delete this;
+}
+
+void AppendThread::Run() {
+  std::string error;
+
+  try {
+    file_system_->Append(path_, data_);
   }
   catch (const std::exception& e) {
     error = e.what();
@@ -316,6 +463,22 @@ void ReadCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
   thread->Start();
 }
 
+void ReadDatabaseCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 2) {
+    ADB_THROW_EXCEPTION(isolate,
+                        "fileSystem.readDatabase requires 2 parameters");
+  }
+  if (!args[1]->IsFunction()) {
+    ADB_THROW_EXCEPTION(
+        isolate,
+        "Second argument to fileSystem.readDatabase must be a function");
+  }
+
+  Thread* thread = new ReadDatabaseThread(args);
+  thread->Start();
+}
+
 void WriteCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
   v8::Isolate* isolate = args.GetIsolate();
   if (args.Length() != 3) {
@@ -326,7 +489,37 @@ void WriteCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
         isolate, "Third argument to fileSystem.write must be a function");
   }
 
-  Thread* thread = new WriteThread(args);
+  Thread* thread = new WriteThread(args, false);
+  thread->Start();
+}
+
+void WriteCompressedCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 3) {
+    ADB_THROW_EXCEPTION(isolate,
+                        "fileSystem.writeCompressed requires 3 parameters");
+  }
+  if (!args[2]->IsFunction()) {
+    ADB_THROW_EXCEPTION(
+        isolate,
+        "Third argument to fileSystem.writeCompressed must be a function");
+  }
+
+  Thread* thread = new WriteThread(args, true);
+  thread->Start();
+}
+
+void AppendCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 3) {
+    ADB_THROW_EXCEPTION(isolate, "fileSystem.append requires 3 parameters");
+  }
+  if (!args[2]->IsFunction()) {
+    ADB_THROW_EXCEPTION(
+        isolate, "Third argument to fileSystem.append must be a function");
+  }
+
+  Thread* thread = new AppendThread(args);
   thread->Start();
 }
 
@@ -388,7 +581,10 @@ v8::Local<v8::Object> Setup(Environment* env) {
   v8::EscapableHandleScope handle_scope(env->isolate());
   auto obj = v8::Object::New();
   ADB_SET_METHOD(obj, "read", ReadCallback);
+  ADB_SET_METHOD(obj, "readDatabase", ReadDatabaseCallback);
   ADB_SET_METHOD(obj, "write", WriteCallback);
+  ADB_SET_METHOD(obj, "writeCompressed", WriteCompressedCallback);
+  ADB_SET_METHOD(obj, "append", AppendCallback);
   ADB_SET_METHOD(obj, "remove", RemoveCallback);
   ADB_SET_METHOD(obj, "move", MoveCallback);
   ADB_SET_METHOD(obj, "stat", StatCallback);
@@ -400,11 +596,14 @@ v8::Local<v8::Object> Setup(Environment* env) {
 
 namespace web_request_object {
 
-void WebRequestThread::Run() {
-  WebRequest::ServerResponse response = web_request_->Get(url_, headers_);
-
-  SETUP_THREAD_CONTEXT(env_);
+// Number of filter lines collected before they are passed to JavaScript
+const size_t kListBatchSize = 2000;
+// Batches waiting for JavaScript at most, the download is paused until it
+// catches up beyond that
+const size_t kMaxListBatches = 8;
 
+v8::Local<v8::Object> ToV8Object(v8::Isolate* isolate,
+                                 const WebRequest::ServerResponse& response) {
   v8::Local<v8::Object> result = v8::Object::New();
   result->Set(STD_STRING_TO_V8_STRING(isolate, "status"),
               v8::Integer::New(response.status));
@@ -412,6 +611,10 @@ void WebRequestThread::Run() {
               v8::Integer::New(response.response_status));
   result->Set(STD_STRING_TO_V8_STRING(isolate, "responseText"),
               STD_STRING_TO_V8_STRING(isolate, response.response_text));
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "bytesReceived"),
+              v8::Number::New(response.bytes_received));
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "downloadTime"),
+              v8::Number::New(response.download_time));
 
   v8::Local<v8::Object> headers_obj = v8::Object::New();
   for (auto it = response.response_headers.begin();
@@ -420,9 +623,26 @@ void WebRequestThread::Run() {
                      STD_STRING_TO_V8_STRING(isolate, it->second));
   }
   result->Set(STD_STRING_TO_V8_STRING(isolate, "responseHeaders"), headers_obj);
+  return result;
+}
+
+boost::thread* WebRequestThread::Start() {
+  web_request_->GetAsync(url_, headers_,
+                         boost::bind(&WebRequestThread::OnResponse, this, _1),
+                         WebRequest::DataCallback());
+  return nullptr;
+}
+
+void WebRequestThread::OnResponse(const WebRequest::ServerResponse& response) {
+  response_ = response;
+  Thread::Start();
+}
+
+void WebRequestThread::Run() {
+  SETUP_THREAD_CONTEXT(env_);
 
   CallParams params;
-  params.push_back(result);
+  params.push_back(ToV8Object(isolate, response_));
   try {
     callback_->Call(params);
   }
@@ -436,6 +656,142 @@ void WebRequestThread::Run() {
   delete this;
 }
 
+boost::thread* ListRequestThread::Start() {
+  Thread::Start();
+  web_request_->GetAsync(url_, headers_,
+                         boost::bind(&ListRequestThread::OnResponse, this, _1),
+                         boost::bind(&ListRequestThread::OnData, this, _1, _2,
+                                     _3));
+  return nullptr;
+}
+
+bool ListRequestThread::OnData(const char* data, size_t size,
+                               const WebRequest::ResumeCallback& resume) {
+  {
+    // The transfer thread is shared by all downloads, it must not wait for
+    // JavaScript to take the batches
+    boost::mutex::scoped_lock lock(mutex_);
+    if (batches_.size() >= kMaxListBatches) {
+      resume_ = resume;
+      return false;
+    }
+  }
+
+  parser_.Feed(data, size);
+  if (parser_.pending_lines() < kListBatchSize) {
+    return true;
+  }
+
+  ListParser::LineList lines;
+  parser_.TakeLines(&lines);
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    batches_.push_back(ListParser::LineList());
+    batches_.back().swap(lines);
+  }
+  ready_.notify_one();
+  return true;
+}
+
+void ListRequestThread::OnResponse(const WebRequest::ServerResponse& response) {
+  parser_.Finish();
+  ListParser::LineList lines;
+  parser_.TakeLines(&lines);
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!lines.empty()) {
+      batches_.push_back(ListParser::LineList());
+      batches_.back().swap(lines);
+    }
+    response_ = response;
+    finished_ = true;
+    // Notified under the lock, the delivering thread deletes this object
+    // once it sees finished_
+    ready_.notify_one();
+  }
+}
+
+void ListRequestThread::Run() {
+  while (true) {
+    ListParser::LineList lines;
+    WebRequest::ResumeCallback resume;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (batches_.empty() && !finished_) {
+        ready_.wait(lock);
+      }
+      if (batches_.empty()) {
+        break;
+      }
+      lines.swap(batches_.front());
+      batches_.pop_front();
+      resume.swap(resume_);
+    }
+    if (resume) {
+      resume();
+    }
+    DeliverLines(lines);
+  }
+
+  DeliverResult();
+  delete this;
+}
+
+void ListRequestThread::DeliverLines(const ListParser::LineList& lines) {
+  SETUP_THREAD_CONTEXT(env_);
+
+  v8::Local<v8::Array> array = v8::Array::New(lines.size());
+  for (uint32_t idx = 0; idx < lines.size(); ++idx) {
+    array->Set(idx, STD_STRING_TO_V8_STRING(isolate, lines[idx]));
+  }
+
+  CallParams params;
+  params.push_back(array);
+  try {
+    data_callback_->Call(params);
+  }
+  catch (const std::exception& e) {
+#ifdef WIN32
+    OutputDebugStringA(e.what());
+#endif  // WIN32
+    std::cerr << e.what() << std::endl;
+  }
+}
+
+void ListRequestThread::DeliverResult() {
+  SETUP_THREAD_CONTEXT(env_);
+
+  v8::Local<v8::Object> list = v8::Object::New();
+  list->Set(STD_STRING_TO_V8_STRING(isolate, "valid"),
+            v8::Boolean::New(parser_.valid()));
+  list->Set(STD_STRING_TO_V8_STRING(isolate, "minVersion"),
+            STD_STRING_TO_V8_STRING(isolate, parser_.min_version()));
+  list->Set(STD_STRING_TO_V8_STRING(isolate, "checksumMismatch"),
+            v8::Boolean::New(parser_.checksum_mismatch()));
+  v8::Local<v8::Object> parameters = v8::Object::New();
+  for (auto it = parser_.parameters().begin(); it != parser_.parameters().end();
+       ++it) {
+    parameters->Set(STD_STRING_TO_V8_STRING(isolate, it->first),
+                    STD_STRING_TO_V8_STRING(isolate, it->second));
+  }
+  list->Set(STD_STRING_TO_V8_STRING(isolate, "params"), parameters);
+
+  v8::Local<v8::Object> result = ToV8Object(isolate, response_);
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "list"), list);
+
+  CallParams params;
+  params.push_back(result);
+  try {
+    callback_->Call(params);
+  }
+  catch (const std::exception& e) {
+#ifdef WIN32
+    OutputDebugStringA(e.what());
+#endif  // WIN32
+    std::cerr << e.what() << std::endl;
+  }
+}
+
 void GetCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
   v8::Isolate* isolate = args.GetIsolate();
   if (args.Length() != 3) {
@@ -454,15 +810,171 @@ void GetCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
   thread->Start();
 }
 
+void GetListCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 4) {
+    ADB_THROW_EXCEPTION(isolate, "webRequest.getList requires 4 parameters");
+  }
+  if (!args[1]->IsObject()) {
+    ADB_THROW_EXCEPTION(
+        isolate, "Second argument to webRequest.getList must be a object");
+  }
+  if (!args[2]->IsFunction()) {
+    ADB_THROW_EXCEPTION(
+        isolate, "Third argument to webRequest.getList must be a function");
+  }
+  if (!args[3]->IsFunction()) {
+    ADB_THROW_EXCEPTION(
+        isolate, "Fourth argument to webRequest.getList must be a function");
+  }
+
+  Thread* thread = new ListRequestThread(args);
+  thread->Start();
+}
+
 v8::Local<v8::Object> Setup(Environment* env) {
   v8::EscapableHandleScope handle_scope(env->isolate());
   auto obj = v8::Object::New();
   ADB_SET_METHOD(obj, "get", GetCallback);
+  ADB_SET_METHOD(obj, "getList", GetListCallback);
   return handle_scope.Escape(obj);
 }
 
 }  // namespace web_request_object
 
+namespace filter_index_object {
+
+// Buckets are passed flattened: keyword, filter count, then text, pattern,
+// content type, flags and domains of every filter.
+bool ConvertBuckets(const v8::Handle<v8::Value>& value, BucketList* buckets) {
+  if (!value->IsArray()) {
+    return false;
+  }
+  auto list = v8::Handle<v8::Array>::Cast<v8::Value>(value);
+  uint32_t length = list->Length();
+  uint32_t idx = 0;
+  while (idx + 2 <= length) {
+    KeywordBucket bucket;
+    bucket.keyword = V8_STRING_TO_STD_STRING(list->Get(idx++)->ToString());
+    uint32_t count = list->Get(idx++)->Uint32Value();
+    if (idx + count * 5 > length) {
+      return false;
+    }
+    bucket.filters.resize(count);
+    for (uint32_t filter = 0; filter < count; ++filter) {
+      FilterData& data = bucket.filters[filter];
+      data.text = V8_STRING_TO_STD_STRING(list->Get(idx++)->ToString());
+      data.pattern = V8_STRING_TO_STD_STRING(list->Get(idx++)->ToString());
+      data.content_type = list->Get(idx++)->Uint32Value();
+      data.flags = list->Get(idx++)->Uint32Value();
+      data.domains = V8_STRING_TO_STD_STRING(list->Get(idx++)->ToString());
+    }
+    buckets->push_back(bucket);
+  }
+  return idx == length;
+}
+
+void AttachCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  auto filter_index = Environment::GetCurrent(isolate)->GetFilterIndex();
+  const char* role = "";
+  switch (filter_index->Attach()) {
+    case FilterIndex::BUILDER:
+      role = "builder";
+      break;
+    case FilterIndex::READER:
+      role = "reader";
+      break;
+    default:
+      break;
+  }
+  args.GetReturnValue().Set(v8::String::NewFromUtf8(isolate, role));
+}
+
+void TakeOverCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto filter_index =
+      Environment::GetCurrent(args.GetIsolate())->GetFilterIndex();
+  args.GetReturnValue().Set(filter_index->TakeOver());
+}
+
+void PublishCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 2) {
+    ADB_THROW_EXCEPTION(isolate, "filterIndex.publish requires 2 parameters");
+  }
+  BucketList blacklist;
+  BucketList whitelist;
+  if (!ConvertBuckets(args[0], &blacklist) ||
+      !ConvertBuckets(args[1], &whitelist)) {
+    ADB_THROW_EXCEPTION(isolate,
+                        "Arguments to filterIndex.publish must be filter lists");
+  }
+
+  auto filter_index = Environment::GetCurrent(isolate)->GetFilterIndex();
+  args.GetReturnValue().Set(filter_index->Publish(blacklist, whitelist));
+}
+
+void MatchCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 4 && args.Length() != 5) {
+    ADB_THROW_EXCEPTION(isolate,
+                        "filterIndex.match requires 4 or 5 parameters");
+  }
+
+  auto filter_index = Environment::GetCurrent(isolate)->GetFilterIndex();
+  FilterMatch match;
+  bool whitelist_only = args.Length() == 5 && args[4]->BooleanValue();
+  if (!filter_index->Match(V8_STRING_TO_STD_STRING(args[0]->ToString()),
+                           args[1]->Uint32Value(),
+                           V8_STRING_TO_STD_STRING(args[2]->ToString()),
+                           args[3]->BooleanValue(), whitelist_only, &match)) {
+    args.GetReturnValue().SetNull();
+    return;
+  }
+
+  // Same properties as Filter.toJSON(), API consumers can't tell the
+  // difference
+  auto result = v8::Object::New();
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "type"),
+              v8::Integer::New(match.type));
+  if (match.type == FilterMatch::BLOCKING_FILTER) {
+    v8::Handle<v8::Value> collapse = v8::Null(isolate);
+    if (match.collapse >= 0) {
+      collapse = v8::Boolean::New(match.collapse != 0);
+    }
+    result->Set(STD_STRING_TO_V8_STRING(isolate, "collapse"), collapse);
+  } else {
+    result->Set(STD_STRING_TO_V8_STRING(isolate, "siteKeys"),
+                v8::Null(isolate));
+  }
+  if (match.malware) {
+    result->Set(STD_STRING_TO_V8_STRING(isolate, "malware"),
+                v8::Boolean::New(true));
+  }
+  result->Set(STD_STRING_TO_V8_STRING(isolate, "text"),
+              STD_STRING_TO_V8_STRING(isolate, match.text));
+  args.GetReturnValue().Set(result);
+}
+
+void GenerationCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  auto filter_index =
+      Environment::GetCurrent(args.GetIsolate())->GetFilterIndex();
+  args.GetReturnValue().Set(filter_index->generation());
+}
+
+v8::Local<v8::Object> Setup(Environment* env) {
+  v8::EscapableHandleScope handle_scope(env->isolate());
+  auto obj = v8::Object::New();
+  ADB_SET_METHOD(obj, "attach", AttachCallback);
+  ADB_SET_METHOD(obj, "takeOver", TakeOverCallback);
+  ADB_SET_METHOD(obj, "publish", PublishCallback);
+  ADB_SET_METHOD(obj, "match", MatchCallback);
+  ADB_SET_METHOD(obj, "generation", GenerationCallback);
+  return handle_scope.Escape(obj);
+}
+
+}  // namespace filter_index_object
+
 namespace console_object {
 
 void DoLog(LogSystem::LogLevel level,
@@ -535,5 +1047,74 @@ v8::Local<v8::Object> Setup(Environment* env) {
 
 }  // namespace console_object
 
+namespace scheduler_object {
+
+// postTask(fn): runs fn in an engine turn of its own once the queries waiting
+// for the engine got theirs
+void PostTaskCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 1 || !args[0]->IsFunction()) {
+    ADB_THROW_EXCEPTION(isolate, "postTask expects a function");
+  }
+  Environment::GetCurrent(isolate)->task_scheduler()->Post(
+      JsValuePtr(new JsValue(isolate, args[0])));
+}
+
+// shouldYield(): whether a query waits for the engine
+void ShouldYieldCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  args.GetReturnValue().Set(Environment::GetCurrent(args.GetIsolate())
+                                ->task_scheduler()
+                                ->foreground_waiting());
+}
+
+v8::Local<v8::Object> Setup(Environment* env) {
+  v8::EscapableHandleScope handle_scope(env->isolate());
+  auto obj = v8::Object::New();
+  ADB_SET_METHOD(obj, "postTask", PostTaskCallback);
+  ADB_SET_METHOD(obj, "shouldYield", ShouldYieldCallback);
+  return handle_scope.Escape(obj);
+}
+
+}  // namespace scheduler_object
+
+namespace profiler_object {
+
+// Calls |method| of the startup profile with the phase name of |args|
+void CallProfile(const v8::FunctionCallbackInfo<v8::Value>& args,
+                 void (StartupProfile::*method)(const std::string& name)) {
+  v8::Isolate* isolate = args.GetIsolate();
+  if (args.Length() != 1 || !args[0]->IsString()) {
+    ADB_THROW_EXCEPTION(isolate, "The profiler expects a phase name");
+  }
+  (Environment::GetCurrent(isolate)->startup_profile()->*method)(
+      V8_STRING_TO_STD_STRING(args[0]));
+}
+
+// begin(name): a phase of the startup starts
+void BeginCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  CallProfile(args, &StartupProfile::Begin);
+}
+
+// end(name): the phase started with begin(name) ends
+void EndCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  CallProfile(args, &StartupProfile::End);
+}
+
+// mark(name): records a point in time of the startup
+void MarkCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  CallProfile(args, &StartupProfile::Mark);
+}
+
+v8::Local<v8::Object> Setup(Environment* env) {
+  v8::EscapableHandleScope handle_scope(env->isolate());
+  auto obj = v8::Object::New();
+  ADB_SET_METHOD(obj, "begin", BeginCallback);
+  ADB_SET_METHOD(obj, "end", EndCallback);
+  ADB_SET_METHOD(obj, "mark", MarkCallback);
+  return handle_scope.Escape(obj);
+}
+
+}  // namespace profiler_object
+
 }  // namespace js_object
 }  // namespace adblock
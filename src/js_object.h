@@ -2,8 +2,13 @@
 #define JS_OBJECT_H_
 
 #include "env.h"
+#include "list_parser.h"
 #include "utils.h"
 
+#include <deque>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 namespace adblock {
 
 class Thread {
@@ -91,9 +96,37 @@ class ReadThread : public IoThread {
   void Run();
 };
 
+class ReadDatabaseThread : public IoThread {
+ public:
+  explicit ReadDatabaseThread(const v8::FunctionCallbackInfo<v8::Value>& args)
+      : IoThread(args.GetIsolate(), args[1]),
+        path_(V8_STRING_TO_STD_STRING(args[0]->ToString())) {}
+
+ private:
+  std::string path_;
+
+  void Run();
+};
+
 class WriteThread : public IoThread {
  public:
-  explicit WriteThread(const v8::FunctionCallbackInfo<v8::Value>& args)
+  WriteThread(const v8::FunctionCallbackInfo<v8::Value>& args, bool compress)
+      : IoThread(args.GetIsolate(), args[2]),
+        path_(V8_STRING_TO_STD_STRING(args[0]->ToString())),
+        data_(V8_STRING_TO_STD_STRING(args[1]->ToString())),
+        compress_(compress) {}
+
+ private:
+  std::string path_;
+  std::string data_;
+  bool compress_;
+
+  void Run();
+};
+
+class AppendThread : public IoThread {
+ public:
+  explicit AppendThread(const v8::FunctionCallbackInfo<v8::Value>& args)
       : IoThread(args.GetIsolate(), args[2]),
         path_(V8_STRING_TO_STD_STRING(args[0]->ToString())),
         data_(V8_STRING_TO_STD_STRING(args[1]->ToString())) {}
@@ -148,40 +181,106 @@ v8::Local<v8::Object> Setup(Environment* env);
 
 namespace web_request_object {
 
+inline WebRequest::HeaderList ConvertHeaders(
+    const v8::Handle<v8::Value>& value) {
+  WebRequest::HeaderList headers;
+  auto obj = v8::Handle<v8::Object>::Cast<v8::Value>(value);
+  v8::Local<v8::Array> properties = obj->GetOwnPropertyNames();
+  for (uint32_t idx = 0; idx < properties->Length(); ++idx) {
+    v8::Local<v8::Value> property = properties->Get(idx);
+    v8::Local<v8::Value> value = obj->Get(property);
+    std::string property_name = V8_STRING_TO_STD_STRING(property->ToString());
+    std::string value_name = V8_STRING_TO_STD_STRING(value->ToString());
+    headers.push_back(std::make_pair(property_name, value_name));
+  }
+  return headers;
+}
+
 class WebRequestThread : public Thread {
  public:
   explicit WebRequestThread(const v8::FunctionCallbackInfo<v8::Value>& args)
       : Thread(args.GetIsolate()),
         web_request_(env_->GetWebRequest()),
         url_(V8_STRING_TO_STD_STRING(args[0]->ToString())),
-        callback_(new JsValue(args.GetIsolate(), args[2])) {
-    auto obj = v8::Handle<v8::Object>::Cast<v8::Value>(args[1]);
-    v8::Local<v8::Array> properties = obj->GetOwnPropertyNames();
-    for (uint32_t idx = 0; idx < properties->Length(); ++idx) {
-      v8::Local<v8::Value> property = properties->Get(idx);
-      v8::Local<v8::Value> value = obj->Get(property);
-      std::string property_name = V8_STRING_TO_STD_STRING(property->ToString());
-      std::string value_name = V8_STRING_TO_STD_STRING(value->ToString());
-      headers_.push_back(std::make_pair(property_name, value_name));
-    }
-  }
+        headers_(ConvertHeaders(args[1])),
+        callback_(new JsValue(args.GetIsolate(), args[2])) {}
+
+  // Queues the request, the thread delivering the response to JavaScript is
+  // only started once it has arrived.
+  boost::thread* Start();
 
  private:
   WebRequestPtr web_request_;
   std::string url_;
   WebRequest::HeaderList headers_;
   JsValuePtr callback_;
+  WebRequest::ServerResponse response_;
+
+  void OnResponse(const WebRequest::ServerResponse& response);
+  void Run();
+};
+
+// Downloads a filter list and parses it while the data arrives. Batches of
+// filter lines are passed to JavaScript in order as they become available,
+// the final callback gets the response along with the list header data.
+class ListRequestThread : public Thread {
+ public:
+  explicit ListRequestThread(const v8::FunctionCallbackInfo<v8::Value>& args)
+      : Thread(args.GetIsolate()),
+        web_request_(env_->GetWebRequest()),
+        url_(V8_STRING_TO_STD_STRING(args[0]->ToString())),
+        headers_(ConvertHeaders(args[1])),
+        data_callback_(new JsValue(args.GetIsolate(), args[2])),
+        callback_(new JsValue(args.GetIsolate(), args[3])),
+        finished_(false) {}
+
+  boost::thread* Start();
 
+ private:
+  WebRequestPtr web_request_;
+  std::string url_;
+  WebRequest::HeaderList headers_;
+  JsValuePtr data_callback_;
+  JsValuePtr callback_;
+  // Only used by the transfer thread until finished_ is set
+  ListParser parser_;
+  WebRequest::ServerResponse response_;
+
+  boost::mutex mutex_;
+  boost::condition_variable ready_;
+  std::deque<ListParser::LineList> batches_;
+  // Set while the download is paused because the queue is full, called once
+  // a batch was taken
+  WebRequest::ResumeCallback resume_;
+  bool finished_;
+
+  bool OnData(const char* data, size_t size,
+              const WebRequest::ResumeCallback& resume);
+  void OnResponse(const WebRequest::ServerResponse& response);
+  void DeliverLines(const ListParser::LineList& lines);
+  void DeliverResult();
   void Run();
 };
 
 v8::Local<v8::Object> Setup(Environment* env);
 }  // namespace web_request_object
 
+namespace filter_index_object {
+v8::Local<v8::Object> Setup(Environment* env);
+}  // namespace filter_index_object
+
 namespace console_object {
 v8::Local<v8::Object> Setup(Environment* env);
 }  // namespace console_object
 
+namespace scheduler_object {
+v8::Local<v8::Object> Setup(Environment* env);
+}  // namespace scheduler_object
+
+namespace profiler_object {
+v8::Local<v8::Object> Setup(Environment* env);
+}  // namespace profiler_object
+
 }  // namespace js_object
 }  // namespace adblock
 
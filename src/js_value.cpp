@@ -13,10 +13,7 @@ v8::Local<v8::Value> JsValue::Call(const JsValueList& args, Environment* env) {
     throw std::invalid_argument("Attempting to call a non-function");
   }
 
-  v8::Isolate* isolate = env->isolate();
-  v8::Locker locker(isolate);
-  v8::HandleScope handle_scope(isolate);
-  v8::Context::Scope context_scope(env->context());
+  SETUP_THREAD_CONTEXT(env);
 
   CallParams params;
   for (auto it = args.begin(); it != args.end(); ++it) {
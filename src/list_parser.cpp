@@ -0,0 +1,210 @@
+#include "list_parser.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+const char* const kParameters[] = {"redirect", "homepage", "title", "version",
+                                   "expires"};
+
+inline bool IsSeparator(char c) { return c == '\r' || c == '\n'; }
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+inline bool IsWordChar(char c) {
+  return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+size_t SkipSpaces(const std::string& line, size_t pos) {
+  while (pos < line.length() && IsSpace(line[pos])) {
+    ++pos;
+  }
+  return pos;
+}
+
+bool MatchesIgnoreCase(const std::string& line, size_t pos, const char* word) {
+  for (; *word; ++word, ++pos) {
+    if (pos >= line.length() ||
+        tolower(static_cast<unsigned char>(line[pos])) != *word) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Matches /^\s*!\s*(\w+)\s*:\s*(.*)/
+bool ParseParameter(const std::string& line, std::string* name,
+                    std::string* value) {
+  size_t pos = SkipSpaces(line, 0);
+  if (pos >= line.length() || line[pos] != '!') {
+    return false;
+  }
+  pos = SkipSpaces(line, pos + 1);
+
+  size_t name_start = pos;
+  while (pos < line.length() && IsWordChar(line[pos])) {
+    ++pos;
+  }
+  if (pos == name_start) {
+    return false;
+  }
+  name->assign(line, name_start, pos - name_start);
+
+  pos = SkipSpaces(line, pos);
+  if (pos >= line.length() || line[pos] != ':') {
+    return false;
+  }
+  value->assign(line, SkipSpaces(line, pos + 1), std::string::npos);
+  std::transform(name->begin(), name->end(), name->begin(), ::tolower);
+  return true;
+}
+
+}  // namespace
+
+namespace adblock {
+
+ListParser::ListParser()
+    : in_separator_(false),
+      line_count_(0),
+      valid_(false),
+      checksums_(1),
+      has_checksum_(false),
+      checksum_mismatch_(false) {}
+
+void ListParser::Feed(const char* data, size_t size) {
+  // Lines are the pieces between runs of line breaks, like the result of
+  // text.split(/[\r\n]+/)
+  const char* end = data + size;
+  while (data < end) {
+    if (in_separator_) {
+      while (data < end && IsSeparator(*data)) {
+        ++data;
+      }
+      if (data < end) {
+        in_separator_ = false;
+      }
+      continue;
+    }
+
+    const char* line_end = std::find_if(data, end, IsSeparator);
+    partial_line_.append(data, line_end);
+    data = line_end;
+    if (data < end) {
+      AddLine(partial_line_);
+      partial_line_.clear();
+      in_separator_ = true;
+    }
+  }
+}
+
+void ListParser::Finish() {
+  AddLine(partial_line_);
+  partial_line_.clear();
+
+  if (valid_ && has_checksum_) {
+    for (auto it = checksums_.begin(); it != checksums_.end(); ++it) {
+      if (it->md5.Base64Digest() != it->expected) {
+        checksum_mismatch_ = true;
+      }
+    }
+  }
+}
+
+void ListParser::TakeLines(LineList* lines) {
+  lines->clear();
+  lines->swap(lines_);
+}
+
+void ListParser::AddLine(const std::string& line) {
+  if (line_count_++ == 0) {
+    valid_ = ParseHeader(line);
+    AddToChecksums(line);
+    return;
+  }
+  if (!valid_) {
+    return;
+  }
+
+  std::string name;
+  std::string value;
+  if (ParseParameter(line, &name, &value)) {
+    if (name == "checksum") {
+      Checksum checksum = checksums_.back();
+      checksum.expected = value.substr(0, value.find_last_not_of('=') + 1);
+      if (has_checksum_) {
+        AddToChecksums(line);
+      } else {
+        // The initial state was only kept to start from
+        checksums_.clear();
+        has_checksum_ = true;
+      }
+      checksums_.push_back(checksum);
+      return;
+    }
+    AddToChecksums(line);
+    const char* const* end = kParameters + sizeof(kParameters) / sizeof(char*);
+    if (std::find(kParameters, end, name) != end) {
+      SetParameter(name, value);
+      return;
+    }
+  } else {
+    AddToChecksums(line);
+  }
+  lines_.push_back(line);
+}
+
+void ListParser::AddToChecksums(const std::string& line) {
+  for (auto it = checksums_.begin(); it != checksums_.end(); ++it) {
+    if (it->started) {
+      it->md5.Update("\n", 1);
+    }
+    it->md5.Update(line);
+    it->started = true;
+  }
+}
+
+// Matches /\[Adblock(?:\s*Plus\s*([\d\.]+)?)?\]/i
+bool ListParser::ParseHeader(const std::string& line) {
+  for (size_t start = line.find('['); start != std::string::npos;
+       start = line.find('[', start + 1)) {
+    if (!MatchesIgnoreCase(line, start + 1, "adblock")) {
+      continue;
+    }
+
+    size_t pos = start + 8;
+    size_t plus = SkipSpaces(line, pos);
+    if (MatchesIgnoreCase(line, plus, "plus")) {
+      size_t version_start = SkipSpaces(line, plus + 4);
+      size_t version_end = version_start;
+      while (version_end < line.length() &&
+             (isdigit(static_cast<unsigned char>(line[version_end])) ||
+              line[version_end] == '.')) {
+        ++version_end;
+      }
+      if (version_end < line.length() && line[version_end] == ']') {
+        min_version_ = line.substr(version_start, version_end - version_start);
+        return true;
+      }
+    }
+    if (pos < line.length() && line[pos] == ']') {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ListParser::SetParameter(const std::string& name,
+                              const std::string& value) {
+  for (auto it = parameters_.begin(); it != parameters_.end(); ++it) {
+    if (it->first == name) {
+      it->second = value;
+      return;
+    }
+  }
+  parameters_.push_back(std::make_pair(name, value));
+}
+
+}  // namespace adblock
@@ -0,0 +1,67 @@
+#ifndef LIST_PARSER_H_
+#define LIST_PARSER_H_
+
+#include "md5.h"
+
+#include <string>
+#include <vector>
+
+namespace adblock {
+
+// Parses a downloaded filter list piece by piece the same way
+// Synchronizer._parseList in lib/synchronizer.js parses the complete text:
+// checks the "[Adblock Plus x.y]" header, extracts "! Key: value" parameters
+// and verifies the checksum. Filter lines are collected until they are taken
+// so memory use is bounded by how often that happens, not by the list size.
+class ListParser {
+ public:
+  typedef std::vector<std::string> LineList;
+  typedef std::vector<std::pair<std::string, std::string>> ParameterList;
+
+  ListParser();
+
+  void Feed(const char* data, size_t size);
+  void Finish();
+
+  // Moves the filter lines collected so far into |lines|.
+  void TakeLines(LineList* lines);
+
+  inline size_t pending_lines() const { return lines_.size(); }
+  // Whether the first line is a valid header, data fed after an invalid
+  // header is ignored.
+  inline bool valid() const { return valid_; }
+  inline const std::string& min_version() const { return min_version_; }
+  inline const ParameterList& parameters() const { return parameters_; }
+  // Only meaningful after Finish()
+  inline bool checksum_mismatch() const { return checksum_mismatch_; }
+
+ private:
+  std::string partial_line_;
+  bool in_separator_;
+  size_t line_count_;
+  bool valid_;
+  std::string min_version_;
+  ParameterList parameters_;
+  LineList lines_;
+  struct Checksum {
+    Checksum() : started(false) {}
+
+    Md5 md5;
+    bool started;
+    std::string expected;
+  };
+  // Each "! Checksum:" line is verified against the lines without it and
+  // the checksum lines before it, later ones are still included.
+  std::vector<Checksum> checksums_;
+  bool has_checksum_;
+  bool checksum_mismatch_;
+
+  void AddLine(const std::string& line);
+  void AddToChecksums(const std::string& line);
+  bool ParseHeader(const std::string& line);
+  void SetParameter(const std::string& name, const std::string& value);
+};
+
+}  // namespace adblock
+
+#endif  // LIST_PARSER_H_
@@ -1,4 +1,5 @@
 #include "log_system.h"
+#include <iostream>
 #include <sstream>
 #ifdef WIN32
 #include <Windows.h>
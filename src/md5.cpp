@@ -0,0 +1,145 @@
+#include "md5.h"
+
+#include <cstring>
+
+namespace {
+
+const unsigned int kSines[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+
+const unsigned int kShifts[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+const char kBase64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+inline unsigned int RotateLeft(unsigned int value, unsigned int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+}  // namespace
+
+namespace adblock {
+
+Md5::Md5() : length_(0) {
+  state_[0] = 0x67452301;
+  state_[1] = 0xefcdab89;
+  state_[2] = 0x98badcfe;
+  state_[3] = 0x10325476;
+}
+
+void Md5::Update(const char* data, size_t size) {
+  const unsigned char* input = reinterpret_cast<const unsigned char*>(data);
+  size_t used = static_cast<size_t>(length_ % 64);
+  length_ += size;
+
+  if (used) {
+    size_t fill = 64 - used;
+    if (size < fill) {
+      std::memcpy(buffer_ + used, input, size);
+      return;
+    }
+    std::memcpy(buffer_ + used, input, fill);
+    Transform(buffer_);
+    input += fill;
+    size -= fill;
+  }
+  for (; size >= 64; input += 64, size -= 64) {
+    Transform(input);
+  }
+  std::memcpy(buffer_, input, size);
+}
+
+void Md5::Final(unsigned char digest[DIGEST_SIZE]) {
+  unsigned long long bits = length_ * 8;
+  unsigned char padding[72] = {0x80};
+  size_t used = static_cast<size_t>(length_ % 64);
+  size_t padding_size = (used < 56 ? 56 : 120) - used;
+  for (int idx = 0; idx < 8; ++idx) {
+    padding[padding_size + idx] = static_cast<unsigned char>(bits >> (idx * 8));
+  }
+  Update(reinterpret_cast<const char*>(padding), padding_size + 8);
+
+  for (int idx = 0; idx < DIGEST_SIZE; ++idx) {
+    digest[idx] =
+        static_cast<unsigned char>(state_[idx / 4] >> ((idx % 4) * 8));
+  }
+}
+
+std::string Md5::Base64Digest() {
+  unsigned char digest[DIGEST_SIZE];
+  Final(digest);
+
+  std::string result;
+  for (int idx = 0; idx < DIGEST_SIZE; idx += 3) {
+    unsigned int group = digest[idx] << 16;
+    if (idx + 1 < DIGEST_SIZE) {
+      group |= digest[idx + 1] << 8;
+    }
+    if (idx + 2 < DIGEST_SIZE) {
+      group |= digest[idx + 2];
+    }
+    result += kBase64[(group >> 18) & 0x3f];
+    result += kBase64[(group >> 12) & 0x3f];
+    if (idx + 1 < DIGEST_SIZE) {
+      result += kBase64[(group >> 6) & 0x3f];
+    }
+    if (idx + 2 < DIGEST_SIZE) {
+      result += kBase64[group & 0x3f];
+    }
+  }
+  return result;
+}
+
+void Md5::Transform(const unsigned char block[64]) {
+  unsigned int words[16];
+  for (int idx = 0; idx < 16; ++idx) {
+    words[idx] = block[idx * 4] | (block[idx * 4 + 1] << 8) |
+                 (block[idx * 4 + 2] << 16) |
+                 (static_cast<unsigned int>(block[idx * 4 + 3]) << 24);
+  }
+
+  unsigned int a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+  for (int idx = 0; idx < 64; ++idx) {
+    unsigned int f;
+    int word;
+    if (idx < 16) {
+      f = (b & c) | (~b & d);
+      word = idx;
+    } else if (idx < 32) {
+      f = (d & b) | (~d & c);
+      word = (5 * idx + 1) % 16;
+    } else if (idx < 48) {
+      f = b ^ c ^ d;
+      word = (3 * idx + 5) % 16;
+    } else {
+      f = c ^ (b | ~d);
+      word = (7 * idx) % 16;
+    }
+    unsigned int temp = d;
+    d = c;
+    c = b;
+    b += RotateLeft(a + f + kSines[idx] + words[word], kShifts[idx]);
+    a = temp;
+  }
+
+  state_[0] += a;
+  state_[1] += b;
+  state_[2] += c;
+  state_[3] += d;
+}
+
+}  // namespace adblock
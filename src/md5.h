@@ -0,0 +1,32 @@
+#ifndef MD5_H_
+#define MD5_H_
+
+#include <string>
+
+namespace adblock {
+
+// Incremental MD5 (RFC 1321) as used for filter list checksums.
+class Md5 {
+ public:
+  enum { DIGEST_SIZE = 16 };
+
+  Md5();
+
+  void Update(const char* data, size_t size);
+  void Update(const std::string& data) { Update(data.data(), data.length()); }
+  // Completes the computation, the object must not be updated afterwards.
+  void Final(unsigned char digest[DIGEST_SIZE]);
+  // Base64 encoded digest without padding, the format of "! Checksum:" lines
+  std::string Base64Digest();
+
+ private:
+  unsigned int state_[4];
+  unsigned long long length_;
+  unsigned char buffer_[64];
+
+  void Transform(const unsigned char block[64]);
+};
+
+}  // namespace adblock
+
+#endif  // MD5_H_
@@ -0,0 +1,55 @@
+#include "process_util.h"
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#endif  // WIN32
+
+#include <boost/filesystem/path.hpp>
+
+namespace adblock {
+
+std::uint32_t CurrentProcessId() {
+#ifdef WIN32
+  return GetCurrentProcessId();
+#else
+  return static_cast<std::uint32_t>(getpid());
+#endif  // WIN32
+}
+
+std::string CurrentProcessName() {
+#ifdef WIN32
+  char file_name[MAX_PATH] = {0};
+  if (GetModuleFileNameA(NULL, file_name, MAX_PATH)) {
+    boost::filesystem::path path(file_name);
+    return path.filename().string();
+  }
+#else
+  char file_name[4096] = {0};
+  ssize_t length = readlink("/proc/self/exe", file_name, sizeof(file_name) - 1);
+  if (length > 0) {
+    boost::filesystem::path path(std::string(file_name, length));
+    return path.filename().string();
+  }
+#endif  // WIN32
+  return "";
+}
+
+bool ProcessExists(std::uint32_t pid) {
+#ifdef WIN32
+  HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+  if (process == NULL) {
+    return GetLastError() == ERROR_ACCESS_DENIED;
+  }
+  bool running = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+  CloseHandle(process);
+  return running;
+#else
+  return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif  // WIN32
+}
+
+}  // namespace adblock
@@ -0,0 +1,17 @@
+#ifndef PROCESS_UTIL_H_
+#define PROCESS_UTIL_H_
+
+#include <cstdint>
+#include <string>
+
+namespace adblock {
+
+std::uint32_t CurrentProcessId();
+// File name of the executable, empty if it can't be determined
+std::string CurrentProcessName();
+// Processes we may not open are assumed to be running
+bool ProcessExists(std::uint32_t pid);
+
+}  // namespace adblock
+
+#endif  // PROCESS_UTIL_H_
@@ -0,0 +1,295 @@
+#include "query_executor.h"
+#include "engine_stats.h"
+
+#include <boost/bind.hpp>
+#include <glog/logging.h>
+
+namespace adblock {
+
+namespace {
+
+// Same answers the daemon client fails open with
+const char kNoMatch[] = "{\"type\":0}";
+const char kNoSelectors[] =
+    "{\"host\": \"\", \"hostDomain\": \"\", \"selectors\": []}";
+
+}  // namespace
+
+QueryExecutor::QueryExecutor() : stopping_(false), completed_(0), expired_(0) {}
+
+QueryExecutor::~QueryExecutor() { Stop(); }
+
+void QueryExecutor::Post(const Task& task, std::uint32_t timeout_ms) {
+  Entry entry;
+  entry.task = task;
+  entry.deadline =
+      timeout_ms ? EngineStats::Now() + timeout_ms * 1000000ULL : 0;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!stopping_) {
+      if (!thread_.joinable()) {
+        thread_ = boost::thread(&QueryExecutor::Work, this);
+      }
+      queue_.push_back(entry);
+      wakeup_.notify_one();
+      return;
+    }
+  }
+  // Shutting down, the callback is still owed an answer
+  expired_.fetch_add(1, boost::memory_order_relaxed);
+  task(true, entry.deadline);
+}
+
+bool QueryExecutor::PostIdle(const IdleTask& task, size_t max_queued) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (stopping_ || idle_queue_.size() >= max_queued) {
+    return false;
+  }
+  if (!thread_.joinable()) {
+    thread_ = boost::thread(&QueryExecutor::Work, this);
+  }
+  idle_queue_.push_back(task);
+  wakeup_.notify_one();
+  return true;
+}
+
+void QueryExecutor::Stop() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+  }
+  wakeup_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+size_t QueryExecutor::queued() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return queue_.size();
+}
+
+void QueryExecutor::WriteJson(std::ostream* out) {
+  boost::mutex::scoped_lock lock(mutex_);
+  *out << "{\"queued\": " << queue_.size()
+       << ", \"completed\": " << completed_.load(boost::memory_order_relaxed)
+       << ", \"expired\": " << expired_.load(boost::memory_order_relaxed)
+       << ", \"idle\": " << idle_queue_.size() << "}";
+}
+
+void QueryExecutor::Work() {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (true) {
+    while (queue_.empty() && idle_queue_.empty() && !stopping_) {
+      wakeup_.wait(lock);
+    }
+    if (queue_.empty() && stopping_) {
+      idle_queue_.clear();
+      break;
+    }
+    // Queries always go first
+    if (queue_.empty()) {
+      IdleTask task;
+      task.swap(idle_queue_.front());
+      idle_queue_.pop_front();
+      lock.unlock();
+      try {
+        task();
+      }
+      catch (const std::exception& e) {
+        LOG(ERROR) << "Background query failed: " << e.what();
+      }
+      lock.lock();
+      continue;
+    }
+    Entry entry = queue_.front();
+    queue_.pop_front();
+    // Left over at shutdown counts as expired as well
+    bool expired = stopping_;
+    lock.unlock();
+
+    if (entry.deadline != 0 && EngineStats::Now() > entry.deadline) {
+      expired = true;
+    }
+    if (expired) {
+      expired_.fetch_add(1, boost::memory_order_relaxed);
+    } else {
+      completed_.fetch_add(1, boost::memory_order_relaxed);
+    }
+    try {
+      entry.task(expired, entry.deadline);
+    }
+    catch (const std::exception& e) {
+      LOG(ERROR) << "Asynchronous query failed: " << e.what();
+    }
+
+    lock.lock();
+  }
+}
+
+AsyncAdBlock::AsyncAdBlock(Readiness readiness) : startup_(readiness) {}
+
+void AsyncAdBlock::CheckFilterMatchAsync(const std::string& location,
+                                         const std::string& type,
+                                         const std::string& document,
+                                         const StringCallback& callback,
+                                         std::uint32_t timeout_ms) {
+  executor_.Post(boost::bind(&AsyncAdBlock::RunCheckFilterMatch, this,
+                             location, type, document, callback, _1, _2),
+                 timeout_ms);
+}
+
+void AsyncAdBlock::CheckFilterMatchAsync(std::uint32_t document,
+                                         const std::string& location,
+                                         const std::string& type,
+                                         const StringCallback& callback,
+                                         std::uint32_t timeout_ms) {
+  executor_.Post(boost::bind(&AsyncAdBlock::RunCheckDocumentMatch, this,
+                             document, location, type, callback, _1, _2),
+                 timeout_ms);
+}
+
+void AsyncAdBlock::GetElementHidingSelectorsAsync(
+    const std::string& domain, const StringCallback& callback,
+    std::uint32_t timeout_ms) {
+  executor_.Post(boost::bind(&AsyncAdBlock::RunGetElementHidingSelectors,
+                             this, domain, callback, _1, _2),
+                 timeout_ms);
+}
+
+void AsyncAdBlock::IsWhitelistedAsync(const std::string& url,
+                                      const std::string& parent_url,
+                                      const std::string& type,
+                                      const BoolCallback& callback,
+                                      std::uint32_t timeout_ms) {
+  executor_.Post(boost::bind(&AsyncAdBlock::RunIsWhitelisted, this, url,
+                             parent_url, type, callback, _1, _2),
+                 timeout_ms);
+}
+
+void AsyncAdBlock::GenerateCSSContentAsync(const StringCallback& callback,
+                                           std::uint32_t timeout_ms) {
+  executor_.Post(
+      boost::bind(&AsyncAdBlock::RunGenerateCSSContent, this, callback, _1,
+                  _2),
+      timeout_ms);
+}
+
+AdBlock::Readiness AsyncAdBlock::readiness() { return startup_.readiness(); }
+
+bool AsyncAdBlock::WaitForReadiness(Readiness readiness,
+                                    std::uint32_t timeout_ms) {
+  return startup_.WaitFor(
+      readiness,
+      timeout_ms ? EngineStats::Now() + timeout_ms * 1000000ULL : 0);
+}
+
+void AsyncAdBlock::AddReadinessCallback(const ReadinessCallback& callback) {
+  startup_.AddCallback(callback);
+}
+
+std::string AsyncAdBlock::DefaultMatch() { return kNoMatch; }
+
+std::string AsyncAdBlock::DefaultSelectors() { return kNoSelectors; }
+
+std::string AsyncAdBlock::CheckFilterMatchBefore(const std::string& location,
+                                                 const std::string& type,
+                                                 const std::string& document,
+                                                 std::uint64_t deadline,
+                                                 bool* timed_out) {
+  return CheckFilterMatch(location, type, document);
+}
+
+std::string AsyncAdBlock::CheckDocumentMatchBefore(std::uint32_t document,
+                                                   const std::string& location,
+                                                   const std::string& type,
+                                                   std::uint64_t deadline,
+                                                   bool* timed_out) {
+  return CheckFilterMatch(document, location, type);
+}
+
+std::string AsyncAdBlock::GetElementHidingSelectorsBefore(
+    const std::string& domain, std::uint64_t deadline, bool* timed_out) {
+  return GetElementHidingSelectors(domain);
+}
+
+bool AsyncAdBlock::IsWhitelistedBefore(const std::string& url,
+                                       const std::string& parent_url,
+                                       const std::string& type,
+                                       std::uint64_t deadline,
+                                       bool* timed_out) {
+  return IsWhitelisted(url, parent_url, type);
+}
+
+void AsyncAdBlock::RunCheckFilterMatch(const std::string& location,
+                                       const std::string& type,
+                                       const std::string& document,
+                                       const StringCallback& callback,
+                                       bool expired, std::uint64_t deadline) {
+  if (expired) {
+    callback(DefaultMatch(), true);
+    return;
+  }
+  bool timed_out = false;
+  std::string result =
+      CheckFilterMatchBefore(location, type, document, deadline, &timed_out);
+  callback(result, timed_out);
+}
+
+void AsyncAdBlock::RunCheckDocumentMatch(std::uint32_t document,
+                                         const std::string& location,
+                                         const std::string& type,
+                                         const StringCallback& callback,
+                                         bool expired, std::uint64_t deadline) {
+  if (expired) {
+    callback(DefaultMatch(), true);
+    return;
+  }
+  bool timed_out = false;
+  std::string result =
+      CheckDocumentMatchBefore(document, location, type, deadline, &timed_out);
+  callback(result, timed_out);
+}
+
+void AsyncAdBlock::RunGetElementHidingSelectors(const std::string& domain,
+                                                const StringCallback& callback,
+                                                bool expired,
+                                                std::uint64_t deadline) {
+  if (expired) {
+    callback(DefaultSelectors(), true);
+    return;
+  }
+  bool timed_out = false;
+  std::string result =
+      GetElementHidingSelectorsBefore(domain, deadline, &timed_out);
+  callback(result, timed_out);
+}
+
+void AsyncAdBlock::RunIsWhitelisted(const std::string& url,
+                                    const std::string& parent_url,
+                                    const std::string& type,
+                                    const BoolCallback& callback,
+                                    bool expired, std::uint64_t deadline) {
+  if (expired) {
+    callback(false, true);
+    return;
+  }
+  bool timed_out = false;
+  bool result =
+      IsWhitelistedBefore(url, parent_url, type, deadline, &timed_out);
+  callback(result, timed_out);
+}
+
+void AsyncAdBlock::RunGenerateCSSContent(const StringCallback& callback,
+                                         bool expired, std::uint64_t deadline) {
+  if (expired) {
+    callback(std::string(), true);
+    return;
+  }
+  callback(GenerateCSSContent(), false);
+}
+
+}  // namespace adblock
@@ -0,0 +1,155 @@
+#ifndef QUERY_EXECUTOR_H_
+#define QUERY_EXECUTOR_H_
+
+#include "adblock.h"
+#include "startup_state.h"
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace adblock {
+
+// Runs queued queries in order on a thread of its own. One thread is enough,
+// the engine answers one query at a time anyway. A query whose deadline
+// passed before its turn is still run, but told to give its default answer
+// instead of asking the engine. Background work waits in a queue of its own
+// and only runs while no query is queued.
+class QueryExecutor {
+ public:
+  // |expired| is set when the deadline passed while the query was queued.
+  // |deadline| is the query's own, 0 if there is none.
+  typedef boost::function<void(bool expired, std::uint64_t deadline)> Task;
+  typedef boost::function<void()> IdleTask;
+
+  QueryExecutor();
+  // Expires whatever is still queued and stops the thread.
+  ~QueryExecutor();
+
+  // |timeout_ms| counts from now, 0 waits as long as it takes.
+  void Post(const Task& task, std::uint32_t timeout_ms);
+  // False if |max_queued| tasks are waiting already or the executor stopped.
+  // Idle tasks left over on Stop() are dropped.
+  bool PostIdle(const IdleTask& task, size_t max_queued);
+  void Stop();
+  // Queries waiting for their turn
+  size_t queued();
+
+  // Writes queued, completed, expired and idle counts as a JSON object.
+  void WriteJson(std::ostream* out);
+
+ private:
+  struct Entry {
+    Task task;
+    // Monotonic nanoseconds, 0 if there is none
+    std::uint64_t deadline;
+  };
+
+  boost::mutex mutex_;
+  boost::condition_variable wakeup_;
+  std::deque<Entry> queue_;
+  std::deque<IdleTask> idle_queue_;
+  bool stopping_;
+  boost::thread thread_;
+  boost::atomic<std::uint64_t> completed_;
+  boost::atomic<std::uint64_t> expired_;
+
+  void Work();
+};
+
+// Provides the asynchronous queries of AdBlock on top of the synchronous
+// ones. Engines derive from it and call StopQueries() first thing in their
+// destructor, the queued queries use the engine. Also keeps the engine's
+// startup stage, engines that are ready right away keep the default.
+class AsyncAdBlock : public AdBlock {
+ public:
+  explicit AsyncAdBlock(Readiness readiness = FIRST_SYNC_DONE);
+
+  void CheckFilterMatchAsync(const std::string& location,
+                             const std::string& type,
+                             const std::string& document,
+                             const StringCallback& callback,
+                             std::uint32_t timeout_ms);
+  void CheckFilterMatchAsync(std::uint32_t document,
+                             const std::string& location,
+                             const std::string& type,
+                             const StringCallback& callback,
+                             std::uint32_t timeout_ms);
+  void GetElementHidingSelectorsAsync(const std::string& domain,
+                                      const StringCallback& callback,
+                                      std::uint32_t timeout_ms);
+  void IsWhitelistedAsync(const std::string& url,
+                          const std::string& parent_url,
+                          const std::string& type,
+                          const BoolCallback& callback,
+                          std::uint32_t timeout_ms);
+  void GenerateCSSContentAsync(const StringCallback& callback,
+                               std::uint32_t timeout_ms);
+  Readiness readiness();
+  bool WaitForReadiness(Readiness readiness, std::uint32_t timeout_ms);
+  void AddReadinessCallback(const ReadinessCallback& callback);
+
+ protected:
+  void StopQueries() { executor_.Stop(); }
+  QueryExecutor* executor() { return &executor_; }
+  StartupState* startup() { return &startup_; }
+
+  // Answers of queries that can't wait for the engine. IsWhitelisted()
+  // answers false and GenerateCSSContent() an empty string.
+  virtual std::string DefaultMatch();
+  std::string DefaultSelectors();
+
+  // The queries behind the asynchronous ones, answering before |deadline|,
+  // see EngineStats::Now(), 0 if there is none. |*timed_out| is set when the
+  // default answer was given because the engine couldn't answer in time.
+  // The defaults make the synchronous queries, bound by their own budget.
+  virtual std::string CheckFilterMatchBefore(const std::string& location,
+                                             const std::string& type,
+                                             const std::string& document,
+                                             std::uint64_t deadline,
+                                             bool* timed_out);
+  virtual std::string CheckDocumentMatchBefore(std::uint32_t document,
+                                               const std::string& location,
+                                               const std::string& type,
+                                               std::uint64_t deadline,
+                                               bool* timed_out);
+  virtual std::string GetElementHidingSelectorsBefore(
+      const std::string& domain, std::uint64_t deadline, bool* timed_out);
+  virtual bool IsWhitelistedBefore(const std::string& url,
+                                   const std::string& parent_url,
+                                   const std::string& type,
+                                   std::uint64_t deadline, bool* timed_out);
+
+ private:
+  QueryExecutor executor_;
+  StartupState startup_;
+
+  void RunCheckFilterMatch(const std::string& location,
+                           const std::string& type,
+                           const std::string& document,
+                           const StringCallback& callback, bool expired,
+                           std::uint64_t deadline);
+  void RunCheckDocumentMatch(std::uint32_t document,
+                             const std::string& location,
+                             const std::string& type,
+                             const StringCallback& callback, bool expired,
+                             std::uint64_t deadline);
+  void RunGetElementHidingSelectors(const std::string& domain,
+                                    const StringCallback& callback,
+                                    bool expired, std::uint64_t deadline);
+  void RunIsWhitelisted(const std::string& url, const std::string& parent_url,
+                        const std::string& type, const BoolCallback& callback,
+                        bool expired, std::uint64_t deadline);
+  void RunGenerateCSSContent(const StringCallback& callback, bool expired,
+                             std::uint64_t deadline);
+};
+
+}  // namespace adblock
+
+#endif  // QUERY_EXECUTOR_H_
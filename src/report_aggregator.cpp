@@ -0,0 +1,116 @@
+#include "report_aggregator.h"
+#include "report_channel.h"
+
+#include <boost/functional/hash.hpp>
+
+namespace adblock {
+
+namespace {
+
+// Milliseconds between two regular flushes
+const int kFlushInterval = 1000;
+// Distinct keys a shard may collect before it is flushed right away
+const size_t kMaxShardEntries = 256;
+
+}  // namespace
+
+bool ReportAggregator::Key::operator==(const Key& other) const {
+  return type == other.type && process == other.process &&
+         website == other.website && rule == other.rule;
+}
+
+size_t ReportAggregator::KeyHash::operator()(const Key& key) const {
+  KeyRef ref = {&key.type, &key.process, &key.website, &key.rule};
+  return (*this)(ref);
+}
+
+size_t ReportAggregator::KeyHash::operator()(const KeyRef& key) const {
+  size_t seed = 0;
+  boost::hash_combine(seed, *key.type);
+  boost::hash_combine(seed, *key.process);
+  boost::hash_combine(seed, *key.website);
+  boost::hash_combine(seed, *key.rule);
+  return seed;
+}
+
+bool ReportAggregator::KeyRefEqual::operator()(const KeyRef& ref,
+                                               const Key& key) const {
+  return *ref.type == key.type && *ref.process == key.process &&
+         *ref.website == key.website && *ref.rule == key.rule;
+}
+
+ReportAggregator::ReportAggregator(ReportWriter* writer)
+    : writer_(writer), stopping_(false) {
+  thread_ = boost::thread(&ReportAggregator::Run, this);
+}
+
+ReportAggregator::~ReportAggregator() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stopping_ = true;
+  }
+  wakeup_.notify_one();
+  thread_.join();
+  Flush();
+}
+
+void ReportAggregator::Add(const std::string& type, const std::string& process,
+                           const std::string& website,
+                           const std::string& rule) {
+  KeyRef ref = {&type, &process, &website, &rule};
+  KeyHash hasher;
+  Shard* shard = &shards_[hasher(ref) % SHARD_COUNT];
+
+  bool full = false;
+  {
+    boost::mutex::scoped_lock lock(shard->mutex);
+    auto it = shard->counters.find(ref, hasher, KeyRefEqual());
+    if (it != shard->counters.end()) {
+      ++it->second;
+    } else {
+      Key key = {type, process, website, rule};
+      shard->counters.emplace(key, 1);
+      full = shard->counters.size() >= kMaxShardEntries;
+    }
+  }
+  if (full) {
+    FlushShard(shard);
+  }
+}
+
+void ReportAggregator::Flush() {
+  for (size_t idx = 0; idx < SHARD_COUNT; ++idx) {
+    FlushShard(&shards_[idx]);
+  }
+}
+
+void ReportAggregator::FlushShard(Shard* shard) {
+  // Write outside of the lock, reporting threads keep counting meanwhile
+  CounterMap counters;
+  {
+    boost::mutex::scoped_lock lock(shard->mutex);
+    counters.swap(shard->counters);
+  }
+
+  // Counts that do not fit into the ring are reported as dropped by the writer
+  for (auto it = counters.begin(); it != counters.end(); ++it) {
+    const Key& key = it->first;
+    writer_->Write(key.type, key.process, key.website, "", key.rule,
+                   it->second);
+  }
+}
+
+void ReportAggregator::Run() {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (!stopping_) {
+    wakeup_.timed_wait(lock, boost::posix_time::milliseconds(kFlushInterval));
+    if (stopping_) {
+      break;
+    }
+    lock.unlock();
+    Flush();
+    lock.lock();
+  }
+}
+
+}  // namespace adblock
@@ -0,0 +1,81 @@
+#ifndef REPORT_AGGREGATOR_H_
+#define REPORT_AGGREGATOR_H_
+
+#include <cstdint>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered/unordered_map.hpp>
+
+namespace adblock {
+
+class ReportWriter;
+
+// Counts blocked requests per (type, process, website, rule) and hands one
+// summarized record per key to the writer, once a second or as soon as a
+// shard collects too many distinct keys. The blocked location is not part of
+// the summary.
+class ReportAggregator {
+ public:
+  explicit ReportAggregator(ReportWriter* writer);
+  // Stops the flush thread and sends what is left.
+  ~ReportAggregator();
+
+  void Add(const std::string& type, const std::string& process,
+           const std::string& website, const std::string& rule);
+  void Flush();
+
+ private:
+  struct Key {
+    std::string type;
+    std::string process;
+    std::string website;
+    std::string rule;
+
+    bool operator==(const Key& other) const;
+  };
+
+  // Refers to the caller's strings so that lookups of known keys don't copy
+  struct KeyRef {
+    const std::string* type;
+    const std::string* process;
+    const std::string* website;
+    const std::string* rule;
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+    size_t operator()(const KeyRef& key) const;
+  };
+
+  struct KeyRefEqual {
+    bool operator()(const KeyRef& ref, const Key& key) const;
+  };
+
+  typedef boost::unordered_map<Key, std::uint32_t, KeyHash> CounterMap;
+
+  // Independent locks keep reporting threads from queuing behind each other
+  enum { SHARD_COUNT = 16 };
+
+  struct Shard {
+    boost::mutex mutex;
+    CounterMap counters;
+  };
+
+  ReportWriter* writer_;
+  Shard shards_[SHARD_COUNT];
+
+  boost::mutex mutex_;
+  boost::condition_variable wakeup_;
+  bool stopping_;
+  boost::thread thread_;
+
+  void FlushShard(Shard* shard);
+  void Run();
+};
+
+}  // namespace adblock
+
+#endif  // REPORT_AGGREGATOR_H_
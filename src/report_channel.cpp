@@ -0,0 +1,399 @@
+#include "report_channel.h"
+#include "process_util.h"
+
+#include <cstring>
+
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+#include <glog/logging.h>
+
+namespace adblock {
+
+namespace ipc = boost::interprocess;
+
+namespace {
+
+const char kSegmentName[] =
+    "asdv2_adblock_report_channel_{5095C5F0-D82D-4442-9A62-8769871F42D1}";
+const char kChannelName[] = "ReportChannel";
+// Start of every channel object, "ARPT"
+const std::uint32_t kChannelMagic = 0x54505241;
+// Raised with every change of ReportChannel, ReportRing or ReportRecord
+const std::uint32_t kChannelVersion = 1;
+
+const size_t kRingCount = 8;
+// Large enough to take a complete flush of the report aggregator
+const std::uint32_t kRecordCapacity = 4096;
+const std::uint32_t kStringCapacity = 128 * 1024;
+// Seconds between attempts to attach to a consumer that is not running
+const std::time_t kReopenInterval = 5;
+// Seconds between checks for rings left behind by exited processes
+const std::time_t kReapInterval = 10;
+
+// Rings live in memory shared between processes, they must not fall back to
+// the lock based emulation.
+BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT_LOCK_FREE == 2);
+
+// Positions count up forever and wrap around, compare them by distance
+inline bool NotBefore(std::uint32_t position, std::uint32_t reference) {
+  return position - reference < 0x80000000u;
+}
+
+std::uint32_t Hash(const std::string& value) {
+  // FNV-1a
+  std::uint32_t hash = 2166136261u;
+  for (size_t idx = 0; idx < value.length(); ++idx) {
+    hash ^= static_cast<unsigned char>(value[idx]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+}  // namespace
+
+struct ReportString {
+  std::uint32_t offset;
+  std::uint32_t length;
+};
+
+// Fixed layout record, strings point into the string area of the ring.
+struct ReportRecord {
+  std::int64_t time;
+  std::uint32_t pid;
+  std::uint32_t count;
+  // Lowest string offset referenced, never decreases from record to record
+  std::uint32_t string_floor;
+  ReportString type;
+  ReportString process;
+  ReportString website;
+  ReportString location;
+  ReportString rule;
+};
+
+// Single producer, single consumer ring. The producer owns head and
+// string_head, the consumer owns tail and string_tail. Each side only reads
+// the other's positions, so neither needs a lock.
+struct ReportRing {
+  boost::atomic<std::uint32_t> owner;
+  // Reports discarded by the producer, counts up forever
+  boost::atomic<std::uint32_t> dropped;
+  char padding0[64 - 2 * sizeof(std::uint32_t)];
+  boost::atomic<std::uint32_t> head;
+  char padding1[64 - sizeof(std::uint32_t)];
+  boost::atomic<std::uint32_t> tail;
+  boost::atomic<std::uint32_t> string_tail;
+  char padding2[64 - 2 * sizeof(std::uint32_t)];
+  std::uint32_t string_head;
+  ReportRecord records[kRecordCapacity];
+  char strings[kStringCapacity];
+};
+
+// The magic, version and size come first and never move. Producers and
+// consumers only attach to a channel with their own layout.
+struct ReportChannel {
+  ReportChannel()
+      : magic(kChannelMagic),
+        version(kChannelVersion),
+        size(sizeof(ReportChannel)),
+        rings() {}
+
+  bool IsCurrentLayout() const {
+    return magic == kChannelMagic && version == kChannelVersion &&
+           size == sizeof(ReportChannel);
+  }
+
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t size;
+  ReportRing rings[kRingCount];
+};
+
+ReportWriter::ReportWriter()
+    : segment_(nullptr),
+      ring_(nullptr),
+      pid_(CurrentProcessId()),
+      next_open_(0),
+      string_floor_(0),
+      lost_(0),
+      layout_mismatch_(false) {
+  std::memset(interned_, 0, sizeof(interned_));
+}
+
+ReportWriter::~ReportWriter() {
+  if (segment_ != nullptr) {
+    delete segment_;
+    segment_ = nullptr;
+  }
+}
+
+bool ReportWriter::Open() {
+  std::time_t now = std::time(nullptr);
+  if (now < next_open_) {
+    return false;
+  }
+  next_open_ = now + kReopenInterval;
+
+  try {
+    if (!segment_) {
+      segment_ = new ipc::managed_shared_memory(ipc::open_only, kSegmentName);
+    }
+    auto res = segment_->find<ReportChannel>(kChannelName);
+    if (res.second != 1 || res.first == nullptr) {
+      return false;
+    }
+    if (!res.first->IsCurrentLayout()) {
+      // Reports are lost until both sides are updated, only say so once
+      if (!layout_mismatch_) {
+        LOG(ERROR) << "[ReportWriter::Open] Unsupported report channel "
+                   << "version " << res.first->version << std::endl;
+        layout_mismatch_ = true;
+      }
+      return false;
+    }
+    for (size_t idx = 0; idx < kRingCount; ++idx) {
+      ReportRing* ring = &res.first->rings[idx];
+      std::uint32_t owner = 0;
+      // A ring may still be ours if the library was loaded before
+      if (ring->owner.compare_exchange_strong(owner, pid_) || owner == pid_) {
+        ring_ = ring;
+        string_floor_ = ring->string_head;
+        std::memset(interned_, 0, sizeof(interned_));
+        if (lost_) {
+          LOG(WARNING) << lost_ << " reports lost before the report channel "
+                       << "was available" << std::endl;
+          ring->dropped.fetch_add(lost_, boost::memory_order_relaxed);
+          lost_ = 0;
+        }
+        return true;
+      }
+    }
+    LOG(ERROR) << "[ReportWriter::Open] No free report ring" << std::endl;
+    return false;
+  }
+  catch (const ipc::interprocess_exception& e) {
+    LOG(ERROR) << "[ReportWriter::Open] " << e.what() << std::endl;
+    return false;
+  }
+  catch (const std::bad_alloc&) {
+    LOG(ERROR) << "Failed to allocate memory when opening the report channel"
+               << std::endl;
+    return false;
+  }
+}
+
+bool ReportWriter::Intern(const std::string& value, ReportString* ref) {
+  ref->offset = ring_->string_head;
+  ref->length = static_cast<std::uint32_t>(value.length());
+  if (value.empty()) {
+    return true;
+  }
+  if (value.length() > kStringCapacity / 4) {
+    return false;
+  }
+
+  // Reuse a copy that is still in the ring
+  std::uint32_t hash = Hash(value);
+  InternedString& cached = interned_[hash % INTERN_CACHE_SIZE];
+  if (cached.hash == hash && cached.length == ref->length &&
+      NotBefore(cached.offset, string_floor_) &&
+      std::memcmp(ring_->strings + cached.offset % kStringCapacity,
+                  value.data(), value.length()) == 0) {
+    ref->offset = cached.offset;
+    return true;
+  }
+
+  // Strings never wrap around the end of the area, skip the remainder
+  std::uint32_t offset = ring_->string_head;
+  std::uint32_t index = offset % kStringCapacity;
+  if (index + ref->length > kStringCapacity) {
+    offset += kStringCapacity - index;
+    index = 0;
+  }
+  std::uint32_t released =
+      ring_->string_tail.load(boost::memory_order_acquire);
+  if (offset + ref->length - released > kStringCapacity) {
+    return false;
+  }
+  std::memcpy(ring_->strings + index, value.data(), value.length());
+  ring_->string_head = offset + ref->length;
+
+  ref->offset = offset;
+  cached.hash = hash;
+  cached.offset = offset;
+  cached.length = ref->length;
+  return true;
+}
+
+bool ReportWriter::Write(const std::string& type, const std::string& process,
+                         const std::string& website,
+                         const std::string& location,
+                         const std::string& rule, std::uint32_t count) {
+  boost::mutex::scoped_lock lock(mutex_);
+
+  if (!ring_ && !Open()) {
+    lost_ += count;
+    return false;
+  }
+
+  std::uint32_t head = ring_->head.load(boost::memory_order_relaxed);
+  std::uint32_t tail = ring_->tail.load(boost::memory_order_acquire);
+  if (head - tail >= kRecordCapacity) {
+    ring_->dropped.fetch_add(count, boost::memory_order_relaxed);
+    return false;
+  }
+
+  ReportRecord& record = ring_->records[head % kRecordCapacity];
+  if (!Intern(type, &record.type) || !Intern(process, &record.process) ||
+      !Intern(website, &record.website) ||
+      !Intern(location, &record.location) || !Intern(rule, &record.rule)) {
+    ring_->dropped.fetch_add(count, boost::memory_order_relaxed);
+    return false;
+  }
+
+  // Later records may only reference strings at or above this one's floor
+  std::uint32_t floor = ring_->string_head;
+  const ReportString* refs[] = {&record.type, &record.process, &record.website,
+                             &record.location, &record.rule};
+  for (size_t idx = 0; idx < sizeof(refs) / sizeof(refs[0]); ++idx) {
+    if (refs[idx]->length && !NotBefore(refs[idx]->offset, floor)) {
+      floor = refs[idx]->offset;
+    }
+  }
+  record.time = std::time(nullptr);
+  record.pid = pid_;
+  record.count = count;
+  record.string_floor = floor;
+  string_floor_ = floor;
+
+  ring_->head.store(head + 1, boost::memory_order_release);
+  return true;
+}
+
+ReportReader::ReportReader()
+    : segment_(nullptr),
+      channel_(nullptr),
+      dropped_seen_(kRingCount, 0),
+      next_reap_(0) {}
+
+ReportReader::~ReportReader() {
+  if (segment_ != nullptr) {
+    delete segment_;
+    segment_ = nullptr;
+  }
+}
+
+bool ReportReader::Create() {
+  try {
+    if (!segment_) {
+      segment_ = new ipc::managed_shared_memory(
+          ipc::open_or_create, kSegmentName,
+          sizeof(ReportChannel) + 64 * 1024);
+    }
+    ReportChannel* channel =
+        segment_->find_or_construct<ReportChannel>(kChannelName)();
+    if (!channel->IsCurrentLayout()) {
+      LOG(ERROR) << "[ReportReader::Create] Report channel version "
+                 << channel->version << " is in use" << std::endl;
+      delete segment_;
+      segment_ = nullptr;
+      return false;
+    }
+    channel_ = channel;
+    for (size_t idx = 0; idx < kRingCount; ++idx) {
+      dropped_seen_[idx] = channel_->rings[idx].dropped.load();
+    }
+    return true;
+  }
+  catch (const ipc::interprocess_exception& e) {
+    LOG(ERROR) << "[ReportReader::Create] " << e.what() << std::endl;
+    return false;
+  }
+  catch (const std::bad_alloc&) {
+    LOG(ERROR) << "Failed to allocate memory when creating the report channel"
+               << std::endl;
+    return false;
+  }
+}
+
+size_t ReportReader::DrainRing(ReportRing* ring,
+                               std::vector<ReportEntry>* entries) {
+  std::uint32_t tail = ring->tail.load(boost::memory_order_relaxed);
+  std::uint32_t head = ring->head.load(boost::memory_order_acquire);
+  if (head == tail) {
+    return 0;
+  }
+
+  const char* strings = ring->strings;
+  std::uint32_t floor = 0;
+  for (std::uint32_t pos = tail; pos != head; ++pos) {
+    const ReportRecord& record = ring->records[pos % kRecordCapacity];
+    entries->push_back(ReportEntry());
+    ReportEntry& entry = entries->back();
+    entry.time = record.time;
+    entry.pid = record.pid;
+    entry.count = record.count;
+    entry.type.assign(strings + record.type.offset % kStringCapacity,
+                      record.type.length);
+    entry.process.assign(strings + record.process.offset % kStringCapacity,
+                         record.process.length);
+    entry.website.assign(strings + record.website.offset % kStringCapacity,
+                         record.website.length);
+    entry.location.assign(strings + record.location.offset % kStringCapacity,
+                          record.location.length);
+    entry.rule.assign(strings + record.rule.offset % kStringCapacity,
+                      record.rule.length);
+    floor = record.string_floor;
+  }
+
+  // The producer may reuse anything below the floor of the last record
+  ring->string_tail.store(floor, boost::memory_order_release);
+  ring->tail.store(head, boost::memory_order_release);
+  return head - tail;
+}
+
+void ReportReader::ReleaseRing(ReportRing* ring, size_t slot) {
+  ring->head.store(0, boost::memory_order_relaxed);
+  ring->tail.store(0, boost::memory_order_relaxed);
+  ring->string_head = 0;
+  ring->string_tail.store(0, boost::memory_order_relaxed);
+  ring->dropped.store(0, boost::memory_order_relaxed);
+  dropped_seen_[slot] = 0;
+  ring->owner.store(0, boost::memory_order_release);
+}
+
+size_t ReportReader::Drain(std::vector<ReportEntry>* entries,
+                           std::uint32_t* dropped) {
+  *dropped = 0;
+  if (!channel_) {
+    return 0;
+  }
+
+  std::time_t now = std::time(nullptr);
+  bool reap = now >= next_reap_;
+  if (reap) {
+    next_reap_ = now + kReapInterval;
+  }
+
+  size_t count = 0;
+  for (size_t idx = 0; idx < kRingCount; ++idx) {
+    ReportRing* ring = &channel_->rings[idx];
+    std::uint32_t owner = ring->owner.load(boost::memory_order_acquire);
+    if (!owner) {
+      continue;
+    }
+    count += DrainRing(ring, entries);
+
+    std::uint32_t total = ring->dropped.load(boost::memory_order_relaxed);
+    *dropped += total - dropped_seen_[idx];
+    dropped_seen_[idx] = total;
+
+    // Everything the exited process wrote is consumed now
+    if (reap && !ProcessExists(owner)) {
+      count += DrainRing(ring, entries);
+      ReleaseRing(ring, idx);
+    }
+  }
+  return count;
+}
+
+}  // namespace adblock
@@ -0,0 +1,97 @@
+#ifndef REPORT_CHANNEL_H_
+#define REPORT_CHANNEL_H_
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace adblock {
+
+struct ReportRing;
+struct ReportChannel;
+struct ReportString;
+
+// A blocked request as seen by the consumer.
+struct ReportEntry {
+  std::int64_t time;
+  std::uint32_t pid;
+  // Number of blocked requests the entry stands for, 1 for raw reports
+  std::uint32_t count;
+  std::string type;
+  std::string process;
+  std::string website;
+  std::string location;
+  std::string rule;
+};
+
+// Producer side of the report channel. Every process claims one ring of the
+// shared channel and is its only producer, threads of the process take turns
+// through an in-process mutex. Appending a report touches shared memory only,
+// strings already sent recently are referenced instead of copied again.
+class ReportWriter {
+ public:
+  ReportWriter();
+  ~ReportWriter();
+
+  // Returns false if the report was dropped, either because no consumer is
+  // running or because the ring is full. |count| is the number of blocked
+  // requests the record summarizes, dropping it counts all of them.
+  bool Write(const std::string& type, const std::string& process,
+             const std::string& website, const std::string& location,
+             const std::string& rule, std::uint32_t count = 1);
+
+ private:
+  enum { INTERN_CACHE_SIZE = 256 };
+
+  struct InternedString {
+    std::uint32_t hash;
+    std::uint32_t offset;
+    std::uint32_t length;
+  };
+
+  boost::mutex mutex_;
+  boost::interprocess::managed_shared_memory* segment_;
+  ReportRing* ring_;
+  std::uint32_t pid_;
+  std::time_t next_open_;
+  // Lowest string offset referenced by the last record, strings below it may
+  // already be overwritten.
+  std::uint32_t string_floor_;
+  std::uint32_t lost_;
+  // Whether the channel was found with another layout, logged only once
+  bool layout_mismatch_;
+  InternedString interned_[INTERN_CACHE_SIZE];
+
+  bool Open();
+  bool Intern(const std::string& value, ReportString* ref);
+};
+
+// Consumer side of the report channel, creates the shared segment and drains
+// the rings of all producers in batches.
+class ReportReader {
+ public:
+  ReportReader();
+  ~ReportReader();
+
+  bool Create();
+  // Appends all pending reports to |entries|. |dropped| receives the number
+  // of blocked requests the producers had to discard since the previous call.
+  size_t Drain(std::vector<ReportEntry>* entries, std::uint32_t* dropped);
+
+ private:
+  boost::interprocess::managed_shared_memory* segment_;
+  ReportChannel* channel_;
+  std::vector<std::uint32_t> dropped_seen_;
+  std::time_t next_reap_;
+
+  size_t DrainRing(ReportRing* ring, std::vector<ReportEntry>* entries);
+  void ReleaseRing(ReportRing* ring, size_t slot);
+};
+
+}  // namespace adblock
+
+#endif  // REPORT_CHANNEL_H_
@@ -0,0 +1,277 @@
+#include "request_capture.h"
+#include "md5.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include <boost/chrono.hpp>
+#include <glog/logging.h>
+
+namespace adblock {
+
+namespace {
+
+const char kMagic[] = "ADBCAP1\n";
+const size_t kMagicSize = sizeof(kMagic) - 1;
+
+// Records waiting for the writer, more are dropped
+const size_t kQueueCapacity = 16384;
+// Milliseconds between writes to the file
+const int kWriteInterval = 200;
+const size_t kMaxCapturedResult = 256;
+const size_t kMaxTruncatedUrl = 128;
+
+void AppendVarint(std::uint64_t value, std::string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+void AppendField(const std::string& value, std::string* out) {
+  AppendVarint(value.length(), out);
+  out->append(value);
+}
+
+bool ReadVarint(std::istream* in, std::uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = in->get();
+    if (byte == EOF) {
+      return false;
+    }
+    *value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string HexDigest(const std::string& value, size_t digits) {
+  static const char kHex[] = "0123456789abcdef";
+  Md5 md5;
+  md5.Update(value);
+  unsigned char digest[Md5::DIGEST_SIZE];
+  md5.Final(digest);
+
+  std::string result;
+  for (size_t idx = 0; idx < digits && idx / 2 < Md5::DIGEST_SIZE; ++idx) {
+    unsigned char byte = digest[idx / 2];
+    result.push_back(kHex[idx % 2 ? byte & 0xF : byte >> 4]);
+  }
+  return result;
+}
+
+std::uint64_t Now() {
+  return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+             boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+RequestCapture::RequestCapture()
+    : active_(false),
+      mode_(FULL_URLS),
+      started_(0),
+      dropped_(0),
+      queue_(kQueueCapacity),
+      stopping_(false) {}
+
+RequestCapture::~RequestCapture() {
+  Stop();
+  std::string* record;
+  while (queue_.pop(record)) {
+    delete record;
+  }
+}
+
+bool RequestCapture::Start(const std::string& path, UrlMode mode) {
+  if (mode < FULL_URLS || mode > HASHED_URLS) {
+    LOG(ERROR) << "Unknown capture URL mode " << mode;
+    return false;
+  }
+  boost::mutex::scoped_lock control(control_mutex_);
+  StopLocked();
+
+  // Calls recorded after the previous capture stopped belong to no file
+  std::string* record;
+  while (queue_.pop(record)) {
+    delete record;
+  }
+
+  file_.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file_) {
+    LOG(ERROR) << "Failed to create the capture file " << path;
+    file_.clear();
+    return false;
+  }
+  file_.write(kMagic, kMagicSize);
+  file_.put(static_cast<char>(mode));
+
+  mode_.store(mode, boost::memory_order_relaxed);
+  started_.store(Now(), boost::memory_order_relaxed);
+  dropped_.store(0);
+  stopping_ = false;
+  thread_ = boost::thread(&RequestCapture::Run, this);
+  active_.store(true, boost::memory_order_release);
+  return true;
+}
+
+void RequestCapture::Stop() {
+  boost::mutex::scoped_lock control(control_mutex_);
+  StopLocked();
+}
+
+void RequestCapture::StopLocked() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  active_.store(false);
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stopping_ = true;
+  }
+  wakeup_.notify_one();
+  thread_.join();
+  file_.close();
+  if (dropped_.load() != 0) {
+    LOG(ERROR) << "Request capture dropped " << dropped_.load() << " calls";
+  }
+}
+
+std::uint64_t RequestCapture::Begin() const {
+  return active_.load(boost::memory_order_acquire) ? Now() : 0;
+}
+
+void RequestCapture::Record(Method method, std::uint64_t begin,
+                            const std::string& arg0, const std::string& arg1,
+                            const std::string& arg2,
+                            const std::string& result) {
+  if (begin == 0 || !active_.load(boost::memory_order_acquire)) {
+    return;
+  }
+  std::uint64_t now = Now();
+  std::uint64_t started = started_.load(boost::memory_order_relaxed);
+  UrlMode mode = mode_.load(boost::memory_order_relaxed);
+
+  std::string* record = new std::string();
+  record->push_back(static_cast<char>(method));
+  AppendVarint(begin > started ? (begin - started) / 1000 : 0, record);
+  AppendVarint(now - begin, record);
+  AppendVarint(4, record);
+  // Every method takes URLs except for the type of CheckFilterMatch and
+  // IsWhitelisted
+  AppendField(CaptureUrl(arg0, mode), record);
+  AppendField(method == IS_WHITELISTED ? CaptureUrl(arg1, mode) : arg1, record);
+  AppendField(method == CHECK_FILTER_MATCH ? CaptureUrl(arg2, mode) : arg2,
+              record);
+  if (result.length() > kMaxCapturedResult) {
+    std::stringstream digest;
+    digest << "#" << result.length() << ":" << HexDigest(result, 32);
+    AppendField(digest.str(), record);
+  } else {
+    AppendField(result, record);
+  }
+
+  if (!queue_.push(record)) {
+    delete record;
+    dropped_.fetch_add(1, boost::memory_order_relaxed);
+  }
+}
+
+std::string RequestCapture::CaptureUrl(const std::string& url,
+                                       UrlMode mode) {
+  if (mode == FULL_URLS || url.empty()) {
+    return url;
+  }
+
+  size_t host = url.find("://");
+  host = host == std::string::npos ? 0 : host + 3;
+  size_t path = std::min(url.find_first_of("/?#", host), url.length());
+  if (mode == HASHED_URLS) {
+    if (path == url.length()) {
+      return url;
+    }
+    return url.substr(0, path) + "/" + HexDigest(url.substr(path), 16);
+  }
+
+  size_t end = std::min(url.find_first_of("?#", path), url.length());
+  return url.substr(0, std::min(end, kMaxTruncatedUrl));
+}
+
+void RequestCapture::Drain() {
+  std::string* record;
+  while (queue_.pop(record)) {
+    file_.write(record->data(), record->length());
+    delete record;
+  }
+  file_.flush();
+}
+
+void RequestCapture::Run() {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (!stopping_) {
+    wakeup_.timed_wait(lock, boost::posix_time::milliseconds(kWriteInterval));
+    lock.unlock();
+    Drain();
+    lock.lock();
+  }
+  lock.unlock();
+  Drain();
+}
+
+bool RequestCapture::IsCaptureFile(const std::string& path) {
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  char magic[kMagicSize];
+  return file.read(magic, kMagicSize) &&
+         std::memcmp(magic, kMagic, kMagicSize) == 0;
+}
+
+bool RequestCapture::Load(const std::string& path, UrlMode* mode,
+                          std::vector<CaptureRecord>* records) {
+  std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+  char magic[kMagicSize];
+  if (!file.read(magic, kMagicSize) ||
+      std::memcmp(magic, kMagic, kMagicSize) != 0) {
+    return false;
+  }
+  int url_mode = file.get();
+  if (url_mode < FULL_URLS || url_mode > HASHED_URLS) {
+    return false;
+  }
+  *mode = static_cast<UrlMode>(url_mode);
+
+  int method;
+  while ((method = file.get()) != EOF) {
+    CaptureRecord record;
+    record.method = static_cast<std::uint8_t>(method);
+    std::uint64_t count;
+    if (!ReadVarint(&file, &record.time) ||
+        !ReadVarint(&file, &record.latency_ns) ||
+        !ReadVarint(&file, &count) || count == 0) {
+      return false;
+    }
+    for (std::uint64_t idx = 0; idx < count; ++idx) {
+      std::uint64_t length;
+      if (!ReadVarint(&file, &length) || length > (1 << 24)) {
+        return false;
+      }
+      std::string field(static_cast<size_t>(length), '\0');
+      if (length && !file.read(&field[0], field.length())) {
+        return false;
+      }
+      if (idx + 1 < count) {
+        record.args.push_back(field);
+      } else {
+        record.result.swap(field);
+      }
+    }
+    records->push_back(record);
+  }
+  return true;
+}
+
+}  // namespace adblock
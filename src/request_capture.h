@@ -0,0 +1,98 @@
+#ifndef REQUEST_CAPTURE_H_
+#define REQUEST_CAPTURE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace adblock {
+
+// A call read back from a capture file.
+struct CaptureRecord {
+  std::uint8_t method;
+  // Microseconds since the capture started
+  std::uint64_t time;
+  std::uint64_t latency_ns;
+  std::vector<std::string> args;
+  // Results longer than 256 bytes are stored as "#<length>:<md5 hex>"
+  std::string result;
+};
+
+// Records the queries the engine answers into a binary log that
+// "bench replay" plays back. The file starts with the 8 byte magic
+// "ADBCAP1\n" and the URL mode byte, followed by one record per call:
+//   method byte, varint time, varint latency, varint field count and
+//   fields as varint length and bytes, the arguments first, the result last.
+// Varints are little-endian base 128. Callers only encode their record and
+// push it into a lock-free queue, a background thread writes the file.
+class RequestCapture {
+ public:
+  enum Method {
+    CHECK_FILTER_MATCH = 1,
+    IS_WHITELISTED = 2,
+    GET_ELEMENT_HIDING_SELECTORS = 3
+  };
+
+  enum UrlMode {
+    FULL_URLS,
+    // Query and fragment removed, at most 128 characters
+    TRUNCATED_URLS,
+    // Scheme and host kept, the rest replaced by a digest
+    HASHED_URLS
+  };
+
+  RequestCapture();
+  ~RequestCapture();
+
+  // Starts writing a new file, a running capture is stopped first. False if
+  // the file can't be created or |mode| is none of UrlMode.
+  bool Start(const std::string& path, UrlMode mode);
+  void Stop();
+
+  // Timestamp to pass to Record(), 0 while no capture is running.
+  std::uint64_t Begin() const;
+  void Record(Method method, std::uint64_t begin, const std::string& arg0,
+              const std::string& arg1, const std::string& arg2,
+              const std::string& result);
+
+  // Reads a capture file, returns false if it is not one.
+  static bool Load(const std::string& path, UrlMode* mode,
+                   std::vector<CaptureRecord>* records);
+  static bool IsCaptureFile(const std::string& path);
+
+  UrlMode mode() const { return mode_.load(boost::memory_order_relaxed); }
+  // Records dropped because the writer fell behind
+  std::uint64_t dropped() const { return dropped_.load(); }
+
+ private:
+  // Serializes Start() and Stop()
+  boost::mutex control_mutex_;
+  boost::atomic<bool> active_;
+  // Written by Start() before active_ is set, read by recording threads
+  boost::atomic<UrlMode> mode_;
+  boost::atomic<std::uint64_t> started_;
+  boost::atomic<std::uint64_t> dropped_;
+  boost::lockfree::queue<std::string*> queue_;
+
+  boost::mutex mutex_;
+  boost::condition_variable wakeup_;
+  bool stopping_;
+  std::ofstream file_;
+  boost::thread thread_;
+
+  void StopLocked();
+  static std::string CaptureUrl(const std::string& url, UrlMode mode);
+  void Drain();
+  void Run();
+};
+
+}  // namespace adblock
+
+#endif  // REQUEST_CAPTURE_H_
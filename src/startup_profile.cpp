@@ -0,0 +1,129 @@
+#include "startup_profile.h"
+#include "engine_stats.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace adblock {
+
+namespace {
+
+double Milliseconds(std::uint64_t nanoseconds) {
+  return nanoseconds / 1000000.0;
+}
+
+}  // namespace
+
+StartupProfile::StartupProfile() : finished_(false) {}
+
+void StartupProfile::Record(const std::string& name, std::uint64_t start,
+                            std::uint64_t end) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (finished_ || Find(name)) {
+    return;
+  }
+  Phase phase = {name, start, end};
+  phases_.push_back(phase);
+}
+
+void StartupProfile::Begin(const std::string& name) {
+  Record(name, EngineStats::Now(), 0);
+}
+
+void StartupProfile::End(const std::string& name) {
+  std::uint64_t now = EngineStats::Now();
+  boost::mutex::scoped_lock lock(mutex_);
+  Phase* phase = Find(name);
+  if (!finished_ && phase && phase->end == 0) {
+    phase->end = now;
+  }
+}
+
+void StartupProfile::Mark(const std::string& name) {
+  std::uint64_t now = EngineStats::Now();
+  Record(name, now, now);
+}
+
+bool StartupProfile::Finish(const std::string& name) {
+  std::uint64_t now = EngineStats::Now();
+  boost::mutex::scoped_lock lock(mutex_);
+  if (finished_) {
+    return false;
+  }
+  Phase phase = {name, now, now};
+  phases_.push_back(phase);
+  finished_ = true;
+  return true;
+}
+
+void StartupProfile::WriteJson(std::ostream* out) {
+  boost::mutex::scoped_lock lock(mutex_);
+  std::uint64_t first = origin();
+  *out << std::fixed << std::setprecision(3)
+       << "{\"finished\": " << (finished_ ? "true" : "false")
+       << ", \"total_ms\": " << Milliseconds(total())
+       << ", \"phases\": {";
+  for (auto it = phases_.begin(); it != phases_.end(); ++it) {
+    *out << (it != phases_.begin() ? ", " : "") << "\"" << it->name
+         << "\": {\"start_ms\": " << Milliseconds(it->start - first)
+         << ", \"ms\": ";
+    if (it->end != 0) {
+      *out << Milliseconds(it->end - it->start);
+    } else {
+      *out << "null";
+    }
+    *out << "}";
+  }
+  *out << "}}";
+}
+
+std::string StartupProfile::ToString() {
+  boost::mutex::scoped_lock lock(mutex_);
+  std::uint64_t first = origin();
+  std::stringstream result;
+  result << std::fixed << std::setprecision(1);
+  for (auto it = phases_.begin(); it != phases_.end(); ++it) {
+    result << it->name << " ";
+    if (it->end == 0) {
+      result << "unfinished, ";
+    } else if (it->end == it->start) {
+      result << "at " << Milliseconds(it->start - first) << " ms, ";
+    } else {
+      result << Milliseconds(it->end - it->start) << " ms, ";
+    }
+  }
+  result << "total " << Milliseconds(total()) << " ms";
+  return result.str();
+}
+
+StartupProfile::Phase* StartupProfile::Find(const std::string& name) {
+  for (auto it = phases_.begin(); it != phases_.end(); ++it) {
+    if (it->name == name) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+std::uint64_t StartupProfile::origin() const {
+  std::uint64_t result = 0;
+  for (auto it = phases_.begin(); it != phases_.end(); ++it) {
+    if (result == 0 || it->start < result) {
+      result = it->start;
+    }
+  }
+  return result;
+}
+
+std::uint64_t StartupProfile::total() const {
+  std::uint64_t last = 0;
+  for (auto it = phases_.begin(); it != phases_.end(); ++it) {
+    if (it->end > last) {
+      last = it->end;
+    }
+  }
+  std::uint64_t first = origin();
+  return last > first ? last - first : 0;
+}
+
+}  // namespace adblock
@@ -0,0 +1,59 @@
+#ifndef STARTUP_PROFILE_H_
+#define STARTUP_PROFILE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+namespace adblock {
+
+// Wall clock time of the phases of an engine's startup, from creating the
+// context until its filters are loaded. Each phase is kept the first time it
+// is recorded, later reloads of the database don't count, and nothing is
+// recorded any more once the startup is finished.
+class StartupProfile {
+ public:
+  StartupProfile();
+
+  // |start| and |end| in monotonic nanoseconds, see EngineStats::Now()
+  void Record(const std::string& name, std::uint64_t start,
+              std::uint64_t end);
+  void Begin(const std::string& name);
+  void End(const std::string& name);
+  // A point in time, recorded as a phase that takes no time
+  void Mark(const std::string& name);
+  // Marks the end of the startup as |name|, false if it was finished already
+  bool Finish(const std::string& name);
+
+  // Writes whether the startup is finished, the milliseconds it took and the
+  // start and duration of every phase relative to the first one as a JSON
+  // object. Phases that didn't end have a duration of null.
+  void WriteJson(std::ostream* out);
+  // The phases and their durations on one line, for the log
+  std::string ToString();
+
+ private:
+  struct Phase {
+    std::string name;
+    std::uint64_t start;
+    // 0 while the phase runs
+    std::uint64_t end;
+  };
+
+  boost::mutex mutex_;
+  std::vector<Phase> phases_;
+  bool finished_;
+
+  Phase* Find(const std::string& name);
+  // Start of the first phase, 0 if there is none
+  std::uint64_t origin() const;
+  // From the start of the first phase to the end of the last one
+  std::uint64_t total() const;
+};
+
+}  // namespace adblock
+
+#endif  // STARTUP_PROFILE_H_
@@ -0,0 +1,104 @@
+#include "startup_state.h"
+#include "engine_stats.h"
+
+#include <boost/chrono.hpp>
+
+namespace adblock {
+
+namespace {
+
+const char* const kReadinessNames[] = {"starting", "code_loaded",
+                                       "filters_loaded", "first_sync_done"};
+
+}  // namespace
+
+StartupState::StartupState(AdBlock::Readiness readiness)
+    : readiness_(readiness), created_(EngineStats::Now()), early_answers_(0) {
+  for (int stage = 0; stage <= AdBlock::FIRST_SYNC_DONE; ++stage) {
+    reached_[stage] = stage <= readiness ? created_ : 0;
+  }
+}
+
+AdBlock::Readiness StartupState::readiness() {
+  return readiness_.load(boost::memory_order_acquire);
+}
+
+void StartupState::Reach(AdBlock::Readiness readiness) {
+  std::vector<AdBlock::ReadinessCallback> callbacks;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    AdBlock::Readiness current = readiness_.load(boost::memory_order_relaxed);
+    if (current == AdBlock::INIT_FAILED ||
+        current == AdBlock::FIRST_SYNC_DONE ||
+        (readiness != AdBlock::INIT_FAILED && readiness <= current)) {
+      return;
+    }
+    if (readiness != AdBlock::INIT_FAILED) {
+      reached_[readiness] = EngineStats::Now();
+    }
+    readiness_.store(readiness, boost::memory_order_release);
+    callbacks = callbacks_;
+    // Nothing is going to happen any more
+    if (readiness == AdBlock::INIT_FAILED ||
+        readiness == AdBlock::FIRST_SYNC_DONE) {
+      callbacks_.clear();
+    }
+  }
+  changed_.notify_all();
+  for (auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+    (*it)(readiness);
+  }
+}
+
+bool StartupState::WaitFor(AdBlock::Readiness readiness,
+                           std::uint64_t deadline) {
+  if (Reached(this->readiness(), readiness)) {
+    return true;
+  }
+  boost::mutex::scoped_lock lock(mutex_);
+  AdBlock::Readiness current;
+  while ((current = readiness_.load(boost::memory_order_relaxed)) !=
+             AdBlock::INIT_FAILED &&
+         current < readiness) {
+    if (deadline == 0) {
+      changed_.wait(lock);
+      continue;
+    }
+    std::uint64_t now = EngineStats::Now();
+    if (now >= deadline) {
+      return false;
+    }
+    changed_.wait_for(lock, boost::chrono::nanoseconds(deadline - now));
+  }
+  return Reached(current, readiness);
+}
+
+void StartupState::AddCallback(const AdBlock::ReadinessCallback& callback) {
+  boost::mutex::scoped_lock lock(mutex_);
+  AdBlock::Readiness current = readiness_.load(boost::memory_order_relaxed);
+  if (current != AdBlock::INIT_FAILED && current != AdBlock::FIRST_SYNC_DONE) {
+    callbacks_.push_back(callback);
+  }
+}
+
+void StartupState::WriteJson(std::ostream* out) {
+  boost::mutex::scoped_lock lock(mutex_);
+  AdBlock::Readiness current = readiness_.load(boost::memory_order_relaxed);
+  *out << "{\"readiness\": \""
+       << (current == AdBlock::INIT_FAILED ? "init_failed"
+                                           : kReadinessNames[current])
+       << "\"";
+  for (int stage = AdBlock::CODE_LOADED; stage <= AdBlock::FIRST_SYNC_DONE;
+       ++stage) {
+    *out << ", \"" << kReadinessNames[stage] << "_ms\": ";
+    if (reached_[stage] != 0) {
+      *out << (reached_[stage] - created_) / 1000000;
+    } else {
+      *out << "null";
+    }
+  }
+  *out << ", \"early_answers\": "
+       << early_answers_.load(boost::memory_order_relaxed) << "}";
+}
+
+}  // namespace adblock
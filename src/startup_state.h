@@ -0,0 +1,57 @@
+#ifndef STARTUP_STATE_H_
+#define STARTUP_STATE_H_
+
+#include "adblock.h"
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace adblock {
+
+// Startup stage of an engine that threads can wait for. Stages are only
+// reached in order, a failure ends the startup. Checking a stage that was
+// reached already doesn't lock, every query does it.
+class StartupState {
+ public:
+  explicit StartupState(AdBlock::Readiness readiness);
+
+  AdBlock::Readiness readiness();
+  // Moves on to |readiness| unless the engine got that far already and
+  // tells the waiting threads and the callbacks.
+  void Reach(AdBlock::Readiness readiness);
+  // |deadline| in monotonic nanoseconds, see EngineStats::Now(), 0 waits as
+  // long as it takes.
+  bool WaitFor(AdBlock::Readiness readiness, std::uint64_t deadline);
+  void AddCallback(const AdBlock::ReadinessCallback& callback);
+  // A query got its default answer because the engine wasn't ready
+  void RecordEarlyAnswer() {
+    early_answers_.fetch_add(1, boost::memory_order_relaxed);
+  }
+
+  // Writes the stage, the milliseconds it took to reach each one and the
+  // early answers as a JSON object.
+  void WriteJson(std::ostream* out);
+
+ private:
+  boost::mutex mutex_;
+  boost::condition_variable changed_;
+  boost::atomic<AdBlock::Readiness> readiness_;
+  std::uint64_t created_;
+  // When each stage was reached, indexed by its value, 0 if it wasn't
+  std::uint64_t reached_[AdBlock::FIRST_SYNC_DONE + 1];
+  std::vector<AdBlock::ReadinessCallback> callbacks_;
+  boost::atomic<std::uint64_t> early_answers_;
+
+  static bool Reached(AdBlock::Readiness current, AdBlock::Readiness wanted) {
+    return current != AdBlock::INIT_FAILED && current >= wanted;
+  }
+};
+
+}  // namespace adblock
+
+#endif  // STARTUP_STATE_H_
@@ -0,0 +1,117 @@
+#include "task_scheduler.h"
+#include "env.h"
+#include "utils.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace adblock {
+
+namespace {
+
+// Longest time a pending task is held back while queries wait for the engine
+const boost::chrono::milliseconds kMaxTaskDelay(50);
+
+}  // namespace
+
+TaskScheduler::TaskScheduler(Environment* env)
+    : env_(env), stopping_(false), foreground_waiters_(0), completed_(0) {}
+
+TaskScheduler::~TaskScheduler() { Stop(); }
+
+void TaskScheduler::Post(const JsValuePtr& task) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (stopping_) {
+    return;
+  }
+  if (!thread_.joinable()) {
+    thread_ = boost::thread(&TaskScheduler::Work, this);
+  }
+  Task entry = {task, boost::chrono::steady_clock::now()};
+  tasks_.push_back(entry);
+  wakeup_.notify_one();
+}
+
+void TaskScheduler::Stop() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+  }
+  wakeup_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void TaskScheduler::BeginForegroundWait() {
+  foreground_waiters_.fetch_add(1, boost::memory_order_relaxed);
+}
+
+void TaskScheduler::EndForegroundWait() {
+  if (foreground_waiters_.fetch_sub(1, boost::memory_order_relaxed) == 1) {
+    // Taking the mutex makes sure the thread is either waiting already or
+    // will see the count
+    boost::mutex::scoped_lock lock(mutex_);
+    wakeup_.notify_one();
+  }
+}
+
+void TaskScheduler::WriteJson(std::ostream* out) {
+  boost::mutex::scoped_lock lock(mutex_);
+  *out << "{\"pending\": " << tasks_.size()
+       << ", \"completed\": " << completed_.load(boost::memory_order_relaxed)
+       << "}";
+}
+
+bool TaskScheduler::Ready(boost::chrono::steady_clock::time_point* due) const {
+  if (tasks_.empty()) {
+    return false;
+  }
+  if (!foreground_waiting()) {
+    return true;
+  }
+  *due = std::max(tasks_.front().posted, last_run_) + kMaxTaskDelay;
+  return boost::chrono::steady_clock::now() >= *due;
+}
+
+void TaskScheduler::Work() {
+  boost::mutex::scoped_lock lock(mutex_);
+  while (true) {
+    boost::chrono::steady_clock::time_point due;
+    while (!stopping_ && !Ready(&due)) {
+      if (tasks_.empty()) {
+        wakeup_.wait(lock);
+      } else {
+        wakeup_.wait_until(lock, due);
+      }
+    }
+    if (stopping_) {
+      break;
+    }
+    JsValuePtr task = tasks_.front().function;
+    tasks_.pop_front();
+    lock.unlock();
+
+    {
+      // Also releases the function while the isolate is locked
+      SETUP_THREAD_CONTEXT(env_);
+      try {
+        task->Call(JsValueList(), env_);
+      }
+      catch (const std::exception& e) {
+        LOG(ERROR) << "Scheduled task failed: " << e.what();
+      }
+      task.reset();
+    }
+    completed_.fetch_add(1, boost::memory_order_relaxed);
+
+    lock.lock();
+    last_run_ = boost::chrono::steady_clock::now();
+  }
+}
+
+}  // namespace adblock
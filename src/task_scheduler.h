@@ -0,0 +1,83 @@
+#ifndef TASK_SCHEDULER_H_
+#define TASK_SCHEDULER_H_
+
+#include "js_value.h"
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace adblock {
+
+class Environment;
+
+// Runs the functions scripts post with scheduler.postTask() in order, each in
+// an engine turn of its own. Long jobs are split into such tasks, a task is
+// started when no query waits for the engine, so queries get their turn
+// between the slices of a job. Under steady load a task still runs once
+// kMaxTaskDelay passed since the previous one or since it was posted.
+class TaskScheduler {
+ public:
+  explicit TaskScheduler(Environment* env);
+  // Drops the tasks that didn't run, the isolate has to be locked.
+  ~TaskScheduler();
+
+  void Post(const JsValuePtr& task);
+  // Stops the thread. Must not be called holding the engine, the current
+  // task might be waiting for it.
+  void Stop();
+
+  // A query that is about to wait for the engine, see ForegroundWait
+  void BeginForegroundWait();
+  void EndForegroundWait();
+  bool foreground_waiting() const {
+    return foreground_waiters_.load(boost::memory_order_relaxed) > 0;
+  }
+
+  // Writes pending and completed counts as a JSON object.
+  void WriteJson(std::ostream* out);
+
+  // Announces a query to the scheduler for as long as it waits for the engine
+  class ForegroundWait {
+   public:
+    explicit ForegroundWait(TaskScheduler* scheduler) : scheduler_(scheduler) {
+      scheduler_->BeginForegroundWait();
+    }
+    ~ForegroundWait() { scheduler_->EndForegroundWait(); }
+
+   private:
+    TaskScheduler* scheduler_;
+  };
+
+ private:
+  struct Task {
+    JsValuePtr function;
+    boost::chrono::steady_clock::time_point posted;
+  };
+
+  Environment* env_;
+  boost::mutex mutex_;
+  boost::condition_variable wakeup_;
+  std::deque<Task> tasks_;
+  // When the last task finished
+  boost::chrono::steady_clock::time_point last_run_;
+  bool stopping_;
+  boost::thread thread_;
+  boost::atomic<int> foreground_waiters_;
+  boost::atomic<std::uint64_t> completed_;
+
+  void Work();
+  // Whether the first task may start now, otherwise sets |due| to the time
+  // it will start at even if queries keep waiting.
+  bool Ready(boost::chrono::steady_clock::time_point* due) const;
+};
+
+}  // namespace adblock
+
+#endif  // TASK_SCHEDULER_H_
@@ -19,11 +19,27 @@ inline v8::Local<v8::String> STD_STRING_TO_V8_STRING(v8::Isolate* isolate,
 #define STD_STRING_TO_V8_STRING adblock::utils::STD_STRING_TO_V8_STRING
 
 #define SETUP_THREAD_CONTEXT(env)        \
+  adblock::EngineLock engine_lock(env);  \
+  SETUP_LOCKED_THREAD_CONTEXT(env)
+
+// SETUP_THREAD_CONTEXT for a thread that holds the EngineLock already
+#define SETUP_LOCKED_THREAD_CONTEXT(env) \
   v8::Isolate* isolate = env->isolate(); \
   v8::Locker locker(isolate);            \
   v8::HandleScope handle_scope(isolate); \
   v8::Context::Scope context_scope(env->context())
 
+// SETUP_THREAD_CONTEXT that reports the wait for the isolate lock to the
+// EngineStats |stats|
+#define SETUP_TIMED_THREAD_CONTEXT(env, stats)             \
+  v8::Isolate* isolate = env->isolate();                   \
+  std::uint64_t lock_begin = adblock::EngineStats::Now();  \
+  adblock::EngineLock engine_lock(env);                    \
+  v8::Locker locker(isolate);                              \
+  (stats)->RecordLockWait(lock_begin);                     \
+  v8::HandleScope handle_scope(isolate);                   \
+  v8::Context::Scope context_scope(env->context())
+
 }  // namespace utils
 }  // namespace adblock
 
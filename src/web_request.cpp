@@ -1,7 +1,13 @@
 #include "web_request.h"
 #include <curl/curl.h>
 #include <glog/logging.h>
+#include <algorithm>
+#include <set>
 #include <sstream>
+#include <boost/bind.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace {
 
@@ -52,12 +58,6 @@ unsigned int ConvertErrorCode(CURLcode code) {
   return status;
 }
 
-size_t ReceiveData(char* ptr, size_t size, size_t nmemb, void* userdata) {
-  std::stringstream* stream = static_cast<std::stringstream*>(userdata);
-  stream->write(ptr, size * nmemb);
-  return nmemb;
-}
-
 size_t ReceiveHeader(char* ptr, size_t size, size_t nmemb, void* userdata) {
   HeaderData* data = static_cast<HeaderData*>(userdata);
   std::string header(ptr, size * nmemb);
@@ -102,47 +102,53 @@ size_t ReceiveHeader(char* ptr, size_t size, size_t nmemb, void* userdata) {
   return nmemb;
 }
 
-}  // namespace
-
-namespace adblock {
-
-WebRequest::ServerResponse DefaultWebRequest::Get(
-    const std::string& url, const HeaderList& headers) const {
-  ServerResponse result;
-  result.status = NS_ERROR_NOT_INITIALIZED;
-  result.response_status = 0;
+// Longest wait for socket activity, Add() and the destructor wake the loop
+// right away.
+const int kPollTimeout = 1000;
 
-  CURL* curl = curl_easy_init();
-  if (!curl) {
-    LOG(ERROR) << "curl_easy_init failed" << std::endl;
-    return result;
-  }
+struct Transfer {
+  Transfer() : curl(nullptr), header_list(nullptr), paused(false) {}
 
+  CURL* curl;
+  struct curl_slist* header_list;
+  // Whether the data callback refused data, only used by the loop thread
+  bool paused;
+  adblock::WebRequest::ResumeCallback resume;
   std::stringstream response_text;
   HeaderData header_data;
-  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ReceiveData);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_text);
-  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ReceiveHeader);
-  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header_data);
+  adblock::WebRequest::GetCallback callback;
+  adblock::WebRequest::DataCallback data_callback;
+};
 
-  struct curl_slist* header_list = nullptr;
-  for (auto it = headers.begin(); it != headers.end(); ++it) {
-    header_list =
-        curl_slist_append(header_list, (it->first + ": " + it->second).c_str());
+size_t ReceiveData(char* ptr, size_t size, size_t nmemb, void* userdata) {
+  Transfer* transfer = static_cast<Transfer*>(userdata);
+  if (!transfer->data_callback) {
+    transfer->response_text.write(ptr, size * nmemb);
+    return nmemb;
+  }
+
+  bool taken;
+  try {
+    taken = transfer->data_callback(ptr, size * nmemb, transfer->resume);
   }
-  if (header_list) {
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+  catch (const std::exception& e) {
+    // Aborts the transfer
+    LOG(ERROR) << "WebRequest data callback failed: " << e.what() << std::endl;
+    return 0;
   }
+  if (!taken) {
+    // libcurl keeps the data and passes it again once the transfer continues
+    transfer->paused = true;
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  return nmemb;
+}
 
-  result.status = ConvertErrorCode(curl_easy_perform(curl));
-  result.response_status = header_data.status;
-  result.response_text = response_text.str();
-  for (auto it = header_data.headers.begin(); it != header_data.headers.end();
-       ++it) {
+void ParseHeaders(const std::vector<std::string>& headers,
+                  adblock::WebRequest::HeaderList* result) {
+  for (auto it = headers.begin(); it != headers.end(); ++it) {
     // Parse header name and value out of something like "Foo: bar"
-    std::string header = *it;
+    const std::string& header = *it;
     size_t colon_pos = header.find(':');
     if (colon_pos != std::string::npos) {
       size_t name_start = 0;
@@ -161,17 +167,260 @@ WebRequest::ServerResponse DefaultWebRequest::Get(
         std::string name = header.substr(name_start, name_end - name_start);
         std::transform(name.begin(), name.end(), name.begin(), ::tolower);
         std::string value = header.substr(value_start, value_end - value_start);
-        result.response_headers.push_back(
-            std::pair<std::string, std::string>(name, value));
+        result->push_back(std::pair<std::string, std::string>(name, value));
+      }
+    }
+  }
+}
+
+void SetResponse(boost::promise<adblock::WebRequest::ServerResponse>* promise,
+                 const adblock::WebRequest::ServerResponse& response) {
+  promise->set_value(response);
+}
+
+}  // namespace
+
+namespace adblock {
+
+class TransferLoop {
+ public:
+  TransferLoop();
+  ~TransferLoop();
+
+  void Add(Transfer* transfer);
+  // Ends the loop thread and drops every transfer without its callback,
+  // transfers added later are dropped as well
+  void Stop();
+  // Continues |transfer| on the loop thread if it is still paused
+  void Resume(Transfer* transfer);
+
+ private:
+  CURLM* multi_;
+  CURLSH* share_;
+  boost::mutex mutex_;
+  std::vector<Transfer*> pending_;
+  std::vector<Transfer*> resumed_;
+  std::set<Transfer*> active_;
+  bool stopping_;
+  boost::thread thread_;
+
+  void Run();
+  void Start(Transfer* transfer);
+  // |status| is one of WebRequest::NetworkStatus
+  void Finish(Transfer* transfer, unsigned int status);
+  static void Release(Transfer* transfer);
+};
+
+TransferLoop::TransferLoop() : stopping_(false) {
+  curl_global_init(CURL_GLOBAL_ALL);
+  multi_ = curl_multi_init();
+  // The multi handle keeps a connection cache of its own, DNS results and TLS
+  // sessions are shared explicitly. All handles are only ever used by the
+  // loop thread so the share doesn't need lock callbacks.
+  share_ = curl_share_init();
+  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  thread_ = boost::thread(&TransferLoop::Run, this);
+}
+
+TransferLoop::~TransferLoop() {
+  Stop();
+  curl_multi_cleanup(multi_);
+  curl_share_cleanup(share_);
+  curl_global_cleanup();
+}
+
+void TransferLoop::Add(Transfer* transfer) {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!stopping_) {
+      pending_.push_back(transfer);
+      transfer = nullptr;
+    }
+  }
+  if (transfer) {
+    Release(transfer);
+    return;
+  }
+  curl_multi_wakeup(multi_);
+}
+
+void TransferLoop::Stop() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (stopping_) {
+      return;
+    }
+    stopping_ = true;
+  }
+  curl_multi_wakeup(multi_);
+  thread_.join();
+
+  for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+    Release(*it);
+  }
+  pending_.clear();
+  resumed_.clear();
+  for (auto it = active_.begin(); it != active_.end(); ++it) {
+    curl_multi_remove_handle(multi_, (*it)->curl);
+    Release(*it);
+  }
+  active_.clear();
+}
+
+void TransferLoop::Resume(Transfer* transfer) {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    resumed_.push_back(transfer);
+  }
+  curl_multi_wakeup(multi_);
+}
+
+void TransferLoop::Run() {
+  int running = 0;
+  while (true) {
+    std::vector<Transfer*> added;
+    std::vector<Transfer*> resumed;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (stopping_) {
+        break;
+      }
+      added.swap(pending_);
+      resumed.swap(resumed_);
+    }
+
+    for (auto it = added.begin(); it != added.end(); ++it) {
+      Start(*it);
+    }
+    for (auto it = resumed.begin(); it != resumed.end(); ++it) {
+      // The transfer may have failed meanwhile
+      Transfer* transfer = *it;
+      if (active_.count(transfer) && transfer->paused) {
+        transfer->paused = false;
+        curl_easy_pause(transfer->curl, CURLPAUSE_CONT);
+      }
+    }
+
+    curl_multi_perform(multi_, &running);
+    CURLMsg* message;
+    int queued;
+    while ((message = curl_multi_info_read(multi_, &queued))) {
+      if (message->msg == CURLMSG_DONE) {
+        Transfer* transfer;
+        curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+        Finish(transfer, ConvertErrorCode(message->data.result));
       }
     }
+
+    // Also returns when there is nothing to transfer, once woken up
+    curl_multi_poll(multi_, nullptr, 0, kPollTimeout, nullptr);
+  }
+}
+
+void TransferLoop::Start(Transfer* transfer) {
+  CURL* curl = transfer->curl;
+  transfer->resume = boost::bind(&TransferLoop::Resume, this, transfer);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer);
+  curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+  // Empty string enables every encoding libcurl was built with
+  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ReceiveData);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, ReceiveHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer->header_data);
+  if (transfer->header_list) {
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->header_list);
   }
 
-  if (header_list) {
-    curl_slist_free_all(header_list);
+  CURLMcode code = curl_multi_add_handle(multi_, curl);
+  if (code != CURLM_OK) {
+    LOG(ERROR) << "curl_multi_add_handle failed: " << curl_multi_strerror(code)
+               << std::endl;
+    Finish(transfer, WebRequest::NS_ERROR_NOT_INITIALIZED);
+    return;
+  }
+  active_.insert(transfer);
+}
+
+void TransferLoop::Finish(Transfer* transfer, unsigned int status) {
+  WebRequest::ServerResponse result;
+  result.status = status;
+  result.response_status = transfer->header_data.status;
+  result.response_text = transfer->response_text.str();
+  ParseHeaders(transfer->header_data.headers, &result.response_headers);
+
+  double body_size = 0;
+  long header_size = 0;
+  double total_time = 0;
+  curl_easy_getinfo(transfer->curl, CURLINFO_SIZE_DOWNLOAD, &body_size);
+  curl_easy_getinfo(transfer->curl, CURLINFO_HEADER_SIZE, &header_size);
+  curl_easy_getinfo(transfer->curl, CURLINFO_TOTAL_TIME, &total_time);
+  result.bytes_received = body_size + header_size;
+  result.download_time = total_time * 1000;
+
+  if (active_.erase(transfer)) {
+    curl_multi_remove_handle(multi_, transfer->curl);
+  }
+  try {
+    transfer->callback(result);
+  }
+  catch (const std::exception& e) {
+    LOG(ERROR) << "WebRequest callback failed: " << e.what() << std::endl;
+  }
+  Release(transfer);
+}
+
+void TransferLoop::Release(Transfer* transfer) {
+  if (transfer->header_list) {
+    curl_slist_free_all(transfer->header_list);
+  }
+  curl_easy_cleanup(transfer->curl);
+  delete transfer;
+}
+
+WebRequest::ServerResponse WebRequest::Get(const std::string& url,
+                                           const HeaderList& headers) {
+  boost::promise<ServerResponse> promise;
+  GetAsync(url, headers, boost::bind(SetResponse, &promise, _1),
+           DataCallback());
+  return promise.get_future().get();
+}
+
+DefaultWebRequest::DefaultWebRequest() : loop_(new TransferLoop()) {}
+
+DefaultWebRequest::~DefaultWebRequest() {}
+
+void DefaultWebRequest::Stop() { loop_->Stop(); }
+
+void DefaultWebRequest::GetAsync(const std::string& url,
+                                 const HeaderList& headers,
+                                 const GetCallback& callback,
+                                 const DataCallback& data_callback) {
+  Transfer* transfer = new Transfer();
+  transfer->callback = callback;
+  transfer->data_callback = data_callback;
+  transfer->curl = curl_easy_init();
+  if (!transfer->curl) {
+    LOG(ERROR) << "curl_easy_init failed" << std::endl;
+    delete transfer;
+
+    ServerResponse result;
+    result.status = NS_ERROR_NOT_INITIALIZED;
+    result.response_status = 0;
+    result.bytes_received = 0;
+    result.download_time = 0;
+    callback(result);
+    return;
+  }
+
+  curl_easy_setopt(transfer->curl, CURLOPT_URL, url.c_str());
+  for (auto it = headers.begin(); it != headers.end(); ++it) {
+    transfer->header_list = curl_slist_append(
+        transfer->header_list, (it->first + ": " + it->second).c_str());
   }
-  curl_easy_cleanup(curl);
-  return result;
+  loop_->Add(transfer);
 }
 
 }  // namespace adblock
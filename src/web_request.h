@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 namespace adblock {
@@ -15,7 +17,19 @@ class WebRequest {
     int response_status;
     HeaderList response_headers;
     std::string response_text;
+    // Bytes read from the network, headers included and body still encoded
+    double bytes_received;
+    // Milliseconds from the start of the transfer until it completed
+    double download_time;
   };
+  typedef boost::function<void(const ServerResponse&)> GetCallback;
+  // Continues a transfer paused by its data callback, may be called from any
+  // thread.
+  typedef boost::function<void()> ResumeCallback;
+  // Returns false to pause the transfer instead of taking the data, it is
+  // passed again once |resume| is called. Must not block.
+  typedef boost::function<bool(const char* data, size_t size,
+                               const ResumeCallback& resume)> DataCallback;
   enum NetworkStatus {
     NS_OK = 0,
     NS_ERROR_FAILURE = 0x80004005,
@@ -36,16 +50,39 @@ class WebRequest {
   };
 
   virtual ~WebRequest() {}
-  virtual ServerResponse Get(const std::string& url,
-                             const HeaderList& headers) const = 0;
+  // Returns immediately, the callback is invoked once the request completes.
+  // If |data_callback| is set, the body is passed to it piece by piece as it
+  // arrives and response_text stays empty.
+  virtual void GetAsync(const std::string& url, const HeaderList& headers,
+                        const GetCallback& callback,
+                        const DataCallback& data_callback) = 0;
+  // Called before the engine goes away. Requests still running and later
+  // ones must be dropped without invoking their callbacks.
+  virtual void Stop() {}
+  // Blocks until the request completes.
+  ServerResponse Get(const std::string& url, const HeaderList& headers);
 };
 
 typedef boost::shared_ptr<WebRequest> WebRequestPtr;
 
+class TransferLoop;
+
+// Runs every request on a single thread driving a curl multi handle, so that
+// connections, DNS lookups and TLS sessions are reused between downloads.
+// Callbacks are invoked on that thread and must not block. Requests still
+// running on Stop() or destruction are dropped without their callbacks, they
+// would start threads on an environment that is being torn down.
 class DefaultWebRequest : public WebRequest {
  public:
-  WebRequest::ServerResponse Get(const std::string& url,
-                                 const HeaderList& headers) const;
+  DefaultWebRequest();
+  ~DefaultWebRequest();
+
+  void GetAsync(const std::string& url, const HeaderList& headers,
+                const GetCallback& callback, const DataCallback& data_callback);
+  void Stop();
+
+ private:
+  boost::scoped_ptr<TransferLoop> loop_;
 };
 
 }  // namespace adblock
@@ -0,0 +1,97 @@
+#include "whitelist_cache.h"
+
+#include <algorithm>
+
+namespace adblock {
+
+namespace {
+
+// End of the part of |url| the script derives the host from, see the URI
+// constructor in basedomain.js. Addresses it can't parse are kept whole.
+size_t AuthorityEnd(const std::string& url) {
+  size_t scheme_end = url.find(':');
+  if (scheme_end == std::string::npos ||
+      url.compare(scheme_end + 1, 2, "//") != 0) {
+    return url.length();
+  }
+  size_t start = scheme_end + 3;
+  size_t end = url.find('/', start);
+  if (end == std::string::npos) {
+    end = std::min(url.find('?', start), url.find('#', start));
+  }
+  return end == std::string::npos ? url.length() : end;
+}
+
+}  // namespace
+
+WhitelistCache::WhitelistCache()
+    : generation_(0), index_generation_(0), hits_(0), misses_(0) {}
+
+std::string WhitelistCache::Key(const std::string& url,
+                                const std::string& parent_url,
+                                const std::string& type) {
+  std::string key(url, 0, url.find('#'));
+  // Without a parent the script ignores the type and uses the page's host
+  if (!parent_url.empty()) {
+    key.append(1, '\0').append(parent_url, 0, AuthorityEnd(parent_url));
+    key.append(1, '\0').append(type);
+  }
+  return key;
+}
+
+bool WhitelistCache::Lookup(const std::string& key, bool* whitelisted) {
+  boost::mutex::scoped_lock lock(mutex_);
+  EntryMap::const_iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    misses_.fetch_add(1, boost::memory_order_relaxed);
+    return false;
+  }
+  hits_.fetch_add(1, boost::memory_order_relaxed);
+  *whitelisted = it->second;
+  return true;
+}
+
+void WhitelistCache::Store(const std::string& key, std::uint32_t generation,
+                           bool whitelisted) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (generation != generation_) {
+    return;
+  }
+  if (entries_.size() >= MAX_ENTRIES) {
+    entries_.clear();
+  }
+  entries_[key] = whitelisted;
+}
+
+std::uint32_t WhitelistCache::generation() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return generation_;
+}
+
+void WhitelistCache::Invalidate() {
+  boost::mutex::scoped_lock lock(mutex_);
+  InvalidateLocked();
+}
+
+void WhitelistCache::SetIndexGeneration(std::uint32_t index_generation) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (index_generation != index_generation_) {
+    index_generation_ = index_generation;
+    InvalidateLocked();
+  }
+}
+
+void WhitelistCache::WriteJson(std::ostream* out) {
+  boost::mutex::scoped_lock lock(mutex_);
+  *out << "{\"hits\": " << hits_.load(boost::memory_order_relaxed)
+       << ", \"misses\": " << misses_.load(boost::memory_order_relaxed)
+       << ", \"entries\": " << entries_.size()
+       << ", \"generation\": " << generation_ << "}";
+}
+
+void WhitelistCache::InvalidateLocked() {
+  entries_.clear();
+  ++generation_;
+}
+
+}  // namespace adblock
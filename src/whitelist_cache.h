@@ -0,0 +1,58 @@
+#ifndef WHITELIST_CACHE_H_
+#define WHITELIST_CACHE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered/unordered_map.hpp>
+
+namespace adblock {
+
+// Results of AdBlock::IsWhitelisted() by page address without the fragment,
+// scheme and authority of the parent frame and request type, so repeated
+// frame checks don't have to enter the engine. Only changes of the exception
+// rules make entries stale, the engine reports them through Invalidate().
+class WhitelistCache {
+ public:
+  // Same bound as the result cache of the script matcher
+  enum { MAX_ENTRIES = 1000 };
+
+  WhitelistCache();
+
+  // Two calls with the same key always get the same answer from the engine.
+  static std::string Key(const std::string& url, const std::string& parent_url,
+                         const std::string& type);
+
+  bool Lookup(const std::string& key, bool* whitelisted);
+  // Keeps |whitelisted| unless the cache was invalidated after |generation|
+  // was read, the result might be outdated then.
+  void Store(const std::string& key, std::uint32_t generation,
+             bool whitelisted);
+  std::uint32_t generation();
+  void Invalidate();
+  // Also invalidates whenever the shared filter index moved to another
+  // generation.
+  void SetIndexGeneration(std::uint32_t index_generation);
+
+  // Writes hits, misses, entries and the generation as a JSON object.
+  void WriteJson(std::ostream* out);
+
+ private:
+  typedef boost::unordered_map<std::string, bool> EntryMap;
+
+  boost::mutex mutex_;
+  EntryMap entries_;
+  std::uint32_t generation_;
+  std::uint32_t index_generation_;
+  boost::atomic<std::uint64_t> hits_;
+  boost::atomic<std::uint64_t> misses_;
+
+  void InvalidateLocked();
+};
+
+}  // namespace adblock
+
+#endif  // WHITELIST_CACHE_H_
@@ -0,0 +1,183 @@
+// Runs the engine against a local stand-in for a subscription server whose
+// list did not change: the database holds the list's filters and the
+// validators of its last download, and the expired subscription is checked
+// right after startup. Downloader has to send the stored validators back,
+// and once the server answers "304 Not Modified" Synchronizer has to keep
+// the filters and renew the subscription's expiration.
+// Usage: engine_test
+
+#include "stand_in_server.h"
+#include "../src/adblock.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <boost/chrono.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace fs = boost::filesystem;
+using test::kEtag;
+using test::kLastModified;
+using test::StandInServer;
+
+namespace {
+
+// Milliseconds to wait for the engine to start and check the subscription
+const std::uint32_t kTimeout = 60000;
+
+int failures = 0;
+
+void Check(bool condition, const std::string& description) {
+  if (!condition) {
+    std::cerr << "FAILED: " << description << std::endl;
+    ++failures;
+  }
+}
+
+// Directory the engine runs in while it exists
+class Sandbox {
+ public:
+  Sandbox()
+      : previous_(fs::current_path()),
+        directory_(fs::temp_directory_path() /
+                   fs::unique_path("adblock-test-%%%%%%%%")) {
+    fs::create_directories(directory_);
+    fs::current_path(directory_);
+  }
+
+  ~Sandbox() {
+    boost::system::error_code error;
+    fs::current_path(previous_, error);
+    fs::remove_all(directory_, error);
+  }
+
+ private:
+  fs::path previous_;
+  fs::path directory_;
+};
+
+// The subscription as the last successful download left it, expired an
+// hour ago
+void WriteDatabase(const std::string& url, std::time_t now) {
+  std::ofstream database("adblock.db");
+  database << "# Adblock preferences" << std::endl
+           << "version=4" << std::endl
+           << std::endl
+           << "[Subscription]" << std::endl
+           << "url=" << url << std::endl
+           << "title=Stand-in" << std::endl
+           << "lastDownload=" << now - 2 * 86400 << std::endl
+           << "downloadStatus=synchronize_ok" << std::endl
+           << "lastSuccess=" << now - 2 * 86400 << std::endl
+           << "lastCheck=" << now - 3600 << std::endl
+           << "expires=" << now - 3600 << std::endl
+           << "softExpiration=" << now - 3600 << std::endl
+           << "etag=" << kEtag << std::endl
+           << "lastModified=" << kLastModified << std::endl
+           << std::endl
+           << "[Subscription filters]" << std::endl
+           << "||ads.example.com^" << std::endl
+           << "##.banner" << std::endl;
+
+  // Checks the subscriptions right away
+  std::ofstream prefs("prefs.json");
+  prefs << "{\"subscriptions_check_delay_ms\": 0}";
+}
+
+// Last journal record of the subscription, empty if there is none yet
+std::string JournalRecord(const std::string& url) {
+  std::ifstream journal("adblock.db.journal");
+  std::string line, record;
+  while (std::getline(journal, line)) {
+    if (line.find("\"action\":\"subscription\"") != std::string::npos &&
+        line.find("\"url\":\"" + url + "\"") != std::string::npos) {
+      record = line;
+    }
+  }
+  return record;
+}
+
+// Integer property of a journal record, 0 if it is missing
+long long Property(const std::string& record, const std::string& name) {
+  std::string key = "\"" + name + "\":";
+  size_t pos = record.find(key);
+  if (pos == std::string::npos) {
+    return 0;
+  }
+  return std::atoll(record.c_str() + pos + key.length());
+}
+
+}  // namespace
+
+int main() {
+  {
+    StandInServer server;
+    Sandbox sandbox;
+    std::string url = server.Url("/list");
+    std::time_t now = std::time(nullptr);
+    WriteDatabase(url, now);
+
+    adblock::AdBlockPtr adblock;
+    adblock::CreateInstance(&adblock);
+    Check(adblock && adblock->WaitForReadiness(
+                         adblock::AdBlock::FILTERS_LOADED, kTimeout),
+          "the engine loaded the database");
+    if (!adblock) {
+      return 1;
+    }
+
+    // Synchronizer journals the subscription once the answer is handled
+    std::string record;
+    boost::chrono::steady_clock::time_point deadline =
+        boost::chrono::steady_clock::now() +
+        boost::chrono::milliseconds(kTimeout);
+    while (boost::chrono::steady_clock::now() < deadline) {
+      record = JournalRecord(url);
+      if (server.requests() > 0 &&
+          Property(record, "expires") > static_cast<long long>(now)) {
+        break;
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    }
+
+    Check(server.requests() == 1, "the expired subscription was checked once");
+    std::map<std::string, std::string> headers = server.last_headers();
+    Check(headers["if-none-match"] == kEtag,
+          "Downloader sent the stored ETag as If-None-Match");
+    Check(headers["if-modified-since"] == kLastModified,
+          "Downloader sent the stored Last-Modified as If-Modified-Since");
+
+    Check(!record.empty(), "the subscription was journaled");
+    Check(record.find("\"downloadStatus\":\"synchronize_ok\"") !=
+              std::string::npos,
+          "not modified: the download counts as successful");
+    Check(Property(record, "lastCheck") >= static_cast<long long>(now),
+          "not modified: lastCheck advanced");
+    Check(Property(record, "lastSuccess") >= static_cast<long long>(now),
+          "not modified: lastSuccess advanced");
+    Check(Property(record, "expires") > static_cast<long long>(now) &&
+              Property(record, "softExpiration") > static_cast<long long>(now),
+          "not modified: the expiration was renewed");
+
+    std::string match = adblock->CheckFilterMatch(
+        "http://ads.example.com/banner.png", "IMAGE",
+        "http://www.example.org/");
+    Check(match.find("||ads.example.com^") != std::string::npos,
+          "not modified: the stored filters still match");
+    Check(adblock->GetElementHidingSelectors("www.example.org")
+                  .find(".banner") != std::string::npos,
+          "not modified: the stored hiding rules still apply");
+  }
+
+  if (failures) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,145 @@
+#ifndef TEST_STAND_IN_SERVER_H_
+#define TEST_STAND_IN_SERVER_H_
+
+#include <cctype>
+#include <istream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace test {
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+
+const char kList[] =
+    "[Adblock Plus 2.0]\n"
+    "! Title: Stand-in\n"
+    "! Expires: 2 days\n"
+    "||ads.example.com^\n"
+    "##.banner\n";
+const char kEtag[] = "\"v1\"";
+const char kLastModified[] = "Mon, 19 Oct 2026 12:00:00 GMT";
+
+// Answers one request per connection until destroyed:
+//   /list   the list above with validators, 304 if If-None-Match matches
+//   /error  500 Internal Server Error
+class StandInServer {
+ public:
+  StandInServer()
+      : acceptor_(service_, tcp::endpoint(asio::ip::address_v4::loopback(), 0)),
+        stopping_(false),
+        requests_(0) {
+    thread_ = boost::thread(&StandInServer::Run, this);
+  }
+
+  ~StandInServer() {
+    stopping_ = true;
+    // Wakes up the blocking accept
+    boost::system::error_code error;
+    tcp::socket socket(service_);
+    socket.connect(acceptor_.local_endpoint(), error);
+    thread_.join();
+  }
+
+  std::string Url(const std::string& path) const {
+    std::ostringstream url;
+    url << "http://127.0.0.1:" << acceptor_.local_endpoint().port() << path;
+    return url.str();
+  }
+
+  // Request headers of the last request, names in lower case
+  std::map<std::string, std::string> last_headers() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return last_headers_;
+  }
+
+  // Requests answered so far
+  int requests() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return requests_;
+  }
+
+ private:
+  asio::io_service service_;
+  tcp::acceptor acceptor_;
+  boost::thread thread_;
+  volatile bool stopping_;
+  boost::mutex mutex_;
+  std::map<std::string, std::string> last_headers_;
+  int requests_;
+
+  void Run() {
+    while (true) {
+      tcp::socket socket(service_);
+      boost::system::error_code error;
+      acceptor_.accept(socket, error);
+      if (stopping_) {
+        return;
+      }
+      if (!error) {
+        Serve(&socket);
+      }
+    }
+  }
+
+  void Serve(tcp::socket* socket) {
+    boost::system::error_code error;
+    asio::streambuf buffer;
+    asio::read_until(*socket, buffer, "\r\n\r\n", error);
+    if (error) {
+      return;
+    }
+    std::istream request(&buffer);
+    std::string method, path, line;
+    request >> method >> path;
+    // Downloader adds the application to the query
+    path = path.substr(0, path.find('?'));
+    std::getline(request, line);
+    std::map<std::string, std::string> headers;
+    while (std::getline(request, line) && line != "\r") {
+      size_t colon = line.find(':');
+      if (colon == std::string::npos) {
+        continue;
+      }
+      std::string name = line.substr(0, colon);
+      for (auto it = name.begin(); it != name.end(); ++it) {
+        *it = static_cast<char>(tolower(*it));
+      }
+      size_t start = line.find_first_not_of(' ', colon + 1);
+      size_t end = line.find_last_not_of("\r ");
+      headers[name] = start <= end ? line.substr(start, end - start + 1) : "";
+    }
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      last_headers_ = headers;
+    }
+
+    std::ostringstream response;
+    if (path == "/list" && headers["if-none-match"] == kEtag) {
+      response << "HTTP/1.1 304 Not Modified\r\n"
+               << "ETag: " << kEtag << "\r\n"
+               << "Connection: close\r\n\r\n";
+    } else if (path == "/list") {
+      response << "HTTP/1.1 200 OK\r\n"
+               << "ETag: " << kEtag << "\r\n"
+               << "Last-Modified: " << kLastModified << "\r\n"
+               << "Content-Length: " << sizeof(kList) - 1 << "\r\n"
+               << "Connection: close\r\n\r\n" << kList;
+    } else {
+      response << "HTTP/1.1 500 Internal Server Error\r\n"
+               << "Content-Length: 0\r\n"
+               << "Connection: close\r\n\r\n";
+    }
+    asio::write(*socket, asio::buffer(response.str()), error);
+    boost::mutex::scoped_lock lock(mutex_);
+    ++requests_;
+  }
+};
+
+}  // namespace test
+
+#endif  // TEST_STAND_IN_SERVER_H_
@@ -0,0 +1,271 @@
+// Runs DefaultWebRequest against a local stand-in for a subscription server
+// the way Downloader does through webRequest.getList: the list is streamed
+// into a ListParser, the validators of the first download are sent back and
+// answered with "304 Not Modified", and failures come back as HTTP or network
+// errors. A download paused by its data callback must not hold up others, and
+// none of the callbacks run after Stop().
+// Usage: web_request_test
+
+#include "stand_in_server.h"
+#include "../src/list_parser.h"
+#include "../src/web_request.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <boost/bind.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+using test::kEtag;
+using test::kLastModified;
+using test::kList;
+using test::StandInServer;
+
+namespace {
+
+// A download the way ListRequestThread runs it, the body goes to the parser
+struct ListDownload {
+  adblock::ListParser parser;
+  adblock::WebRequest::ServerResponse response;
+  size_t data_calls;
+
+  ListDownload() : data_calls(0) {}
+
+  void Run(adblock::WebRequest* web_request, const std::string& url,
+           const adblock::WebRequest::HeaderList& headers) {
+    boost::promise<void> done;
+    web_request->GetAsync(
+        url, headers, boost::bind(&ListDownload::OnResponse, this, &done, _1),
+        boost::bind(&ListDownload::OnData, this, _1, _2, _3));
+    done.get_future().get();
+  }
+
+  bool OnData(const char* data, size_t size,
+              const adblock::WebRequest::ResumeCallback& resume) {
+    ++data_calls;
+    parser.Feed(data, size);
+    return true;
+  }
+
+  void OnResponse(boost::promise<void>* done,
+                  const adblock::WebRequest::ServerResponse& result) {
+    parser.Finish();
+    response = result;
+    done->set_value();
+  }
+};
+
+std::string Header(const adblock::WebRequest::ServerResponse& response,
+                   const std::string& name) {
+  for (auto it = response.response_headers.begin();
+       it != response.response_headers.end(); ++it) {
+    if (it->first == name) {
+      return it->second;
+    }
+  }
+  return "";
+}
+
+int failures = 0;
+
+void Check(bool condition, const std::string& description) {
+  if (!condition) {
+    std::cerr << "FAILED: " << description << std::endl;
+    ++failures;
+  }
+}
+
+void TestSuccess(adblock::WebRequest* web_request, StandInServer* server) {
+  ListDownload download;
+  download.Run(web_request, server->Url("/list"),
+               adblock::WebRequest::HeaderList());
+  Check(download.response.status == adblock::WebRequest::NS_OK,
+        "success: network status is NS_OK");
+  Check(download.response.response_status == 200, "success: HTTP 200");
+  Check(download.response.response_text.empty(),
+        "success: streamed body is not kept as text");
+  Check(download.response.bytes_received > sizeof(kList) - 1,
+        "success: received bytes include the headers");
+  Check(Header(download.response, "etag") == kEtag, "success: ETag header");
+  Check(Header(download.response, "last-modified") == kLastModified,
+        "success: Last-Modified header");
+  Check(download.parser.valid(), "success: list header is valid");
+
+  adblock::ListParser::LineList lines;
+  download.parser.TakeLines(&lines);
+  // The final newline leaves an empty line, Synchronizer skips those
+  lines.erase(std::remove(lines.begin(), lines.end(), std::string()),
+              lines.end());
+  Check(lines.size() == 2 && lines[0] == "||ads.example.com^" &&
+            lines[1] == "##.banner",
+        "success: filters parsed from the streamed body");
+
+  std::map<std::string, std::string> headers = server->last_headers();
+  Check(headers.find("if-none-match") == headers.end() &&
+            headers.find("if-modified-since") == headers.end(),
+        "success: first download is unconditional");
+}
+
+void TestNotModified(adblock::WebRequest* web_request,
+                     StandInServer* server) {
+  // Validators Downloader sends back once the subscription has filters
+  adblock::WebRequest::HeaderList validators;
+  validators.push_back(std::make_pair("If-None-Match", kEtag));
+  validators.push_back(std::make_pair("If-Modified-Since", kLastModified));
+
+  ListDownload download;
+  download.Run(web_request, server->Url("/list"), validators);
+  Check(download.response.status == adblock::WebRequest::NS_OK,
+        "not modified: network status is NS_OK");
+  Check(download.response.response_status == 304, "not modified: HTTP 304");
+  Check(download.data_calls == 0, "not modified: no body delivered");
+
+  std::map<std::string, std::string> headers = server->last_headers();
+  Check(headers["if-none-match"] == kEtag,
+        "not modified: If-None-Match was sent");
+  Check(headers["if-modified-since"] == kLastModified,
+        "not modified: If-Modified-Since was sent");
+}
+
+// Refuses the body until Resume(), the way ListRequestThread does while
+// JavaScript is behind
+struct PausedDownload {
+  boost::mutex mutex;
+  boost::condition_variable paused_changed;
+  bool paused;
+  adblock::WebRequest::ResumeCallback resume;
+  std::string body;
+  boost::promise<adblock::WebRequest::ServerResponse> done;
+
+  PausedDownload() : paused(false) {}
+
+  void Start(adblock::WebRequest* web_request, const std::string& url) {
+    web_request->GetAsync(
+        url, adblock::WebRequest::HeaderList(),
+        boost::bind(&PausedDownload::OnResponse, this, _1),
+        boost::bind(&PausedDownload::OnData, this, _1, _2, _3));
+  }
+
+  bool WaitUntilPaused() {
+    boost::mutex::scoped_lock lock(mutex);
+    return paused_changed.wait_for(lock, boost::chrono::seconds(5),
+                                   [this] { return paused; });
+  }
+
+  void Resume() {
+    adblock::WebRequest::ResumeCallback callback;
+    {
+      boost::mutex::scoped_lock lock(mutex);
+      callback.swap(resume);
+    }
+    callback();
+  }
+
+  bool OnData(const char* data, size_t size,
+              const adblock::WebRequest::ResumeCallback& resume_callback) {
+    boost::mutex::scoped_lock lock(mutex);
+    if (!paused) {
+      paused = true;
+      resume = resume_callback;
+      paused_changed.notify_all();
+      return false;
+    }
+    body.append(data, size);
+    return true;
+  }
+
+  void OnResponse(const adblock::WebRequest::ServerResponse& response) {
+    done.set_value(response);
+  }
+};
+
+void TestPause(adblock::WebRequest* web_request, StandInServer* server) {
+  PausedDownload paused;
+  paused.Start(web_request, server->Url("/list"));
+  Check(paused.WaitUntilPaused(), "pause: data callback was asked");
+
+  // The transfer thread keeps serving other downloads meanwhile
+  ListDownload other;
+  other.Run(web_request, server->Url("/list"),
+            adblock::WebRequest::HeaderList());
+  Check(other.response.response_status == 200,
+        "pause: other download completes while one is paused");
+
+  paused.Resume();
+  boost::unique_future<adblock::WebRequest::ServerResponse> result =
+      paused.done.get_future();
+  Check(result.wait_for(boost::chrono::seconds(5)) ==
+            boost::future_status::ready,
+        "pause: paused download completes once resumed");
+  if (result.is_ready()) {
+    Check(result.get().response_status == 200, "pause: HTTP 200");
+    Check(paused.body == kList, "pause: refused data is passed again");
+  }
+}
+
+void TestStop(StandInServer* server) {
+  adblock::DefaultWebRequest web_request;
+  PausedDownload running;
+  running.Start(&web_request, server->Url("/list"));
+  Check(running.WaitUntilPaused(), "stop: download is running");
+
+  web_request.Stop();
+  PausedDownload later;
+  later.Start(&web_request, server->Url("/list"));
+  Check(!running.done.get_future().is_ready(),
+        "stop: running download is dropped without its callback");
+  Check(!later.done.get_future().is_ready() && !later.paused,
+        "stop: download started later is dropped");
+}
+
+void TestErrors(adblock::WebRequest* web_request, StandInServer* server) {
+  ListDownload download;
+  download.Run(web_request, server->Url("/error"),
+               adblock::WebRequest::HeaderList());
+  Check(download.response.status == adblock::WebRequest::NS_OK,
+        "HTTP error: network status is NS_OK");
+  Check(download.response.response_status == 500, "HTTP error: HTTP 500");
+
+  // A port nothing listens on any more
+  std::string url;
+  {
+    asio::io_service service;
+    tcp::acceptor closed(service,
+                         tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+    std::ostringstream out;
+    out << "http://127.0.0.1:" << closed.local_endpoint().port() << "/list";
+    url = out.str();
+  }
+  adblock::WebRequest::ServerResponse response =
+      web_request->Get(url, adblock::WebRequest::HeaderList());
+  Check(response.status != adblock::WebRequest::NS_OK,
+        "network error: status is an error");
+  Check(response.response_status == 0, "network error: no HTTP status");
+}
+
+}  // namespace
+
+int main() {
+  {
+    StandInServer server;
+    adblock::DefaultWebRequest web_request;
+    TestSuccess(&web_request, &server);
+    TestNotModified(&web_request, &server);
+    TestPause(&web_request, &server);
+    TestErrors(&web_request, &server);
+    TestStop(&server);
+  }
+
+  if (failures) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "All checks passed" << std::endl;
+  return 0;
+}